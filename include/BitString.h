@@ -19,6 +19,105 @@
  * the first bit set, if such available.
  */
 
+/** Bulk operations on bitmaps stored as byte arrays. Bit with index @a idx is
+ * stored in byte @a idx / 8 at position @a idx % 8. The scanning and counting
+ * primitives are selected at run time according to the CPU capabilities. All
+ * the operations are used by the @ref BitString classes and can be applied to
+ * any other bitmaps of the same layout.
+ */
+class BitStringOps {
+public:
+    /** Find first set bit starting from the specified position.
+     *
+     * @param bits Bitmap.
+     * @param numBits Number of bits in the bitmap.
+     * @param from Index of the bit to start the search from.
+     * @return Index of the found bit, @a numBits if not found.
+     */
+    static size_t FindSet(const u8 *bits, size_t numBits, size_t from = 0);
+
+    /** Find first clear bit starting from the specified position.
+     *
+     * @param bits Bitmap.
+     * @param numBits Number of bits in the bitmap.
+     * @param from Index of the bit to start the search from.
+     * @return Index of the found bit, @a numBits if not found.
+     */
+    static size_t FindClear(const u8 *bits, size_t numBits, size_t from = 0);
+
+    /** Count set bits.
+     *
+     * @param bits Bitmap.
+     * @param numBits Number of bits in the bitmap.
+     * @return Number of set bits.
+     */
+    static size_t Count(const u8 *bits, size_t numBits);
+
+    /** Find first run of clear bits of the specified length.
+     *
+     * @param bits Bitmap.
+     * @param numBits Number of bits in the bitmap.
+     * @param runLength Required number of consecutive clear bits.
+     * @return Index of the first bit in the run, @a numBits if not found.
+     */
+    static size_t FindClearRun(const u8 *bits, size_t numBits,
+                               size_t runLength);
+
+    /** Set range of bits.
+     *
+     * @param bits Bitmap.
+     * @param start Index of the first bit in the range.
+     * @param count Number of bits in the range.
+     */
+    static void SetRange(u8 *bits, size_t start, size_t count);
+
+    /** Clear range of bits.
+     *
+     * @param bits Bitmap.
+     * @param start Index of the first bit in the range.
+     * @param count Number of bits in the range.
+     */
+    static void ClearRange(u8 *bits, size_t start, size_t count);
+
+    /** Select the primitives implementation. It is done automatically on
+     * first use, explicit call is mostly needed for testing.
+     *
+     * @param allowSimd Allow vectorized implementations if the CPU supports
+     *      them. The generic word-based ones are used otherwise.
+     */
+    static void Select(bool allowSimd = true);
+
+private:
+    /** Find first byte which differs from the pattern.
+     *
+     * @return Offset of the found byte, @a size if all bytes match.
+     */
+    typedef size_t (*ScanFunc)(const u8 *bytes, size_t size, u8 pattern);
+    /** Count set bits in the buffer. */
+    typedef size_t (*CountFunc)(const u8 *bytes, size_t size);
+
+    static ScanFunc _scan;
+    static CountFunc _count;
+
+    static size_t _ScanGeneric(const u8 *bytes, size_t size, u8 pattern);
+    static size_t _CountGeneric(const u8 *bytes, size_t size);
+    /* Initial values of the primitives pointers which do the selection. */
+    static size_t _ScanSelect(const u8 *bytes, size_t size, u8 pattern);
+    static size_t _CountSelect(const u8 *bytes, size_t size);
+
+    /** Get mask of bits in a byte from the specified bit position. */
+    static inline u8 _HeadMask(size_t bitIdx) {
+        return static_cast<u8>(0xff << (bitIdx % NBBY));
+    }
+
+    /** Get mask of bits in a byte before the specified one-past-end bit
+     * position.
+     */
+    static inline u8 _TailMask(size_t endIdx) {
+        return static_cast<u8>(0xff >> ((NBBY - endIdx % NBBY) % NBBY));
+    }
+};
+
 /** Class for manipulating bit strings. Bit string is a sequence of bits which
  * are indexed by a null-based index. Each bit in a string can be accessed
  * (checked or modified) individually by its index.
@@ -86,52 +185,56 @@ public:
      *
      * @return Index of first bit set. -1 if no bits set.
      */
-    int FirstSet() {
-        const size_t numWords = numBits / (sizeof(uintptr_t) * NBBY);
-        for (size_t word = 0; word < numWords; word++) {
-            uintptr_t x = static_cast<uintptr_t *>(static_cast<void *>(_bits))[word];
-            if (x) {
-                size_t bit = cpu::bsf(x);
-                bit += word * sizeof(uintptr_t) * NBBY;
-                return bit;
-            }
-        }
-        /* Check remainder. */
-        for (size_t idx = numWords * sizeof(uintptr_t) * NBBY;
-             idx < numBits;
-             idx++) {
-
-            if (IsSet(idx)) {
-                return idx;
-            }
-        }
-        return -1;
+    inline int FirstSet() {
+        size_t idx = BitStringOps::FindSet(_bits, numBits);
+        return idx < numBits ? static_cast<int>(idx) : -1;
     }
 
     /** Find first clear bit.
      *
-     * @return Index of first bit set. -1 if no bits set.
+     * @return Index of first bit clear. -1 if all bits set.
      */
-    int FirstClear() {
-        const size_t numWords = numBits / (sizeof(uintptr_t) * NBBY);
-        for (size_t word = 0; word < numWords; word++) {
-            uintptr_t x = static_cast<uintptr_t *>(static_cast<void *>(_bits))[word];
-            if (x != static_cast<uintptr_t>(~0)) {
-                size_t bit = cpu::bsf(~x);
-                bit += word * sizeof(uintptr_t) * NBBY;
-                return bit;
-            }
-        }
-        /* Check remainder. */
-        for (size_t idx = numWords * sizeof(uintptr_t) * NBBY;
-             idx < numBits;
-             idx++) {
+    inline int FirstClear() {
+        size_t idx = BitStringOps::FindClear(_bits, numBits);
+        return idx < numBits ? static_cast<int>(idx) : -1;
+    }
 
-            if (IsClear(idx)) {
-                return idx;
-            }
-        }
-        return -1;
+    /** Count set bits.
+     *
+     * @return Number of bits set.
+     */
+    inline size_t Count() {
+        return BitStringOps::Count(_bits, numBits);
+    }
+
+    /** Find first run of clear bits.
+     *
+     * @param runLength Required number of consecutive clear bits.
+     * @return Index of the first bit in the run. -1 if not found.
+     */
+    inline int FindClearRun(size_t runLength) {
+        size_t idx = BitStringOps::FindClearRun(_bits, numBits, runLength);
+        return idx < numBits ? static_cast<int>(idx) : -1;
+    }
+
+    /** Set range of bits.
+     *
+     * @param start Index of the first bit in the range.
+     * @param count Number of bits in the range.
+     */
+    inline void SetRange(size_t start, size_t count) {
+        ASSERT(start + count <= numBits);
+        BitStringOps::SetRange(_bits, start, count);
+    }
+
+    /** Clear range of bits.
+     *
+     * @param start Index of the first bit in the range.
+     * @param count Number of bits in the range.
+     */
+    inline void ClearRange(size_t start, size_t count) {
+        ASSERT(start + count <= numBits);
+        BitStringOps::ClearRange(_bits, start, count);
     }
 
     /** Clear all bits in the string. */
@@ -235,52 +338,56 @@ public:
      *
      * @return Index of first bit set. -1 if no bits set.
      */
-    int FirstSet() {
-        const size_t numWords = _numBits / (sizeof(uintptr_t) * NBBY);
-        for (size_t word = 0; word < numWords; word++) {
-            uintptr_t x = static_cast<uintptr_t *>(static_cast<void *>(_bits))[word];
-            if (x) {
-                size_t bit = cpu::bsf(x);
-                bit += word * sizeof(uintptr_t) * NBBY;
-                return bit;
-            }
-        }
-        /* Check remainder. */
-        for (size_t idx = numWords * sizeof(uintptr_t) * NBBY;
-             idx < _numBits;
-             idx++) {
-
-            if (IsSet(idx)) {
-                return idx;
-            }
-        }
-        return -1;
+    inline int FirstSet() {
+        size_t idx = BitStringOps::FindSet(_bits, _numBits);
+        return idx < _numBits ? static_cast<int>(idx) : -1;
     }
 
     /** Find first clear bit.
      *
-     * @return Index of first bit set. -1 if no bits set.
+     * @return Index of first bit clear. -1 if all bits set.
      */
-    int FirstClear() {
-        const size_t numWords = _numBits / (sizeof(uintptr_t) * NBBY);
-        for (size_t word = 0; word < numWords; word++) {
-            uintptr_t x = static_cast<uintptr_t *>(static_cast<void *>(_bits))[word];
-            if (x != static_cast<uintptr_t>(~0)) {
-                size_t bit = cpu::bsf(~x);
-                bit += word * sizeof(uintptr_t) * NBBY;
-                return bit;
-            }
-        }
-        /* Check remainder. */
-        for (size_t idx = numWords * sizeof(uintptr_t) * NBBY;
-             idx < _numBits;
-             idx++) {
+    inline int FirstClear() {
+        size_t idx = BitStringOps::FindClear(_bits, _numBits);
+        return idx < _numBits ? static_cast<int>(idx) : -1;
+    }
 
-            if (IsClear(idx)) {
-                return idx;
-            }
-        }
-        return -1;
+    /** Count set bits.
+     *
+     * @return Number of bits set.
+     */
+    inline size_t Count() {
+        return BitStringOps::Count(_bits, _numBits);
+    }
+
+    /** Find first run of clear bits.
+     *
+     * @param runLength Required number of consecutive clear bits.
+     * @return Index of the first bit in the run. -1 if not found.
+     */
+    inline int FindClearRun(size_t runLength) {
+        size_t idx = BitStringOps::FindClearRun(_bits, _numBits, runLength);
+        return idx < _numBits ? static_cast<int>(idx) : -1;
+    }
+
+    /** Set range of bits.
+     *
+     * @param start Index of the first bit in the range.
+     * @param count Number of bits in the range.
+     */
+    inline void SetRange(size_t start, size_t count) {
+        ASSERT(start + count <= _numBits);
+        BitStringOps::SetRange(_bits, start, count);
+    }
+
+    /** Clear range of bits.
+     *
+     * @param start Index of the first bit in the range.
+     * @param count Number of bits in the range.
+     */
+    inline void ClearRange(size_t start, size_t count) {
+        ASSERT(start + count <= _numBits);
+        BitStringOps::ClearRange(_bits, start, count);
     }
 
     /** Clear all bits in the string. */
@@ -307,7 +414,320 @@ public:
     }
 private:
     u8 *_bits;
-    const size_t _numBits, _bitmapSize;
+    size_t _numBits, _bitmapSize;
+};
+
+/** Dynamically allocated bit string with hierarchical summary. It provides the
+ * same interface as @ref BitString<0> but @ref FirstSet and @ref FirstClear
+ * methods run in logarithmic time instead of scanning the whole bitmap. @n
+ *
+ * Bits are stored in machine words. Above the bitmap there are two hierarchies
+ * of summary levels - one has a bit set for each non-empty word of the lower
+ * level, another one has a bit set for each non-full word of the lower level.
+ * Each level is a machine word bits times smaller than the lower one, the top
+ * level fits one word. The search descends from the top level following the
+ * first set bit on each level. @ref Set and @ref Clear update the summaries
+ * only when a word changes its empty or full state.
+ */
+class SummaryBitString {
+public:
+    /** Get size of storage required for the bit string.
+     *
+     * @param numBits Number of bits in the bitmap.
+     * @return Size in bytes of the buffer which should be provided to the
+     *      constructor.
+     */
+    static size_t GetStorageSize(size_t numBits) {
+        size_t numWords = _GetNumWords(numBits);
+        size_t size = numWords;
+        while (numWords > 1) {
+            numWords = _GetNumWords(numWords);
+            /* Non-empty and non-full summaries. */
+            size += numWords * 2;
+        }
+        return size * sizeof(uintptr_t);
+    }
+
+    /** Construct bit string in dynamically allocated storage. All bits are
+     * initially cleared.
+     *
+     * @param storage Pointer to the buffer of at least
+     *      @ref GetStorageSize bytes. Should be aligned on machine word size.
+     * @param numBits Number of bits in the bitmap.
+     */
+    inline SummaryBitString(u8 *storage = 0, size_t numBits = 0) :
+        _numBits(numBits), _numLevels(0)
+    {
+        _bits = static_cast<uintptr_t *>(static_cast<void *>(storage));
+        if (!_bits) {
+            return;
+        }
+        _setLevels[0] = _bits;
+        _clearLevels[0] = _bits;
+        size_t numWords = _GetNumWords(numBits);
+        uintptr_t *ptr = _bits + numWords;
+        while (numWords > 1) {
+            _numLevels++;
+            ASSERT(_numLevels < MAX_LEVELS);
+            numWords = _GetNumWords(numWords);
+            _setLevels[_numLevels] = ptr;
+            ptr += numWords;
+            _clearLevels[_numLevels] = ptr;
+            ptr += numWords;
+        }
+        ClearAll();
+    }
+
+    /** Set bit at specified position.
+     *
+     * @param idx Null based bit index.
+     */
+    inline void Set(size_t idx) {
+        ASSERT(idx < _numBits);
+        size_t word = idx / BITS_PER_WORD;
+        uintptr_t old = _bits[word];
+        uintptr_t x = old | _Bit(idx);
+        _bits[word] = x;
+        if (!old) {
+            _SummarySet(_setLevels, word);
+        }
+        if (x == FULL_WORD && old != x) {
+            _SummaryClear(_clearLevels, word);
+        }
+    }
+
+    /** Clear bit at specified position.
+     *
+     * @param idx Null based bit index.
+     */
+    inline void Clear(size_t idx) {
+        ASSERT(idx < _numBits);
+        size_t word = idx / BITS_PER_WORD;
+        uintptr_t old = _bits[word];
+        uintptr_t x = old & ~_Bit(idx);
+        _bits[word] = x;
+        if (old && !x) {
+            _SummaryClear(_setLevels, word);
+        }
+        if (old == FULL_WORD && old != x) {
+            _SummarySet(_clearLevels, word);
+        }
+    }
+
+    /** Check if bit is set at specified position.
+     *
+     * @param idx Null based bit index.
+     * @return @a true if the bit is set, @a false otherwise.
+     */
+    inline bool IsSet(size_t idx) {
+        ASSERT(idx < _numBits);
+        return _bits[idx / BITS_PER_WORD] & _Bit(idx);
+    }
+
+    /** Check if bit is clear at specified position.
+     *
+     * @param idx Null based bit index.
+     * @return @a true if the bit is clear, @a false otherwise.
+     */
+    inline bool IsClear(size_t idx) {
+        return !IsSet(idx);
+    }
+
+    /** Check if bit is set at specified position. Equivalent of @ref IsSet
+     * method.
+     *
+     * @param idx Null based bit index.
+     * @return @a true if the bit is set, @a false otherwise.
+     */
+    inline bool operator[](size_t idx) {
+        return IsSet(idx);
+    }
+
+    /** Find first set bit.
+     *
+     * @return Index of first bit set. -1 if no bits set.
+     */
+    int FirstSet() {
+        if (!_numBits) {
+            return -1;
+        }
+        size_t idx = 0;
+        for (int lvl = _numLevels; lvl >= 0; lvl--) {
+            uintptr_t x = _setLevels[lvl][idx];
+            if (!x) {
+                return -1;
+            }
+            idx = idx * BITS_PER_WORD + cpu::bsf(x);
+        }
+        return idx;
+    }
+
+    /** Find first set bit starting from the specified position. The search
+     * ascends the non-empty summaries from the starting word until a
+     * non-empty word is found and then descends to the bitmap.
+     *
+     * @param from Index of the bit to start the search from.
+     * @return Index of the found bit. -1 if no bits set at or after @a from.
+     */
+    int NextSet(size_t from) {
+        size_t levelBits = _numBits;
+        size_t idx = from;
+        int lvl = 0;
+        while (true) {
+            if (idx >= levelBits) {
+                return -1;
+            }
+            size_t word = idx / BITS_PER_WORD;
+            uintptr_t x = _setLevels[lvl][word] &
+                (FULL_WORD << (idx % BITS_PER_WORD));
+            if (x) {
+                idx = word * BITS_PER_WORD + cpu::bsf(x);
+                break;
+            }
+            if (lvl == _numLevels) {
+                return -1;
+            }
+            /* Continue from the next word on the upper level. */
+            lvl++;
+            levelBits = _GetNumWords(levelBits);
+            idx = word + 1;
+        }
+        while (lvl > 0) {
+            lvl--;
+            idx = idx * BITS_PER_WORD + cpu::bsf(_setLevels[lvl][idx]);
+        }
+        return idx;
+    }
+
+    /** Find first clear bit.
+     *
+     * @return Index of first bit clear. -1 if all bits set.
+     */
+    int FirstClear() {
+        if (!_numBits) {
+            return -1;
+        }
+        size_t idx = 0;
+        for (int lvl = _numLevels; lvl > 0; lvl--) {
+            uintptr_t x = _clearLevels[lvl][idx];
+            if (!x) {
+                return -1;
+            }
+            idx = idx * BITS_PER_WORD + cpu::bsf(x);
+        }
+        /* Bits past the end are always clear so the last word is never full,
+         * check for them here.
+         */
+        uintptr_t x = ~_bits[idx];
+        if (!x) {
+            return -1;
+        }
+        idx = idx * BITS_PER_WORD + cpu::bsf(x);
+        return idx < _numBits ? static_cast<int>(idx) : -1;
+    }
+
+    /** Clear all bits in the string. */
+    inline void ClearAll() {
+        memset(_bits, 0, _GetNumWords(_numBits) * sizeof(uintptr_t));
+        _Rebuild();
+    }
+
+    inline void SetAll() {
+        memset(_bits, 0xff, _GetNumWords(_numBits) * sizeof(uintptr_t));
+        _Rebuild();
+    }
+
+    inline void Invert() {
+        size_t numWords = _GetNumWords(_numBits);
+        for (size_t word = 0; word < numWords; word++) {
+            _bits[word] = ~_bits[word];
+        }
+        _Rebuild();
+    }
+
+private:
+    enum {
+        /** Number of bits in one word. */
+        BITS_PER_WORD = sizeof(uintptr_t) * NBBY,
+        /** Maximal number of levels including the bitmap itself. */
+        MAX_LEVELS = 8,
+    };
+
+    static const uintptr_t FULL_WORD = ~static_cast<uintptr_t>(0);
+
+    uintptr_t *_bits;
+    size_t _numBits;
+    /** Number of summary levels above the bitmap. */
+    int _numLevels;
+    /** Non-empty words summaries, index zero is the bitmap itself. */
+    uintptr_t *_setLevels[MAX_LEVELS];
+    /** Non-full words summaries, index zero is the bitmap itself. */
+    uintptr_t *_clearLevels[MAX_LEVELS];
+
+    static inline size_t _GetNumWords(size_t numBits) {
+        return (numBits + BITS_PER_WORD - 1) / BITS_PER_WORD;
+    }
+
+    static inline uintptr_t _Bit(size_t idx) {
+        return static_cast<uintptr_t>(1) << (idx % BITS_PER_WORD);
+    }
+
+    /** Mark word as present in the summary hierarchy.
+     *
+     * @param levels Summary hierarchy.
+     * @param word Word index in the bitmap.
+     */
+    inline void _SummarySet(uintptr_t **levels, size_t word) {
+        for (int lvl = 1; lvl <= _numLevels; lvl++) {
+            uintptr_t &x = levels[lvl][word / BITS_PER_WORD];
+            uintptr_t old = x;
+            x |= _Bit(word);
+            if (old) {
+                /* Upper levels already have it. */
+                break;
+            }
+            word /= BITS_PER_WORD;
+        }
+    }
+
+    /** Mark word as absent in the summary hierarchy.
+     *
+     * @param levels Summary hierarchy.
+     * @param word Word index in the bitmap.
+     */
+    inline void _SummaryClear(uintptr_t **levels, size_t word) {
+        for (int lvl = 1; lvl <= _numLevels; lvl++) {
+            uintptr_t &x = levels[lvl][word / BITS_PER_WORD];
+            x &= ~_Bit(word);
+            if (x) {
+                break;
+            }
+            word /= BITS_PER_WORD;
+        }
+    }
+
+    /** Recalculate all the summaries from the bitmap content. */
+    void _Rebuild() {
+        size_t numWords = _GetNumWords(_numBits);
+        /* Keep bits past the end clear. */
+        if (_numBits % BITS_PER_WORD) {
+            _bits[numWords - 1] &= _Bit(_numBits) - 1;
+        }
+        size_t levelWords = numWords;
+        for (int lvl = 1; lvl <= _numLevels; lvl++) {
+            levelWords = _GetNumWords(levelWords);
+            memset(_setLevels[lvl], 0, levelWords * sizeof(uintptr_t));
+            memset(_clearLevels[lvl], 0, levelWords * sizeof(uintptr_t));
+        }
+        for (size_t word = 0; word < numWords; word++) {
+            if (_bits[word]) {
+                _SummarySet(_setLevels, word);
+            }
+            if (_bits[word] != FULL_WORD) {
+                _SummarySet(_clearLevels, word);
+            }
+        }
+    }
 };
 
 #endif /* BITSTRING_H_ */
@@ -80,6 +80,144 @@ public:
     RetCode Initialize(Addr startAddress, Addr endAddress, int minOrder = 0,
                        int maxOrder = -1, size_t cacheSize = 8192);
 
+    /** Allocate a block. The block of the smallest order which can fit the
+     * requested size is allocated. Free blocks cache is checked first, the
+     * bitmap is scanned only if there are no cached free blocks of the
+     * required order. If a block of greater order is taken, it is split and
+     * the unused halves are returned to the corresponding orders.
+     *
+     * @param size Size of the block to allocate.
+     * @param address Allocated block address is stored there on success.
+     * @return @ref RetCode::SUCCESS if the block allocated,
+     *      @ref RetCode::NO_RESOURCES if there is no free block of sufficient
+     *      size, @ref RetCode::INV_PARAM if the size is invalid.
+     */
+    RetCode Allocate(Addr size, Addr *address);
+
+    /** Free previously allocated block. The block is coalesced with its buddy
+     * while the buddy is also free.
+     *
+     * @param address Address of the block to free. Must be the value
+     *      previously returned by @ref Allocate method.
+     * @param size Size of the block. Must be the same as passed to
+     *      @ref Allocate method for this block.
+     * @return @ref RetCode::SUCCESS if the block freed,
+     *      @ref RetCode::INV_PARAM if the block does not belong to the managed
+     *      range, is misaligned or is already free.
+     */
+    RetCode Free(Addr address, Addr size);
+
+    /** Allocate contiguous range of arbitrary size. Unlike @ref Allocate the
+     * size is rounded up to the minimal block size only, the unused tail of
+     * the underlying blocks is returned to the allocator. For power of two
+     * sizes a single free block of the smallest fitting order is looked for
+     * first. Otherwise the lowest run of adjacent free blocks of any orders
+     * is searched in the requested address window (first fit).
+     *
+     * @param size Size of the range.
+     * @param address Allocated range address is stored there on success.
+     * @param alignment Required alignment of the range start, must be power
+     *      of two. Zero for minimal block size alignment.
+     * @param lowLimit Lowest allowed address of the range start.
+     * @param highLimit Highest allowed address of the range one-past-end
+     *      address. Zero for no limit.
+     * @return @ref RetCode::SUCCESS if the range allocated,
+     *      @ref RetCode::NO_RESOURCES if there is no free range which satisfies
+     *      the constraints, @ref RetCode::INV_PARAM if the parameters are
+     *      invalid.
+     */
+    RetCode AllocateRange(Addr size, Addr *address, Addr alignment = 0,
+                          Addr lowLimit = 0, Addr highLimit = 0);
+
+    /** Free range allocated by @ref AllocateRange. Parts of the range can be
+     * freed separately, each part is coalesced with free neighbours.
+     *
+     * @param address Start address of the range.
+     * @param size Size of the range.
+     * @return @ref RetCode::SUCCESS if the range freed,
+     *      @ref RetCode::INV_PARAM if the range does not belong to the managed
+     *      range, is misaligned or overlaps free blocks.
+     */
+    RetCode FreeRange(Addr address, Addr size);
+
+    /** Get minimal order of allocated blocks. */
+    inline int GetMinOrder() { return _minOrder; }
+
+    /** Get maximal order of allocated blocks. */
+    inline int GetMaxOrder() { return _maxOrder; }
+
+    /** Get order of the block which is allocated for the provided size.
+     *
+     * @param size Requested allocation size. Should not exceed maximal order
+     *      block size.
+     * @return Order of the block.
+     */
+    inline int GetBlockOrder(Addr size) {
+        return Max(_GetOrder(size), _minOrder);
+    }
+
+    /** Counters of one order. */
+    class OrderStats {
+    public:
+        size_t numFree; /**< Number of free blocks. */
+        size_t cacheHits; /**< Free blocks taken from the free blocks cache. */
+        size_t cacheMisses; /**< Free blocks found by bitmap scanning. */
+        size_t splits; /**< Blocks split into halves of lower order. */
+        size_t coalesces; /**< Blocks coalesced with their buddies. */
+    };
+
+    /** Snapshot of the allocator statistics. It can be output to a text
+     * stream with "%s" format, the per-order counters are printed as a table.
+     * The object is rather big, so avoid placing it on the kernel stack.
+     */
+    class Stats {
+    public:
+        int minOrder, maxOrder; /**< Orders range of the allocator. */
+        /** Per-order counters, valid for orders from @a minOrder to
+         * @a maxOrder only.
+         */
+        OrderStats orders[MAX_ORDER + 1];
+        Addr freeSize; /**< Total size of free blocks. */
+        size_t numFree; /**< Total number of free blocks. */
+        int largestFreeOrder; /**< Order of the largest free block, -1 if none. */
+        size_t cacheSize; /**< Number of free blocks cache entries. */
+        size_t cacheUsed; /**< Number of cache entries in use. */
+        /** Number of free blocks which were not cached because all the cache
+         * entries were in use.
+         */
+        size_t cacheExhausted;
+
+        /** Get fragmentation index for the specified order. The index shows
+         * whether failure of an allocation of this order is caused by lack
+         * of memory (values close to zero) or by external fragmentation
+         * (values close to 1000).
+         *
+         * @param order Order to get the index for.
+         * @return Fragmentation index in per mille, -1 if there is a free
+         *      block of this or greater order, i.e. the allocation of this
+         *      order would succeed.
+         */
+        int GetFragmentation(int order);
+
+        bool CheckFmtChar(char fmtChar) { return fmtChar == 's'; }
+
+        bool ToString(text_stream::OTextStreamBase &stream,
+                      text_stream::OTextStreamBase::Context &ctx,
+                      char fmtChar = 0);
+    };
+
+    /** Take statistics snapshot. The counters are plain variables updated
+     * under the same serialization as the rest of the allocator state, so
+     * maintaining them costs just a few increments. The caller should hold
+     * the allocator lock while the snapshot is taken.
+     *
+     * @param stats Snapshot is stored there.
+     */
+    void GetStats(Stats *stats);
+
+    /** Reset all the event counters. Free blocks numbers are not affected. */
+    void ResetStats();
+
 private:
     bool _isInitialized = false;
     Addr _startAddress, _endAddress;
@@ -94,8 +232,18 @@ private:
         /** Index which indicates cache entry null reference. */
         static const Index NONE = ~0;
 
-        int Compare(CacheEntry &e) { return address - e.address; }
-        int Compare(Addr &address) { return address - this->address; }
+        int Compare(CacheEntry &e) {
+            if (address < e.address) {
+                return -1;
+            }
+            return address > e.address ? 1 : 0;
+        }
+        int Compare(Addr &key) {
+            if (key < address) {
+                return -1;
+            }
+            return key > address ? 1 : 0;
+        }
         typedef RBTree<CacheEntry, &CacheEntry::Compare, Addr, &CacheEntry::Compare> Tree;
 
         Addr address;  /**< Address of the block this entry represents. */
@@ -127,6 +275,10 @@ private:
     size_t _cacheSize;
     /** Pool of cache entries. */
     CacheEntry::ListHead _freeCacheEntries = CacheEntry::NONE;
+    /** Number of free blocks which were not cached due to cache exhaustion. */
+    size_t _cacheExhausted = 0;
+    /** Number of cache entries in use. */
+    size_t _cacheUsed = 0;
     /** Tree of cache entries. */
     CacheEntry::Tree _cacheTree;
 
@@ -139,11 +291,18 @@ private:
          * @return Status code.
          */
         RetCode Initialize(size_t numBlocks);
-        ~OrderPool() {/* XXX */}
+        ~OrderPool() { DELETE [] _bitmapData; }
     private:
+        friend class BuddyAllocatorBase;
+
         u8 *_bitmapData = 0; /**< Storage for bitmap data. */
-        BitString<> _bitmap; /**< Free blocks bitmap. */
-        CacheEntry::ListHead _freeBlocks; /** Free blocks cache. */
+        SummaryBitString _bitmap; /**< Free blocks bitmap. */
+        CacheEntry::ListHead _freeBlocks = CacheEntry::NONE; /**< Free blocks cache. */
+        size_t _numFree = 0; /**< Number of free blocks of this order. */
+        size_t _cacheHits = 0, /**< Blocks taken from the cache. */
+               _cacheMisses = 0, /**< Blocks found by bitmap scanning. */
+               _splits = 0, /**< Blocks split into halves. */
+               _coalesces = 0; /**< Blocks coalesced with their buddies. */
     };
 
     /** All managed resources are represented in this pool. */
@@ -153,7 +312,7 @@ private:
     inline int _GetOrder(Addr size) {
         int order = 0;
         Addr osize = 1;
-        while (osize < size) {
+        while (osize < size && order < static_cast<int>(MAX_ORDER)) {
             order++;
             osize <<= 1;
         }
@@ -163,11 +322,114 @@ private:
     /** Get size which corresponds to the provided order. */
     inline Addr _GetOrderSize(int order) {
         ASSERT(order >= 0);
-        return 1 << order;
+        return static_cast<Addr>(1) << order;
+    }
+
+    /** Get pool which corresponds to the provided order. */
+    inline OrderPool &_GetPool(int order) {
+        ASSERT(order >= _minOrder && order <= _maxOrder);
+        return _pool[order - _minOrder];
+    }
+
+    /** Get index of the block in its order pool bitmap. */
+    inline size_t _GetBlockIdx(Addr address, int order) {
+        return (address - _startAddress) >> order;
+    }
+
+    /** Get address of the block by its index in its order pool bitmap. */
+    inline Addr _GetBlockAddress(size_t idx, int order) {
+        return _startAddress + (static_cast<Addr>(idx) << order);
     }
 
     /** Release all allocated resources. */
     void _Free();
+
+    /** Mark block as free in the bitmap and place it in the free blocks cache
+     * if there are unused cache entries.
+     *
+     * @param address Address of the block.
+     * @param order Order of the block.
+     */
+    void _PutFreeBlock(Addr address, int order);
+
+    /** Take any free block of the specified order. Cached blocks are taken
+     * first.
+     *
+     * @param order Order of the block.
+     * @param address Address of the block is stored there.
+     * @return @a true if the block is taken, @a false if there are no free
+     *      blocks of the specified order.
+     */
+    bool _TakeFreeBlock(int order, Addr *address);
+
+    /** Take the specified free block. It is removed from the bitmap and from
+     * the free blocks cache if it was cached there.
+     *
+     * @param address Address of the block.
+     * @param order Order of the block.
+     */
+    void _TakeBlock(Addr address, int order);
+
+    /** Release cache entry which represents a free block. The entry is
+     * removed from the order pool cache list and from the cache tree.
+     *
+     * @param entry Entry to release.
+     * @param pool Pool of the order where the entry is cached.
+     */
+    void _ReleaseCacheEntry(CacheEntry *entry, OrderPool &pool);
+
+    /** Return block to the allocator coalescing it with its buddies while
+     * they are free.
+     *
+     * @param address Address of the block.
+     * @param order Order of the block.
+     */
+    void _ReleaseBlock(Addr address, int order);
+
+    /** Return range to the allocator. The range is split into the largest
+     * possible blocks.
+     *
+     * @param start Start address of the range.
+     * @param end One-past-end address of the range.
+     */
+    void _ReleaseRange(Addr start, Addr end);
+
+    /** Get order of the largest block which starts the range.
+     *
+     * @param start Start address of the range.
+     * @param end One-past-end address of the range.
+     * @return Order of the block which is aligned on its size and fits the
+     *      range.
+     */
+    int _GetRangeOrder(Addr start, Addr end);
+
+    /** Find free block which contains the specified address.
+     *
+     * @param address Address to look for.
+     * @param block Address of the found block is stored there.
+     * @param order Order of the found block is stored there.
+     * @return @a true if the block found, @a false if the address is
+     *      allocated.
+     */
+    bool _FindFreeBlock(Addr address, Addr *block, int *order);
+
+    /** Find the nearest free block located after the specified allocated
+     * address.
+     *
+     * @param address Allocated address to search from.
+     * @return Start address of the found block, end of the managed range if
+     *      there are no free blocks after the address.
+     */
+    Addr _FindNextFree(Addr address);
+
+    /** Take all free blocks in the range. Parts of the blocks outside the
+     * range are returned to the allocator. The range must consist of free
+     * blocks only.
+     *
+     * @param start Start address of the range.
+     * @param end One-past-end address of the range.
+     */
+    void _TakeRange(Addr start, Addr end);
 };
 
 /** Universal buddy allocator.
@@ -186,6 +448,43 @@ public:
         return BuddyAllocatorBase::Initialize(startAddress, endAddress,
                                               minOrder, maxOrder, cacheSize);
     }
+
+    /** @see BuddyAllocatorBase::Allocate */
+    inline RetCode Allocate(Addr size, AddrType *address)
+    {
+        Addr addr;
+        RetCode rc = BuddyAllocatorBase::Allocate(size, &addr);
+        if (rc.IsOk()) {
+            *address = addr;
+        }
+        return rc;
+    }
+
+    /** @see BuddyAllocatorBase::Free */
+    inline RetCode Free(AddrType address, Addr size)
+    {
+        return BuddyAllocatorBase::Free(address, size);
+    }
+
+    /** @see BuddyAllocatorBase::AllocateRange */
+    inline RetCode AllocateRange(Addr size, AddrType *address,
+                                 Addr alignment = 0, AddrType lowLimit = 0,
+                                 AddrType highLimit = 0)
+    {
+        Addr addr;
+        RetCode rc = BuddyAllocatorBase::AllocateRange(size, &addr, alignment,
+                                                       lowLimit, highLimit);
+        if (rc.IsOk()) {
+            *address = addr;
+        }
+        return rc;
+    }
+
+    /** @see BuddyAllocatorBase::FreeRange */
+    inline RetCode FreeRange(AddrType address, Addr size)
+    {
+        return BuddyAllocatorBase::FreeRange(address, size);
+    }
 };
 
 
@@ -0,0 +1,247 @@
+/*
+ * /phoenix/include/common/BuddyMagazine.h
+ *
+ * This file is a part of Phoenix operating system.
+ * Copyright (c) 2011-2012, Artyom Lebedev <artyom.lebedev@gmail.com>
+ * All rights reserved.
+ * See COPYING file for copyright details.
+ */
+
+/** @file BuddyMagazine.h
+ * Per-CPU magazine cache layered over the buddy allocator.
+ */
+
+#ifndef BUDDYMAGAZINE_H_
+#define BUDDYMAGAZINE_H_
+
+/** Per-CPU magazine cache for the buddy allocator. It serves allocations and
+ * freeings of the lowest orders of an underlying @ref BuddyAllocatorBase
+ * instance. @n
+ *
+ * A magazine is a small stack of free blocks of one order. Each CPU has two
+ * magazines for each cached order - loaded and previous one. Allocations pop
+ * blocks from the loaded magazine, freeings push blocks to it. When the loaded
+ * magazine is empty (on allocation) or full (on freeing) it is swapped with the
+ * previous one. Only when both magazines cannot serve the request the CPU
+ * exchanges a magazine with the depot - shared stacks of full and empty
+ * magazines. If the depot cannot help either, the blocks are allocated from or
+ * returned to the underlying allocator in a batch under one lock acquisition.
+ * So most of the operations do not touch any shared state. @n
+ *
+ * The per-CPU state is not protected by any lock. The caller must ensure that
+ * all calls with a given CPU index are serialized, i.e. the caller should not
+ * be preempted or migrated to another CPU during the call. Once the
+ * underlying allocator is attached to the cache it must not be used directly.
+ * @n
+ *
+ * Blocks stored in magazines are not coalesced with their buddies. Use
+ * @ref Flush and @ref Reclaim methods to return them to the underlying
+ * allocator when fragmentation matters.
+ */
+class BuddyMagazineBase {
+public:
+    /** Address type for representing all ranges with which the allocator
+     * operates.
+     */
+    typedef BuddyAllocatorBase::Addr Addr;
+
+    /** Various constants. */
+    enum :size_t {
+        /** Number of the lowest orders served by magazines. */
+        NUM_ORDERS = 4,
+        /** Number of blocks in one magazine. */
+        MAGAZINE_SIZE = 32,
+        /** Number of blocks allocated in one batch when refilling a magazine
+         * from the underlying allocator.
+         */
+        REFILL_SIZE = MAGAZINE_SIZE / 2,
+    };
+
+    BuddyMagazineBase();
+
+    ~BuddyMagazineBase();
+
+    /** Initialize the cache. It will require some memory allocations for the
+     * magazines.
+     *
+     * @param alloc Initialized underlying allocator.
+     * @param numCpus Number of CPUs which use the cache.
+     * @param depotSize Number of additional magazines in the depot for each
+     *      cached order.
+     * @return @ref RetCode::SUCCESS if successfully initialized, error code
+     *      otherwise.
+     */
+    RetCode Initialize(BuddyAllocatorBase *alloc, size_t numCpus,
+                       size_t depotSize = 16);
+
+    /** Allocate a block.
+     *
+     * @param cpu Index of the current CPU.
+     * @param size Size of the block to allocate.
+     * @param address Allocated block address is stored there on success.
+     * @return Status code, see @ref BuddyAllocatorBase::Allocate.
+     */
+    RetCode Allocate(size_t cpu, Addr size, Addr *address);
+
+    /** Free previously allocated block. Note that for cached orders the
+     * block is not validated until it is returned to the underlying allocator.
+     *
+     * @param cpu Index of the current CPU.
+     * @param address Address of the block to free.
+     * @param size Size of the block.
+     * @return Status code, see @ref BuddyAllocatorBase::Free.
+     */
+    RetCode Free(size_t cpu, Addr address, Addr size);
+
+    /** Return all blocks cached by the specified CPU to the underlying
+     * allocator. The same serialization rules as for @ref Allocate apply.
+     *
+     * @param cpu Index of the current CPU.
+     */
+    void Flush(size_t cpu);
+
+    /** Return all blocks stored in the depot to the underlying allocator. Can
+     * be called from any CPU.
+     */
+    void Reclaim();
+
+private:
+    /** Stack of free blocks of one order. */
+    class Magazine {
+    public:
+        Magazine *next = 0; /**< Next magazine in the depot stack. */
+        size_t numRounds = 0; /**< Number of blocks in the magazine. */
+        Addr rounds[MAGAZINE_SIZE]; /**< Stored blocks. */
+
+        inline bool IsEmpty() { return !numRounds; }
+        inline bool IsFull() { return numRounds == MAGAZINE_SIZE; }
+        inline Addr Pop() {
+            ASSERT(numRounds);
+            return rounds[--numRounds];
+        }
+        inline void Push(Addr address) {
+            ASSERT(numRounds < MAGAZINE_SIZE);
+            rounds[numRounds++] = address;
+        }
+    };
+
+    /** Magazines of one CPU for one order. */
+    class CpuOrderCache {
+    public:
+        Magazine *loaded, *previous;
+
+        inline void Swap() {
+            Magazine *m = loaded;
+            loaded = previous;
+            previous = m;
+        }
+    };
+
+    /** Per-CPU state. Aligned to avoid false sharing between CPUs. */
+    class CpuCache {
+    public:
+        CpuOrderCache orders[NUM_ORDERS];
+    } __ALIGNED(CACHE_LINE_SIZE);
+
+    /** Shared stacks of magazines for one order. */
+    class Depot {
+    public:
+        Magazine *full = 0, *empty = 0;
+
+        inline void PushFull(Magazine *m) {
+            m->next = full;
+            full = m;
+        }
+        inline void PushEmpty(Magazine *m) {
+            m->next = empty;
+            empty = m;
+        }
+        inline Magazine *PopFull() {
+            Magazine *m = full;
+            if (m) {
+                full = m->next;
+            }
+            return m;
+        }
+        inline Magazine *PopEmpty() {
+            Magazine *m = empty;
+            if (m) {
+                empty = m->next;
+            }
+            return m;
+        }
+    };
+
+    BuddyAllocatorBase *_alloc = 0;
+    size_t _numCpus = 0;
+    /** Storage for all magazines. */
+    Magazine *_magazines = 0;
+    /** Per-CPU state, indexed by CPU index. */
+    CpuCache *_cpus = 0;
+    /** Depot for each cached order. */
+    Depot _depot[NUM_ORDERS];
+    /** Lock for the depot. */
+    SpinLock _depotLock;
+    /** Lock for the underlying allocator. */
+    SpinLock _allocLock;
+
+    /** Release all allocated resources. */
+    void _Free();
+
+    /** Allocate a block from the underlying allocator. */
+    RetCode _AllocateGlobal(Addr size, Addr *address);
+
+    /** Free a block to the underlying allocator. */
+    RetCode _FreeGlobal(Addr address, Addr size);
+
+    /** Fill the magazine with blocks from the underlying allocator up to
+     * @ref REFILL_SIZE rounds. Should be called with @a _allocLock held.
+     *
+     * @param m Magazine to fill.
+     * @param order Order of the blocks to allocate.
+     */
+    void _FillMagazine(Magazine *m, int order);
+
+    /** Return all blocks from the magazine to the underlying allocator. Should
+     * be called with @a _allocLock held.
+     *
+     * @param m Magazine to empty.
+     * @param order Order of the blocks in the magazine.
+     */
+    void _EmptyMagazine(Magazine *m, int order);
+};
+
+/** Per-CPU magazine cache for the buddy allocator.
+ * @param AddrType Type of the address with which the allocator operates.
+ */
+template <class AddrType>
+class BuddyMagazine : public BuddyMagazineBase {
+public:
+    inline BuddyMagazine() : BuddyMagazineBase() { }
+
+    /** @see BuddyMagazineBase::Initialize */
+    inline RetCode Initialize(BuddyAllocator<AddrType> *alloc, size_t numCpus,
+                              size_t depotSize = 16)
+    {
+        return BuddyMagazineBase::Initialize(alloc, numCpus, depotSize);
+    }
+
+    /** @see BuddyMagazineBase::Allocate */
+    inline RetCode Allocate(size_t cpu, Addr size, AddrType *address)
+    {
+        Addr addr;
+        RetCode rc = BuddyMagazineBase::Allocate(cpu, size, &addr);
+        if (rc.IsOk()) {
+            *address = addr;
+        }
+        return rc;
+    }
+
+    /** @see BuddyMagazineBase::Free */
+    inline RetCode Free(size_t cpu, AddrType address, Addr size)
+    {
+        return BuddyMagazineBase::Free(cpu, address, size);
+    }
+};
+
+#endif /* BUDDYMAGAZINE_H_ */
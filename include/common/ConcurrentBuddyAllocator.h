@@ -0,0 +1,235 @@
+/*
+ * /phoenix/include/common/ConcurrentBuddyAllocator.h
+ *
+ * This file is a part of Phoenix operating system.
+ * Copyright (c) 2011-2012, Artyom Lebedev <artyom.lebedev@gmail.com>
+ * All rights reserved.
+ * See COPYING file for copyright details.
+ */
+
+/** @file ConcurrentBuddyAllocator.h
+ * Buddy allocator with fine-grained locking.
+ */
+
+#ifndef CONCURRENTBUDDYALLOCATOR_H_
+#define CONCURRENTBUDDYALLOCATOR_H_
+
+/** Concurrent variant of the universal buddy allocator. It manages address
+ * ranges the same way as @ref BuddyAllocatorBase does but it can be called
+ * from several CPUs simultaneously without any external locking. @n
+ *
+ * Each order pool has its own lock, so operations which touch different
+ * orders proceed in parallel. Locks are always acquired in ascending order
+ * which excludes deadlocks:
+ * - allocation locks the requested order and, if it has no free blocks,
+ *   climbs to higher orders keeping the lower ones locked. When a block is
+ *   found, it is split and the halves are returned to the already locked
+ *   lower orders, then all the locks are released. So the halves are never
+ *   invisible to other CPUs which could fail to find free memory otherwise.
+ * - freeing coalesces the block with its buddies hand over hand - the next
+ *   order lock is acquired before the current one is released.
+ *
+ * Free block lookup in an order pool is done by scanning the pool bitmap
+ * before the lock is acquired. The found block is verified under the lock and
+ * the bitmap is rescanned only if it was taken meanwhile. This keeps the
+ * critical sections short. @n
+ *
+ * There is no free blocks cache in this variant since the cache is shared by
+ * all orders. The bitmaps summary levels make the lookup fast enough.
+ */
+class ConcurrentBuddyAllocatorBase {
+public:
+    /** Address type for representing all ranges with which the allocator
+     * operates.
+     */
+    typedef BuddyAllocatorBase::Addr Addr;
+
+    /** Various constants. */
+    enum :size_t {
+        /** Maximal allowed value for @a maxOrder parameter. */
+        MAX_ORDER = BuddyAllocatorBase::MAX_ORDER,
+    };
+
+    ConcurrentBuddyAllocatorBase();
+
+    ~ConcurrentBuddyAllocatorBase();
+
+    /** Initialize the allocator. It will require some memory allocations for
+     * the allocator internal data structures.
+     *
+     * @see BuddyAllocatorBase::Initialize
+     */
+    RetCode Initialize(Addr startAddress, Addr endAddress, int minOrder = 0,
+                       int maxOrder = -1);
+
+    /** Allocate a block. Can be called concurrently with any other method.
+     *
+     * @see BuddyAllocatorBase::Allocate
+     */
+    RetCode Allocate(Addr size, Addr *address);
+
+    /** Free previously allocated block. Can be called concurrently with any
+     * other method.
+     *
+     * @see BuddyAllocatorBase::Free
+     */
+    RetCode Free(Addr address, Addr size);
+
+    /** Get minimal order of allocated blocks. */
+    inline int GetMinOrder() { return _minOrder; }
+
+    /** Get maximal order of allocated blocks. */
+    inline int GetMaxOrder() { return _maxOrder; }
+
+    /** Get order of the block which is allocated for the provided size. */
+    inline int GetBlockOrder(Addr size) {
+        return Max(_GetOrder(size), _minOrder);
+    }
+
+    /** Take statistics snapshot. Each order is locked while its counters are
+     * copied so the snapshot is consistent per order only. There is no free
+     * blocks cache, so the cache hits and misses counters count the bitmap
+     * probes which were confirmed under the lock and which were stale, and
+     * the rest cache counters are zero.
+     *
+     * @param stats Snapshot is stored there.
+     */
+    void GetStats(BuddyAllocatorBase::Stats *stats);
+
+private:
+    bool _isInitialized = false;
+    Addr _startAddress, _endAddress;
+    int _minOrder, _maxOrder;
+
+    /** Each managed order is represented by one instance of this class.
+     * Aligned to avoid false sharing between the locks.
+     */
+    class OrderPool {
+    public:
+        /** Initialize pool element.
+         *
+         * @param numBlocks Number of blocks of corresponding order.
+         * @return Status code.
+         */
+        RetCode Initialize(size_t numBlocks);
+        ~OrderPool() { DELETE [] _bitmapData; }
+    private:
+        friend class ConcurrentBuddyAllocatorBase;
+
+        SpinLock _lock; /**< Protects all the rest members. */
+        u8 *_bitmapData = 0; /**< Storage for bitmap data. */
+        SummaryBitString _bitmap; /**< Free blocks bitmap. */
+        size_t _numFree = 0; /**< Number of free blocks of this order. */
+        size_t _probeHits = 0, /**< Probed blocks which were still free. */
+               _probeMisses = 0, /**< Probed blocks taken meanwhile. */
+               _splits = 0, /**< Blocks split into halves. */
+               _coalesces = 0; /**< Blocks coalesced with their buddies. */
+    } __ALIGNED(CACHE_LINE_SIZE);
+
+    /** All managed resources are represented in this pool. */
+    OrderPool *_pool = 0;
+
+    /** Get order which corresponds to the provided size. */
+    inline int _GetOrder(Addr size) {
+        int order = 0;
+        Addr osize = 1;
+        while (osize < size && order < static_cast<int>(MAX_ORDER)) {
+            order++;
+            osize <<= 1;
+        }
+        return order;
+    }
+
+    /** Get size which corresponds to the provided order. */
+    inline Addr _GetOrderSize(int order) {
+        ASSERT(order >= 0);
+        return static_cast<Addr>(1) << order;
+    }
+
+    /** Get pool which corresponds to the provided order. */
+    inline OrderPool &_GetPool(int order) {
+        ASSERT(order >= _minOrder && order <= _maxOrder);
+        return _pool[order - _minOrder];
+    }
+
+    /** Get index of the block in its order pool bitmap. */
+    inline size_t _GetBlockIdx(Addr address, int order) {
+        return (address - _startAddress) >> order;
+    }
+
+    /** Get address of the block by its index in its order pool bitmap. */
+    inline Addr _GetBlockAddress(size_t idx, int order) {
+        return _startAddress + (static_cast<Addr>(idx) << order);
+    }
+
+    /** Release all allocated resources. */
+    void _Free();
+
+    /** Probe the pool bitmap for a free block. The bitmap is read without
+     * locking, so the result is just a hint which must be verified under the
+     * pool lock.
+     *
+     * @param pool Pool to probe.
+     * @return Index of the probed block, -1 if none found.
+     */
+    inline int _Probe(OrderPool &pool) {
+        if (!__atomic_load_n(&pool._numFree, __ATOMIC_RELAXED)) {
+            return -1;
+        }
+        return pool._bitmap.FirstSet();
+    }
+
+    /** Take any free block of the specified order. The pool lock must be
+     * held.
+     *
+     * @param order Order of the block.
+     * @param hint Index of the block found by @ref _Probe, -1 if none.
+     * @param address Address of the block is stored there.
+     * @return @a true if the block is taken, @a false if there are no free
+     *      blocks of the specified order.
+     */
+    bool _TakeFreeBlock(int order, int hint, Addr *address);
+
+    /** Mark block as free. The pool lock must be held.
+     *
+     * @param address Address of the block.
+     * @param order Order of the block.
+     */
+    void _PutFreeBlock(Addr address, int order);
+};
+
+/** Concurrent buddy allocator.
+ * @param AddrType Type of the address with which the allocator operates.
+ */
+template <class AddrType>
+class ConcurrentBuddyAllocator : public ConcurrentBuddyAllocatorBase {
+public:
+    inline ConcurrentBuddyAllocator() : ConcurrentBuddyAllocatorBase() { }
+
+    /** @see ConcurrentBuddyAllocatorBase::Initialize */
+    inline RetCode Initialize(AddrType startAddress, AddrType endAddress,
+                              int minOrder = 0,  int maxOrder = -1)
+    {
+        return ConcurrentBuddyAllocatorBase::Initialize(startAddress, endAddress,
+                                                        minOrder, maxOrder);
+    }
+
+    /** @see ConcurrentBuddyAllocatorBase::Allocate */
+    inline RetCode Allocate(Addr size, AddrType *address)
+    {
+        Addr addr;
+        RetCode rc = ConcurrentBuddyAllocatorBase::Allocate(size, &addr);
+        if (rc.IsOk()) {
+            *address = addr;
+        }
+        return rc;
+    }
+
+    /** @see ConcurrentBuddyAllocatorBase::Free */
+    inline RetCode Free(AddrType address, Addr size)
+    {
+        return ConcurrentBuddyAllocatorBase::Free(address, size);
+    }
+};
+
+#endif /* CONCURRENTBUDDYALLOCATOR_H_ */
@@ -0,0 +1,375 @@
+/*
+ * /phoenix/include/common/ConcurrentRBTree.h
+ *
+ * This file is a part of Phoenix operating system.
+ * Copyright (c) 2011-2012, Artyom Lebedev <artyom.lebedev@gmail.com>
+ * All rights reserved.
+ * See COPYING file for copyright details.
+ */
+
+/** @file ConcurrentRBTree.h
+ * Red-black tree with lockless lookups.
+ */
+
+#ifndef CONCURRENTRBTREE_H_
+#define CONCURRENTRBTREE_H_
+
+/** Registry of lockless readers used for deferred reclamation of the nodes
+ * removed from a concurrent tree. It is epoch based. Each reader publishes
+ * the current epoch in its per-CPU slot when it starts reading and clears the
+ * slot when done. A removed node is stamped with the current epoch and the
+ * epoch is advanced. The node can be reclaimed when all active readers have
+ * published later epochs, i.e. they started after the node removal and
+ * cannot reach it. @n
+ *
+ * Readers write only to their own slots, so there is no shared cache line
+ * written by all the readers.
+ */
+class RBTreeReaders {
+public:
+    /** Epoch value of inactive reader. */
+    static const u64 INACTIVE = 0;
+
+    RBTreeReaders();
+
+    ~RBTreeReaders();
+
+    /** Initialize the registry. It requires memory allocation for the per-CPU
+     * slots.
+     *
+     * @param numCpus Number of CPUs which can read.
+     * @return Status code.
+     */
+    RetCode Initialize(size_t numCpus);
+
+    /** Start read-side section. Sections cannot be nested. The caller should
+     * not be preempted or migrated to another CPU until the section end.
+     *
+     * @param cpu Index of the current CPU.
+     */
+    inline void Enter(size_t cpu) {
+        ASSERT(cpu < _numCpus);
+        ASSERT(_slots[cpu].epoch == INACTIVE);
+        __atomic_store_n(&_slots[cpu].epoch,
+                         __atomic_load_n(&_epoch, __ATOMIC_ACQUIRE),
+                         __ATOMIC_RELAXED);
+        /* The slot should be visible before any tree node is read. */
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    }
+
+    /** End read-side section.
+     *
+     * @param cpu Index of the current CPU.
+     */
+    inline void Exit(size_t cpu) {
+        ASSERT(cpu < _numCpus);
+        __atomic_store_n(&_slots[cpu].epoch, INACTIVE, __ATOMIC_RELEASE);
+    }
+
+    /** Stamp for a removed node. Should be called by the writer after the
+     * node was removed. Advances the current epoch.
+     *
+     * @return Epoch value which the node should be stamped with.
+     */
+    inline u64 Retire() {
+        u64 epoch = _epoch;
+        __atomic_store_n(&_epoch, epoch + 1, __ATOMIC_RELEASE);
+        return epoch;
+    }
+
+    /** Get the oldest epoch published by the active readers.
+     *
+     * @return The oldest epoch, current epoch if there are no active readers.
+     *      Nodes stamped with lesser epochs can be reclaimed.
+     */
+    u64 GetOldestEpoch();
+
+private:
+    /** Per-CPU slot. Aligned to avoid false sharing between CPUs. */
+    class Slot {
+    public:
+        u64 epoch = INACTIVE;
+    } __ALIGNED(CACHE_LINE_SIZE);
+
+    Slot *_slots = 0;
+    size_t _numCpus = 0;
+    /** Current epoch, starts from one so that it never equals INACTIVE. */
+    u64 _epoch = 1;
+};
+
+/** Red-black tree with lockless lookups. Intended for trees where lookups
+ * far outnumber modifications. @n
+ *
+ * Writers are serialized by the tree lock. The tree generation is odd while a
+ * modification is in progress and is changed by each modification, so it
+ * serves as a sequence counter. Readers do not write any shared memory, they
+ * walk the tree without locks and retry if the generation was changed
+ * meanwhile. A reader may walk through a node which is being removed, so the
+ * removed objects are not released immediately, they are passed to the
+ * reclamation function when no reader can reference them. @n
+ *
+ * Lookups should be done inside read-side sections, see @ref ReadBegin. The
+ * objects found are valid until the section end. The object keys must not be
+ * changed while the objects are in the tree. Only @ref Lookup is lockless,
+ * other read methods inherited from @ref RBTree (ordered iteration, bounds
+ * lookup) must not be used concurrently with modifications. The tree lock
+ * does not disable interrupts, the caller should take care if the tree is
+ * modified in interrupt context.
+ *
+ * @param T Class for objects which are stored in a tree.
+ * @param Comparator See @ref RBTree.
+ * @param key_t See @ref RBTree.
+ * @param KeyComparator See @ref RBTree.
+ */
+template <class T, int (T::*Comparator)(T &obj),
+          typename key_t, int (T::*KeyComparator)(key_t &key)>
+class ConcurrentRBTree : public RBTree<T, Comparator, key_t, KeyComparator> {
+private:
+    typedef RBTree<T, Comparator, key_t, KeyComparator> Base;
+    typedef RBTreeBase::EntryBase EntryBase;
+
+public:
+    /** Function which is called for each removed object when it is not
+     * referenced by readers anymore.
+     *
+     * @param obj Removed object. Its tree entry can be reused after that.
+     * @param arg Argument provided to the tree constructor.
+     */
+    typedef void (*ReclaimFunc)(T *obj, void *arg);
+
+    class Entry : public Base::Entry {
+    protected:
+        friend class ConcurrentRBTree;
+
+        /** Next entry in the retired entries list. */
+        Entry *nextRetired;
+        /** Epoch in which the entry was removed. */
+        u64 retireEpoch;
+    };
+
+    /** Construct the tree.
+     *
+     * @param reclaim Function to call for removed objects. Can be NULL.
+     * @param arg Argument for @a reclaim function.
+     */
+    inline ConcurrentRBTree(ReclaimFunc reclaim = 0, void *arg = 0) :
+        Base(), _reclaim(reclaim), _reclaimArg(arg) { }
+
+    /** All removed objects are reclaimed on destruction. There should be no
+     * active readers.
+     */
+    ~ConcurrentRBTree()
+    {
+        _Reclaim(~static_cast<u64>(0));
+    }
+
+    /** Initialize the tree. Should be called before any readers appear.
+     *
+     * @param numCpus Number of CPUs which can read the tree.
+     * @return Status code.
+     */
+    inline RetCode Initialize(size_t numCpus)
+    {
+        return _readers.Initialize(numCpus);
+    }
+
+    /** Start read-side section. Sections cannot be nested. The caller should
+     * not be preempted or migrated to another CPU until the section end.
+     *
+     * @param cpu Index of the current CPU.
+     */
+    inline void ReadBegin(size_t cpu)
+    {
+        _readers.Enter(cpu);
+    }
+
+    /** End read-side section. Objects found in the section should not be
+     * accessed after that.
+     *
+     * @param cpu Index of the current CPU.
+     */
+    inline void ReadEnd(size_t cpu)
+    {
+        _readers.Exit(cpu);
+    }
+
+    /** Lockless lookup. Should be called inside a read-side section.
+     *
+     * @param key Key for lookup.
+     * @return Pointer to found object, 0 if not found.
+     */
+    T *Lookup(key_t &key)
+    {
+        /* Maximal depth of a valid red-black tree. A reader can run into a
+         * loop when walking through concurrently rotated nodes, so the walk
+         * is limited and retried.
+         */
+        const size_t maxDepth = 2 * sizeof(size_t) * NBBY;
+        while (true) {
+            unsigned gen = this->GetGeneration();
+            if (gen & 1) {
+                cpu::Pause();
+                continue;
+            }
+            EntryBase *node = this->LoadRoot(), *found = 0;
+            for (size_t depth = 0; node && depth < maxDepth; depth++) {
+                int cmp = Base::_Compare(node, key);
+                if (!cmp) {
+                    found = node;
+                    break;
+                }
+                node = this->LoadChild(node, cmp > 0);
+            }
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (this->GetGeneration() == gen) {
+                return found ? Base::GetObj(found) : 0;
+            }
+        }
+    }
+
+    /** @see RBTree::InsertProbe */
+    inline T *InsertProbe(T *obj, Entry *e)
+    {
+        _lock.Lock();
+        T *result = Base::InsertProbe(obj, e);
+        _lock.Unlock();
+        return result;
+    }
+
+    /** @see RBTree::Insert */
+    inline T *Insert(T *obj, Entry *e)
+    {
+        _lock.Lock();
+        T *result = Base::Insert(obj, e);
+        _lock.Unlock();
+        return result;
+    }
+
+    /** Delete a node by its entry in user object. The object is passed to
+     * the reclamation function when no readers reference it. The entry should
+     * not be reused before that.
+     *
+     * @param e Tree entry of a node to delete.
+     */
+    inline void Delete(Entry *e)
+    {
+        _lock.Lock();
+        Base::Delete(e);
+        _Retire(e);
+        _Reclaim(_readers.GetOldestEpoch());
+        _lock.Unlock();
+    }
+
+    /** Delete a node by its key. The object is passed to the reclamation
+     * function when no readers reference it.
+     *
+     * @param key Key of the node to delete.
+     * @return Corresponding object if found, 0 if no such object in the tree.
+     */
+    inline T *Delete(key_t &key)
+    {
+        _lock.Lock();
+        EntryBase *e = Base::_LookupNode(key);
+        T *obj = 0;
+        if (e) {
+            obj = Base::GetObj(e);
+            RBTreeBase::Delete(e);
+            _Retire(static_cast<Entry *>(e));
+            _Reclaim(_readers.GetOldestEpoch());
+        }
+        _lock.Unlock();
+        return obj;
+    }
+
+    /** Remove all objects from the tree. They are passed to the reclamation
+     * function when no readers reference them.
+     */
+    void Clear()
+    {
+        _lock.Lock();
+        EntryBase *node = 0;
+        while ((node = this->GetNextNode(node))) {
+            _Append(static_cast<Entry *>(node));
+        }
+        Base::Clear();
+        u64 epoch = _readers.Retire();
+        for (Entry *e = _retiredHead; e; e = e->nextRetired) {
+            if (e->retireEpoch == INVALID_EPOCH) {
+                e->retireEpoch = epoch;
+            }
+        }
+        _Reclaim(_readers.GetOldestEpoch());
+        _lock.Unlock();
+    }
+
+    /** Reclaim removed objects which are not referenced by readers anymore.
+     * It is done on each deletion, this method can be used to force it when
+     * there are no deletions for a long time.
+     */
+    inline void Reclaim()
+    {
+        _lock.Lock();
+        _Reclaim(_readers.GetOldestEpoch());
+        _lock.Unlock();
+    }
+
+    /** @see RBTree::BuildFromSorted */
+    template <class EntryType>
+    inline void BuildFromSorted(T **objs, size_t numObjs, EntryType T::*entry)
+    {
+        _lock.Lock();
+        Base::BuildFromSorted(objs, numObjs, entry);
+        _lock.Unlock();
+    }
+
+private:
+    enum :u64 {
+        /** Epoch of the entry which is appended but not yet stamped. */
+        INVALID_EPOCH = ~static_cast<u64>(0),
+    };
+
+    /** Serializes writers. */
+    SpinLock _lock;
+    RBTreeReaders _readers;
+    ReclaimFunc _reclaim;
+    void *_reclaimArg;
+    /** List of removed entries ordered by removal epoch. */
+    Entry *_retiredHead = 0, *_retiredTail = 0;
+
+    /** Append entry to the retired list. */
+    inline void _Append(Entry *e)
+    {
+        e->nextRetired = 0;
+        e->retireEpoch = INVALID_EPOCH;
+        if (_retiredTail) {
+            _retiredTail->nextRetired = e;
+        } else {
+            _retiredHead = e;
+        }
+        _retiredTail = e;
+    }
+
+    /** Put removed entry to the retired list. */
+    inline void _Retire(Entry *e)
+    {
+        _Append(e);
+        e->retireEpoch = _readers.Retire();
+    }
+
+    /** Reclaim retired entries stamped with epochs less than the provided. */
+    void _Reclaim(u64 oldestEpoch)
+    {
+        while (_retiredHead && _retiredHead->retireEpoch < oldestEpoch) {
+            Entry *e = _retiredHead;
+            _retiredHead = e->nextRetired;
+            if (!_retiredHead) {
+                _retiredTail = 0;
+            }
+            if (_reclaim) {
+                _reclaim(Base::GetObj(e), _reclaimArg);
+            }
+        }
+    }
+};
+
+#endif /* CONCURRENTRBTREE_H_ */
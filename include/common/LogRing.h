@@ -0,0 +1,99 @@
+/*
+ * /phoenix/include/common/LogRing.h
+ *
+ * This file is a part of Phoenix operating system.
+ * Copyright (c) 2011-2012, Artyom Lebedev <artyom.lebedev@gmail.com>
+ * All rights reserved.
+ * See COPYING file for copyright details.
+ */
+
+/** @file LogRing.h
+ * Lockless ring buffer for log records.
+ */
+
+#ifndef LOGRING_H_
+#define LOGRING_H_
+
+/** Lockless ring buffer of fixed size log records, see @ref SeqRing for the
+ * concurrency and overflow handling details. Long texts are split into
+ * several records.
+ */
+class LogRing : public SeqRing {
+public:
+    enum {
+        /** Size of one record slot. */
+        SLOT_SIZE = 128,
+        /** Maximal text length in one record. */
+        TEXT_SIZE = SLOT_SIZE - 3 * sizeof(u64),
+    };
+
+    /** Record flags. */
+    enum Flags {
+        /** Text is continuation of the previous record text of the same
+         * producer.
+         */
+        F_CONTINUATION =    0x1,
+    };
+
+    /** Log record. */
+    class Record {
+    public:
+        /** Sequence number, see @ref SeqRing. */
+        u64 seq;
+        /** Time stamp provided by the producer. */
+        u64 timestamp;
+        /** Index of the CPU which produced the record. */
+        u16 cpu;
+        /** Log level of the record. */
+        u8 level;
+        /** Record flags, see @ref Flags. */
+        u8 flags;
+        /** Text length. */
+        u16 length;
+        u16 reserved;
+        /** Record text, not null-terminated. */
+        char text[TEXT_SIZE];
+    };
+
+    static_assert(OFFSETOF(Record, seq) == 0,
+                  "Record should start with the sequence number");
+
+    /** Initialize the ring. It requires memory allocation for the record
+     * slots.
+     *
+     * @param numSlots Number of record slots. Must be an integer power of two.
+     * @param policy Overflow policy.
+     * @return Status code.
+     */
+    inline RetCode Initialize(size_t numSlots, OverflowPolicy policy = DROP_NEW) {
+        return SeqRing::Initialize(numSlots, sizeof(Record), policy);
+    }
+
+    /** Put a record into the ring. Texts longer than @ref TEXT_SIZE are split
+     * into several records, the following ones are marked by
+     * @ref F_CONTINUATION flag. Can be called concurrently from any number of
+     * producers.
+     *
+     * @param timestamp Time stamp of the record.
+     * @param cpu Index of the current CPU.
+     * @param level Log level of the record.
+     * @param text Record text.
+     * @param length Text length.
+     * @return Number of text characters put. It is less than @a length if
+     *      records were dropped due to overflow.
+     */
+    size_t Put(u64 timestamp, u16 cpu, u8 level, const char *text, size_t length);
+
+    /** Get the oldest committed record and remove it from the ring. Consumers
+     * should be serialized by the caller.
+     *
+     * @param rec Record is copied here.
+     * @return @a true if the record was retrieved, @a false if there are no
+     *      committed records.
+     */
+    inline bool Get(Record *rec) {
+        return _Get(rec);
+    }
+};
+
+#endif /* LOGRING_H_ */
@@ -19,6 +19,270 @@
 /** Text streams manipulations. */
 namespace text_stream {
 
+/** Compile-time format strings support. Format string literals wrapped by
+ * @ref OTS_FMT macro are parsed during compilation, format characters are
+ * checked against the argument types so that mismatches are reported as
+ * compilation errors. Only literal parts and values are processed at run time.
+ */
+namespace static_fmt {
+
+/** Flags of a format specifier. */
+enum SpecFlags {
+    SF_SHARP =      0x1,
+    SF_SPACE =      0x2,
+    SF_SIGN =       0x4,
+    SF_ZERO =       0x8,
+    SF_LEFT_ADJ =   0x10,
+    SF_LONG =       0x20,
+    SF_SHORT =      0x40,
+    SF_WIDTH =      0x80,
+    SF_PREC =       0x100,
+};
+
+/** Format specifier parsed at compile time. */
+class Spec {
+public:
+    /** Position next to the format character. */
+    size_t end;
+    /** Format character, zero if the specifier is invalid. */
+    char fmtChar;
+    /** Combination of @ref SpecFlags. */
+    unsigned flags;
+    long width, prec;
+    /** Order of width and precision arguments specified by '*', zero if
+     * not taken from the arguments.
+     */
+    int widthArg, precArg;
+
+    constexpr Spec(size_t end = 0, char fmtChar = 0, unsigned flags = 0,
+                   long width = 0, long prec = 0, int widthArg = 0,
+                   int precArg = 0) :
+        end(end), fmtChar(fmtChar), flags(flags), width(width), prec(prec),
+        widthArg(widthArg), precArg(precArg) {}
+
+    constexpr Spec Flag(unsigned flag) const {
+        return Spec(end, fmtChar, flags | flag, width, prec, widthArg, precArg);
+    }
+
+    constexpr Spec Width(long value) const {
+        return Spec(end, fmtChar, flags | SF_WIDTH, value, prec, widthArg, precArg);
+    }
+
+    constexpr Spec Prec(long value) const {
+        return Spec(end, fmtChar, flags | SF_PREC, width, value, widthArg, precArg);
+    }
+
+    constexpr Spec WidthArg() const {
+        return Spec(end, fmtChar, flags, width, prec, NumArgs() + 1, precArg);
+    }
+
+    constexpr Spec PrecArg() const {
+        return Spec(end, fmtChar, flags, width, prec, widthArg, NumArgs() + 1);
+    }
+
+    constexpr Spec Final(char c, size_t pos) const {
+        return Spec(pos, c, flags, width, prec, widthArg, precArg);
+    }
+
+    /** Number of arguments consumed for width and precision. */
+    constexpr int NumArgs() const {
+        return (widthArg ? 1 : 0) + (precArg ? 1 : 0);
+    }
+};
+
+constexpr bool
+IsDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+constexpr bool
+IsAlpha(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+constexpr long
+ParseNum(const char *s, size_t pos, long n = 0)
+{
+    return IsDigit(s[pos]) ? ParseNum(s, pos + 1, n * 10 + s[pos] - '0') : n;
+}
+
+constexpr size_t
+SkipNum(const char *s, size_t pos)
+{
+    return IsDigit(s[pos]) ? SkipNum(s, pos + 1) : pos;
+}
+
+/** Find next '%' character or the string end. */
+constexpr size_t
+FindPercent(const char *s, size_t pos)
+{
+    return s[pos] == 0 || s[pos] == '%' ? pos : FindPercent(s, pos + 1);
+}
+
+/** Parse format specifier. The same syntax as in run-time parser is
+ * accepted.
+ *
+ * @param s Format string.
+ * @param pos Position of the first character after '%'.
+ * @param spec Specifier state accumulated so far.
+ * @param dot Precision is expected.
+ */
+constexpr Spec
+ParseSpec(const char *s, size_t pos, Spec spec = Spec(), bool dot = false)
+{
+    return
+        s[pos] == 'l' || s[pos] == 'L' ? ParseSpec(s, pos + 1, spec.Flag(SF_LONG), dot) :
+        s[pos] == 'h' || s[pos] == 'H' ? ParseSpec(s, pos + 1, spec.Flag(SF_SHORT), dot) :
+        s[pos] == '*' ? ParseSpec(s, pos + 1, dot ? spec.PrecArg() : spec.WidthArg(), false) :
+        s[pos] == '.' ? ParseSpec(s, pos + 1, spec, true) :
+        s[pos] == '#' ? ParseSpec(s, pos + 1, spec.Flag(SF_SHARP), dot) :
+        s[pos] == ' ' ? ParseSpec(s, pos + 1, spec.Flag(SF_SPACE), dot) :
+        s[pos] == '+' ? ParseSpec(s, pos + 1, spec.Flag(SF_SIGN), dot) :
+        s[pos] == '-' ? ParseSpec(s, pos + 1, spec.Flag(SF_LEFT_ADJ), dot) :
+        s[pos] == '0' ? ParseSpec(s, pos + 1, spec.Flag(SF_ZERO), dot) :
+        IsDigit(s[pos]) ?
+            ParseSpec(s, SkipNum(s, pos),
+                      dot ? spec.Prec(ParseNum(s, pos)) : spec.Width(ParseNum(s, pos)),
+                      false) :
+        IsAlpha(s[pos]) ? spec.Final(s[pos], pos + 1) :
+        /* Invalid character or unexpected end of string. */
+        spec;
+}
+
+/** Kind of the next format string segment. */
+enum StepKind {
+    /** End of format string. */
+    STEP_END,
+    /** Escaped percent character. */
+    STEP_PERCENT,
+    /** Format specifier. */
+    STEP_SPEC,
+    /** Width or precision argument. */
+    STEP_STAR,
+    /** Value argument. */
+    STEP_VALUE,
+};
+
+/** Tag type for compile-time dispatching of format string segments. */
+template <StepKind kind>
+class StepTag {};
+
+/** Get kind of the segment which starts at '%' character or string end. */
+constexpr StepKind
+GetStepKind(const char *s, size_t pos)
+{
+    return s[pos] == 0 ? STEP_END : s[pos + 1] == '%' ? STEP_PERCENT : STEP_SPEC;
+}
+
+/** Compile-time checks of format characters for argument types. Types which
+ * are not known here (user defined classes) are checked at run time.
+ */
+template <typename T>
+class ArgTraits {
+public:
+    static constexpr bool IsKnown() { return false; }
+    static constexpr bool IsInteger() { return false; }
+    static constexpr bool CheckFmtChar(char) { return true; }
+};
+
+template <typename T>
+class SignedArgTraits {
+public:
+    static constexpr bool IsKnown() { return true; }
+    static constexpr bool IsInteger() { return true; }
+    static constexpr bool CheckFmtChar(char c) {
+        return c == 'd' || c == 'o' || c == 'x' || c == 'X';
+    }
+};
+
+template <typename T>
+class UnsignedArgTraits {
+public:
+    static constexpr bool IsKnown() { return true; }
+    static constexpr bool IsInteger() { return true; }
+    static constexpr bool CheckFmtChar(char c) {
+        return c == 'u' || c == 'o' || c == 'x' || c == 'X';
+    }
+};
+
+template <>
+class ArgTraits<bool>: public SignedArgTraits<bool> {};
+
+template <>
+class ArgTraits<short>: public SignedArgTraits<short> {};
+
+template <>
+class ArgTraits<int>: public SignedArgTraits<int> {};
+
+template <>
+class ArgTraits<long>: public SignedArgTraits<long> {};
+
+template <>
+class ArgTraits<unsigned short>: public UnsignedArgTraits<unsigned short> {};
+
+template <>
+class ArgTraits<unsigned>: public UnsignedArgTraits<unsigned> {};
+
+template <>
+class ArgTraits<unsigned long>: public UnsignedArgTraits<unsigned long> {
+public:
+    static constexpr bool CheckFmtChar(char c) {
+        return c == 'd' || c == 'o' || c == 'x' || c == 'X' || c == 'z';
+    }
+};
+
+template <>
+class ArgTraits<char> {
+public:
+    static constexpr bool IsKnown() { return true; }
+    static constexpr bool IsInteger() { return false; }
+    static constexpr bool CheckFmtChar(char c) { return c == 'c'; }
+};
+
+template <>
+class ArgTraits<const char *> {
+public:
+    static constexpr bool IsKnown() { return true; }
+    static constexpr bool IsInteger() { return false; }
+    static constexpr bool CheckFmtChar(char c) { return c == 's'; }
+};
+
+template <>
+class ArgTraits<char *>: public ArgTraits<const char *> {};
+
+template <typename T>
+class ArgTraits<T *> {
+public:
+    static constexpr bool IsKnown() { return true; }
+    static constexpr bool IsInteger() { return false; }
+    static constexpr bool CheckFmtChar(char c) { return c == 'p'; }
+};
+
+} /* namespace static_fmt */
+
+/** Format string parsed at compile time. Objects are created by
+ * @ref OTS_FMT macro.
+ *
+ * @param S Class with static constexpr @a Get() method which returns the
+ *      format string literal.
+ */
+template <class S>
+class StaticFormat {};
+
+/** Wrap format string literal for compile-time parsing. Example:
+ * @code
+ * LOG.Format(OTS_FMT("[%016x - %016x] %s\n"), start, end, name);
+ * @endcode
+ */
+#define OTS_FMT(__fmt) ([]() { \
+    struct __OtsFmt { \
+        static constexpr const char *Get() { return __fmt; } \
+    }; \
+    return text_stream::StaticFormat<__OtsFmt>(); \
+}())
+
 /** Base class for output text stream objects. They should be derived from this
  * class. Output text streams are capable of converting user defined classes
  * to strings. In order to support such conversion the user defined class
@@ -125,10 +389,51 @@ public:
         bool _enable;
     };
 
+    /** Output buffer which accumulates characters of one formatting call so
+     * that they are passed to the back-end by spans. It is allocated on the
+     * stack of top-level formatting method and referenced by all contexts
+     * of the call, so output of the call is not interleaved with output of
+     * concurrent calls if the back-end writes a span atomically.
+     */
+    class OutputBuffer {
+    public:
+        enum {
+            /** Buffer capacity in characters. */
+            SIZE = 128
+        };
+
+        inline OutputBuffer() {
+            _len = 0;
+            _numDropped = 0;
+        }
+
+    private:
+        friend class OTextStreamBase;
+
+        /** Buffered characters. */
+        char _data[SIZE];
+        /** Number of buffered characters. */
+        size_t _len;
+        /** Number of characters not accepted by the back-end. Non-zero value
+         * indicates end of stream.
+         */
+        size_t _numDropped;
+    };
+
     /** Conversion context. */
     class Context {
     public:
-        Context();
+        /** Construct context.
+         *
+         * @param buffer Output buffer to accumulate characters in. Characters
+         *      are passed directly to the back-end if zero.
+         */
+        explicit Context(OutputBuffer *buffer = 0);
+
+        /** Get output buffer associated with the context. Nested contexts
+         * should use the same buffer to preserve characters order.
+         */
+        inline OutputBuffer *GetBuffer() { return _buffer; }
 
         /** Get option presence and value.
          *
@@ -208,14 +513,17 @@ public:
         size_t _size;
         /** @a true if end of stream reached. */
         bool _endOfStream;
+        /** Output buffer, zero if not buffered. */
+        OutputBuffer *_buffer;
     };
 
     /** Output formated string. */
     template <typename... Args>
     inline size_t Format(const char *fmt, Args... args) {
-        Context ctx;
+        OutputBuffer buf;
+        Context ctx(&buf);
         Format(ctx, fmt, args...);
-        return ctx;
+        return _Flush(ctx);
     }
 
     /** This method handles edge case of previous template when only format
@@ -226,9 +534,10 @@ public:
      * @return Number of characters written.
      */
     inline size_t Format(const char *fmt) {
-        Context ctx;
+        OutputBuffer buf;
+        Context ctx(&buf);
         Format(ctx, fmt);
-        return ctx;
+        return _Flush(ctx);
     }
 
     /** Output formatted string. This method should be used by user defined
@@ -244,7 +553,7 @@ public:
     bool Format(Context &ctx, const char *fmt, T &value, Args... args) {
         char fmtChar;
         long _fmtChar;
-        Context __ctx, *pCtx;
+        Context __ctx(ctx.GetBuffer()), *pCtx;
 
         if (ctx.Opt(Opt::O_WIDTH_REQUIRED) || ctx.Opt(Opt::O_PREC_REQUIRED)) {
 
@@ -309,6 +618,35 @@ public:
      */
     bool Format(Context &ctx, const char *fmt);
 
+    /** Output formatted string with format parsed at compile time. Format
+     * errors and mismatches between format characters and argument types are
+     * reported as compilation errors.
+     *
+     * @param fmt Format string wrapped by @ref OTS_FMT macro.
+     * @param args Format arguments.
+     * @return Number of characters written.
+     */
+    template <class S, typename... Args>
+    inline size_t Format(StaticFormat<S> fmt UNUSED, Args... args) {
+        OutputBuffer buf;
+        Context ctx(&buf);
+        _FormatStatic<S, 0>(ctx, args...);
+        return _Flush(ctx);
+    }
+
+    /** Output formatted string with format parsed at compile time. This
+     * method can be used by user defined classes in @a ToString method.
+     *
+     * @param ctx Conversion context.
+     * @param fmt Format string wrapped by @ref OTS_FMT macro.
+     * @param args Format arguments.
+     * @return @a true if end of stream is not yet reached, @a false otherwise.
+     */
+    template <class S, typename... Args>
+    inline bool Format(Context &ctx, StaticFormat<S> fmt UNUSED, Args... args) {
+        return _FormatStatic<S, 0>(ctx, args...);
+    }
+
     /** Output formatted string. It has more limited functionality than
      * @a Format method because it is not types aware for format arguments.
      * So it cannot format user defined classes. For the same reason it is not
@@ -319,9 +657,10 @@ public:
      * @return Number of characters written.
      */
     inline size_t FormatV(const char *fmt, va_list args) {
-        Context ctx;
+        OutputBuffer buf;
+        Context ctx(&buf);
         FormatV(ctx, fmt, args);
-        return ctx;
+        return _Flush(ctx);
     }
 
     /** Output formatted string.
@@ -333,6 +672,18 @@ public:
      */
     bool FormatV(Context &ctx, const char *fmt, va_list args);
 
+    /** Output characters span as is. The span is passed to the back-end at
+     * once, so it is not interleaved with output of concurrent calls if the
+     * back-end writes a span atomically.
+     *
+     * @param buf Characters to output.
+     * @param len Number of characters to output.
+     * @return Number of characters written.
+     */
+    inline size_t WriteSpan(const char *buf, size_t len) {
+        return _Write(buf, len);
+    }
+
     /** Specify option for conversion.
      *
      * @param opt Option to switch.
@@ -435,9 +786,15 @@ public:
         return _FormatIntValue(ctx, reinterpret_cast<uintptr_t>(value), fmt);
     }
 
-    /** Format user defined class object. */
+    /** Format user defined class object. The output buffer is flushed
+     * before the conversion since the object may output its data through
+     * its own unbuffered context.
+     */
     template <class T>
     inline bool FormatValue(Context &ctx, T &value, char fmt = 0) {
+        if (!_FlushBuffer(ctx)) {
+            return false;
+        }
         return value.ToString(*this, ctx, fmt);
     }
 
@@ -457,6 +814,17 @@ protected:
      */
     virtual bool _Putc(char c) = 0;
 
+    /** Output characters span. Default implementation calls @ref _Putc for
+     * each character, derived classes may override it to pass the span to the
+     * back-end at once.
+     *
+     * @param buf Characters to output.
+     * @param len Number of characters to output.
+     * @return Number of characters output. If it is less than @a len then end
+     *      of stream reached.
+     */
+    virtual size_t _Write(const char *buf, size_t len);
+
     /** Output provided character.
      *
      * @param ctx Conversion context.
@@ -464,6 +832,19 @@ protected:
      * @return @a true if character was written, @a false otherwise.
      */
     inline bool _Putc(Context &ctx, char c) {
+        OutputBuffer *buf = ctx.GetBuffer();
+        if (buf) {
+            if (UNLIKELY(buf->_len == OutputBuffer::SIZE) && !_FlushBuffer(ctx)) {
+                return false;
+            }
+            if (UNLIKELY(buf->_numDropped)) {
+                ctx.End();
+                return false;
+            }
+            buf->_data[buf->_len++] = c;
+            ctx++;
+            return true;
+        }
         if (_Putc(c)) {
             ctx++;
             return true;
@@ -472,6 +853,29 @@ protected:
         return false;
     }
 
+    /** Output the specified number of padding characters.
+     *
+     * @param ctx Conversion context.
+     * @param c Padding character.
+     * @param count Number of characters to output.
+     * @return @a true if end of stream is not yet reached, @a false otherwise.
+     */
+    bool _PutPad(Context &ctx, char c, size_t count);
+
+    /** Pass buffered characters of the context to the back-end.
+     *
+     * @param ctx Conversion context.
+     * @return @a true if end of stream is not yet reached, @a false otherwise.
+     */
+    bool _FlushBuffer(Context &ctx);
+
+    /** Flush output buffer of top-level formatting call.
+     *
+     * @param ctx Top-level conversion context.
+     * @return Number of characters accepted by the back-end.
+     */
+    size_t _Flush(Context &ctx);
+
     /** Output provided string.
      *
      * @param ctx Conversion context.
@@ -481,6 +885,131 @@ protected:
      */
     bool _Puts(Context &ctx, const char *str);
 
+    /** Output provided string of the specified length.
+     *
+     * @param ctx Conversion context.
+     * @param str String to output.
+     * @param len Number of characters to output.
+     * @return @a true if end of stream is not yet reached, @a false otherwise
+     *      (end of stream reached).
+     */
+    bool _Puts(Context &ctx, const char *str, size_t len);
+
+    /** Apply options of compile-time parsed format specifier. */
+    inline void _ApplySpec(Context &ctx, const static_fmt::Spec &spec) {
+        using namespace static_fmt;
+        if (spec.flags & SF_SHARP) {
+            ctx.SetOpt(Opt::O_SHARP);
+        }
+        if (spec.flags & SF_SPACE) {
+            ctx.SetOpt(Opt::O_SPACE);
+        }
+        if (spec.flags & SF_SIGN) {
+            ctx.SetOpt(Opt::O_SIGN);
+        }
+        if (spec.flags & SF_ZERO) {
+            ctx.SetOpt(Opt::O_ZERO);
+        }
+        if (spec.flags & SF_LEFT_ADJ) {
+            ctx.SetOpt(Opt::O_LEFT_ADJ);
+        }
+        if (spec.flags & SF_LONG) {
+            ctx.SetOpt(Opt::O_LONG);
+        }
+        if (spec.flags & SF_SHORT) {
+            ctx.SetOpt(Opt::O_SHORT);
+        }
+        if (spec.flags & SF_WIDTH) {
+            ctx.SetOpt(Opt::O_WIDTH, spec.width);
+        }
+        if (spec.flags & SF_PREC) {
+            ctx.SetOpt(Opt::O_PREC, spec.prec);
+        }
+    }
+
+    /** Output literal part of compile-time parsed format string starting at
+     * position @a pos and dispatch the segment which follows it.
+     */
+    template <class S, size_t pos, typename... Args>
+    bool _FormatStatic(Context &ctx, Args... args) {
+        constexpr size_t pct = static_fmt::FindPercent(S::Get(), pos);
+        if (pct > pos && !_Puts(ctx, S::Get() + pos, pct - pos)) {
+            return false;
+        }
+        return _FormatStaticStep<S, pct>(
+            ctx, static_fmt::StepTag<static_fmt::GetStepKind(S::Get(), pct)>(),
+            args...);
+    }
+
+    template <class S, size_t pos, typename... Args>
+    bool _FormatStaticStep(Context &ctx, static_fmt::StepTag<static_fmt::STEP_END>,
+                           Args...) {
+        static_assert(sizeof...(Args) == 0, "Too many arguments for format string");
+        return ctx;
+    }
+
+    template <class S, size_t pos, typename... Args>
+    bool _FormatStaticStep(Context &ctx, static_fmt::StepTag<static_fmt::STEP_PERCENT>,
+                           Args... args) {
+        return _Putc(ctx, '%') && _FormatStatic<S, pos + 2>(ctx, args...);
+    }
+
+    template <class S, size_t pos, typename... Args>
+    bool _FormatStaticStep(Context &ctx, static_fmt::StepTag<static_fmt::STEP_SPEC>,
+                           Args... args) {
+        using namespace static_fmt;
+        constexpr Spec spec = ParseSpec(S::Get(), pos + 1);
+        static_assert(spec.fmtChar, "Invalid format specifier");
+        Context valueCtx(ctx.GetBuffer());
+        _ApplySpec(valueCtx, spec);
+        return _FormatStaticArg<S, pos, 0>(
+            ctx, valueCtx, StepTag<spec.NumArgs() ? STEP_STAR : STEP_VALUE>(),
+            args...);
+    }
+
+    /** Consume width or precision argument. */
+    template <class S, size_t pos, int argIdx, typename T, typename... Args>
+    bool _FormatStaticArg(Context &ctx, Context &valueCtx,
+                          static_fmt::StepTag<static_fmt::STEP_STAR>,
+                          T value, Args... args) {
+        using namespace static_fmt;
+        constexpr Spec spec = ParseSpec(S::Get(), pos + 1);
+        static_assert(ArgTraits<T>::IsInteger(),
+                      "Width and precision arguments should be integer");
+        valueCtx.SetOpt(spec.widthArg == argIdx + 1 ? Opt::O_WIDTH : Opt::O_PREC,
+                        value);
+        return _FormatStaticArg<S, pos, argIdx + 1>(
+            ctx, valueCtx,
+            StepTag<(spec.NumArgs() > argIdx + 1) ? STEP_STAR : STEP_VALUE>(),
+            args...);
+    }
+
+    /** Format value argument and proceed with the rest of format string. */
+    template <class S, size_t pos, int argIdx, typename T, typename... Args>
+    bool _FormatStaticArg(Context &ctx, Context &valueCtx,
+                          static_fmt::StepTag<static_fmt::STEP_VALUE>,
+                          T value, Args... args) {
+        using namespace static_fmt;
+        constexpr Spec spec = ParseSpec(S::Get(), pos + 1);
+        static_assert(ArgTraits<T>::CheckFmtChar(spec.fmtChar),
+                      "Format character does not match argument type");
+        if (!ArgTraits<T>::IsKnown() && !_CheckFmtChar(spec.fmtChar, value)) {
+            FAULT("Format operator ('%c') does not match format argument",
+                  spec.fmtChar);
+            return ctx += valueCtx;
+        }
+        bool ret = FormatValue(valueCtx, value, spec.fmtChar);
+        ctx += valueCtx;
+        return ret && _FormatStatic<S, spec.end>(ctx, args...);
+    }
+
+    /** Arguments exhausted while format string has more specifiers. */
+    template <class S, size_t pos, int argIdx, static_fmt::StepKind kind>
+    bool _FormatStaticArg(Context &ctx, Context &, static_fmt::StepTag<kind>) {
+        static_assert(pos != pos, "Missing argument for format string");
+        return ctx;
+    }
+
     /** These methods validate type against format character.
      *
      * @param fmtChar Format character which was specified for @a value.
@@ -586,16 +1115,20 @@ protected:
         FAULT("Invalid argument type used for initializing format option");
     }
 
-    /** Convert integer value to string. String is filled in reverse order.
+    /** Convert integer value to string. Number of digits is calculated in
+     * advance so the digits are written in place ending at @a bufEnd.
+     * Decimal digits are produced by pairs from a lookup table, hexadecimal
+     * digits are produced for all 16 nibbles at once.
      *
      * @param value Value to convert.
-     * @param buf Buffer where to store the result.
+     * @param bufEnd End of buffer where to store the result. At least
+     *      sizeof(u64) * NBBY characters should be available before it.
      * @param radix Radix for integer representation (2..36).
      * @param upperCase Use upper case letter if @a true.
-     * @return Number of characters stored in output buffer.
+     * @return Number of characters stored before @a bufEnd.
      */
-    size_t _IntToString(unsigned long value, char *buf, unsigned long radix = 10,
-                        bool upperCase = false);
+    static size_t _IntToString(unsigned long value, char *bufEnd,
+                               unsigned long radix = 10, bool upperCase = false);
 
     /** Output field representation.
      *
@@ -623,7 +1156,14 @@ typedef OTextStreamBase::Opt OtsOpt;
  *      bool Putc(char c, T_arg *arg = 0);
  *      @endcode
  *      It should have optional argument which is pointer to type @a T_arg in
- *      this template.
+ *      this template. The back-end may also implement @a Write method which
+ *      outputs characters span at once and returns number of characters
+ *      written:
+ *      @code
+ *      size_t Write(const char *buf, size_t len, T_arg *arg = 0);
+ *      @endcode
+ *      If it is not implemented @a Putc is called for each character of a
+ *      span.
  * @param T_arg Type of optional argument pointer to which is passed to the
  *      @a Putc method of a back-end class.
  *
@@ -644,6 +1184,23 @@ private:
     virtual bool _Putc(char c) {
         return _backend->Putc(c, _arg);
     }
+
+    virtual size_t _Write(const char *buf, size_t len) {
+        return _BackendWrite(_backend, buf, len, 0);
+    }
+
+    /** Back-end with @a Write method. */
+    template <class T>
+    inline auto _BackendWrite(T *backend, const char *buf, size_t len, int) ->
+        decltype(backend->Write(buf, len, _arg))
+    {
+        return backend->Write(buf, len, _arg);
+    }
+
+    /** Back-end without @a Write method. */
+    inline size_t _BackendWrite(T_backend *, const char *buf, size_t len, long) {
+        return OTextStreamBase::_Write(buf, len);
+    }
 };
 
 } /* namespace text_stream */
@@ -14,22 +14,44 @@
 #ifndef RBTREE_H_
 #define RBTREE_H_
 
-/** Base class for red-black tree implementation. */
+template <class T, int (T::*Comparator)(T &obj),
+          typename key_t, int (T::*KeyComparator)(key_t &key)>
+class RBTree;
+
+/** Base class for red-black tree implementation. It implements everything
+ * what does not depend on the nodes ordering - linking, re-balancing and
+ * traversal. The search loops which compare nodes are instantiated in the
+ * @ref RBTree template for each comparator so that the comparator calls are
+ * inlined there.
+ */
 class RBTreeBase {
 public:
-    /** Validate the tree. This method is intended for tree implementation
-     * troubleshooting and normally is not required to be used.
+    /** Validate the tree structure. This method is intended for tree
+     * implementation troubleshooting and normally is not required to be used.
+     * Nodes ordering is not checked here, see @ref RBTree::Validate.
      *
      * @return @a true if the tree is valid red-black tree, @a false if there
      *      are some rules violations or dis-integrity.
      */
     bool Validate();
 
+    /** Get number of nodes in the tree. */
+    inline size_t GetSize() { return _nodesCount; }
+
+    /** Remove all nodes from the tree. Nodes are just unlinked without any
+     * re-balancing so it takes linear time. The nodes can be inserted in a
+     * tree again after that.
+     */
+    void Clear();
+
 protected:
     /** Tree node represented by this class. */
     class EntryBase {
     protected:
         friend class RBTreeBase;
+        template <class T, int (T::*Comparator)(T &obj),
+                  typename key_t, int (T::*KeyComparator)(key_t &key)>
+        friend class RBTree;
 
         u8 isRed:1, /**< The node is red. */
            isWired:1; /**< The node is in a tree. */
@@ -38,34 +60,87 @@ protected:
         EntryBase() { isWired = false; }
     };
 
+    /** Function which recomputes aggregates of the node from its own data
+     * and aggregates of its children.
+     */
+    typedef void (*AugmentFunc)(EntryBase *node);
+
+    /** Root node. */
+    EntryBase *_root;
+    /** Aggregates update function, NULL if the tree is not augmented. */
+    AugmentFunc _augment;
+
     RBTreeBase();
 
-    /** This method should be overloaded in derived class. It must compare two
-     * nodes.
-     * @param e1 The first node to compare.
-     * @param e2 The second node to compare.
-     * @return Positive value if @a e1 greater than @a e2, negative value if
-     *      @a e1 less than @a e2, zero if @a e1 equal to @a e2.
+    /** Get child of the node. */
+    static inline EntryBase *GetChild(EntryBase *node, int dir) {
+        return node->child[dir];
+    }
+
+    /** Get parent of the node. */
+    static inline EntryBase *GetParent(EntryBase *node) {
+        return node->parent;
+    }
+
+    /** Get the tree generation. It is odd while the tree is being modified
+     * and it is changed by each modification, so a lockless reader can
+     * validate what it has read by comparing the generation before and
+     * after reading.
      */
-    virtual int Compare(EntryBase *e1, EntryBase *e2) = 0;
+    inline unsigned GetGeneration() {
+        return __atomic_load_n(&_generation, __ATOMIC_ACQUIRE);
+    }
+
+    /** Get root node for lockless reading. */
+    inline EntryBase *LoadRoot() {
+        return __atomic_load_n(&_root, __ATOMIC_RELAXED);
+    }
+
+    /** Get child of the node for lockless reading. */
+    static inline EntryBase *LoadChild(EntryBase *node, int dir) {
+        return __atomic_load_n(&node->child[dir], __ATOMIC_RELAXED);
+    }
 
-    /** This method should be overloaded in derived class. It must compare a
-     * node with a key.
-     * @param e Node to compare.
-     * @param key Pointer to a key.
-     * @return Positive value if @a key is greater than @a e, negative value if
-     *      @a key is less than @a e, zero if @a key is equal to @a e.
+    /** Recompute aggregates of the node and all its ancestors. Does nothing
+     * if the tree is not augmented.
+     *
+     * @param node Node to start from.
      */
-    virtual int Compare(EntryBase *e, void *key) = 0;
+    inline void PropagateAggregates(EntryBase *node) {
+        if (_augment) {
+            for (; node; node = node->parent) {
+                _augment(node);
+            }
+        }
+    }
 
-    /** Insert node in the tree. This method either inserts the node or finds
-     * existing node with the same key.
+    /** Link new node into the tree and re-balance it. The insertion point
+     * should be found by the caller.
      *
      * @param node Node to insert.
-     * @return Either @a node if it was inserted or existing node with the
-     *      same key (@a node is not inserted in the tree in such case).
+     * @param parent Parent node for the inserted one, NULL if the tree is
+     *      empty.
+     * @param dir Direction of the new node relatively to its parent, 0 for
+     *      the left child, 1 for the right one. The corresponding child link
+     *      of the parent should be empty.
+     */
+    void LinkNode(EntryBase *node, EntryBase *parent, int dir);
+
+    /** Attach a tree which was built by the caller. The tree should be empty
+     * before. Used for bulk construction.
+     *
+     * @param root Root node of the built tree.
+     * @param numNodes Number of nodes in the built tree.
      */
-    EntryBase *InsertNode(EntryBase *node);
+    void AttachTree(EntryBase *root, size_t numNodes);
+
+    /** Get adjacent node in the tree order.
+     *
+     * @param node Node to start from.
+     * @param dir Direction, 1 for the successor, 0 for the predecessor.
+     * @return Adjacent node, NULL if @a node is the highest (lowest) one.
+     */
+    static EntryBase *GetAdjacentNode(EntryBase *node, int dir);
 
     /** Get next tree node during the tree traversal.
      *
@@ -74,13 +149,6 @@ protected:
      */
     EntryBase *GetNextNode(EntryBase *node = 0);
 
-    /** Lookup tree node by key.
-     *
-     * @param key Pointer to key.
-     * @return Pointer to found node, @a 0 if nothing is found.
-     */
-    EntryBase *Lookup(void *key);
-
     /** Delete a node from the tree.
      *
      * @param entry Node to delete.
@@ -100,13 +168,26 @@ protected:
     EntryBase *Highest();
 
 private:
-    /** Root node. */
-    EntryBase *_root;
     /** Total number of nodes in the tree. */
     size_t _nodesCount;
-    /** Tree generation, incremented after each change. */
+    /** Tree generation, incremented before and after each change. */
     unsigned _generation;
 
+    /** Mark the tree modification start. All following stores are not
+     * visible before the generation change.
+     */
+    inline void _BeginUpdate() {
+        __atomic_store_n(&_generation, _generation + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+    }
+
+    /** Mark the tree modification end. All previous stores are visible
+     * before the generation change.
+     */
+    inline void _EndUpdate() {
+        __atomic_store_n(&_generation, _generation + 1, __ATOMIC_RELEASE);
+    }
+
     /** Re-balance the tree after insertion. This function can be called
      * recursively. It must be called only if there is RB balancing rules
      * violations. In particular only one violation must be present upon this
@@ -152,6 +233,14 @@ private:
 
         x->child[!dir] = node;
         node->parent = x;
+
+        /* The subtree content is not changed, so only the two rotated nodes
+         * need their aggregates to be recomputed.
+         */
+        if (_augment) {
+            _augment(node);
+            _augment(x);
+        }
     }
 
     /** Check if re-balancing after insertion is required for the provided
@@ -167,7 +256,10 @@ private:
     }
 };
 
-/** Implementation template for red-black tree class.
+/** Implementation template for red-black tree class. The comparators are
+ * template parameters so the search loops are instantiated for each tree type
+ * and the comparators are called directly, there are no virtual calls and no
+ * vtable in the tree object.
  *
  * Usage example:
  * @code
@@ -203,6 +295,8 @@ private:
  *      @code
  *      int Compare(key_t &key);
  *      @endcode
+ *      Can be @a nullptr if the tree is never accessed by key, the key access
+ *      methods fail to compile in such case.
  */
 template <class T, int (T::*Comparator)(T &obj),
           typename key_t, int (T::*KeyComparator)(key_t &key)>
@@ -217,19 +311,6 @@ public:
 
     inline RBTree() : RBTreeBase() { }
 
-    virtual int Compare(EntryBase *e1, EntryBase *e2)
-    {
-        return (static_cast<Entry *>(e1)->obj->*Comparator)(*static_cast<Entry *>(e2)->obj);
-    }
-
-    virtual int Compare(EntryBase *e, void *key)
-    {
-        if (!KeyComparator) {
-            FAULT("Key comparator not provided");
-        }
-        return (static_cast<Entry *>(e)->obj->*KeyComparator)(*static_cast<key_t *>(key));
-    }
-
     /** Try to insert an object in the tree. The object is inserted only if
      * there is no another object with the same key in the tree.
      *
@@ -242,7 +323,7 @@ public:
     inline T *InsertProbe(T *obj, Entry *e)
     {
         e->obj = obj;
-        return static_cast<Entry *>(InsertNode(e))->obj;
+        return _InsertNode(e)->obj;
     }
 
     /** Insert an object in the tree. The object is inserted only if
@@ -257,7 +338,7 @@ public:
     inline T *Insert(T *obj, Entry *e)
     {
         e->obj = obj;
-        if (static_cast<Entry *>(InsertNode(e)) != e) {
+        if (_InsertNode(e) != e) {
             return 0;
         }
         return obj;
@@ -270,11 +351,11 @@ public:
      */
     inline T *Lookup(key_t &key)
     {
-        EntryBase *e = RBTreeBase::Lookup(&key);
+        Entry *e = _LookupNode(key);
         if (!e) {
             return 0;
         }
-        return static_cast<Entry *>(e)->obj;
+        return e->obj;
     }
 
     /** Delete a node by its entry in user object.
@@ -293,12 +374,12 @@ public:
      */
     inline T *Delete(key_t &key)
     {
-        EntryBase *e = RBTreeBase::Lookup(&key);
+        Entry *e = _LookupNode(key);
         if (!e) {
             return 0;
         }
         RBTreeBase::Delete(e);
-        return static_cast<Entry *>(e)->obj;
+        return e->obj;
     }
 
     /** Get the object with the lowest value.
@@ -325,6 +406,53 @@ public:
         return static_cast<Entry *>(e)->obj;
     }
 
+    /** Validate the tree. In addition to the structure checks done by
+     * @ref RBTreeBase::Validate it checks nodes ordering.
+     *
+     * @return @a true if the tree is valid red-black tree, @a false if there
+     *      are some rules violations or dis-integrity.
+     */
+    bool Validate()
+    {
+        if (!RBTreeBase::Validate()) {
+            return false;
+        }
+        EntryBase *node = 0;
+        while ((node = GetNextNode(node))) {
+            if (node->child[0] && _Compare(node->child[0], node) >= 0) {
+                return false;
+            }
+            if (node->child[1] && _Compare(node->child[1], node) <= 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /** Build the tree from the sorted array of objects. It takes linear time
+     * while inserting the objects one by one takes O(n log n). The tree
+     * should be empty.
+     *
+     * The tree is built perfectly balanced. All nodes are black except the
+     * nodes of the last level if it is incomplete, these ones are red. So the
+     * black height is the same for all paths.
+     *
+     * @param objs Array of objects sorted in ascending order without
+     *      duplicates.
+     * @param numObjs Number of objects in the array.
+     * @param entry Pointer to the tree entry member of class @a T.
+     */
+    template <class EntryType>
+    void BuildFromSorted(T **objs, size_t numObjs, EntryType T::*entry)
+    {
+        /* Depth of the last level if it is incomplete. */
+        size_t redDepth = 0;
+        for (size_t n = numObjs + 1; n > 1; n >>= 1) {
+            redDepth++;
+        }
+        AttachTree(_Build(objs, entry, 0, numObjs, 0, 0, redDepth), numObjs);
+    }
+
     /* Iteration interface. */
 
     class Iterator {
@@ -356,6 +484,222 @@ public:
 
     inline Iterator begin() { return Iterator(*this, true); }
     inline Iterator end() { return Iterator(*this, false); }
+
+    /* Ordered iteration interface. */
+
+    /** Iterator which steps through the objects in the tree order. Stepping
+     * takes amortized constant time. Default constructed iterator is the end
+     * of any range.
+     */
+    class OrderedIterator {
+    public:
+        inline OrderedIterator(EntryBase *e = 0) : _e(e) { }
+
+        inline bool operator ==(const OrderedIterator &iter) const {
+            return _e == iter._e;
+        }
+
+        inline bool operator !=(const OrderedIterator &iter) const {
+            return _e != iter._e;
+        }
+
+        /** Step to the next object. */
+        inline OrderedIterator &operator ++() {
+            ASSERT(_e);
+            _e = GetAdjacentNode(_e, 1);
+            return *this;
+        }
+
+        /** Step to the previous object. */
+        inline OrderedIterator &operator --() {
+            ASSERT(_e);
+            _e = GetAdjacentNode(_e, 0);
+            return *this;
+        }
+
+        inline T &operator *() { return *GetObj(_e); }
+        inline T *operator ->() { return GetObj(_e); }
+
+        /** Get current object, NULL if the iterator is at the end. */
+        inline T *Get() { return _e ? GetObj(_e) : 0; }
+
+    private:
+        EntryBase *_e;
+    };
+
+    /** Range of objects which can be iterated in the tree order. */
+    class Range {
+    public:
+        inline Range(OrderedIterator begin, OrderedIterator end) :
+            _begin(begin), _end(end) { }
+
+        inline OrderedIterator begin() { return _begin; }
+        inline OrderedIterator end() { return _end; }
+
+    private:
+        OrderedIterator _begin, _end;
+    };
+
+    /** Get iterator pointing to the lowest object. */
+    inline OrderedIterator First() { return OrderedIterator(RBTreeBase::Lowest()); }
+
+    /** Get iterator pointing to the highest object. */
+    inline OrderedIterator Last() { return OrderedIterator(RBTreeBase::Highest()); }
+
+    /** Find the first object which is not less than the key.
+     *
+     * @param key Key to look for.
+     * @return Iterator pointing to the found object, end iterator if all
+     *      objects are less than the key.
+     */
+    OrderedIterator LowerBound(key_t &key)
+    {
+        EntryBase *node = _root, *found = 0;
+        while (node) {
+            int cmp = _Compare(node, key);
+            if (cmp > 0) {
+                node = node->child[1];
+            } else {
+                found = node;
+                if (!cmp) {
+                    break;
+                }
+                node = node->child[0];
+            }
+        }
+        return OrderedIterator(found);
+    }
+
+    /** Find the first object which is greater than the key.
+     *
+     * @param key Key to look for.
+     * @return Iterator pointing to the found object, end iterator if there
+     *      are no objects greater than the key.
+     */
+    OrderedIterator UpperBound(key_t &key)
+    {
+        EntryBase *node = _root, *found = 0;
+        while (node) {
+            if (_Compare(node, key) < 0) {
+                found = node;
+                node = node->child[0];
+            } else {
+                node = node->child[1];
+            }
+        }
+        return OrderedIterator(found);
+    }
+
+    /** Get range of objects with keys in [@a from; @a to) interval.
+     * @code
+     * for (MyItem &item: tree.GetRange(from, to)) {
+     *     ...
+     * }
+     * @endcode
+     */
+    inline Range GetRange(key_t &from, key_t &to)
+    {
+        return Range(LowerBound(from), LowerBound(to));
+    }
+
+protected:
+    /** Get object of the tree node. */
+    static inline T *GetObj(EntryBase *e)
+    {
+        return static_cast<Entry *>(e)->obj;
+    }
+
+    /** Compare two nodes. */
+    static inline int _Compare(EntryBase *e1, EntryBase *e2)
+    {
+        return (static_cast<Entry *>(e1)->obj->*Comparator)(*static_cast<Entry *>(e2)->obj);
+    }
+
+    /** Compare a node with a key. */
+    static inline int _Compare(EntryBase *e, key_t &key)
+    {
+        static_assert(KeyComparator != nullptr, "Key comparator not provided");
+        return (static_cast<Entry *>(e)->obj->*KeyComparator)(key);
+    }
+
+    /** Lookup tree node by key.
+     *
+     * @param key Key to look for.
+     * @return Pointer to found node, @a 0 if nothing is found.
+     */
+    inline Entry *_LookupNode(key_t &key)
+    {
+        EntryBase *node = _root;
+        while (node) {
+            int cmp = _Compare(node, key);
+            if (!cmp) {
+                return static_cast<Entry *>(node);
+            }
+            node = node->child[cmp > 0];
+        }
+        return 0;
+    }
+
+private:
+    /** Insert node in the tree. This method either inserts the node or finds
+     * existing node with the same key.
+     *
+     * @param node Node to insert.
+     * @return Either @a node if it was inserted or existing node with the
+     *      same key (@a node is not inserted in the tree in such case).
+     */
+    Entry *_InsertNode(Entry *node)
+    {
+        EntryBase *parent = _root;
+        int dir = 0;
+        while (parent) {
+            int cmp = _Compare(node, parent);
+            if (!cmp) {
+                return static_cast<Entry *>(parent);
+            }
+            dir = cmp > 0;
+            if (!parent->child[dir]) {
+                break;
+            }
+            parent = parent->child[dir];
+        }
+        LinkNode(node, parent, dir);
+        return node;
+    }
+
+    /** Build subtree from the objects array slice, see @ref BuildFromSorted.
+     *
+     * @param objs Objects array.
+     * @param entry Pointer to the tree entry member of class @a T.
+     * @param start Start index of the slice.
+     * @param end End index of the slice (exclusive).
+     * @param parent Parent node for the subtree root.
+     * @param depth Depth of the subtree root.
+     * @param redDepth Depth of the nodes which should be red.
+     * @return Subtree root, NULL if the slice is empty.
+     */
+    template <class EntryType>
+    EntryBase *_Build(T **objs, EntryType T::*entry, size_t start, size_t end,
+                      EntryBase *parent, size_t depth, size_t redDepth)
+    {
+        if (start == end) {
+            return 0;
+        }
+        size_t mid = start + (end - start) / 2;
+        Entry *e = &(objs[mid]->*entry);
+        ASSERT(!e->isWired);
+        ASSERT(mid == start || (objs[mid]->*Comparator)(*objs[mid - 1]) > 0);
+        e->obj = objs[mid];
+        e->parent = parent;
+        e->isRed = depth == redDepth;
+        e->isWired = true;
+        e->child[0] = _Build(objs, entry, start, mid, e, depth + 1, redDepth);
+        e->child[1] = _Build(objs, entry, mid + 1, end, e, depth + 1, redDepth);
+        if (_augment) {
+            _augment(e);
+        }
+        return e;
+    }
 };
 
 template <class T, int (T::*Comparator)(T &obj),
@@ -374,4 +718,232 @@ end(RBTree<T, Comparator, key_t, KeyComparator> &tree)
     return tree.end();
 }
 
+/** Augmented red-black tree. Each node keeps aggregate values of its subtree
+ * which are kept up to date through all insertions, deletions and rotations.
+ * The tree itself maintains subtree sizes which provide order-statistic
+ * queries - @ref Select and @ref Rank. User-defined aggregates (e.g. maximal
+ * end address or maximal free gap in the subtree) are stored in the user
+ * objects and are recomputed by @a Augment method of the object. @n
+ *
+ * If object data which the aggregates depend on is changed while the object
+ * is in the tree, @ref Update method must be called for it.
+ *
+ * Usage example:
+ * @code
+ * class Region {
+ * public:
+ *    vaddr_t start, end, maxEnd;
+ *
+ *    int Compare(Region &region);
+ *    int Compare(vaddr_t key);
+ *    void UpdateMaxEnd(Region *left, Region *right);
+ *    typedef class AugmentedRBTree<Region, &Region::Compare, vaddr_t,
+ *        &Region::Compare, &Region::UpdateMaxEnd> Tree;
+ *
+ *    Tree::Entry _rbEntry;
+ * };
+ * @endcode
+ *
+ * @param T Class for objects which are stored in a tree.
+ * @param Comparator See @ref RBTree.
+ * @param key_t See @ref RBTree.
+ * @param KeyComparator See @ref RBTree.
+ * @param Augment Method of class @a T which recomputes the object aggregates.
+ *      It should have the following prototype:
+ *      @code
+ *      void Augment(T *left, T *right);
+ *      @endcode
+ *      Its arguments are the objects in the left and right children of this
+ *      object node, NULL if there is no corresponding child. Their aggregates
+ *      are already up to date. Can be @a nullptr if only order-statistic
+ *      queries are required.
+ */
+template <class T, int (T::*Comparator)(T &obj),
+          typename key_t, int (T::*KeyComparator)(key_t &key),
+          void (T::*Augment)(T *left, T *right) = nullptr>
+class AugmentedRBTree : public RBTree<T, Comparator, key_t, KeyComparator> {
+private:
+    typedef RBTree<T, Comparator, key_t, KeyComparator> Base;
+    typedef RBTreeBase::EntryBase EntryBase;
+
+public:
+    class Entry : public Base::Entry {
+    protected:
+        friend class AugmentedRBTree;
+
+        /** Number of nodes in the subtree rooted at this node. */
+        size_t subtreeSize;
+    };
+
+    inline AugmentedRBTree() : Base()
+    {
+        this->_augment = _Augment;
+    }
+
+    /** @see RBTree::InsertProbe */
+    inline T *InsertProbe(T *obj, Entry *e)
+    {
+        return Base::InsertProbe(obj, e);
+    }
+
+    /** @see RBTree::Insert */
+    inline T *Insert(T *obj, Entry *e)
+    {
+        return Base::Insert(obj, e);
+    }
+
+    /** @see RBTree::Delete */
+    inline void Delete(Entry *e)
+    {
+        Base::Delete(e);
+    }
+
+    /** @see RBTree::Delete */
+    inline T *Delete(key_t &key)
+    {
+        return Base::Delete(key);
+    }
+
+    /** Recompute aggregates after the object data they depend on was changed.
+     *
+     * @param e Tree entry of the changed object.
+     */
+    inline void Update(Entry *e)
+    {
+        this->PropagateAggregates(e);
+    }
+
+    /** Get the object by its position in the tree order.
+     *
+     * @param k Zero-based position of the object in ascending order.
+     * @return The object, NULL if @a k is not less than the number of objects
+     *      in the tree.
+     */
+    T *Select(size_t k)
+    {
+        EntryBase *node = this->_root;
+        while (node) {
+            size_t leftSize = _GetSize(this->GetChild(node, 0));
+            if (k < leftSize) {
+                node = this->GetChild(node, 0);
+            } else if (k == leftSize) {
+                return this->GetObj(node);
+            } else {
+                k -= leftSize + 1;
+                node = this->GetChild(node, 1);
+            }
+        }
+        return 0;
+    }
+
+    /** Get position of the object in the tree order.
+     *
+     * @param e Tree entry of the object. Must be in the tree.
+     * @return Number of objects in the tree which are less than this one.
+     */
+    size_t Rank(Entry *e)
+    {
+        EntryBase *node = e;
+        size_t rank = _GetSize(this->GetChild(node, 0));
+        for (EntryBase *parent = this->GetParent(node); parent;
+             node = parent, parent = this->GetParent(node)) {
+
+            if (this->GetChild(parent, 1) == node) {
+                rank += _GetSize(this->GetChild(parent, 0)) + 1;
+            }
+        }
+        return rank;
+    }
+
+    /** Find the lowest object matching the provided filter. Subtrees are
+     * pruned by their aggregates, so the search takes logarithmic time if
+     * the filter precisely tells whether a subtree contains a matching object.
+     *
+     * @param filter Filter object which should have the following methods:
+     *      @code
+     *      // Check if the subtree rooted at the object can contain a match.
+     *      bool MatchSubtree(T &obj);
+     *      // Check if the object itself matches.
+     *      bool Match(T &obj);
+     *      @endcode
+     * @return The lowest matching object, NULL if nothing found.
+     */
+    template <class Filter>
+    inline T *FindFirst(Filter &filter)
+    {
+        return _FindFirst(this->_root, filter);
+    }
+
+    /** Validate the tree including subtree sizes. User-defined aggregates are
+     * not checked.
+     *
+     * @return @a true if the tree is valid, @a false otherwise.
+     */
+    bool Validate()
+    {
+        if (!Base::Validate()) {
+            return false;
+        }
+        EntryBase *node = 0;
+        while ((node = this->GetNextNode(node))) {
+            if (_GetSize(node) != 1 + _GetSize(this->GetChild(node, 0)) +
+                                  _GetSize(this->GetChild(node, 1))) {
+                return false;
+            }
+        }
+        return _GetSize(this->_root) == this->GetSize();
+    }
+
+private:
+    /** Get number of nodes in the subtree, NULL node is an empty subtree. */
+    static inline size_t _GetSize(EntryBase *node)
+    {
+        return node ? static_cast<Entry *>(node)->subtreeSize : 0;
+    }
+
+    /** Recompute the node aggregates. */
+    static void _Augment(EntryBase *node)
+    {
+        EntryBase *left = Base::GetChild(node, 0), *right = Base::GetChild(node, 1);
+        static_cast<Entry *>(node)->subtreeSize =
+            1 + _GetSize(left) + _GetSize(right);
+        _CallAugment(Base::GetObj(node), left ? Base::GetObj(left) : 0,
+                     right ? Base::GetObj(right) : 0,
+                     AugmentTag<Augment != nullptr>());
+    }
+
+    /** Tag for resolving at compile time whether user-defined aggregates
+     * should be recomputed.
+     */
+    template <bool hasAugment>
+    class AugmentTag {};
+
+    /** No user-defined aggregates. */
+    static inline void _CallAugment(T *obj UNUSED, T *left UNUSED,
+                                    T *right UNUSED, AugmentTag<false>)
+    {}
+
+    /** Recompute user-defined aggregates. */
+    static inline void _CallAugment(T *obj, T *left, T *right, AugmentTag<true>)
+    {
+        (obj->*Augment)(left, right);
+    }
+
+    template <class Filter>
+    static T *_FindFirst(EntryBase *node, Filter &filter)
+    {
+        if (!node || !filter.MatchSubtree(*Base::GetObj(node))) {
+            return 0;
+        }
+        T *obj = _FindFirst(Base::GetChild(node, 0), filter);
+        if (obj) {
+            return obj;
+        }
+        if (filter.Match(*Base::GetObj(node))) {
+            return Base::GetObj(node);
+        }
+        return _FindFirst(Base::GetChild(node, 1), filter);
+    }
+};
+
 #endif /* RBTREE_H_ */
@@ -0,0 +1,247 @@
+/*
+ * /phoenix/include/common/SeqRing.h
+ *
+ * This file is a part of Phoenix operating system.
+ * Copyright (c) 2011-2012, Artyom Lebedev <artyom.lebedev@gmail.com>
+ * All rights reserved.
+ * See COPYING file for copyright details.
+ */
+
+/** @file SeqRing.h
+ * Lockless ring buffer of fixed size records with sequence numbered slots.
+ */
+
+#ifndef SEQRING_H_
+#define SEQRING_H_
+
+/** Lockless ring buffer of fixed size records. It is intended to be used per
+ * CPU so that producers on different CPUs never share cache lines. Any number
+ * of producers (e.g. interrupt handlers nested into normal code) can put
+ * records concurrently. Records should be consumed by one consumer at a time,
+ * the caller should serialize consumers. The ring does not know the record
+ * layout except that the record starts with 64 bits sequence number, derived
+ * classes define the record type and fill the records. @n
+ *
+ * The sequence number is zero while the record is being written and is set to
+ * the record position plus one when the record is committed. The consumer
+ * stops at the first record which is not yet committed, so the records are
+ * always consumed in the order of reservation. @n
+ *
+ * The behavior on overflow is defined by @ref OverflowPolicy. Each lost record
+ * is accounted in the corresponding counter. With @ref OVERWRITE_OLD policy a
+ * producer which is delayed for the whole ring lap can corrupt the slot
+ * reused by a later record, the ring should be large enough to make it
+ * practically impossible.
+ */
+class SeqRing {
+public:
+    /** What to do when a record is put into full ring. */
+    enum OverflowPolicy {
+        /** Drop the new record, the ring content is preserved. Lost records
+         * are counted by @ref GetNumDropped.
+         */
+        DROP_NEW,
+        /** Overwrite the oldest record. Lost records are detected by the
+         * consumer and counted by @ref GetNumOverwritten.
+         */
+        OVERWRITE_OLD,
+    };
+
+    /** Get number of records which are put but not yet consumed. */
+    inline size_t GetNumPending() {
+        u64 pending = __atomic_load_n(&_head.value, __ATOMIC_RELAXED) -
+                      __atomic_load_n(&_tail.value, __ATOMIC_RELAXED);
+        return pending > _numSlots ? _numSlots : pending;
+    }
+
+    /** Get number of slots in the ring. */
+    inline size_t GetNumSlots() {
+        return _numSlots;
+    }
+
+    /** Get total number of records put into the ring. */
+    inline u64 GetNumPut() {
+        return __atomic_load_n(&_head.value, __ATOMIC_RELAXED);
+    }
+
+    /** Get number of records dropped by @ref DROP_NEW policy. */
+    inline u64 GetNumDropped() {
+        return __atomic_load_n(&_numDropped, __ATOMIC_RELAXED);
+    }
+
+    /** Get number of records lost by @ref OVERWRITE_OLD policy. */
+    inline u64 GetNumOverwritten() {
+        return __atomic_load_n(&_numOverwritten, __ATOMIC_RELAXED);
+    }
+
+protected:
+    SeqRing();
+
+    ~SeqRing();
+
+    /** Initialize the ring. It requires memory allocation for the record
+     * slots.
+     *
+     * @param numSlots Number of record slots. Must be an integer power of two.
+     * @param slotSize Size of one record.
+     * @param policy Overflow policy.
+     * @return Status code.
+     */
+    RetCode Initialize(size_t numSlots, size_t slotSize, OverflowPolicy policy);
+
+    /** Reserve a slot for a new record. The record should be committed by
+     * @ref _Commit when filled.
+     *
+     * @param pos Reserved position is stored here.
+     * @return Slot for the record, zero if the record should be dropped.
+     */
+    inline void *_Reserve(u64 *pos) {
+        u64 head;
+        if (_policy == OVERWRITE_OLD) {
+            head = __atomic_fetch_add(&_head.value, 1, __ATOMIC_RELAXED);
+        } else {
+            head = __atomic_load_n(&_head.value, __ATOMIC_RELAXED);
+            do {
+                if (head - __atomic_load_n(&_tail.value, __ATOMIC_ACQUIRE) >=
+                    _numSlots) {
+
+                    __atomic_fetch_add(&_numDropped, 1, __ATOMIC_RELAXED);
+                    return 0;
+                }
+            } while (!__atomic_compare_exchange_n(&_head.value, &head, head + 1,
+                                                  true, __ATOMIC_ACQ_REL,
+                                                  __ATOMIC_RELAXED));
+        }
+        u64 *seq = _GetSlot(head);
+        /* The slot may still be read by the consumer if it was overwritten,
+         * it detects the change by the sequence number.
+         */
+        __atomic_store_n(seq, 0, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        *pos = head;
+        return seq;
+    }
+
+    /** Commit the record filled after @ref _Reserve call.
+     *
+     * @param slot Slot returned by @ref _Reserve.
+     * @param pos Position returned by @ref _Reserve.
+     */
+    inline void _Commit(void *slot, u64 pos) {
+        __atomic_store_n(static_cast<u64 *>(slot), pos + 1, __ATOMIC_RELEASE);
+    }
+
+    /** Get the oldest committed record and remove it from the ring. Consumers
+     * should be serialized by the caller.
+     *
+     * @param rec Record is copied here.
+     * @return @a true if the record was retrieved, @a false if there are no
+     *      committed records.
+     */
+    bool _Get(void *rec);
+
+private:
+    /** Head and tail are placed in separate cache lines since the head is
+     * written by producers and the tail by the consumer.
+     */
+    class Position {
+    public:
+        u64 value = 0;
+    } __ALIGNED(CACHE_LINE_SIZE);
+
+    u8 *_slots = 0;
+    size_t _numSlots = 0, _slotSize = 0;
+    OverflowPolicy _policy = DROP_NEW;
+    /** Position of the next record to reserve. */
+    Position _head;
+    /** Position of the next record to consume. */
+    Position _tail;
+    u64 _numDropped = 0, _numOverwritten = 0;
+
+    /** Get the slot for the position. The slot starts with the sequence
+     * number.
+     */
+    inline u64 *_GetSlot(u64 pos) {
+        return reinterpret_cast<u64 *>(
+            _slots + (pos & (_numSlots - 1)) * _slotSize);
+    }
+};
+
+/** Consumer which merges records of several rings (e.g. per-CPU ones) in time
+ * stamp order. Each ring provides the oldest record, the oldest one of them is
+ * output first. Calls should be serialized by the caller.
+ *
+ * @param Ring Ring class. It should define @a Record type which has @a
+ *      timestamp member and @a Get method which retrieves the oldest record.
+ */
+template <class Ring>
+class SeqRingMerger {
+public:
+    typedef typename Ring::Record Record;
+
+    SeqRingMerger() {}
+
+    ~SeqRingMerger() {
+        if (_pending) {
+            DELETE [] _pending;
+        }
+    }
+
+    /** Initialize the merger. It requires memory allocation for the pending
+     * records.
+     *
+     * @param rings Rings to merge.
+     * @param numRings Number of rings.
+     * @return @a true if initialized, @a false if memory allocation failed.
+     */
+    bool Initialize(Ring *rings, size_t numRings) {
+        ASSERT(!_pending);
+        _pending = NEW PendingRecord[numRings];
+        if (!_pending) {
+            return false;
+        }
+        _rings = rings;
+        _numRings = numRings;
+        _last = numRings;
+        return true;
+    }
+
+    /** Get the oldest record of all the rings and remove it from its ring.
+     *
+     * @return The record, valid until the next call. Zero if there are no
+     *      committed records.
+     */
+    Record *GetNext() {
+        if (_last != _numRings) {
+            _pending[_last].valid = false;
+        }
+        _last = _numRings;
+        for (size_t i = 0; i < _numRings; i++) {
+            PendingRecord &p = _pending[i];
+            if (!p.valid) {
+                p.valid = _rings[i].Get(&p.rec);
+            }
+            if (p.valid && (_last == _numRings ||
+                            p.rec.timestamp < _pending[_last].rec.timestamp)) {
+                _last = i;
+            }
+        }
+        return _last == _numRings ? 0 : &_pending[_last].rec;
+    }
+
+private:
+    /** Record retrieved from a ring but not yet merged. */
+    class PendingRecord {
+    public:
+        Record rec;
+        bool valid = false;
+    };
+
+    Ring *_rings = 0;
+    PendingRecord *_pending = 0;
+    size_t _numRings = 0;
+    /** Index of the ring the last returned record was taken from. */
+    size_t _last = 0;
+};
+
+#endif /* SEQRING_H_ */
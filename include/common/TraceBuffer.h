@@ -0,0 +1,113 @@
+/*
+ * /phoenix/include/common/TraceBuffer.h
+ *
+ * This file is a part of Phoenix operating system.
+ * Copyright (c) 2011-2012, Artyom Lebedev <artyom.lebedev@gmail.com>
+ * All rights reserved.
+ * See COPYING file for copyright details.
+ */
+
+/** @file TraceBuffer.h
+ * Lockless ring buffer for binary trace records.
+ */
+
+#ifndef TRACEBUFFER_H_
+#define TRACEBUFFER_H_
+
+/** Lockless ring buffer of binary trace records. Unlike @ref LogRing the
+ * records contain raw arguments instead of text, they are formatted only when
+ * decoded, so putting a record costs just a few stores. It is intended to be
+ * used per CPU as a flight recorder: the oldest records are always
+ * overwritten, the buffer keeps the latest history. See @ref SeqRing for the
+ * concurrency details. @n
+ *
+ * The layout is simple enough to be decoded from a halted system by a
+ * debugger: the records between positions @a head - @a numSlots and @a head
+ * with matching sequence numbers are valid.
+ */
+class TraceBuffer : public SeqRing {
+public:
+    enum {
+        /** Maximal number of arguments in one record. */
+        MAX_ARGS = 4,
+    };
+
+    /** Trace record, occupies one cache line. */
+    class Record {
+    public:
+        /** Sequence number, see @ref SeqRing. */
+        u64 seq;
+        /** Identifier of the record source. */
+        u64 id;
+        /** Time stamp provided by the producer. */
+        u64 timestamp;
+        /** Index of the CPU which produced the record. */
+        u16 cpu;
+        /** Number of valid entries in @a args. */
+        u8 numArgs;
+        u8 reserved[5];
+        /** Raw arguments. */
+        u64 args[MAX_ARGS];
+
+        /** Format the record arguments. Only @a numArgs arguments are passed
+         * to the stream so the format should contain exactly that number of
+         * conversions.
+         *
+         * @param stream Stream to output to.
+         * @param fmt Format string for the arguments.
+         * @return Number of characters output.
+         */
+        size_t FormatArgs(text_stream::OTextStreamBase &stream, const char *fmt);
+    };
+
+    static_assert(sizeof(Record) == CACHE_LINE_SIZE,
+                  "Trace record should occupy one cache line");
+    static_assert(OFFSETOF(Record, seq) == 0,
+                  "Record should start with the sequence number");
+
+    /** Initialize the buffer. It requires memory allocation for the record
+     * slots.
+     *
+     * @param numSlots Number of record slots. Must be an integer power of two.
+     * @return Status code.
+     */
+    inline RetCode Initialize(size_t numSlots) {
+        return SeqRing::Initialize(numSlots, sizeof(Record), OVERWRITE_OLD);
+    }
+
+    /** Put a record into the buffer. Can be called concurrently from any
+     * number of producers.
+     *
+     * @param id Identifier of the record source.
+     * @param timestamp Time stamp of the record.
+     * @param cpu Index of the current CPU.
+     * @param args Record arguments.
+     * @param numArgs Number of arguments, not more than @ref MAX_ARGS.
+     */
+    inline void Put(u64 id, u64 timestamp, u16 cpu, const u64 *args,
+                    size_t numArgs) {
+        u64 pos = 0;
+        Record *rec = static_cast<Record *>(_Reserve(&pos));
+        rec->id = id;
+        rec->timestamp = timestamp;
+        rec->cpu = cpu;
+        rec->numArgs = numArgs;
+        for (size_t i = 0; i < numArgs; i++) {
+            rec->args[i] = args[i];
+        }
+        _Commit(rec, pos);
+    }
+
+    /** Get the oldest committed record and remove it from the buffer.
+     * Consumers should be serialized by the caller.
+     *
+     * @param rec Record is copied here.
+     * @return @a true if the record was retrieved, @a false if there are no
+     *      committed records.
+     */
+    inline bool Get(Record *rec) {
+        return _Get(rec);
+    }
+};
+
+#endif /* TRACEBUFFER_H_ */
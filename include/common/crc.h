@@ -14,14 +14,35 @@
 #ifndef CRC_H_
 #define CRC_H_
 
-/** CCITT CRC32 implementation. */
+/** CRC32 implementation. The polynomial is specified in reversed (LSB-first)
+ * form, the data is processed in reflected bit order as in the most common
+ * CRC32 variants. The generic implementation uses slicing-by-16 tables. For
+ * IEEE and Castagnoli polynomials the hardware accelerated implementations are
+ * selected if the CPU supports them. @n
+ *
+ * The object holds 16KB of tables, so it should not be placed on stack. A
+ * single object can be used concurrently since it is not modified after
+ * construction.
+ */
 class Crc32 {
 public:
+    enum: u32 {
+        /** IEEE 802.3 polynomial (Ethernet, GPT, EFI, zlib). */
+        POLY_IEEE = 0xedb88320,
+        /** Castagnoli polynomial (CRC32C - iSCSI, SCTP, ext4). */
+        POLY_CASTAGNOLI = 0x82f63b78,
+        /** Initial CRC value. */
+        INITIAL = 0xffffffff,
+    };
+
     /** Construct CRC calculator.
      *
      * @param polynomial Polynomial value to use in calculations.
+     * @param allowHw Allow hardware accelerated implementations if the CPU
+     *      supports them. The generic table-based one is used otherwise.
+     *      Mostly needed for testing.
      */
-    Crc32(u32 polynomial = 0x04c11db7);
+    Crc32(u32 polynomial = POLY_IEEE, bool allowHw = true);
     /** Calculate CRC for the buffer content. Can be used incrementally.
      *
      * @param buf Buffer with the data.
@@ -30,10 +51,48 @@ public:
      *      value for the incremental call.
      * @return CRC value for the data in the provided buffer.
      */
-    u32 Calculate(void *buf, size_t size, u32 crc = 0xffffffff);
+    u32 Calculate(const void *buf, size_t size, u32 crc = INITIAL) const;
+
+    /** Combine CRC values of two adjacent buffers. Allows calculating CRC of
+     * a big buffer by parts in parallel.
+     *
+     * @param crcA CRC value of the first buffer.
+     * @param crcB CRC value of the second buffer, should be calculated with
+     *      the default initial value.
+     * @param lenB Size of the second buffer in bytes.
+     * @return CRC value of the concatenated buffers, the same as
+     *      @ref Calculate would return for the second buffer with @a crcA
+     *      passed as initial value.
+     */
+    u32 Combine(u32 crcA, u32 crcB, size_t lenB) const;
+
 private:
+    enum Method {
+        /** Generic slicing-by-16 tables. */
+        METHOD_TABLES,
+        /** PCLMULQDQ folding, IEEE polynomial only. */
+        METHOD_PCLMUL,
+        /** SSE4.2 crc32 instruction, Castagnoli polynomial only. */
+        METHOD_SSE42,
+    };
+
     u32 _polynomial;
-    u32 _crcTable[256];
+    Method _method;
+    /** Slicing tables. The first one is the classic byte-wise table, each next
+     * one gives CRC of a byte followed by one more zero byte.
+     */
+    u32 _crcTable[16][256];
+    /** x^(2^n) mod P values for the CRC values shifting, one for each bit of
+     * 64 bits shift. The sequence period depends on the polynomial (32 for
+     * IEEE, 31 for Castagnoli), so all the values are stored.
+     */
+    u32 _x2n[64];
+
+    /** Generic table-based implementation. */
+    u32 _CalculateTables(const u8 *ptr, size_t size, u32 crc) const;
+
+    /** Multiply two polynomials modulo the CRC polynomial. */
+    u32 _MultModP(u32 a, u32 b) const;
 };
 
 
@@ -29,6 +29,101 @@
 #define strlen      __builtin_strlen
 #define strcpy      __builtin_strcpy
 
+/** Memory and string primitives behind the C run-time functions. The
+ * implementations are selected at run time according to the CPU capabilities.
+ */
+class StringOps {
+public:
+    /** Copy non-overlapping memory blocks. */
+    static inline void
+    Copy(u8 *dst, const u8 *src, size_t size)
+    {
+        _copy(dst, src, size);
+    }
+
+    /** Copy possibly overlapping memory blocks. */
+    static inline void
+    Move(u8 *dst, const u8 *src, size_t size)
+    {
+        if (dst + size <= src || src + size <= dst) {
+            _copy(dst, src, size);
+        } else if (dst != src) {
+            _move(dst, src, size);
+        }
+    }
+
+    /** Fill memory block with the specified byte value. */
+    static inline void
+    Fill(u8 *dst, u8 value, size_t size)
+    {
+        _fill(dst, value, size);
+    }
+
+    /** Compare memory blocks.
+     *
+     * @return Difference of the first mismatching bytes, zero if the blocks
+     *      are equal.
+     */
+    static inline int
+    Compare(const u8 *p1, const u8 *p2, size_t size)
+    {
+        return _compare(p1, p2, size);
+    }
+
+    /** Find byte in memory block.
+     *
+     * @return Pointer to the found byte, zero if not found.
+     */
+    static inline const u8 *
+    Find(const u8 *ptr, u8 value, size_t size)
+    {
+        return _find(ptr, value, size);
+    }
+
+    /** Get length of null-terminated string. */
+    static inline size_t
+    Length(const char *str)
+    {
+        return _length(str);
+    }
+
+    /** Select the primitives implementation. It is done automatically on
+     * first use, explicit call is mostly needed for testing.
+     *
+     * @param allowSimd Allow vectorized implementations and string
+     *      instructions if the CPU supports them. The generic byte-wise ones
+     *      are used otherwise.
+     */
+    static void Select(bool allowSimd = true);
+
+private:
+    typedef void (*CopyFunc)(u8 *dst, const u8 *src, size_t size);
+    typedef void (*FillFunc)(u8 *dst, u8 value, size_t size);
+    typedef int (*CompareFunc)(const u8 *p1, const u8 *p2, size_t size);
+    typedef const u8 *(*FindFunc)(const u8 *ptr, u8 value, size_t size);
+    typedef size_t (*LengthFunc)(const char *str);
+
+    static CopyFunc _copy, _move;
+    static FillFunc _fill;
+    static CompareFunc _compare;
+    static FindFunc _find;
+    static LengthFunc _length;
+
+    static void _CopyGeneric(u8 *dst, const u8 *src, size_t size);
+    static void _MoveGeneric(u8 *dst, const u8 *src, size_t size);
+    static void _FillGeneric(u8 *dst, u8 value, size_t size);
+    static int _CompareGeneric(const u8 *p1, const u8 *p2, size_t size);
+    static const u8 *_FindGeneric(const u8 *ptr, u8 value, size_t size);
+    static size_t _LengthGeneric(const char *str);
+    /* Initial values of the primitives pointers which do the selection. */
+    static void _CopySelect(u8 *dst, const u8 *src, size_t size);
+    static void _MoveSelect(u8 *dst, const u8 *src, size_t size);
+    static void _FillSelect(u8 *dst, u8 value, size_t size);
+    static int _CompareSelect(const u8 *p1, const u8 *p2, size_t size);
+    static const u8 *_FindSelect(const u8 *ptr, u8 value, size_t size);
+    static size_t _LengthSelect(const char *str);
+};
+
 ASMCALL char *strncpy(char *dst, const char *src, size_t len);
 ASMCALL int strcmp(const char *s1, const char *s2);
 ASMCALL int strncmp(const char *s1, const char *s2, size_t len);
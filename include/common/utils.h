@@ -120,7 +120,7 @@ template <typename T>
 inline void
 PutUnaligned(T value, void *p)
 {
-    static_cast<const UnalignedData<T> *>(p)->value = value;
+    static_cast<UnalignedData<T> *>(p)->value = value;
 }
 
 } /* Anonymous namespace */
@@ -100,6 +100,7 @@
 #define __FORMAT(type, fmtIdx, argIdx)  __attribute__ ((format(type, fmtIdx, argIdx)))
 #define __NORETURN                  __attribute__ ((noreturn))
 #define __NOINLINE                  __attribute__ ((noinline))
+#define __ALIGNED(align)            __attribute__ ((aligned(align)))
 
 /** Minimal value. */
 #define MIN(x, y)                   ((x) < (y) ? (x) : (y))
@@ -117,6 +117,17 @@ public:
         return *this;
     }
 
+    /** Output formatted string with format parsed at compile time (see
+     * @ref OTS_FMT).
+     */
+    template <class S, typename... Args>
+    inline SysLogBase &Format(text_stream::StaticFormat<S> fmt, Args... args) {
+        if (UNLIKELY(_curLevel <= _maxLevel)) {
+            text_stream::OTextStream<SysLogBase>::Format(fmt, args...);
+        }
+        return *this;
+    }
+
     inline SysLogBase &FormatV(const char *fmt, va_list args) {
         if (UNLIKELY(_curLevel <= _maxLevel)) {
             text_stream::OTextStream<SysLogBase>::FormatV(fmt, args);
@@ -196,6 +207,24 @@ public:
      *      otherwise.
      */
     virtual bool Putc(char c, void *arg) = 0;
+
+    /** Output characters span to the log. Default implementation calls
+     * @ref Putc for each character, back-end class may override it to output
+     * the span at once.
+     *
+     * @param buf Characters to output.
+     * @param len Number of characters to output.
+     * @param arg Optional argument.
+     * @return Number of characters written.
+     */
+    virtual size_t Write(const char *buf, size_t len, void *arg) {
+        for (size_t i = 0; i < len; i++) {
+            if (!Putc(buf[i], arg)) {
+                return i;
+            }
+        }
+        return len;
+    }
 protected:
     /** Level for the message currently being printed. */
     Level _curLevel;
@@ -205,16 +234,102 @@ protected:
 
 #ifdef KERNEL
 
-/** Kernel implementation for system log. */
+/** Kernel implementation for system log. Messages are output synchronously
+ * to the debug serial port until @ref Initialize is called. After that they
+ * are recorded into per-CPU lockless ring buffers (see @ref LogRing) and the
+ * buffers are drained to the serial port later, so the producer does not wait
+ * for the port. The buffers are drained:
+ * @li synchronously for messages of @ref LOG_ERROR level and more important;
+ * @li opportunistically when a ring becomes half full and no other CPU is
+ *      draining. At most @ref DRAIN_BATCH records are output while the port
+ *      transmitter is empty, so the producer is not delayed for long;
+ * @li by explicit @ref Flush or @ref Drain calls, e.g. at the end of each
+ *      initialization phase or when a CPU is idle.
+ *
+ * Records of all CPUs are merged in time stamp order when drained. Number of
+ * records lost due to overflow is reported in the log output.
+ */
 class KSysLog : public SysLogBase {
 public:
+    enum {
+        /** Number of record slots in each per-CPU ring. */
+        RING_SIZE = 512,
+        /** Maximal number of records output by one @ref Drain call. */
+        DRAIN_BATCH = 4,
+    };
+
     KSysLog();
 
+    /** Switch to buffered output.
+     *
+     * @param numCpus Number of CPUs which can write to the log.
+     * @param policy Overflow policy for the rings.
+     * @return Status code.
+     */
+    RetCode Initialize(size_t numCpus,
+                       LogRing::OverflowPolicy policy = LogRing::DROP_NEW);
+
     virtual SysLogBase &operator <<(log::SysLogBase::Level level);
 
     virtual bool Putc(char c, void *arg = 0);
+
+    virtual size_t Write(const char *buf, size_t len, void *arg = 0);
+
+    /** Output all buffered records to the debug serial port. Waits if other
+     * CPU is draining.
+     */
+    void Flush();
+
+    /** Output some buffered records to the debug serial port if no other
+     * CPU is draining. Not more than @ref DRAIN_BATCH records are output and
+     * only while the port transmitter is empty, interrupts are enabled
+     * between the records. It is cheap when there are no records so it can be
+     * called when the CPU is idle.
+     */
+    void Drain();
+
+    /** Get total number of records lost due to the rings overflow. */
+    u64 GetNumLost();
+
 private:
+    enum {
+        /** Maximal length of the level prefix, e.g. "[CRITICAL] ". */
+        MAX_PREFIX_LEN = 16,
+    };
+
     bool lastNewLine;
+    /** Name of the current message level if the level prefix is not yet
+     * output, zero otherwise.
+     */
+    const char *_prefix = 0;
+    /** Per-CPU rings, zero if output is not buffered. */
+    LogRing *_rings = 0;
+    /** Merges the rings content in time stamp order. */
+    SeqRingMerger<LogRing> _merger;
+    size_t _numCpus = 0;
+    /** Serializes the rings consumers. */
+    SpinLock _drainLock;
+    /** Number of lost records already reported in the log output. */
+    u64 _numLostReported = 0;
+
+    /** Get index of the current CPU. */
+    size_t _GetCpu();
+
+    /** Output characters span without the level prefix. */
+    size_t _Output(const char *buf, size_t len);
+
+    /** Output all buffered records. The drain lock should be held by the
+     * caller.
+     */
+    void _Drain();
+
+    /** Output the oldest buffered record. The drain lock should be held by
+     * the caller.
+     *
+     * @return @a true if the record was output, @a false if there are no
+     *      buffered records.
+     */
+    bool _DrainRecord();
 };
 
 /** Global system log class. */
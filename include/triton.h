@@ -74,6 +74,10 @@ next(Iterator<IterT> &it);
 #include <triton/numeric.h>
 #include <triton/tuple.h>
 #include <triton/list.h>
+#include <triton/btree_map.h>
+#include <triton/hash_table.h>
+#include <triton/dict.h>
+#include <triton/set.h>
 
 namespace triton {
 
@@ -0,0 +1,1024 @@
+/*
+ * /phoenix/include/triton/btree_map.h
+ *
+ * This file is a part of Phoenix operating system.
+ * Copyright (c) 2011-2012, Artyom Lebedev <artyom.lebedev@gmail.com>
+ * All rights reserved.
+ * See COPYING file for copyright details.
+ */
+
+/** @file btree_map.h
+ * Triton ordered maps implementation.
+ */
+
+#ifndef BTREE_MAP_H_
+#define BTREE_MAP_H_
+
+namespace triton {
+
+namespace triton_internal {
+
+/** Keys search in B-tree nodes. Generic version does binary search using keys
+ * "less than" operator.
+ */
+template <typename K, class Enable = void>
+class BTreeKeySearch {
+public:
+    /** Count keys which are less than the provided one.
+     *
+     * @param keys Sorted array of keys.
+     * @param numKeys Number of keys in the array.
+     * @param key Key to compare with.
+     * @return Number of keys less than @a key, i.e. index of the first key
+     *      which is not less than @a key.
+     */
+    static inline size_t
+    CountLess(const K *keys, size_t numKeys, const K &key)
+    {
+        size_t lo = 0, hi = numKeys;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (keys[mid] < key) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+};
+
+/** Specialization for 32 and 64 bits integral keys. The whole node is scanned
+ * with SIMD comparisons, the comparison masks are accumulated, so the scan has
+ * no data dependent branches which the binary search suffers from.
+ */
+template <typename K>
+class BTreeKeySearch<K, enable_if<is_integral<K>() &&
+                                  (sizeof(K) == 4 || sizeof(K) == 8)>> {
+private:
+    /** Vector of keys. Keys arrays are not required to be aligned. */
+    typedef K Vector __attribute__((vector_size(16), aligned(1)));
+
+    enum: size_t {
+        /** Number of keys in one vector. */
+        NUM_LANES = 16 / sizeof(K),
+    };
+
+public:
+    /** @see BTreeKeySearch::CountLess */
+    static inline size_t
+    CountLess(const K *keys, size_t numKeys, const K &key)
+    {
+        Vector keyVec;
+        for (size_t i = 0; i < NUM_LANES; i++) {
+            keyVec[i] = key;
+        }
+        /* Comparison gives -1 in the matched lanes. */
+        decltype(keyVec < keyVec) acc = {}, acc2 = {};
+        size_t idx = 0;
+        for (; idx + 2 * NUM_LANES <= numKeys; idx += 2 * NUM_LANES) {
+            acc += *reinterpret_cast<const Vector *>(&keys[idx]) < keyVec;
+            acc2 += *reinterpret_cast<const Vector *>(&keys[idx + NUM_LANES]) <
+                    keyVec;
+        }
+        if (idx + NUM_LANES <= numKeys) {
+            acc += *reinterpret_cast<const Vector *>(&keys[idx]) < keyVec;
+            idx += NUM_LANES;
+        }
+        acc += acc2;
+        size_t count = 0;
+        for (size_t i = 0; i < NUM_LANES; i++) {
+            count -= acc[i];
+        }
+        for (; idx < numKeys; idx++) {
+            count += keys[idx] < key;
+        }
+        return count;
+    }
+};
+
+} /* namespace triton_internal */
+
+/** Ordered map implemented as B+ tree. Comparing to @ref RBTree each node
+ * holds many keys so the tree is much shallower and each level costs about
+ * one cache miss for the node keys which are stored contiguously. All values
+ * are stored in leaf nodes, the leaves are linked so the ordered iteration
+ * does not touch inner nodes. @n
+ *
+ * Keys are compared by "less than" operator. Integral keys are searched in
+ * nodes with SIMD instructions. Keys and values should be default
+ * constructible and assignable since node arrays are preconstructed.
+ * Modifications invalidate references to keys and values and all iterators
+ * because items are moved between nodes.
+ *
+ * @param K Type of keys.
+ * @param V Type of values.
+ * @param AllocatorT Allocator which is rebound for nodes allocation.
+ * @param NodeSize Approximate size of one node in bytes. Default size spans a
+ *      few cache lines, page size can be used for huge maps.
+ */
+template <typename K, typename V, class AllocatorT = Allocator<K>,
+          size_t NodeSize = 4 * CACHE_LINE_SIZE>
+class BTreeMap: public Object, public Iterable<K> {
+private:
+    typedef triton_internal::BTreeKeySearch<K> KeySearch;
+
+    class Node {
+    public:
+        /** Number of keys in the node. */
+        u32 numKeys = 0;
+        bool isLeaf;
+
+        inline
+        Node(bool isLeaf) : isLeaf(isLeaf) {}
+    };
+
+    enum: size_t {
+        /** Maximal number of items in leaf node. */
+        LEAF_CAPACITY = (NodeSize - sizeof(Node) - sizeof(void *)) /
+                        (sizeof(K) + sizeof(V)) > 4 ?
+                        (NodeSize - sizeof(Node) - sizeof(void *)) /
+                        (sizeof(K) + sizeof(V)) : 4,
+        /** Maximal number of keys in inner node. */
+        INNER_CAPACITY = (NodeSize - sizeof(Node) - sizeof(void *)) /
+                         (sizeof(K) + sizeof(void *)) > 4 ?
+                         (NodeSize - sizeof(Node) - sizeof(void *)) /
+                         (sizeof(K) + sizeof(void *)) : 4,
+        /** Minimal number of items in non-root leaf node. */
+        LEAF_MIN = LEAF_CAPACITY / 2,
+        /** Minimal number of keys in non-root inner node. */
+        INNER_MIN = INNER_CAPACITY / 2,
+        /** Maximal tree height. Inner nodes have at least three children. */
+        MAX_HEIGHT = sizeof(size_t) * NBBY,
+    };
+
+    class Leaf: public Node {
+    public:
+        /** Next leaf in keys order. */
+        Leaf *next = nullptr;
+        K keys[LEAF_CAPACITY];
+        V values[LEAF_CAPACITY];
+
+        inline
+        Leaf() : Node(true) {}
+    };
+
+    /** Inner node. Keys in @a children[i] subtree are less than @a keys[i],
+     * keys in @a children[i + 1] subtree are not less than @a keys[i].
+     */
+    class Inner: public Node {
+    public:
+        K keys[INNER_CAPACITY];
+        Node *children[INNER_CAPACITY + 1];
+
+        inline
+        Inner() : Node(false) {}
+    };
+
+    /** Path from the root to a leaf. */
+    class Path {
+    public:
+        Inner *nodes[MAX_HEIGHT];
+        /** Index of the child taken in each inner node. */
+        size_t idx[MAX_HEIGHT];
+        /** Number of inner nodes in the path. */
+        size_t depth = 0;
+    };
+
+    typedef typename AllocatorT::template Rebind<Leaf> LeafAllocator;
+    typedef typename AllocatorT::template Rebind<Inner> InnerAllocator;
+
+    LeafAllocator _leafAlloc;
+    InnerAllocator _innerAlloc;
+    Node *_root = nullptr;
+    /** Leftmost leaf. */
+    Leaf *_firstLeaf = nullptr;
+    size_t _numItems = 0;
+
+    /** Find leaf which may contain the key.
+     *
+     * @param key Key to look for.
+     * @param path Path to the leaf is stored there if not null.
+     * @return Leaf node, null if the tree is empty.
+     */
+    Leaf *
+    _FindLeaf(const K &key, Path *path = nullptr) const
+    {
+        Node *node = _root;
+        if (!node) {
+            return nullptr;
+        }
+        while (!node->isLeaf) {
+            Inner *inner = static_cast<Inner *>(node);
+            size_t idx = KeySearch::CountLess(inner->keys, inner->numKeys, key);
+            if (idx < inner->numKeys && !(key < inner->keys[idx])) {
+                /* Equal to separator, the key is in the right subtree. */
+                idx++;
+            }
+            if (path) {
+                path->nodes[path->depth] = inner;
+                path->idx[path->depth] = idx;
+                path->depth++;
+            }
+            node = inner->children[idx];
+        }
+        return static_cast<Leaf *>(node);
+    }
+
+    /** Find position of the first key which is not less than the provided
+     * one.
+     *
+     * @param key Key to look for.
+     * @param leaf Leaf is stored there, null if there are no such keys.
+     * @param pos Position in the leaf is stored there.
+     */
+    void
+    _LowerBound(const K &key, Leaf **leaf, size_t *pos) const
+    {
+        Leaf *l = _FindLeaf(key);
+        if (!l) {
+            *leaf = nullptr;
+            *pos = 0;
+            return;
+        }
+        size_t p = KeySearch::CountLess(l->keys, l->numKeys, key);
+        if (p == l->numKeys) {
+            l = l->next;
+            p = 0;
+        }
+        *leaf = l;
+        *pos = p;
+    }
+
+    /** Find value by the key.
+     *
+     * @return Pointer to the value, null if not found.
+     */
+    V *
+    _Lookup(const K &key) const
+    {
+        Leaf *leaf = _FindLeaf(key);
+        if (!leaf) {
+            return nullptr;
+        }
+        size_t pos = KeySearch::CountLess(leaf->keys, leaf->numKeys, key);
+        if (pos < leaf->numKeys && !(key < leaf->keys[pos])) {
+            return &leaf->values[pos];
+        }
+        return nullptr;
+    }
+
+    /** Insert separator and right child into the parent of the split node.
+     * Splits parents up to the root if necessary.
+     *
+     * @param path Path to the split node.
+     * @param key Separator key.
+     * @param child New node which follows the split node.
+     */
+    void
+    _InsertSeparator(Path &path, K &key, Node *child)
+    {
+        while (path.depth) {
+            path.depth--;
+            Inner *node = path.nodes[path.depth];
+            size_t idx = path.idx[path.depth];
+            if (node->numKeys < INNER_CAPACITY) {
+                for (size_t i = node->numKeys; i > idx; i--) {
+                    node->keys[i] = move(node->keys[i - 1]);
+                    node->children[i + 1] = node->children[i];
+                }
+                node->keys[idx] = move(key);
+                node->children[idx + 1] = child;
+                node->numKeys++;
+                return;
+            }
+            /* Split the full node. The left part keeps the lower half, the
+             * middle key goes up.
+             */
+            Inner *right = _innerAlloc.Allocate();
+            size_t mid = (INNER_CAPACITY + 1) / 2;
+            K sep;
+            if (idx < mid) {
+                /* New key goes to the left part. */
+                sep = move(node->keys[mid - 1]);
+                for (size_t i = mid; i < INNER_CAPACITY; i++) {
+                    right->keys[i - mid] = move(node->keys[i]);
+                    right->children[i - mid] = node->children[i];
+                }
+                right->children[INNER_CAPACITY - mid] =
+                    node->children[INNER_CAPACITY];
+                for (size_t i = mid - 1; i > idx; i--) {
+                    node->keys[i] = move(node->keys[i - 1]);
+                    node->children[i + 1] = node->children[i];
+                }
+                node->keys[idx] = move(key);
+                node->children[idx + 1] = child;
+            } else if (idx == mid) {
+                /* New key goes up itself. */
+                sep = move(key);
+                right->children[0] = child;
+                for (size_t i = mid; i < INNER_CAPACITY; i++) {
+                    right->keys[i - mid] = move(node->keys[i]);
+                    right->children[i - mid + 1] = node->children[i + 1];
+                }
+            } else {
+                /* New key goes to the right part. */
+                sep = move(node->keys[mid]);
+                size_t r = 0;
+                right->children[0] = node->children[mid + 1];
+                for (size_t i = mid + 1; i < INNER_CAPACITY; i++) {
+                    if (i == idx) {
+                        right->keys[r] = move(key);
+                        right->children[r + 1] = child;
+                        r++;
+                    }
+                    right->keys[r] = move(node->keys[i]);
+                    right->children[r + 1] = node->children[i + 1];
+                    r++;
+                }
+                if (idx == INNER_CAPACITY) {
+                    right->keys[r] = move(key);
+                    right->children[r + 1] = child;
+                }
+            }
+            node->numKeys = mid;
+            right->numKeys = INNER_CAPACITY - mid;
+            key = move(sep);
+            child = right;
+        }
+        /* Root was split. */
+        Inner *root = _innerAlloc.Allocate();
+        root->keys[0] = move(key);
+        root->children[0] = _root;
+        root->children[1] = child;
+        root->numKeys = 1;
+        _root = root;
+    }
+
+    /** Find the value or insert default one if not found.
+     *
+     * @param key Key to look for.
+     * @param inserted Set to @a true if new item inserted, @a false if
+     *      existing one found.
+     * @return Reference to the value in the map.
+     */
+    V &
+    _Insert(const K &key, bool *inserted)
+    {
+        if (!_root) {
+            _firstLeaf = _leafAlloc.Allocate();
+            _root = _firstLeaf;
+        }
+        Path path;
+        Leaf *leaf = _FindLeaf(key, &path);
+        size_t pos = KeySearch::CountLess(leaf->keys, leaf->numKeys, key);
+        if (pos < leaf->numKeys && !(key < leaf->keys[pos])) {
+            *inserted = false;
+            return leaf->values[pos];
+        }
+        *inserted = true;
+        _numItems++;
+        if (leaf->numKeys < LEAF_CAPACITY) {
+            return _LeafInsert(leaf, pos, key);
+        }
+        /* Split the full leaf, upper half goes to the new one. */
+        Leaf *right = _leafAlloc.Allocate();
+        size_t mid = (LEAF_CAPACITY + 1) / 2;
+        for (size_t i = mid; i < LEAF_CAPACITY; i++) {
+            right->keys[i - mid] = move(leaf->keys[i]);
+            right->values[i - mid] = move(leaf->values[i]);
+        }
+        right->numKeys = LEAF_CAPACITY - mid;
+        leaf->numKeys = mid;
+        right->next = leaf->next;
+        leaf->next = right;
+        V *value;
+        if (pos <= mid) {
+            value = &_LeafInsert(leaf, pos, key);
+        } else {
+            value = &_LeafInsert(right, pos - mid, key);
+        }
+        K sep = right->keys[0];
+        _InsertSeparator(path, sep, right);
+        return *value;
+    }
+
+    /** Insert key with default value into non-full leaf. */
+    V &
+    _LeafInsert(Leaf *leaf, size_t pos, const K &key)
+    {
+        for (size_t i = leaf->numKeys; i > pos; i--) {
+            leaf->keys[i] = move(leaf->keys[i - 1]);
+            leaf->values[i] = move(leaf->values[i - 1]);
+        }
+        leaf->keys[pos] = key;
+        leaf->values[pos] = V();
+        leaf->numKeys++;
+        return leaf->values[pos];
+    }
+
+    /** Delete item from the map.
+     *
+     * @param key Key of the item to delete.
+     * @param value Deleted value is moved there if not null.
+     * @return @a true if the item was deleted, @a false if not found.
+     */
+    bool
+    _Delete(const K &key, V *value = nullptr)
+    {
+        Path path;
+        Leaf *leaf = _FindLeaf(key, &path);
+        if (!leaf) {
+            return false;
+        }
+        size_t pos = KeySearch::CountLess(leaf->keys, leaf->numKeys, key);
+        if (pos == leaf->numKeys || key < leaf->keys[pos]) {
+            return false;
+        }
+        if (value) {
+            *value = move(leaf->values[pos]);
+        }
+        for (size_t i = pos + 1; i < leaf->numKeys; i++) {
+            leaf->keys[i - 1] = move(leaf->keys[i]);
+            leaf->values[i - 1] = move(leaf->values[i]);
+        }
+        leaf->numKeys--;
+        _numItems--;
+        /* Do not keep references in the released slot. */
+        leaf->keys[leaf->numKeys] = K();
+        leaf->values[leaf->numKeys] = V();
+
+        if (!path.depth) {
+            if (!leaf->numKeys) {
+                _leafAlloc.Free(leaf);
+                _root = nullptr;
+                _firstLeaf = nullptr;
+            }
+            return true;
+        }
+        if (leaf->numKeys >= LEAF_MIN) {
+            /* Separators are still valid bounds. */
+            return true;
+        }
+        _RebalanceLeaf(path, leaf);
+        _RebalanceInner(path);
+        return true;
+    }
+
+    /** Fix underflown leaf by borrowing an item from a sibling or merging with
+     * it.
+     */
+    void
+    _RebalanceLeaf(Path &path, Leaf *leaf)
+    {
+        Inner *parent = path.nodes[path.depth - 1];
+        size_t idx = path.idx[path.depth - 1];
+        if (idx > 0) {
+            Leaf *left = static_cast<Leaf *>(parent->children[idx - 1]);
+            if (left->numKeys > LEAF_MIN) {
+                /* Borrow the last item of the left sibling. */
+                for (size_t i = leaf->numKeys; i > 0; i--) {
+                    leaf->keys[i] = move(leaf->keys[i - 1]);
+                    leaf->values[i] = move(leaf->values[i - 1]);
+                }
+                left->numKeys--;
+                leaf->keys[0] = move(left->keys[left->numKeys]);
+                leaf->values[0] = move(left->values[left->numKeys]);
+                leaf->numKeys++;
+                parent->keys[idx - 1] = leaf->keys[0];
+                return;
+            }
+        }
+        if (idx < parent->numKeys) {
+            Leaf *right = static_cast<Leaf *>(parent->children[idx + 1]);
+            if (right->numKeys > LEAF_MIN) {
+                /* Borrow the first item of the right sibling. */
+                leaf->keys[leaf->numKeys] = move(right->keys[0]);
+                leaf->values[leaf->numKeys] = move(right->values[0]);
+                leaf->numKeys++;
+                for (size_t i = 1; i < right->numKeys; i++) {
+                    right->keys[i - 1] = move(right->keys[i]);
+                    right->values[i - 1] = move(right->values[i]);
+                }
+                right->numKeys--;
+                parent->keys[idx] = right->keys[0];
+                return;
+            }
+        }
+        /* Merge with a sibling, the right node of the pair is released. */
+        if (idx == 0) {
+            idx++;
+        } else {
+            leaf = static_cast<Leaf *>(parent->children[idx - 1]);
+        }
+        Leaf *right = static_cast<Leaf *>(parent->children[idx]);
+        for (size_t i = 0; i < right->numKeys; i++) {
+            leaf->keys[leaf->numKeys + i] = move(right->keys[i]);
+            leaf->values[leaf->numKeys + i] = move(right->values[i]);
+        }
+        leaf->numKeys += right->numKeys;
+        leaf->next = right->next;
+        _leafAlloc.Free(right);
+        _RemoveChild(parent, idx);
+    }
+
+    /** Remove separator @a idx - 1 and child @a idx from inner node. */
+    void
+    _RemoveChild(Inner *node, size_t idx)
+    {
+        for (size_t i = idx; i < node->numKeys; i++) {
+            node->keys[i - 1] = move(node->keys[i]);
+            node->children[i] = node->children[i + 1];
+        }
+        node->numKeys--;
+        node->keys[node->numKeys] = K();
+    }
+
+    /** Fix underflown inner nodes along the path up to the root. */
+    void
+    _RebalanceInner(Path &path)
+    {
+        while (path.depth) {
+            Inner *node = path.nodes[path.depth - 1];
+            if (path.depth == 1) {
+                /* Root. */
+                if (!node->numKeys) {
+                    _root = node->children[0];
+                    _innerAlloc.Free(node);
+                }
+                return;
+            }
+            if (node->numKeys >= INNER_MIN) {
+                return;
+            }
+            path.depth--;
+            Inner *parent = path.nodes[path.depth - 1];
+            size_t idx = path.idx[path.depth - 1];
+            if (idx > 0) {
+                Inner *left = static_cast<Inner *>(parent->children[idx - 1]);
+                if (left->numKeys > INNER_MIN) {
+                    /* Rotate through the parent separator. */
+                    node->children[node->numKeys + 1] =
+                        node->children[node->numKeys];
+                    for (size_t i = node->numKeys; i > 0; i--) {
+                        node->keys[i] = move(node->keys[i - 1]);
+                        node->children[i] = node->children[i - 1];
+                    }
+                    node->keys[0] = move(parent->keys[idx - 1]);
+                    node->children[0] = left->children[left->numKeys];
+                    node->numKeys++;
+                    left->numKeys--;
+                    parent->keys[idx - 1] = move(left->keys[left->numKeys]);
+                    return;
+                }
+            }
+            if (idx < parent->numKeys) {
+                Inner *right = static_cast<Inner *>(parent->children[idx + 1]);
+                if (right->numKeys > INNER_MIN) {
+                    node->keys[node->numKeys] = move(parent->keys[idx]);
+                    node->children[node->numKeys + 1] = right->children[0];
+                    node->numKeys++;
+                    parent->keys[idx] = move(right->keys[0]);
+                    for (size_t i = 1; i < right->numKeys; i++) {
+                        right->keys[i - 1] = move(right->keys[i]);
+                        right->children[i - 1] = right->children[i];
+                    }
+                    right->children[right->numKeys - 1] =
+                        right->children[right->numKeys];
+                    right->numKeys--;
+                    return;
+                }
+            }
+            /* Merge with a sibling, the separator goes down. */
+            if (idx == 0) {
+                idx++;
+            } else {
+                node = static_cast<Inner *>(parent->children[idx - 1]);
+            }
+            Inner *right = static_cast<Inner *>(parent->children[idx]);
+            node->keys[node->numKeys] = move(parent->keys[idx - 1]);
+            for (size_t i = 0; i < right->numKeys; i++) {
+                node->keys[node->numKeys + 1 + i] = move(right->keys[i]);
+                node->children[node->numKeys + 1 + i] = right->children[i];
+            }
+            node->children[node->numKeys + 1 + right->numKeys] =
+                right->children[right->numKeys];
+            node->numKeys += right->numKeys + 1;
+            _innerAlloc.Free(right);
+            _RemoveChild(parent, idx);
+        }
+    }
+
+    /** Release all nodes in the subtree. */
+    void
+    _FreeSubtree(Node *node)
+    {
+        if (node->isLeaf) {
+            _leafAlloc.Free(static_cast<Leaf *>(node));
+            return;
+        }
+        Inner *inner = static_cast<Inner *>(node);
+        for (size_t i = 0; i <= inner->numKeys; i++) {
+            _FreeSubtree(inner->children[i]);
+        }
+        _innerAlloc.Free(inner);
+    }
+
+    /** Copy all items from another map. */
+    void
+    _CopyFrom(const BTreeMap &map)
+    {
+        for (Leaf *leaf = map._firstLeaf; leaf; leaf = leaf->next) {
+            for (size_t i = 0; i < leaf->numKeys; i++) {
+                __setitem__(leaf->keys[i], leaf->values[i]);
+            }
+        }
+    }
+
+    /** Take all items from another map. */
+    void
+    _MoveFrom(BTreeMap &map)
+    {
+        _root = map._root;
+        _firstLeaf = map._firstLeaf;
+        _numItems = map._numItems;
+        map._root = nullptr;
+        map._firstLeaf = nullptr;
+        map._numItems = 0;
+    }
+
+public:
+    /** Type of keys. */
+    typedef K KeyType;
+    /** Type of values mapped to the keys. */
+    typedef V MappedType;
+
+    /** Iterator over the items in keys order. Yields either keys or values
+     * depending on @a IsValues parameter.
+     */
+    template <typename T, bool IsValues>
+    class MapIterator: public IteratorImpl<T> {
+    private:
+        Leaf *_leaf, *_endLeaf;
+        size_t _pos, _endPos;
+    public:
+        /** Iterate items from the specified position until the end
+         * position.
+         */
+        MapIterator(Leaf *leaf, size_t pos, Leaf *endLeaf, size_t endPos) :
+            _leaf(leaf), _endLeaf(endLeaf), _pos(pos), _endPos(endPos)
+        {
+            this->_hasNext = _leaf && (_leaf != _endLeaf || _pos != _endPos);
+        }
+
+        virtual
+        T &
+        __next__()
+        {
+            if (!this->_hasNext) {
+                throw StopIteration();
+            }
+            T &item = _Get(_leaf, _pos);
+            _pos++;
+            if (_pos == _leaf->numKeys) {
+                _leaf = _leaf->next;
+                _pos = 0;
+            }
+            this->_hasNext = _leaf && (_leaf != _endLeaf || _pos != _endPos);
+            return item;
+        }
+
+    private:
+        template <bool isValues = IsValues>
+        static inline enable_if<!isValues, T &>
+        _Get(Leaf *leaf, size_t pos)
+        {
+            return leaf->keys[pos];
+        }
+
+        template <bool isValues = IsValues>
+        static inline enable_if<isValues, T &>
+        _Get(Leaf *leaf, size_t pos)
+        {
+            return leaf->values[pos];
+        }
+    };
+
+    inline
+    BTreeMap() {}
+
+    /** Copy constructor. */
+    inline
+    BTreeMap(const BTreeMap &map)
+    {
+        _CopyFrom(map);
+    }
+
+    /** Move constructor. */
+    inline
+    BTreeMap(BTreeMap &&map)
+    {
+        _MoveFrom(map);
+    }
+
+    inline
+    ~BTreeMap()
+    {
+        clear();
+    }
+
+    /** Copy assignment. */
+    BTreeMap &
+    operator =(const BTreeMap &map)
+    {
+        if (&map != this) {
+            clear();
+            _CopyFrom(map);
+        }
+        return *this;
+    }
+
+    /** Move assignment. */
+    BTreeMap &
+    operator =(BTreeMap &&map)
+    {
+        if (&map != this) {
+            clear();
+            _MoveFrom(map);
+        }
+        return *this;
+    }
+
+    virtual const char *
+    __name__() const
+    {
+        return "BTreeMap";
+    }
+
+    virtual size_t
+    __len__() const
+    {
+        return _numItems;
+    }
+
+    /** Iterate over all keys in ascending order. */
+    virtual
+    Iterator<K>
+    __iter__(bool endIterator = false) const
+    {
+        Iterator<K> it;
+        if (endIterator) {
+            return it;
+        }
+        it.template Assign<MapIterator<K, false>>(_firstLeaf, 0, nullptr, 0);
+        return it;
+    }
+
+    /** Check if the map contains the key. */
+    bool
+    __contains__(const K &key) const
+    {
+        return _Lookup(key) != nullptr;
+    }
+
+    /** Get value by the key. @ref KeyError is thrown if the key is not
+     * found.
+     */
+    V &
+    operator [](const K &key) const
+    {
+        V *value = _Lookup(key);
+        if (!value) {
+            throw KeyError();
+        }
+        return *value;
+    }
+
+    /** Set value for the key. Existing value is replaced. */
+    void
+    __setitem__(const K &key, const V &value)
+    {
+        bool inserted;
+        _Insert(key, &inserted) = value;
+    }
+
+    /** Delete item by the key. @ref KeyError is thrown if the key is not
+     * found.
+     */
+    void
+    __delitem__(const K &key)
+    {
+        if (!_Delete(key)) {
+            throw KeyError();
+        }
+    }
+
+    /** Get value by the key.
+     *
+     * @param key Key to look for.
+     * @param defValue Value to return if the key is not found.
+     * @return Copy of the found value or @a defValue.
+     */
+    V
+    get(const K &key, const V &defValue = V()) const
+    {
+        V *value = _Lookup(key);
+        return value ? *value : defValue;
+    }
+
+    /** Get value by the key, insert the provided value if not found.
+     *
+     * @param key Key to look for.
+     * @param defValue Value to insert if the key is not found.
+     * @return Reference to the value in the map.
+     */
+    V &
+    setdefault(const K &key, const V &defValue = V())
+    {
+        bool inserted;
+        V &value = _Insert(key, &inserted);
+        if (inserted) {
+            value = defValue;
+        }
+        return value;
+    }
+
+    /** Remove item from the map and return its value. @ref KeyError is
+     * thrown if the key is not found.
+     */
+    V
+    pop(const K &key)
+    {
+        V value;
+        if (!_Delete(key, &value)) {
+            throw KeyError();
+        }
+        return value;
+    }
+
+    /** Remove item from the map and return its value.
+     *
+     * @param key Key to look for.
+     * @param defValue Value to return if the key is not found.
+     * @return Removed value or @a defValue.
+     */
+    V
+    pop(const K &key, const V &defValue)
+    {
+        V value;
+        if (!_Delete(key, &value)) {
+            return defValue;
+        }
+        return value;
+    }
+
+    /** Remove all items. */
+    void
+    clear()
+    {
+        if (_root) {
+            _FreeSubtree(_root);
+        }
+        _root = nullptr;
+        _firstLeaf = nullptr;
+        _numItems = 0;
+    }
+
+    /** Iterate over keys in range [@a from; @a to) in ascending order. */
+    Iterator<K>
+    range(const K &from, const K &to) const
+    {
+        Iterator<K> it;
+        Leaf *leaf, *endLeaf;
+        size_t pos, endPos;
+        _LowerBound(from, &leaf, &pos);
+        _LowerBound(to, &endLeaf, &endPos);
+        if (!(from < to)) {
+            leaf = nullptr;
+        }
+        it.template Assign<MapIterator<K, false>>(leaf, pos, endLeaf, endPos);
+        return it;
+    }
+
+    /** Iterate over all values in their keys order. */
+    Iterator<V>
+    values() const
+    {
+        Iterator<V> it;
+        it.template Assign<MapIterator<V, true>>(_firstLeaf, 0, nullptr, 0);
+        return it;
+    }
+
+    /** Iterate over values with keys in range [@a from; @a to) in their keys
+     * order.
+     */
+    Iterator<V>
+    values(const K &from, const K &to) const
+    {
+        Iterator<V> it;
+        Leaf *leaf, *endLeaf;
+        size_t pos, endPos;
+        _LowerBound(from, &leaf, &pos);
+        _LowerBound(to, &endLeaf, &endPos);
+        if (!(from < to)) {
+            leaf = nullptr;
+        }
+        it.template Assign<MapIterator<V, true>>(leaf, pos, endLeaf, endPos);
+        return it;
+    }
+
+    /** Validate the tree structure. Intended for debugging and testing.
+     *
+     * @return @a true if the tree is valid, @a false otherwise.
+     */
+    bool
+    Validate() const
+    {
+        if (!_root) {
+            return !_numItems && !_firstLeaf;
+        }
+        size_t leafDepth = 0, numItems = 0;
+        Leaf *prevLeaf = nullptr;
+        if (!_ValidateSubtree(_root, nullptr, nullptr, 0, &leafDepth,
+                              &prevLeaf, &numItems)) {
+            return false;
+        }
+        return numItems == _numItems && !prevLeaf->next;
+    }
+
+private:
+    /** Validate subtree, all its keys should be in range [@a lo; @a hi).
+     * Null bounds are not checked.
+     */
+    bool
+    _ValidateSubtree(Node *node, const K *lo, const K *hi, size_t depth,
+                     size_t *leafDepth, Leaf **prevLeaf, size_t *numItems) const
+    {
+        if (depth >= MAX_HEIGHT) {
+            return false;
+        }
+        bool isRoot = node == _root;
+        if (node->isLeaf) {
+            Leaf *leaf = static_cast<Leaf *>(node);
+            if (leaf->numKeys > LEAF_CAPACITY ||
+                (!isRoot && leaf->numKeys < LEAF_MIN) || !leaf->numKeys) {
+                return false;
+            }
+            if (*leafDepth && *leafDepth != depth + 1) {
+                return false;
+            }
+            *leafDepth = depth + 1;
+            if (*prevLeaf ? (*prevLeaf)->next != leaf : leaf != _firstLeaf) {
+                return false;
+            }
+            *prevLeaf = leaf;
+            *numItems += leaf->numKeys;
+            for (size_t i = 0; i < leaf->numKeys; i++) {
+                if ((i && !(leaf->keys[i - 1] < leaf->keys[i])) ||
+                    (lo && leaf->keys[i] < *lo) ||
+                    (hi && !(leaf->keys[i] < *hi))) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        Inner *inner = static_cast<Inner *>(node);
+        if (inner->numKeys > INNER_CAPACITY || !inner->numKeys ||
+            (!isRoot && inner->numKeys < INNER_MIN)) {
+            return false;
+        }
+        for (size_t i = 0; i <= inner->numKeys; i++) {
+            if (i < inner->numKeys &&
+                ((i && !(inner->keys[i - 1] < inner->keys[i])) ||
+                 (lo && inner->keys[i] < *lo) ||
+                 (hi && !(inner->keys[i] < *hi)))) {
+                return false;
+            }
+            if (!_ValidateSubtree(inner->children[i],
+                                  i ? &inner->keys[i - 1] : lo,
+                                  i < inner->numKeys ? &inner->keys[i] : hi,
+                                  depth + 1, leafDepth, prevLeaf, numItems)) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+template <typename K, typename V, class AllocatorT, size_t NodeSize>
+constexpr inline BTreeMap<K, V, AllocatorT, NodeSize> &
+object(BTreeMap<K, V, AllocatorT, NodeSize> &obj)
+{
+    return obj;
+}
+
+template <typename K, typename V, class AllocatorT, size_t NodeSize>
+constexpr inline BTreeMap<K, V, AllocatorT, NodeSize> &&
+object(BTreeMap<K, V, AllocatorT, NodeSize> &&obj)
+{
+    return static_cast<BTreeMap<K, V, AllocatorT, NodeSize> &&>(obj);
+}
+
+} /* namespace triton */
+
+#endif /* BTREE_MAP_H_ */
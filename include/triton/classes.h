@@ -60,6 +60,22 @@ class Tuple;
 template <typename T, class AllocatorT>
 class List;
 
+/** Ordered map implemented as B+ tree. Keys of type @a K are mapped to values
+ * of type @a V.
+ */
+template <typename K, typename V, class AllocatorT, size_t NodeSize>
+class BTreeMap;
+
+/** Unordered map implemented as hash table. Keys of type @a K are mapped to
+ * values of type @a V.
+ */
+template <typename K, typename V, class AllocatorT>
+class Dict;
+
+/** Unordered set of unique values of type @a K implemented as hash table. */
+template <typename K, class AllocatorT>
+class Set;
+
 namespace triton_internal {
 
 template <typename T>
@@ -107,6 +123,21 @@ struct is_triton_obj_impl<List<T, Allocator>> {
     static const bool value = true;
 };
 
+template <typename K, typename V, typename Allocator, size_t NodeSize>
+struct is_triton_obj_impl<BTreeMap<K, V, Allocator, NodeSize>> {
+    static const bool value = true;
+};
+
+template <typename K, typename V, typename Allocator>
+struct is_triton_obj_impl<Dict<K, V, Allocator>> {
+    static const bool value = true;
+};
+
+template <typename K, typename Allocator>
+struct is_triton_obj_impl<Set<K, Allocator>> {
+    static const bool value = true;
+};
+
 } /* namespace triton_internal */
 
 /** Check if provided type is Triton object class. */
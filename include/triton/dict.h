@@ -0,0 +1,259 @@
+/*
+ * /phoenix/include/triton/dict.h
+ *
+ * This file is a part of Phoenix operating system.
+ * Copyright (c) 2011-2012, Artyom Lebedev <artyom.lebedev@gmail.com>
+ * All rights reserved.
+ * See COPYING file for copyright details.
+ */
+
+/** @file dict.h
+ * Triton dictionary implementation.
+ */
+
+#ifndef DICT_H_
+#define DICT_H_
+
+namespace triton {
+
+/** Unordered map implemented as open addressing hash table (see
+ * @ref triton_internal::HashTable). Lookups take constant expected time and
+ * usually touch one group of control bytes and one slot. @n
+ *
+ * Keys are hashed by @ref hash function, so they should be either Triton
+ * objects with meaningful @a __hash__ method or types convertible to such
+ * objects (e.g. numeric types). Keys are compared by equality operator. Keys
+ * and values should be default constructible and assignable. Insertions may
+ * rehash the table which invalidates references to keys and values and all
+ * iterators. Iteration order is not defined.
+ *
+ * @param K Type of keys.
+ * @param V Type of values.
+ * @param AllocatorT Allocator which is rebound for the table allocation.
+ */
+template <typename K, typename V, class AllocatorT = Allocator<K>>
+class Dict: public Object, public Iterable<K> {
+private:
+    class Item {
+    public:
+        K key;
+        V value;
+    };
+
+    typedef triton_internal::HashTable<Item, K, AllocatorT> Table;
+
+    Table _table;
+
+public:
+    /** Type of keys. */
+    typedef K KeyType;
+    /** Type of values mapped to the keys. */
+    typedef V MappedType;
+
+    inline
+    Dict() {}
+
+    /** Copy constructor. */
+    inline
+    Dict(const Dict &dict) : _table(dict._table) {}
+
+    /** Move constructor. */
+    inline
+    Dict(Dict &&dict) : _table(move(dict._table)) {}
+
+    /** Copy assignment. */
+    inline Dict &
+    operator =(const Dict &dict)
+    {
+        _table = dict._table;
+        return *this;
+    }
+
+    /** Move assignment. */
+    inline Dict &
+    operator =(Dict &&dict)
+    {
+        _table = move(dict._table);
+        return *this;
+    }
+
+    virtual const char *
+    __name__() const
+    {
+        return "Dict";
+    }
+
+    virtual size_t
+    __len__() const
+    {
+        return _table.GetSize();
+    }
+
+    /** Iterate over all keys. */
+    virtual
+    Iterator<K>
+    __iter__(bool endIterator = false) const
+    {
+        Iterator<K> it;
+        if (endIterator) {
+            return it;
+        }
+        it.template Assign<typename Table::template SlotIterator<K, &Item::key>>(
+            &_table);
+        return it;
+    }
+
+    /** Check if the dictionary contains the key. */
+    bool
+    __contains__(const K &key) const
+    {
+        return _table.Find(key) != nullptr;
+    }
+
+    /** Get value by the key. @ref KeyError is thrown if the key is not
+     * found.
+     */
+    V &
+    operator [](const K &key) const
+    {
+        Item *item = _table.Find(key);
+        if (!item) {
+            throw KeyError();
+        }
+        return item->value;
+    }
+
+    /** Set value for the key. Existing value is replaced. */
+    void
+    __setitem__(const K &key, const V &value)
+    {
+        bool inserted;
+        _table.Insert(key, &inserted)->value = value;
+    }
+
+    /** Delete item by the key. @ref KeyError is thrown if the key is not
+     * found.
+     */
+    void
+    __delitem__(const K &key)
+    {
+        if (!_table.Erase(key)) {
+            throw KeyError();
+        }
+    }
+
+    /** Get value by the key.
+     *
+     * @param key Key to look for.
+     * @param defValue Value to return if the key is not found.
+     * @return Copy of the found value or @a defValue.
+     */
+    V
+    get(const K &key, const V &defValue = V()) const
+    {
+        Item *item = _table.Find(key);
+        return item ? item->value : defValue;
+    }
+
+    /** Get value by the key, insert the provided value if not found.
+     *
+     * @param key Key to look for.
+     * @param defValue Value to insert if the key is not found.
+     * @return Reference to the value in the dictionary.
+     */
+    V &
+    setdefault(const K &key, const V &defValue = V())
+    {
+        bool inserted;
+        Item *item = _table.Insert(key, &inserted);
+        if (inserted) {
+            item->value = defValue;
+        }
+        return item->value;
+    }
+
+    /** Remove item from the dictionary and return its value. @ref KeyError is
+     * thrown if the key is not found.
+     */
+    V
+    pop(const K &key)
+    {
+        Item item;
+        if (!_table.Erase(key, &item)) {
+            throw KeyError();
+        }
+        return move(item.value);
+    }
+
+    /** Remove item from the dictionary and return its value.
+     *
+     * @param key Key to look for.
+     * @param defValue Value to return if the key is not found.
+     * @return Removed value or @a defValue.
+     */
+    V
+    pop(const K &key, const V &defValue)
+    {
+        Item item;
+        if (!_table.Erase(key, &item)) {
+            return defValue;
+        }
+        return move(item.value);
+    }
+
+    /** Remove all items. */
+    void
+    clear()
+    {
+        _table.Clear();
+    }
+
+    /** Iterate over all values. Values are iterated in the same order as
+     * keys by @ref __iter__.
+     */
+    Iterator<V>
+    values() const
+    {
+        Iterator<V> it;
+        it.template Assign<typename Table::template SlotIterator<V, &Item::value>>(
+            &_table);
+        return it;
+    }
+
+    /** Preallocate space for the specified number of items so that they
+     * can be inserted without rehashing.
+     */
+    void
+    Reserve(size_t numItems)
+    {
+        _table.Reserve(numItems);
+    }
+
+    /** Validate the table structure. Intended for debugging and testing.
+     *
+     * @return @a true if the table is valid, @a false otherwise.
+     */
+    bool
+    Validate() const
+    {
+        return _table.Validate();
+    }
+};
+
+template <typename K, typename V, class AllocatorT>
+constexpr inline Dict<K, V, AllocatorT> &
+object(Dict<K, V, AllocatorT> &obj)
+{
+    return obj;
+}
+
+template <typename K, typename V, class AllocatorT>
+constexpr inline Dict<K, V, AllocatorT> &&
+object(Dict<K, V, AllocatorT> &&obj)
+{
+    return static_cast<Dict<K, V, AllocatorT> &&>(obj);
+}
+
+} /* namespace triton */
+
+#endif /* DICT_H_ */
@@ -0,0 +1,536 @@
+/*
+ * /phoenix/include/triton/hash_table.h
+ *
+ * This file is a part of Phoenix operating system.
+ * Copyright (c) 2011-2012, Artyom Lebedev <artyom.lebedev@gmail.com>
+ * All rights reserved.
+ * See COPYING file for copyright details.
+ */
+
+/** @file hash_table.h
+ * Open addressing hash table which is the back-end for Triton dictionaries
+ * and sets.
+ */
+
+#ifndef HASH_TABLE_H_
+#define HASH_TABLE_H_
+
+namespace triton {
+
+namespace triton_internal {
+
+/** Group of hash table control bytes which are probed at once. Each slot of
+ * the table has one control byte which tells whether the slot is empty,
+ * deleted or full. Full slots store seven low bits of the key hash in the
+ * control byte, so the group is matched against the key with a single SIMD
+ * comparison and the keys are compared only for matched slots.
+ */
+class HashGroup {
+public:
+    enum: size_t {
+        /** Number of control bytes in a group. */
+        SIZE = 16,
+    };
+
+    /** Control bytes values for non-full slots. Both have the highest bit
+     * set, full slots have it cleared.
+     */
+    enum: i8 {
+        /** Slot was never used since the last rehash. */
+        EMPTY = -128,
+        /** Slot was used, probing should continue past it. */
+        DELETED = -2,
+    };
+
+    /** Load group of control bytes. Control bytes array is not required to
+     * be aligned.
+     */
+    inline
+    HashGroup(const i8 *ctrl) :
+        _ctrl(*reinterpret_cast<const Vector *>(ctrl)) {}
+
+    /** Match full slots with the provided hash bits.
+     *
+     * @return Bitmask of matched slots.
+     */
+    inline u32
+    Match(i8 h2) const
+    {
+        return _Mask(_ctrl == _Splat(h2));
+    }
+
+    /** Match empty slots.
+     *
+     * @return Bitmask of matched slots.
+     */
+    inline u32
+    MatchEmpty() const
+    {
+        return _Mask(_ctrl == _Splat(EMPTY));
+    }
+
+    /** Match slots which are either empty or deleted.
+     *
+     * @return Bitmask of matched slots.
+     */
+    inline u32
+    MatchFree() const
+    {
+        return _Mask(_ctrl < _Splat(0));
+    }
+
+    /** Match full slots.
+     *
+     * @return Bitmask of matched slots.
+     */
+    inline u32
+    MatchFull() const
+    {
+        return MatchFree() ^ ((1u << SIZE) - 1);
+    }
+
+private:
+    typedef i8 Vector __attribute__((vector_size(SIZE), aligned(1)));
+    /** Comparison result, matched bytes have all bits set. */
+    typedef char Mask __attribute__((vector_size(SIZE)));
+
+    static_assert(static_cast<i8>(-1) < 0, "Control bytes should be signed");
+
+    Vector _ctrl;
+
+    static inline Vector
+    _Splat(i8 value)
+    {
+        Vector v;
+        for (size_t i = 0; i < SIZE; i++) {
+            v[i] = value;
+        }
+        return v;
+    }
+
+    /** Convert comparison result to bitmask. */
+    static inline u32
+    _Mask(Mask v)
+    {
+#ifdef __SSE2__
+        return __builtin_ia32_pmovmskb128(v);
+#else /* __SSE2__ */
+        u32 mask = 0;
+        for (size_t i = 0; i < SIZE; i++) {
+            mask |= (v[i] & 1) << i;
+        }
+        return mask;
+#endif /* __SSE2__ */
+    }
+};
+
+/** Hash table with open addressing. Slots and their control bytes are stored
+ * in two flat arrays, the table capacity is a power of two. Probing is done by
+ * groups of @ref HashGroup::SIZE slots, groups are visited in triangular
+ * sequence which covers all groups of the table. Deleted slots are marked
+ * with tombstones which are purged on rehash. The table is grown when it is
+ * 7/8 full including tombstones, so there are always empty slots which stop
+ * unsuccessful lookups. @n
+ *
+ * Keys are hashed by @ref hash function and compared by equality operator.
+ * Slots should be default constructible and assignable since slots array is
+ * preconstructed. Free slots hold default constructed values.
+ *
+ * @param Slot Type of slot. It should have @a key member.
+ * @param K Type of keys.
+ * @param AllocatorT Allocator which is rebound for arrays allocation.
+ */
+template <class Slot, typename K, class AllocatorT>
+class HashTable {
+public:
+    /** Iterator over the table slots. Yields the specified member of each
+     * full slot.
+     */
+    template <typename T, T Slot::*member>
+    class SlotIterator: public IteratorImpl<T> {
+    private:
+        const HashTable *_table;
+        size_t _pos;
+    public:
+        SlotIterator(const HashTable *table) :
+            _table(table), _pos(table->_NextFull(0))
+        {
+            this->_hasNext = _pos < _table->_capacity;
+        }
+
+        virtual
+        T &
+        __next__()
+        {
+            if (!this->_hasNext) {
+                throw StopIteration();
+            }
+            T &item = _table->_slots[_pos].*member;
+            _pos = _table->_NextFull(_pos + 1);
+            this->_hasNext = _pos < _table->_capacity;
+            return item;
+        }
+    };
+
+    inline
+    HashTable() {}
+
+    /** Copy constructor. The copy has the same capacity and layout. */
+    HashTable(const HashTable &table)
+    {
+        _CopyFrom(table);
+    }
+
+    /** Move constructor. */
+    HashTable(HashTable &&table)
+    {
+        _MoveFrom(table);
+    }
+
+    inline
+    ~HashTable()
+    {
+        Clear();
+    }
+
+    HashTable &
+    operator =(const HashTable &table)
+    {
+        if (&table != this) {
+            Clear();
+            _CopyFrom(table);
+        }
+        return *this;
+    }
+
+    HashTable &
+    operator =(HashTable &&table)
+    {
+        if (&table != this) {
+            Clear();
+            _MoveFrom(table);
+        }
+        return *this;
+    }
+
+    /** Get number of items in the table. */
+    inline size_t
+    GetSize() const
+    {
+        return _size;
+    }
+
+    /** Get number of slots in the table. */
+    inline size_t
+    GetCapacity() const
+    {
+        return _capacity;
+    }
+
+    /** Find slot by the key.
+     *
+     * @return Pointer to the slot, null if not found.
+     */
+    Slot *
+    Find(const K &key) const
+    {
+        if (!_size) {
+            return nullptr;
+        }
+        hash_t h = hash(key);
+        i8 h2 = _H2(h);
+        size_t groupMask = _capacity / HashGroup::SIZE - 1;
+        size_t group = _H1(h) & groupMask;
+        for (size_t step = 1; ; step++) {
+            size_t base = group * HashGroup::SIZE;
+            HashGroup g(&_ctrl[base]);
+            for (u32 mask = g.Match(h2); mask; mask &= mask - 1) {
+                Slot *slot = &_slots[base + __builtin_ctz(mask)];
+                if (slot->key == key) {
+                    return slot;
+                }
+            }
+            if (g.MatchEmpty()) {
+                return nullptr;
+            }
+            group = (group + step) & groupMask;
+        }
+    }
+
+    /** Find slot by the key or allocate new one if not found.
+     *
+     * @param key Key to look for.
+     * @param inserted Set to @a true if new slot allocated, @a false if
+     *      existing one found.
+     * @return Slot for the key. New slot has the key set and default value
+     *      in other members.
+     */
+    Slot *
+    Insert(const K &key, bool *inserted)
+    {
+        Slot *slot = Find(key);
+        if (slot) {
+            *inserted = false;
+            return slot;
+        }
+        *inserted = true;
+        if (!_capacity) {
+            _Rehash(1);
+        }
+        hash_t h = hash(key);
+        size_t idx = _FindFree(h);
+        if (!_growthLeft && _ctrl[idx] == HashGroup::EMPTY) {
+            _Rehash(_size + 1);
+            idx = _FindFree(h);
+        }
+        if (_ctrl[idx] == HashGroup::EMPTY) {
+            _growthLeft--;
+        }
+        _ctrl[idx] = _H2(h);
+        _size++;
+        slot = &_slots[idx];
+        slot->key = key;
+        return slot;
+    }
+
+    /** Delete item from the table.
+     *
+     * @param key Key of the item to delete.
+     * @param removed Content of the deleted slot is moved there if not null.
+     * @return @a true if the item was deleted, @a false if not found.
+     */
+    bool
+    Erase(const K &key, Slot *removed = nullptr)
+    {
+        Slot *slot = Find(key);
+        if (!slot) {
+            return false;
+        }
+        size_t idx = slot - _slots;
+        if (removed) {
+            *removed = move(*slot);
+        }
+        /* Do not keep references in the released slot. */
+        *slot = Slot();
+        _size--;
+        /* If the group has empty slots then all probes stop in this group,
+         * so the slot can be made empty instead of a tombstone.
+         */
+        HashGroup g(&_ctrl[idx & ~(HashGroup::SIZE - 1)]);
+        if (g.MatchEmpty()) {
+            _ctrl[idx] = HashGroup::EMPTY;
+            _growthLeft++;
+        } else {
+            _ctrl[idx] = HashGroup::DELETED;
+        }
+        return true;
+    }
+
+    /** Remove all items and release the table memory. */
+    void
+    Clear()
+    {
+        if (_capacity) {
+            _slotAlloc.FreeArray(_slots);
+            _ctrlAlloc.FreeArray(_ctrl);
+        }
+        _slots = nullptr;
+        _ctrl = nullptr;
+        _capacity = 0;
+        _size = 0;
+        _growthLeft = 0;
+    }
+
+    /** Ensure the table can hold the specified number of items without
+     * rehashing.
+     */
+    void
+    Reserve(size_t numItems)
+    {
+        if (numItems > _size + _growthLeft) {
+            _Rehash(numItems);
+        }
+    }
+
+    /** Validate the table structure. Intended for debugging and testing.
+     *
+     * @return @a true if the table is valid, @a false otherwise.
+     */
+    bool
+    Validate() const
+    {
+        if (!_capacity) {
+            return !_size && !_growthLeft;
+        }
+        if (_capacity % HashGroup::SIZE || (_capacity & (_capacity - 1))) {
+            return false;
+        }
+        size_t numFull = 0, numDeleted = 0;
+        for (size_t idx = 0; idx < _capacity; idx++) {
+            if (_ctrl[idx] == HashGroup::DELETED) {
+                numDeleted++;
+                continue;
+            }
+            if (_ctrl[idx] < 0) {
+                if (_ctrl[idx] != HashGroup::EMPTY) {
+                    return false;
+                }
+                continue;
+            }
+            numFull++;
+            if (_ctrl[idx] != _H2(hash(_slots[idx].key)) ||
+                Find(_slots[idx].key) != &_slots[idx]) {
+                return false;
+            }
+        }
+        return numFull == _size &&
+               _size + numDeleted + _growthLeft == _MaxLoad(_capacity);
+    }
+
+private:
+    typedef Object::hash_t hash_t;
+    typedef typename AllocatorT::template Rebind<Slot> SlotAllocator;
+    typedef typename AllocatorT::template Rebind<i8> CtrlAllocator;
+
+    SlotAllocator _slotAlloc;
+    CtrlAllocator _ctrlAlloc;
+    Slot *_slots = nullptr;
+    i8 *_ctrl = nullptr;
+    /** Number of slots, power of two, zero if no memory allocated. */
+    size_t _capacity = 0;
+    /** Number of full slots. */
+    size_t _size = 0;
+    /** Number of empty slots which can be filled before rehash. */
+    size_t _growthLeft = 0;
+
+    /** Hash bits which select the first group to probe. */
+    static inline size_t
+    _H1(hash_t h)
+    {
+        return h >> 7;
+    }
+
+    /** Hash bits which are stored in the control byte. */
+    static inline i8
+    _H2(hash_t h)
+    {
+        return h & 0x7f;
+    }
+
+    /** Maximal number of full and deleted slots for the capacity. */
+    static inline size_t
+    _MaxLoad(size_t capacity)
+    {
+        return capacity - capacity / 8;
+    }
+
+    /** Find the first free slot in the probe sequence for the hash. */
+    size_t
+    _FindFree(hash_t h) const
+    {
+        size_t groupMask = _capacity / HashGroup::SIZE - 1;
+        size_t group = _H1(h) & groupMask;
+        for (size_t step = 1; ; step++) {
+            size_t base = group * HashGroup::SIZE;
+            u32 mask = HashGroup(&_ctrl[base]).MatchFree();
+            if (mask) {
+                return base + __builtin_ctz(mask);
+            }
+            group = (group + step) & groupMask;
+        }
+    }
+
+    /** Find the first full slot starting from the provided position.
+     *
+     * @return Slot index, the table capacity if not found.
+     */
+    size_t
+    _NextFull(size_t pos) const
+    {
+        while (pos < _capacity) {
+            size_t base = pos & ~(HashGroup::SIZE - 1);
+            u32 mask = HashGroup(&_ctrl[base]).MatchFull() &
+                       (~0u << (pos - base));
+            if (mask) {
+                return base + __builtin_ctz(mask);
+            }
+            pos = base + HashGroup::SIZE;
+        }
+        return _capacity;
+    }
+
+    /** Reallocate the table so that it can hold the specified number of items
+     * and still has at least half of its load reserve free. Tombstones are
+     * purged.
+     */
+    void
+    _Rehash(size_t numItems)
+    {
+        size_t capacity = HashGroup::SIZE;
+        while (_MaxLoad(capacity) < numItems * 2) {
+            capacity *= 2;
+        }
+        Slot *slots = _slots;
+        i8 *ctrl = _ctrl;
+        size_t oldCapacity = _capacity;
+        _slots = _slotAlloc.AllocateArray(capacity);
+        _ctrl = _ctrlAlloc.AllocateArray(capacity);
+        memset(_ctrl, HashGroup::EMPTY, capacity);
+        _capacity = capacity;
+        _growthLeft = _MaxLoad(capacity) - _size;
+        for (size_t idx = 0; idx < oldCapacity; idx++) {
+            if (ctrl[idx] < 0) {
+                continue;
+            }
+            size_t newIdx = _FindFree(hash(slots[idx].key));
+            _ctrl[newIdx] = ctrl[idx];
+            _slots[newIdx] = move(slots[idx]);
+        }
+        if (oldCapacity) {
+            _slotAlloc.FreeArray(slots);
+            _ctrlAlloc.FreeArray(ctrl);
+        }
+    }
+
+    /** Copy all items from another table. */
+    void
+    _CopyFrom(const HashTable &table)
+    {
+        if (!table._capacity) {
+            return;
+        }
+        _slots = _slotAlloc.AllocateArray(table._capacity);
+        _ctrl = _ctrlAlloc.AllocateArray(table._capacity);
+        memcpy(_ctrl, table._ctrl, table._capacity);
+        for (size_t idx = 0; idx < table._capacity; idx++) {
+            if (_ctrl[idx] >= 0) {
+                _slots[idx] = table._slots[idx];
+            }
+        }
+        _capacity = table._capacity;
+        _size = table._size;
+        _growthLeft = table._growthLeft;
+    }
+
+    /** Take all items from another table. */
+    void
+    _MoveFrom(HashTable &table)
+    {
+        _slots = table._slots;
+        _ctrl = table._ctrl;
+        _capacity = table._capacity;
+        _size = table._size;
+        _growthLeft = table._growthLeft;
+        table._slots = nullptr;
+        table._ctrl = nullptr;
+        table._capacity = 0;
+        table._size = 0;
+        table._growthLeft = 0;
+    }
+};
+
+} /* namespace triton_internal */
+
+} /* namespace triton */
+
+#endif /* HASH_TABLE_H_ */
@@ -18,6 +18,45 @@ namespace triton {
 
 namespace triton_internal {
 
+/** Get hash value of an integral number. The value is extended to 64 bits
+ * before hashing so that equal values of different integral types have equal
+ * hashes.
+ */
+template <typename T>
+inline enable_if<is_integral<T>(), Object::hash_t>
+HashNumeric(T value)
+{
+    u64 v = static_cast<u64>(value);
+    Hash h;
+    h.Feed(&v, sizeof(v));
+    return h.Get64();
+}
+
+/** Get hash value of a floating point number. Numbers with integral values
+ * are hashed as integers so that, for example, 2.0 and 2 have equal hashes.
+ * This also gives equal hashes to positive and negative zeros.
+ */
+template <typename T>
+inline enable_if<is_float<T>(), Object::hash_t>
+HashNumeric(T value)
+{
+    if (value > -9.2e18 && value < 9.2e18) {
+        i64 i = static_cast<i64>(value);
+        if (static_cast<T>(i) == value) {
+            return HashNumeric(i);
+        }
+    }
+    union {
+        double value;
+        u64 bits;
+    } v;
+    v.value = value;
+    /* Different salt to not collide with integers. */
+    Hash h(1);
+    h.Feed(&v.bits, sizeof(v.bits));
+    return h.Get64();
+}
+
 /** Class which represents generic numeric value, both integer and floating
  * point.
  */
@@ -48,7 +87,7 @@ public:
     virtual hash_t
     __hash__() const
     {
-        return _v.hash;
+        return HashNumeric(_v.value);
     }
 
     inline
@@ -105,6 +105,12 @@ object(Object &&obj)
     return static_cast<Object &&>(obj);
 }
 
+inline const Object &
+object(const Object &obj)
+{
+    return obj;
+}
+
 } /* namespace triton */
 
 #endif /* OBJECT_H_ */
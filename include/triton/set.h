@@ -0,0 +1,174 @@
+/*
+ * /phoenix/include/triton/set.h
+ *
+ * This file is a part of Phoenix operating system.
+ * Copyright (c) 2011-2012, Artyom Lebedev <artyom.lebedev@gmail.com>
+ * All rights reserved.
+ * See COPYING file for copyright details.
+ */
+
+/** @file set.h
+ * Triton set implementation.
+ */
+
+#ifndef SET_H_
+#define SET_H_
+
+namespace triton {
+
+/** Unordered set of unique values implemented as open addressing hash table
+ * (see @ref triton_internal::HashTable). Requirements for the values are the
+ * same as for @ref Dict keys. Insertions invalidate references to the values
+ * and all iterators. Iteration order is not defined.
+ *
+ * @param K Type of values.
+ * @param AllocatorT Allocator which is rebound for the table allocation.
+ */
+template <typename K, class AllocatorT = Allocator<K>>
+class Set: public Object, public Iterable<K> {
+private:
+    class Item {
+    public:
+        K key;
+    };
+
+    typedef triton_internal::HashTable<Item, K, AllocatorT> Table;
+
+    Table _table;
+
+public:
+    inline
+    Set() {}
+
+    /** Copy constructor. */
+    inline
+    Set(const Set &set) : _table(set._table) {}
+
+    /** Move constructor. */
+    inline
+    Set(Set &&set) : _table(move(set._table)) {}
+
+    /** Copy assignment. */
+    inline Set &
+    operator =(const Set &set)
+    {
+        _table = set._table;
+        return *this;
+    }
+
+    /** Move assignment. */
+    inline Set &
+    operator =(Set &&set)
+    {
+        _table = move(set._table);
+        return *this;
+    }
+
+    virtual const char *
+    __name__() const
+    {
+        return "Set";
+    }
+
+    virtual size_t
+    __len__() const
+    {
+        return _table.GetSize();
+    }
+
+    /** Iterate over all values. */
+    virtual
+    Iterator<K>
+    __iter__(bool endIterator = false) const
+    {
+        Iterator<K> it;
+        if (endIterator) {
+            return it;
+        }
+        it.template Assign<typename Table::template SlotIterator<K, &Item::key>>(
+            &_table);
+        return it;
+    }
+
+    /** Check if the set contains the value. */
+    bool
+    __contains__(const K &value) const
+    {
+        return _table.Find(value) != nullptr;
+    }
+
+    /** Add value to the set. Nothing is done if the value is already
+     * present.
+     */
+    void
+    add(const K &value)
+    {
+        bool inserted;
+        _table.Insert(value, &inserted);
+    }
+
+    /** Remove value from the set. @ref KeyError is thrown if the value is not
+     * present.
+     */
+    void
+    remove(const K &value)
+    {
+        if (!_table.Erase(value)) {
+            throw KeyError();
+        }
+    }
+
+    /** Remove value from the set if it is present.
+     *
+     * @return @a true if the value was removed, @a false if not present.
+     */
+    bool
+    discard(const K &value)
+    {
+        return _table.Erase(value);
+    }
+
+    /** Remove all values. */
+    void
+    clear()
+    {
+        _table.Clear();
+    }
+
+    /** Preallocate space for the specified number of values so that they
+     * can be inserted without rehashing.
+     */
+    void
+    Reserve(size_t numItems)
+    {
+        _table.Reserve(numItems);
+    }
+
+    /** Validate the table structure. Intended for debugging and testing.
+     *
+     * @return @a true if the table is valid, @a false otherwise.
+     */
+    bool
+    Validate() const
+    {
+        return _table.Validate();
+    }
+};
+
+template <typename K, class AllocatorT>
+constexpr inline Set<K, AllocatorT> &
+object(Set<K, AllocatorT> &obj)
+{
+    return obj;
+}
+
+template <typename K, class AllocatorT>
+constexpr inline Set<K, AllocatorT> &&
+object(Set<K, AllocatorT> &&obj)
+{
+    return static_cast<Set<K, AllocatorT> &&>(obj);
+}
+
+} /* namespace triton */
+
+#endif /* SET_H_ */
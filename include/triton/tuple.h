@@ -56,6 +56,10 @@ public:
     /** Type of base class for this one. */
     typedef TupleStorage<components...> BaseType;
 
+    /** Construct tuple storage with default constructed values. */
+    inline
+    TupleStorage() : BaseType(), value() {}
+
     /** Construct tuple storage from provided values. */
     inline
     TupleStorage(add_const_reference<T> firstValue,
@@ -76,14 +80,22 @@ public:
         return TupleGetter<idx - 1, components...>::Get(stg);
     }
 
-    static inline Object::hash_t
-    __hash__(const TupleStorage<T, components...> &stg)
+    /** Feed hashes of the components to the hash calculator. */
+    static inline void
+    FeedHash(const TupleStorage<T, components...> &stg, Hash &h)
+    {
+        Object::hash_t value = hash(stg.value);
+        h.Feed(&value, sizeof(value));
+        TupleGetter<idx - 1, components...>::FeedHash(stg, h);
+    }
+
+    /** Check if all components of two tuples are equal. */
+    static inline bool
+    Equals(const TupleStorage<T, components...> &stg1,
+           const TupleStorage<T, components...> &stg2)
     {
-        u32 h1 = TupleGetter<idx - 1, components...>::__hash__(stg);
-        u32 h2 = hash(stg.value);
-        u32 h3 = idx;
-        Hash::Mix(h1, h2, h3);
-        return static_cast<Object::hash_t>(h2) << 32 | h3;
+        return stg1.value == stg2.value &&
+               TupleGetter<idx - 1, components...>::Equals(stg1, stg2);
     }
 };
 
@@ -96,10 +108,18 @@ public:
         return stg.value;
     }
 
-    static inline Object::hash_t
-    __hash__(const TupleStorage<T, components...> &stg)
+    static inline void
+    FeedHash(const TupleStorage<T, components...> &stg, Hash &h)
     {
-        return hash(stg.value);
+        Object::hash_t value = hash(stg.value);
+        h.Feed(&value, sizeof(value));
+    }
+
+    static inline bool
+    Equals(const TupleStorage<T, components...> &stg1,
+           const TupleStorage<T, components...> &stg2)
+    {
+        return stg1.value == stg2.value;
     }
 };
 
@@ -120,6 +140,10 @@ public:
     template <int idx>
     using Type = triton_internal::TupleType<idx, components...>;
 
+    /** Construct tuple with default constructed components. */
+    inline
+    Tuple() {}
+
     inline
     Tuple(components... values) : _values(values...) {}
 
@@ -155,13 +179,31 @@ public:
         return triton_internal::TupleGetter<idx, components...>::Get(_values);
     }
 
-    /** Get hash value for a tuple. */
-    virtual Object::hash_t
-    __hash__() const
+    /** Tuples are equal if all their components are equal. */
+    inline bool
+    operator ==(const Tuple<components...> &t) const
     {
         return triton_internal::
                TupleGetter<sizeof...(components) - 1, components...>::
-               __hash__(_values);
+               Equals(_values, t._values);
+    }
+
+    inline bool
+    operator !=(const Tuple<components...> &t) const
+    {
+        return !(*this == t);
+    }
+
+    /** Get hash value for a tuple. Hashes of all components are combined,
+     * so the result depends on the components order.
+     */
+    virtual Object::hash_t
+    __hash__() const
+    {
+        Hash h;
+        triton_internal::TupleGetter<sizeof...(components) - 1, components...>::
+            FeedHash(_values, h);
+        return h.Get64();
     }
 };
 
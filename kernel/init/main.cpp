@@ -58,6 +58,99 @@ MT_AllocOnInitialized()
     return true;
 }
 
+static bool
+MT_KmemSlab()
+{
+    /* Mix of sizes which hit all size classes and large allocations. */
+    const size_t numBlocks = 512;
+    u8 *blocks[numBlocks];
+    size_t sizes[numBlocks];
+    for (int pass = 0; pass < 2; pass++) {
+        for (size_t i = 0; i < numBlocks; i++) {
+            sizes[i] = (i * 37 + pass * 11) % 2100 + 1;
+            if (i % 64 == 0) {
+                sizes[i] += 3 * vm::PAGE_SIZE;
+            }
+            size_t align = 1 << (i % 8);
+            blocks[i] = NEW_ALIGNED(align) u8[sizes[i]];
+            if (!blocks[i]) {
+                return false;
+            }
+            if (!vm::Vaddr(blocks[i]).IsAligned(align)) {
+                return false;
+            }
+            memset(blocks[i], i & 0xff, sizes[i]);
+        }
+        /* Free every second block and verify the rest are intact. */
+        for (size_t i = 0; i < numBlocks; i += 2) {
+            DELETE [] blocks[i];
+        }
+        for (size_t i = 1; i < numBlocks; i += 2) {
+            for (size_t j = 0; j < sizes[i]; j++) {
+                if (blocks[i][j] != (i & 0xff)) {
+                    return false;
+                }
+            }
+            DELETE [] blocks[i];
+        }
+    }
+    return true;
+}
+
+static bool
+MT_PhysZones()
+{
+    using namespace vm;
+    const PhysZone::Policy policies[] = {
+        PhysZone::POLICY_DMA32, PhysZone::POLICY_NORMAL, PhysZone::POLICY_HIGH
+    };
+    for (PhysZone::Policy policy: policies) {
+        Page *page = mm->AllocatePages(4, policy);
+        if (!page) {
+            /* High memory may be absent. */
+            if (policy == PhysZone::POLICY_HIGH) {
+                continue;
+            }
+            return false;
+        }
+        Paddr pa = page->GetPaddr();
+        PhysZone *zone = mm->GetZone(pa);
+        if (!zone || !zone->Matches(policy) || &mm->GetPage(pa) != page) {
+            return false;
+        }
+        memset(mm->PhysToVirt(pa), 0x42, 4 * PAGE_SIZE);
+        mm->FreePages(page);
+    }
+    return true;
+}
+
+static bool
+MT_PageOps()
+{
+    using namespace vm;
+    Page *page = mm->AllocatePages(4);
+    if (!page) {
+        return false;
+    }
+    u8 *p = mm->PhysToVirt(page->GetPaddr());
+    memset(p, 0x42, 4 * PAGE_SIZE);
+    ZeroPages(Vaddr(p), 2);
+    Vaddr pages[] = { Vaddr(p + 3 * PAGE_SIZE) };
+    ZeroPages(pages, 1);
+    for (size_t i = 0; i < 4 * PAGE_SIZE; i++) {
+        if (p[i] != (i / PAGE_SIZE == 2 ? 0x42 : 0)) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < PAGE_SIZE; i++) {
+        p[2 * PAGE_SIZE + i] = i;
+    }
+    CopyPage(Vaddr(p), Vaddr(p + 2 * PAGE_SIZE));
+    bool ok = !memcmp(p, p + 2 * PAGE_SIZE, PAGE_SIZE);
+    mm->FreePages(page);
+    return ok;
+}
+
 static bool
 MT_RwLocks()
 {
@@ -81,6 +174,143 @@ MT_RwLocks()
     return true;
 }
 
+static bool
+MT_PageRadixTree()
+{
+    using namespace vm;
+    const size_t numItems = 1024;
+    const PageIdx bigIdx = static_cast<PageIdx>(1) << 40;
+    PageRadixTree<Page> tree;
+    Page *pages = NEW Page[numItems];
+    if (!pages || tree.Initialize(1).IsFailed()) {
+        return false;
+    }
+    /* Sparse indices - dense run at the start and a few far ones. */
+    for (size_t i = 0; i < numItems; i++) {
+        PageIdx idx = i < numItems / 2 ? i : bigIdx + i * 977;
+        if (tree.Insert(idx, &pages[i]).IsFailed()) {
+            return false;
+        }
+    }
+    if (tree.Insert(0, &pages[0]).IsOk() || tree.GetSize() != numItems ||
+        !tree.Validate()) {
+        return false;
+    }
+    tree.ReadBegin(0);
+    bool found = tree.Lookup(5) == &pages[5] &&
+                 tree.Lookup(bigIdx + 600 * 977) == &pages[600] &&
+                 !tree.Lookup(numItems) && !tree.Lookup(bigIdx + 1) &&
+                 tree.Lookup(Paddr(7 * PAGE_SIZE + 1)) == &pages[7];
+    tree.ReadEnd(0);
+    if (!found) {
+        return false;
+    }
+
+    /* Tag every third item. */
+    for (size_t i = 0; i < numItems; i += 3) {
+        PageIdx idx = i < numItems / 2 ? i : bigIdx + i * 977;
+        if (!tree.SetTag(idx, 1)) {
+            return false;
+        }
+    }
+    if (!tree.IsTagged(1) || tree.IsTagged(0) || !tree.GetTag(3, 1) ||
+        tree.GetTag(4, 1) || tree.SetTag(numItems, 0)) {
+        return false;
+    }
+
+    /* Gang lookup across the sparse gap. */
+    Page *items[16];
+    PageIdx indices[16];
+    if (tree.GangLookup(numItems / 2 - 8, items, 16, indices) != 16 ||
+        items[8] != &pages[numItems / 2] ||
+        indices[8] != bigIdx + numItems / 2 * 977) {
+        return false;
+    }
+    size_t numTagged = 0;
+    PageIdx idx = 0;
+    size_t n;
+    while ((n = tree.GangLookup(idx, items, 16, indices, 1))) {
+        for (size_t i = 0; i < n; i++) {
+            if (!tree.GetTag(indices[i], 1)) {
+                return false;
+            }
+        }
+        numTagged += n;
+        idx = indices[n - 1] + 1;
+    }
+    if (numTagged != (numItems + 2) / 3) {
+        return false;
+    }
+
+    /* Deleting the far items shrinks the tree. */
+    int height = tree.GetHeight();
+    for (size_t i = numItems / 2; i < numItems; i++) {
+        if (tree.Delete(bigIdx + i * 977) != &pages[i]) {
+            return false;
+        }
+    }
+    if (tree.GetHeight() >= height || !tree.Validate() ||
+        tree.Delete(bigIdx)) {
+        return false;
+    }
+    for (size_t i = 0; i < numItems / 2; i++) {
+        if (i % 3 == 0 && !tree.ClearTag(i, 1)) {
+            return false;
+        }
+    }
+    if (tree.IsTagged(1) || !tree.Validate()) {
+        return false;
+    }
+    for (size_t i = 0; i < numItems / 2; i++) {
+        tree.Delete(i);
+    }
+    if (tree.GetSize() || tree.GetHeight() || !tree.Validate()) {
+        return false;
+    }
+    DELETE [] pages;
+    return true;
+}
+
+static bool
+MT_LogBuffer()
+{
+    u64 numLost = LOG.GetNumLost();
+    for (int i = 0; i < 8; i++) {
+        LOG.Debug("Log buffer test message %d", i);
+    }
+    LOG.Flush();
+    return LOG.GetNumLost() == numLost;
+}
+
+static bool
+MT_Trace()
+{
+    if (!trace::tracer) {
+        /* Tracing is not compiled in. */
+        return true;
+    }
+    /* Only allocations are traced during the test. */
+    trace::tracer->Disable();
+    trace::tracer->Enable(1 << trace::SUBSYS_MEM);
+    u64 numPut = trace::tracer->GetNumPut();
+    u8 *buf = NEW u8[16];
+    DELETE [] buf;
+    /* One record for the allocation and one for the freeing. */
+    bool ok = trace::tracer->GetNumPut() == numPut + 2;
+
+    trace::tracer->Disable();
+    buf = NEW u8[16];
+    DELETE [] buf;
+    ok = ok && trace::tracer->GetNumPut() == numPut + 2;
+
+    trace::tracer->Enable();
+    if (!ok) {
+        return false;
+    }
+    trace::tracer->Dump();
+    return true;
+}
+
 static bool
 MT_Efi()
 {
@@ -103,6 +333,9 @@ MT_Efi()
 void
 Main(void *arg)
 {
+    /* Select memory and string primitives before their first use. */
+    StringOps::Select();
+
     /* Zero BSS section. */
     memset(&::kernDataEnd, 0, &::kernEnd - &::kernDataEnd);
 
@@ -119,6 +352,7 @@ Main(void *arg)
                           boot::BootToMapped(param->quickMapPte));
 
     log::InitLog();
+    trace::InitTrace();
 
     MODULE_TEST(MT_AllocOnPreinitialized);
 
@@ -135,12 +369,23 @@ Main(void *arg)
                                          boot::kernBootParam->memMapDescSize,
                                          boot::kernBootParam->memMapDescVersion);
 
+    /* Output the messages buffered during the initialization phase. */
+    LOG.Flush();
+
     MODULE_TEST(MT_AllocOnInitialized);
+    MODULE_TEST(MT_KmemSlab);
+    MODULE_TEST(MT_PhysZones);
+    MODULE_TEST(MT_PageOps);
     MODULE_TEST(MT_RwLocks);
+    MODULE_TEST(MT_PageRadixTree);
+    MODULE_TEST(MT_LogBuffer);
+    MODULE_TEST(MT_Trace);
     MODULE_TEST(MT_Efi);
+    LOG.Flush();
 
     /* Call constructors for all static objects. */
     Cxa::ConstructStaticObjects();
+    LOG.Flush();
 
     NOT_REACHED();
 }
@@ -77,6 +77,10 @@ private:
 
     void Initialize();
     void SetSpeed(int speed);
+    /** Output character to the port. The lock should be held by the
+     * caller.
+     */
+    bool _Putc(u8 c);
 public:
     DbgSerialPort();
     /** Get character from the port.
@@ -93,6 +97,19 @@ public:
      * @return @a true if character written, @a false otherwise.
      */
     bool Putc(u8 c, void *arg = 0);
+    /** Output characters span to the port. The port is locked once for the
+     * whole span so it is not interleaved with output from other CPUs.
+     *
+     * @param buf Characters to output.
+     * @param len Number of characters to output.
+     * @param arg Unused argument for compatibility with upper layers.
+     * @return Number of characters written.
+     */
+    size_t Write(const char *buf, size_t len, void *arg = 0);
+    /** Check if the transmitter is empty, i.e. output does not wait for the
+     * previously written characters.
+     */
+    bool IsTxEmpty();
 };
 
 DbgSerialPort::DbgSerialPort()
@@ -181,35 +198,57 @@ DbgSerialPort::Getc(u8 *c, void *arg UNUSED)
 }
 
 bool
-DbgSerialPort::Putc(u8 c, void *arg UNUSED)
+DbgSerialPort::_Putc(u8 c)
 {
-    if (c == '\n') {
-        bool status = Putc('\r');
-        if (!status) {
-            return status;
-        }
+    if (c == '\n' && !_Putc('\r')) {
+        return false;
     }
     u32 timeout = 100000;
     /* Wait until the transmitter holding register is empty */
-    bool intr = cpu::DisableInterrupts();
-    lock.Lock();
-    while (!cpu::inb(iobase + UART_LSR) & UART_EMPTY_TRANSMITTER) {
+    while (!(cpu::inb(iobase + UART_LSR) & UART_EMPTY_TRANSMITTER)) {
         if (!--timeout) {
             /* There is something wrong. But what can I do? */
-            lock.Unlock();
-            if (intr) {
-                cpu::EnableInterrupts();
-            }
             return false;
         }
         cpu::Pause();
     }
     cpu::outb(iobase + UART_TX, c);
+    return true;
+}
+
+bool
+DbgSerialPort::Putc(u8 c, void *arg UNUSED)
+{
+    bool intr = cpu::DisableInterrupts();
+    lock.Lock();
+    bool status = _Putc(c);
     lock.Unlock();
     if (intr) {
         cpu::EnableInterrupts();
     }
-    return true;
+    return status;
+}
+
+size_t
+DbgSerialPort::Write(const char *buf, size_t len, void *arg UNUSED)
+{
+    size_t numWritten = 0;
+    bool intr = cpu::DisableInterrupts();
+    lock.Lock();
+    while (numWritten < len && _Putc(buf[numWritten])) {
+        numWritten++;
+    }
+    lock.Unlock();
+    if (intr) {
+        cpu::EnableInterrupts();
+    }
+    return numWritten;
+}
+
+bool
+DbgSerialPort::IsTxEmpty()
+{
+    return cpu::inb(iobase + UART_LSR) & UART_EMPTY_TRANSMITTER;
 }
 
 DbgSerialPort *log::dbgSerialPort;
@@ -234,6 +273,7 @@ KSysLog::operator << (Level level)
         lastNewLine = true;
     }
     ClearOptions();
+    _prefix = 0;
 
     _curLevel = level;
     if (_curLevel > _maxLevel) {
@@ -267,16 +307,177 @@ KSysLog::operator << (Level level)
         FAULT("Invalid log level specified: %d", static_cast<int>(level));
         break;
     }
-    Format("[%s] ", name);
+    /* The prefix is output together with the first span of the message so
+     * that they are not interleaved with other CPUs output.
+     */
+    _prefix = name;
     return *this;
 }
 
+RetCode
+KSysLog::Initialize(size_t numCpus, LogRing::OverflowPolicy policy)
+{
+    if (!numCpus) {
+        return RC(INV_PARAM);
+    }
+    ASSERT(!_rings);
+    LogRing *rings = NEW_ALIGNED(CACHE_LINE_SIZE) LogRing[numCpus];
+    if (!rings) {
+        return RC(NO_MEMORY);
+    }
+    for (size_t cpu = 0; cpu < numCpus; cpu++) {
+        RetCode rc = rings[cpu].Initialize(RING_SIZE, policy);
+        if (NOK(rc)) {
+            DELETE [] rings;
+            return rc;
+        }
+    }
+    if (!_merger.Initialize(rings, numCpus)) {
+        DELETE [] rings;
+        return RC(NO_MEMORY);
+    }
+    _numCpus = numCpus;
+    /* Start buffering only when everything is ready. */
+    __atomic_store_n(&_rings, rings, __ATOMIC_RELEASE);
+    return RC(SUCCESS);
+}
+
+size_t
+KSysLog::_GetCpu()
+{
+    /* XXX Only the bootstrap CPU is running on this phase. */
+    return 0;
+}
+
 bool
 KSysLog::Putc(char c, void *)
 {
-    lastNewLine = c == '\n';
-    /* XXX Just use debug console on the first phase. */
-    return dbgSerialPort->Putc(c);
+    return Write(&c, 1) == 1;
+}
+
+size_t
+KSysLog::Write(const char *buf, size_t len, void *)
+{
+    if (!_prefix || !len) {
+        return _Output(buf, len);
+    }
+    char line[MAX_PREFIX_LEN + text_stream::OTextStreamBase::OutputBuffer::SIZE];
+    size_t prefixLen = 0;
+    line[prefixLen++] = '[';
+    for (const char *c = _prefix; *c; c++) {
+        line[prefixLen++] = *c;
+    }
+    line[prefixLen++] = ']';
+    line[prefixLen++] = ' ';
+    _prefix = 0;
+    size_t headLen = Min(len, sizeof(line) - prefixLen);
+    memcpy(line + prefixLen, buf, headLen);
+    size_t numWritten = _Output(line, prefixLen + headLen);
+    if (numWritten < prefixLen + headLen) {
+        return numWritten > prefixLen ? numWritten - prefixLen : 0;
+    }
+    if (headLen < len) {
+        headLen += _Output(buf + headLen, len - headLen);
+    }
+    return headLen;
+}
+
+size_t
+KSysLog::_Output(const char *buf, size_t len)
+{
+    if (len) {
+        lastNewLine = buf[len - 1] == '\n';
+    }
+    if (!_rings) {
+        return dbgSerialPort->Write(buf, len);
+    }
+    size_t cpu = _GetCpu();
+    LogRing &ring = _rings[cpu];
+    size_t numWritten = ring.Put(cpu::rdtsc(), cpu, _curLevel, buf, len);
+    if (_curLevel <= LOG_ERROR) {
+        Flush();
+    } else if (ring.GetNumPending() >= ring.GetNumSlots() / 2) {
+        Drain();
+    }
+    return numWritten;
+}
+
+void
+KSysLog::Flush()
+{
+    if (!_rings) {
+        return;
+    }
+    bool intr = cpu::DisableInterrupts();
+    _drainLock.Lock();
+    _Drain();
+    _drainLock.Unlock();
+    if (intr) {
+        cpu::EnableInterrupts();
+    }
+}
+
+void
+KSysLog::Drain()
+{
+    if (!_rings) {
+        return;
+    }
+    for (size_t i = 0; i < DRAIN_BATCH; i++) {
+        /* Do not wait for the port, the rest is output later. */
+        if (!dbgSerialPort->IsTxEmpty()) {
+            break;
+        }
+        bool intr = cpu::DisableInterrupts();
+        if (_drainLock.TryLock()) {
+            /* Other CPU is draining. */
+            if (intr) {
+                cpu::EnableInterrupts();
+            }
+            break;
+        }
+        bool isOutput = _DrainRecord();
+        _drainLock.Unlock();
+        if (intr) {
+            cpu::EnableInterrupts();
+        }
+        if (!isOutput) {
+            break;
+        }
+    }
+}
+
+void
+KSysLog::_Drain()
+{
+    while (_DrainRecord());
+}
+
+bool
+KSysLog::_DrainRecord()
+{
+    LogRing::Record *rec = _merger.GetNext();
+    if (rec) {
+        dbgSerialPort->Write(rec->text, rec->length);
+        return true;
+    }
+    /* Report the losses after all the preceding records are output. */
+    u64 numLost = GetNumLost();
+    if (numLost != _numLostReported) {
+        dbgStream->Format("[log: %d records lost]\n", numLost - _numLostReported);
+        _numLostReported = numLost;
+    }
+    return false;
+}
+
+u64
+KSysLog::GetNumLost()
+{
+    u64 numLost = 0;
+    for (size_t cpu = 0; cpu < _numCpus; cpu++) {
+        numLost += _rings[cpu].GetNumDropped() + _rings[cpu].GetNumOverwritten();
+    }
+    return numLost;
 }
 
 void
@@ -285,4 +486,8 @@ log::InitLog()
     ::dbgSerialPort = NEW DbgSerialPort;
     ::dbgStream = NEW text_stream::OTextStream<DbgSerialPort>(::dbgSerialPort);
     ::sysLog = NEW SysLog;
+    /* XXX Only the bootstrap CPU is running on this phase. */
+    if (NOK(::sysLog->Initialize(1))) {
+        LOG.Warning("Failed to initialize log buffers, using synchronous output");
+    }
 }
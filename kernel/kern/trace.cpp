@@ -0,0 +1,193 @@
+/*
+ * /phoenix/kernel/kern/trace.cpp
+ *
+ * This file is a part of Phoenix operating system.
+ * Copyright (c) 2011-2012, Artyom Lebedev <artyom.lebedev@gmail.com>
+ * All rights reserved.
+ * See COPYING file for copyright details.
+ */
+
+/** @file trace.cpp
+ * Binary tracepoints with deferred formatting.
+ */
+
+#include <sys.h>
+
+using namespace trace;
+
+u32 trace::enabledSubsystems;
+
+Tracer *trace::tracer;
+
+namespace {
+
+/** Stream which accumulates one line of the trace dump. The line is output to
+ * the debug port at once so that it is not interleaved with other output.
+ * Too long lines are truncated.
+ */
+class DumpLine : public text_stream::OTextStream<DumpLine> {
+public:
+    enum {
+        /** Maximal line length including the terminating new line. */
+        SIZE = 256,
+    };
+
+    DumpLine() : text_stream::OTextStream<DumpLine>(this) {}
+
+    bool Putc(char c, void *arg UNUSED) {
+        return Write(&c, 1) == 1;
+    }
+
+    size_t Write(const char *buf, size_t len, void *arg UNUSED = 0) {
+        /* Reserve space for the new line. */
+        len = Min(len, SIZE - 1 - _len);
+        memcpy(_buf + _len, buf, len);
+        _len += len;
+        return len;
+    }
+
+    /** Terminate the line and output it to the debug port. */
+    void Output() {
+        _buf[_len++] = '\n';
+        log::dbgStream->WriteSpan(_buf, _len);
+    }
+
+private:
+    char _buf[SIZE];
+    size_t _len = 0;
+};
+
+} /* anonymous namespace */
+
+Tracer::Tracer()
+{
+
+}
+
+Tracer::~Tracer()
+{
+    Disable();
+    if (_buffers) {
+        DELETE [] _buffers;
+    }
+}
+
+RetCode
+Tracer::Initialize(size_t numCpus)
+{
+    if (!numCpus) {
+        return RC(INV_PARAM);
+    }
+    ASSERT(!_buffers);
+    TraceBuffer *buffers = NEW_ALIGNED(CACHE_LINE_SIZE) TraceBuffer[numCpus];
+    if (!buffers) {
+        return RC(NO_MEMORY);
+    }
+    for (size_t cpu = 0; cpu < numCpus; cpu++) {
+        RetCode rc = buffers[cpu].Initialize(BUFFER_SIZE);
+        if (NOK(rc)) {
+            DELETE [] buffers;
+            return rc;
+        }
+    }
+    if (!_merger.Initialize(buffers, numCpus)) {
+        DELETE [] buffers;
+        return RC(NO_MEMORY);
+    }
+    _buffers = buffers;
+    _numCpus = numCpus;
+    return RC(SUCCESS);
+}
+
+void
+Tracer::Enable(u32 mask)
+{
+    /* Buffers must be ready before the first tracepoint hit. */
+    ENSURE(_buffers);
+    __atomic_fetch_or(&enabledSubsystems, mask & ((1u << SUBSYS_MAX) - 1),
+                      __ATOMIC_RELEASE);
+}
+
+void
+Tracer::Disable(u32 mask)
+{
+    __atomic_fetch_and(&enabledSubsystems, ~mask, __ATOMIC_RELEASE);
+}
+
+void
+Tracer::Dump()
+{
+    if (!_buffers) {
+        return;
+    }
+    /* Previously logged messages should precede the dump. */
+    LOG.Flush();
+
+    u64 numOverwritten = GetNumOverwritten();
+
+    while (true) {
+        /* Only the records retrieval is serialized, the slow output to the
+         * port is done with interrupts enabled.
+         */
+        TraceBuffer::Record rec;
+        bool intr = cpu::DisableInterrupts();
+        _dumpLock.Lock();
+        TraceBuffer::Record *next = _merger.GetNext();
+        if (next) {
+            rec = *next;
+        }
+        _dumpLock.Unlock();
+        if (intr) {
+            cpu::EnableInterrupts();
+        }
+        if (!next) {
+            break;
+        }
+
+        const Tracepoint *tp = reinterpret_cast<const Tracepoint *>(rec.id);
+        DumpLine line;
+        line.Format(OTS_FMT("[trace %016x cpu %d] %s: "), rec.timestamp,
+                    static_cast<int>(rec.cpu), tp->name);
+        rec.FormatArgs(line, tp->format);
+        line.Output();
+    }
+
+    numOverwritten = GetNumOverwritten() - numOverwritten;
+    if (numOverwritten) {
+        log::dbgStream->Format("[trace: %d records overwritten]\n", numOverwritten);
+    }
+}
+
+u64
+Tracer::GetNumPut()
+{
+    u64 numPut = 0;
+    for (size_t cpu = 0; cpu < _numCpus; cpu++) {
+        numPut += _buffers[cpu].GetNumPut();
+    }
+    return numPut;
+}
+
+u64
+Tracer::GetNumOverwritten()
+{
+    u64 numOverwritten = 0;
+    for (size_t cpu = 0; cpu < _numCpus; cpu++) {
+        numOverwritten += _buffers[cpu].GetNumOverwritten();
+    }
+    return numOverwritten;
+}
+
+void
+trace::InitTrace()
+{
+#ifdef ENABLE_TRACING
+    ::tracer = NEW Tracer;
+    /* XXX Only the bootstrap CPU is running on this phase. */
+    if (!::tracer || NOK(::tracer->Initialize(1))) {
+        LOG.Warning("Failed to initialize trace buffers, tracing disabled");
+        return;
+    }
+    ::tracer->Enable();
+#endif /* ENABLE_TRACING */
+}
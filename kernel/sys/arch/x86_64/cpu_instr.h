@@ -31,6 +31,30 @@ bsf(u64 string)
     return rc;
 }
 
+/** Count set bits. Can be used only if @ref CPU_CAP_POPCNT capability is
+ * present.
+ */
+inline u64
+popcnt(u64 string)
+{
+    u64 rc;
+
+    ASM ("popcntq %[string], %[rc]" : [rc]"=r"(rc) : [string]"r"(string));
+    return rc;
+}
+
+/** Read extended control register. Can be used only if OSXSAVE bit is set in
+ * CR4 (reported by @ref CPU_CAP_OSXSAVE capability).
+ */
+inline u64
+xgetbv(u32 xcr)
+{
+    u32 rcL, rcH;
+
+    ASM ("xgetbv" : "=a"(rcL), "=d"(rcH) : "c"(xcr));
+    return rcL | (static_cast<u64>(rcH) << 32);
+}
+
 inline u8
 inb(u16 port)
 {
@@ -0,0 +1,150 @@
+/*
+ * /phoenix/kernel/sys/arch/x86_64/md_bitstring.h
+ *
+ * This file is a part of Phoenix operating system.
+ * Copyright (c) 2011-2012, Artyom Lebedev <artyom.lebedev@gmail.com>
+ * All rights reserved.
+ * See COPYING file for copyright details.
+ */
+
+/** @file md_bitstring.h
+ * Machine-dependent bulk bitmap operations. These are the building blocks for
+ * @ref BitStringOps which selects them according to the CPU capabilities.
+ */
+
+#ifndef MD_BITSTRING_H_
+#define MD_BITSTRING_H_
+
+namespace cpu {
+
+namespace md_bitstring {
+
+typedef char v16qi __attribute__((vector_size(16)));
+typedef char v16qi_u __attribute__((vector_size(16), aligned(1)));
+typedef unsigned long long v2du __attribute__((vector_size(16)));
+typedef unsigned long long v2du_u __attribute__((vector_size(16), aligned(1)));
+typedef u64 u64_u __attribute__((aligned(1), may_alias));
+
+/** Count bits in a byte. Used for buffer tails. */
+inline size_t
+CountByte(u8 x)
+{
+    size_t count = 0;
+    for (; x; x &= x - 1) {
+        count++;
+    }
+    return count;
+}
+
+} /* namespace md_bitstring */
+
+/** Find first byte which differs from the pattern. SSE2 version. SSE2 is
+ * always present on x86_64 so this is the baseline implementation.
+ *
+ * @param bytes Buffer to scan.
+ * @param size Size of the buffer in bytes.
+ * @param pattern Byte value to skip.
+ * @return Offset of the first byte which is not equal to @a pattern, @a size
+ *      if all bytes are equal to it.
+ */
+inline size_t
+BitScanSse2(const u8 *bytes, size_t size, u8 pattern)
+{
+    using namespace md_bitstring;
+    const char c = pattern;
+    const v16qi pv = { c, c, c, c, c, c, c, c, c, c, c, c, c, c, c, c };
+    const char *p = reinterpret_cast<const char *>(bytes);
+    size_t offset = 0;
+
+    /* Skip 64 bytes per iteration while all match. */
+    for (; offset + 64 <= size; offset += 64) {
+        const v16qi_u *v = reinterpret_cast<const v16qi_u *>(p + offset);
+        v16qi eq = (v[0] == pv) & (v[1] == pv) & (v[2] == pv) & (v[3] == pv);
+        if (__builtin_ia32_pmovmskb128(eq) != 0xffff) {
+            break;
+        }
+    }
+    for (; offset + 16 <= size; offset += 16) {
+        v16qi eq = *reinterpret_cast<const v16qi_u *>(p + offset) == pv;
+        int mask = __builtin_ia32_pmovmskb128(eq) ^ 0xffff;
+        if (mask) {
+            return offset + bsf(mask);
+        }
+    }
+    for (; offset < size; offset++) {
+        if (bytes[offset] != pattern) {
+            break;
+        }
+    }
+    return offset;
+}
+
+/** Count set bits in a buffer. SSE2 version, bits are summed in parallel
+ * for each byte and the bytes are summed by PSADBW instruction.
+ *
+ * @param bytes Buffer with bits.
+ * @param size Size of the buffer in bytes.
+ * @return Number of bits set.
+ */
+inline size_t
+BitCountSse2(const u8 *bytes, size_t size)
+{
+    using namespace md_bitstring;
+    const v2du m1 = { 0x5555555555555555ull, 0x5555555555555555ull };
+    const v2du m2 = { 0x3333333333333333ull, 0x3333333333333333ull };
+    const v2du m4 = { 0x0f0f0f0f0f0f0f0full, 0x0f0f0f0f0f0f0f0full };
+    const v16qi zero = { };
+    v2du total = { 0, 0 };
+    size_t offset = 0;
+
+    for (; offset + 16 <= size; offset += 16) {
+        v2du x = *reinterpret_cast<const v2du_u *>(bytes + offset);
+        x = x - ((x >> 1) & m1);
+        x = (x & m2) + ((x >> 2) & m2);
+        x = (x + (x >> 4)) & m4;
+        total += reinterpret_cast<v2du>(
+            __builtin_ia32_psadbw128(reinterpret_cast<v16qi>(x), zero));
+    }
+    size_t count = total[0] + total[1];
+    for (; offset < size; offset++) {
+        count += CountByte(bytes[offset]);
+    }
+    return count;
+}
+
+/** Count set bits in a buffer. POPCNT instruction version, can be used only
+ * if @ref CPU_CAP_POPCNT capability is present.
+ *
+ * @param bytes Buffer with bits.
+ * @param size Size of the buffer in bytes.
+ * @return Number of bits set.
+ */
+inline size_t
+BitCountPopcnt(const u8 *bytes, size_t size)
+{
+    using namespace md_bitstring;
+    const u64_u *words = reinterpret_cast<const u64_u *>(bytes);
+    /* Independent accumulators to avoid serializing on POPCNT latency. */
+    size_t c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+    size_t numWords = size / sizeof(u64);
+    size_t word = 0;
+
+    for (; word + 4 <= numWords; word += 4) {
+        c0 += popcnt(words[word]);
+        c1 += popcnt(words[word + 1]);
+        c2 += popcnt(words[word + 2]);
+        c3 += popcnt(words[word + 3]);
+    }
+    for (; word < numWords; word++) {
+        c0 += popcnt(words[word]);
+    }
+    size_t count = c0 + c1 + c2 + c3;
+    for (size_t offset = numWords * sizeof(u64); offset < size; offset++) {
+        count += CountByte(bytes[offset]);
+    }
+    return count;
+}
+
+} /* namespace cpu */
+
+#endif /* MD_BITSTRING_H_ */
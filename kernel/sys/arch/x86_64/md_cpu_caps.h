@@ -93,6 +93,13 @@ private:
             { CPU_CAP_PG_1GB, 80000001, 0, RES_EDX, 26, 1, 0 },
             { CPU_CAP_PG_WIDTH_PHYS, 0x80000008, 0, RES_EAX, 0, 8, 36 },
             { CPU_CAP_PG_WIDTH_LIN, 0x80000008, 0, RES_EAX, 8, 8, 32 },
+            { CPU_CAP_SSE2, 0x1, 0, RES_EDX, 26, 1, 0 },
+            { CPU_CAP_SSE42, 0x1, 0, RES_ECX, 20, 1, 0 },
+            { CPU_CAP_PCLMUL, 0x1, 0, RES_ECX, 1, 1, 0 },
+            { CPU_CAP_POPCNT, 0x1, 0, RES_ECX, 23, 1, 0 },
+            { CPU_CAP_AVX2, 0x7, 0, RES_EBX, 5, 1, 0 },
+            { CPU_CAP_OSXSAVE, 0x1, 0, RES_ECX, 27, 1, 0 },
+            { CPU_CAP_ERMS, 0x7, 0, RES_EBX, 9, 1, 0 },
         };
 
         for (auto &feature: features) {
@@ -0,0 +1,138 @@
+/*
+ * /phoenix/kernel/sys/arch/x86_64/md_crc.h
+ *
+ * This file is a part of Phoenix operating system.
+ * Copyright (c) 2011-2012, Artyom Lebedev <artyom.lebedev@gmail.com>
+ * All rights reserved.
+ * See COPYING file for copyright details.
+ */
+
+/** @file md_crc.h
+ * Machine-dependent CRC calculation. These are the building blocks for
+ * @ref Crc32 which selects them according to the CPU capabilities.
+ */
+
+#ifndef MD_CRC_H_
+#define MD_CRC_H_
+
+namespace cpu {
+
+namespace md_crc {
+
+typedef unsigned long long v2du __attribute__((vector_size(16)));
+typedef unsigned long long v2du_u __attribute__((vector_size(16), aligned(1)));
+typedef unsigned v4su __attribute__((vector_size(16)));
+
+/** Carry-less multiplication of quadwords selected by @a imm bits 0 and 4. */
+template <int imm>
+inline v2du
+Clmul(v2du a, v2du b)
+{
+    ASM ("pclmulqdq %[imm], %[b], %[a]" : [a]"+x"(a) : [b]"x"(b), [imm]"i"(imm));
+    return a;
+}
+
+/** Fold 128 bits accumulator forward by the distance defined by the
+ * constants.
+ */
+inline v2du
+Fold(v2du x, v2du k)
+{
+    return Clmul<0x00>(x, k) ^ Clmul<0x11>(x, k);
+}
+
+inline v2du
+Load(const u8 *p)
+{
+    return *reinterpret_cast<const v2du_u *>(p);
+}
+
+} /* namespace md_crc */
+
+/** Update CRC32C (Castagnoli polynomial) with the buffer content. SSE4.2
+ * @a crc32 instruction version, can be used only if @ref CPU_CAP_SSE42
+ * capability is present.
+ *
+ * @param crc Current CRC value.
+ * @param bytes Buffer with the data.
+ * @param size Size of the buffer in bytes.
+ * @return Updated CRC value.
+ */
+inline u32
+Crc32cSse42(u32 crc, const u8 *bytes, size_t size)
+{
+    u64 crc64 = crc;
+    size_t offset = 0;
+    for (; offset + 8 <= size; offset += 8) {
+        ASM ("crc32q %[data], %[crc]" : [crc]"+r"(crc64) :
+             [data]"rm"(GetUnaligned<u64>(&bytes[offset])));
+    }
+    crc = crc64;
+    for (; offset < size; offset++) {
+        ASM ("crc32b %[data], %[crc]" : [crc]"+r"(crc) :
+             [data]"rm"(bytes[offset]));
+    }
+    return crc;
+}
+
+/** Update CRC32 (IEEE 802.3 polynomial) with the buffer content. Four 128
+ * bits accumulators are folded with PCLMULQDQ instruction, the result is
+ * reduced by Barrett reduction. Can be used only if @ref CPU_CAP_PCLMUL
+ * capability is present.
+ *
+ * @param crc Current CRC value.
+ * @param bytes Buffer with the data.
+ * @param size Size of the buffer in bytes. Should be at least 64 and multiple
+ *      of 16.
+ * @return Updated CRC value.
+ */
+inline u32
+Crc32Pclmul(u32 crc, const u8 *bytes, size_t size)
+{
+    using namespace md_crc;
+    /* Folding constants x^(n) mod P for the fold distances, reflected. */
+    const v2du k1k2 = { 0x0154442bd4ull, 0x01c6e41596ull };
+    const v2du k3k4 = { 0x01751997d0ull, 0x00ccaa009eull };
+    const v2du k5k0 = { 0x0163cd6124ull, 0 };
+    /* Reflected polynomial and Barrett constant. */
+    const v2du poly = { 0x01db710641ull, 0x01f7011641ull };
+    const v2du mask32 = { 0xffffffffull, 0xffffffffull };
+
+    ASSERT(size >= 64 && !(size % 16));
+    v2du x1 = Load(bytes), x2 = Load(bytes + 16), x3 = Load(bytes + 32),
+         x4 = Load(bytes + 48);
+    x1 ^= v2du{ crc, 0 };
+    bytes += 64;
+    size -= 64;
+
+    for (; size >= 64; bytes += 64, size -= 64) {
+        x1 = Fold(x1, k1k2) ^ Load(bytes);
+        x2 = Fold(x2, k1k2) ^ Load(bytes + 16);
+        x3 = Fold(x3, k1k2) ^ Load(bytes + 32);
+        x4 = Fold(x4, k1k2) ^ Load(bytes + 48);
+    }
+
+    /* Fold into one accumulator. */
+    x1 = Fold(x1, k3k4) ^ x2;
+    x1 = Fold(x1, k3k4) ^ x3;
+    x1 = Fold(x1, k3k4) ^ x4;
+    for (; size >= 16; bytes += 16, size -= 16) {
+        x1 = Fold(x1, k3k4) ^ Load(bytes);
+    }
+
+    /* Reduce 128 bits to 64 bits. */
+    x1 = Clmul<0x10>(x1, k3k4) ^ v2du{ x1[1], 0 };
+    v4su w = reinterpret_cast<v4su>(x1);
+    x2 = reinterpret_cast<v2du>(v4su{ w[1], w[2], w[3], 0 });
+    x1 = Clmul<0x00>(x1 & mask32, k5k0) ^ x2;
+
+    /* Barrett reduction to 32 bits. */
+    x2 = Clmul<0x10>(x1 & mask32, poly);
+    x2 = Clmul<0x00>(x2 & mask32, poly);
+    x1 ^= x2;
+    return reinterpret_cast<v4su>(x1)[1];
+}
+
+} /* namespace cpu */
+
+#endif /* MD_CRC_H_ */
@@ -0,0 +1,640 @@
+/*
+ * /phoenix/kernel/sys/arch/x86_64/md_string.h
+ *
+ * This file is a part of Phoenix operating system.
+ * Copyright (c) 2011-2012, Artyom Lebedev <artyom.lebedev@gmail.com>
+ * All rights reserved.
+ * See COPYING file for copyright details.
+ */
+
+/** @file md_string.h
+ * Machine-dependent memory and string primitives. These are the building
+ * blocks for @ref StringOps which selects them according to the CPU
+ * capabilities. SSE2 is always present on x86_64 so SSE2 versions are the
+ * baseline ones.
+ */
+
+#ifndef MD_STRING_H_
+#define MD_STRING_H_
+
+namespace cpu {
+
+namespace md_string {
+
+typedef char v16qi __attribute__((vector_size(16)));
+typedef char v16qi_u __attribute__((vector_size(16), aligned(1), may_alias));
+typedef char v32qi __attribute__((vector_size(32)));
+typedef char v32qi_u __attribute__((vector_size(32), aligned(1), may_alias));
+typedef u64 u64_u __attribute__((aligned(1), may_alias));
+typedef u32 u32_u __attribute__((aligned(1), may_alias));
+
+/** Minimal size for which "rep movsb" and "rep stosb" are used when
+ * @ref CPU_CAP_ERMS capability is present. Startup overhead of the string
+ * instructions is too high for smaller blocks.
+ */
+const size_t ERMS_THRESHOLD = 2048;
+
+inline v16qi
+Load16(const u8 *p)
+{
+    return *reinterpret_cast<const v16qi_u *>(p);
+}
+
+inline void
+Store16(u8 *p, v16qi v)
+{
+    *reinterpret_cast<v16qi_u *>(p) = v;
+}
+
+inline void
+StoreAligned16(u8 *p, v16qi v)
+{
+    *reinterpret_cast<v16qi *>(p) = v;
+}
+
+inline v16qi
+Broadcast16(u8 value)
+{
+    const char c = value;
+    return v16qi{ c, c, c, c, c, c, c, c, c, c, c, c, c, c, c, c };
+}
+
+inline unsigned
+Mask16(v16qi eq)
+{
+    return __builtin_ia32_pmovmskb128(eq);
+}
+
+/** Copy up to 32 bytes. All the data is loaded before storing so it can be
+ * used for overlapping blocks as well.
+ */
+inline void
+CopySmall(u8 *dst, const u8 *src, size_t size)
+{
+    if (size >= 16) {
+        v16qi head = Load16(src), tail = Load16(src + size - 16);
+        Store16(dst, head);
+        Store16(dst + size - 16, tail);
+    } else if (size >= 8) {
+        u64 head = *reinterpret_cast<const u64_u *>(src),
+            tail = *reinterpret_cast<const u64_u *>(src + size - 8);
+        *reinterpret_cast<u64_u *>(dst) = head;
+        *reinterpret_cast<u64_u *>(dst + size - 8) = tail;
+    } else if (size >= 4) {
+        u32 head = *reinterpret_cast<const u32_u *>(src),
+            tail = *reinterpret_cast<const u32_u *>(src + size - 4);
+        *reinterpret_cast<u32_u *>(dst) = head;
+        *reinterpret_cast<u32_u *>(dst + size - 4) = tail;
+    } else if (size) {
+        /* Three positions cover all the bytes for sizes 1-3. */
+        u8 first = src[0], middle = src[size / 2], last = src[size - 1];
+        dst[0] = first;
+        dst[size / 2] = middle;
+        dst[size - 1] = last;
+    }
+}
+
+/** Fill up to 16 bytes. */
+inline void
+FillSmall(u8 *dst, u8 value, size_t size)
+{
+    if (size >= 8) {
+        u64 v = value * 0x0101010101010101ull;
+        *reinterpret_cast<u64_u *>(dst) = v;
+        *reinterpret_cast<u64_u *>(dst + size - 8) = v;
+    } else if (size >= 4) {
+        u32 v = value * 0x01010101u;
+        *reinterpret_cast<u32_u *>(dst) = v;
+        *reinterpret_cast<u32_u *>(dst + size - 4) = v;
+    } else if (size) {
+        dst[0] = value;
+        dst[size / 2] = value;
+        dst[size - 1] = value;
+    }
+}
+
+inline void
+RepMovsb(u8 *dst, const u8 *src, size_t size)
+{
+    ASM ("rep movsb" : "+D"(dst), "+S"(src), "+c"(size) : : "memory");
+}
+
+inline void
+RepStosb(u8 *dst, u8 value, size_t size)
+{
+    ASM ("rep stosb" : "+D"(dst), "+c"(size) : "a"(value) : "memory");
+}
+
+} /* namespace md_string */
+
+/** Copy non-overlapping memory blocks. SSE2 version, stores are aligned.
+ *
+ * @param dst Destination buffer.
+ * @param src Source buffer.
+ * @param size Number of bytes to copy.
+ */
+inline void
+MemcpySse2(u8 *dst, const u8 *src, size_t size)
+{
+    using namespace md_string;
+    if (size <= 32) {
+        CopySmall(dst, src, size);
+        return;
+    }
+    if (size <= 64) {
+        v16qi x0 = Load16(src), x1 = Load16(src + 16),
+              x2 = Load16(src + size - 32), x3 = Load16(src + size - 16);
+        Store16(dst, x0);
+        Store16(dst + 16, x1);
+        Store16(dst + size - 32, x2);
+        Store16(dst + size - 16, x3);
+        return;
+    }
+
+    /* Unaligned head, the rest is stored with aligned stores. */
+    Store16(dst, Load16(src));
+    size_t skip = 16 - (reinterpret_cast<uintptr_t>(dst) & 15);
+    dst += skip;
+    src += skip;
+    size -= skip;
+    for (; size >= 64; dst += 64, src += 64, size -= 64) {
+        v16qi x0 = Load16(src), x1 = Load16(src + 16),
+              x2 = Load16(src + 32), x3 = Load16(src + 48);
+        StoreAligned16(dst, x0);
+        StoreAligned16(dst + 16, x1);
+        StoreAligned16(dst + 32, x2);
+        StoreAligned16(dst + 48, x3);
+    }
+    for (; size > 16; dst += 16, src += 16, size -= 16) {
+        StoreAligned16(dst, Load16(src));
+    }
+    /* Tail overlaps with already copied data. */
+    if (size) {
+        Store16(dst + size - 16, Load16(src + size - 16));
+    }
+}
+
+/** Copy non-overlapping memory blocks. AVX2 version, can be used only if
+ * @ref CPU_CAP_AVX2 capability is present and AVX state is enabled.
+ *
+ * @param dst Destination buffer.
+ * @param src Source buffer.
+ * @param size Number of bytes to copy.
+ */
+__attribute__((target("avx2"))) inline void
+MemcpyAvx2(u8 *dst, const u8 *src, size_t size)
+{
+    using namespace md_string;
+    if (size <= 32) {
+        CopySmall(dst, src, size);
+        return;
+    }
+    v32qi head = *reinterpret_cast<const v32qi_u *>(src);
+    v32qi tail = *reinterpret_cast<const v32qi_u *>(src + size - 32);
+    if (size <= 64) {
+        *reinterpret_cast<v32qi_u *>(dst) = head;
+        *reinterpret_cast<v32qi_u *>(dst + size - 32) = tail;
+        return;
+    }
+
+    *reinterpret_cast<v32qi_u *>(dst) = head;
+    *reinterpret_cast<v32qi_u *>(dst + size - 32) = tail;
+    size_t skip = 32 - (reinterpret_cast<uintptr_t>(dst) & 31);
+    dst += skip;
+    src += skip;
+    size -= skip;
+    const v32qi_u *s = reinterpret_cast<const v32qi_u *>(src);
+    v32qi *d = reinterpret_cast<v32qi *>(dst);
+    for (; size >= 128; s += 4, d += 4, size -= 128) {
+        v32qi x0 = s[0], x1 = s[1], x2 = s[2], x3 = s[3];
+        d[0] = x0;
+        d[1] = x1;
+        d[2] = x2;
+        d[3] = x3;
+    }
+    /* The last up to 32 bytes are covered by the tail store. */
+    for (; size > 32; s++, d++, size -= 32) {
+        *d = *s;
+    }
+}
+
+/** Copy memory block with "rep movsb" instruction if it is large enough,
+ * vectorized version otherwise. Can be used only if @ref CPU_CAP_ERMS
+ * capability is present.
+ *
+ * @param VecCopy Vectorized copying function for smaller blocks.
+ */
+template <void (*VecCopy)(u8 *, const u8 *, size_t)>
+inline void
+MemcpyErms(u8 *dst, const u8 *src, size_t size)
+{
+    if (size >= md_string::ERMS_THRESHOLD) {
+        md_string::RepMovsb(dst, src, size);
+    } else {
+        VecCopy(dst, src, size);
+    }
+}
+
+/** Copy overlapping memory blocks. SSE2 version.
+ *
+ * @param dst Destination buffer.
+ * @param src Source buffer.
+ * @param size Number of bytes to copy.
+ */
+inline void
+MemmoveSse2(u8 *dst, const u8 *src, size_t size)
+{
+    using namespace md_string;
+    if (size <= 32) {
+        CopySmall(dst, src, size);
+        return;
+    }
+    /* Each chunk is loaded before being stored, the edge chunk which
+     * overlaps with the last processed one is loaded in advance.
+     */
+    if (dst < src) {
+        v16qi tail = Load16(src + size - 16);
+        size_t offset = 0;
+        for (; offset + 64 < size; offset += 64) {
+            v16qi x0 = Load16(src + offset), x1 = Load16(src + offset + 16),
+                  x2 = Load16(src + offset + 32), x3 = Load16(src + offset + 48);
+            Store16(dst + offset, x0);
+            Store16(dst + offset + 16, x1);
+            Store16(dst + offset + 32, x2);
+            Store16(dst + offset + 48, x3);
+        }
+        for (; offset + 16 < size; offset += 16) {
+            Store16(dst + offset, Load16(src + offset));
+        }
+        Store16(dst + size - 16, tail);
+    } else {
+        v16qi head = Load16(src);
+        size_t offset = size;
+        for (; offset > 64; offset -= 64) {
+            v16qi x0 = Load16(src + offset - 16), x1 = Load16(src + offset - 32),
+                  x2 = Load16(src + offset - 48), x3 = Load16(src + offset - 64);
+            Store16(dst + offset - 16, x0);
+            Store16(dst + offset - 32, x1);
+            Store16(dst + offset - 48, x2);
+            Store16(dst + offset - 64, x3);
+        }
+        for (; offset > 16; offset -= 16) {
+            Store16(dst + offset - 16, Load16(src + offset - 16));
+        }
+        Store16(dst, head);
+    }
+}
+
+/** Fill memory block. SSE2 version, stores are aligned.
+ *
+ * @param dst Buffer to fill.
+ * @param value Value to fill with.
+ * @param size Size of the buffer in bytes.
+ */
+inline void
+MemsetSse2(u8 *dst, u8 value, size_t size)
+{
+    using namespace md_string;
+    if (size <= 16) {
+        FillSmall(dst, value, size);
+        return;
+    }
+    v16qi v = Broadcast16(value);
+    Store16(dst, v);
+    Store16(dst + size - 16, v);
+    if (size <= 32) {
+        return;
+    }
+    /* Aligned part, the last unaligned bytes are covered by the tail. */
+    u8 *p = reinterpret_cast<u8 *>((reinterpret_cast<uintptr_t>(dst) + 16) & ~15ul);
+    u8 *end = reinterpret_cast<u8 *>(reinterpret_cast<uintptr_t>(dst + size) & ~15ul);
+    for (; p + 64 <= end; p += 64) {
+        StoreAligned16(p, v);
+        StoreAligned16(p + 16, v);
+        StoreAligned16(p + 32, v);
+        StoreAligned16(p + 48, v);
+    }
+    for (; p < end; p += 16) {
+        StoreAligned16(p, v);
+    }
+}
+
+/** Fill memory block. AVX2 version, can be used only if @ref CPU_CAP_AVX2
+ * capability is present and AVX state is enabled.
+ *
+ * @param dst Buffer to fill.
+ * @param value Value to fill with.
+ * @param size Size of the buffer in bytes.
+ */
+__attribute__((target("avx2"))) inline void
+MemsetAvx2(u8 *dst, u8 value, size_t size)
+{
+    using namespace md_string;
+    if (size <= 32) {
+        MemsetSse2(dst, value, size);
+        return;
+    }
+    const char c = value;
+    const v32qi v = { c, c, c, c, c, c, c, c, c, c, c, c, c, c, c, c,
+                      c, c, c, c, c, c, c, c, c, c, c, c, c, c, c, c };
+    *reinterpret_cast<v32qi_u *>(dst) = v;
+    *reinterpret_cast<v32qi_u *>(dst + size - 32) = v;
+    if (size <= 64) {
+        return;
+    }
+    v32qi *p = reinterpret_cast<v32qi *>((reinterpret_cast<uintptr_t>(dst) + 32) & ~31ul);
+    v32qi *end = reinterpret_cast<v32qi *>(reinterpret_cast<uintptr_t>(dst + size) & ~31ul);
+    for (; p + 4 <= end; p += 4) {
+        p[0] = v;
+        p[1] = v;
+        p[2] = v;
+        p[3] = v;
+    }
+    for (; p < end; p++) {
+        *p = v;
+    }
+}
+
+/** Fill memory block with "rep stosb" instruction if it is large enough,
+ * vectorized version otherwise. Can be used only if @ref CPU_CAP_ERMS
+ * capability is present.
+ *
+ * @param VecFill Vectorized filling function for smaller blocks.
+ */
+template <void (*VecFill)(u8 *, u8, size_t)>
+inline void
+MemsetErms(u8 *dst, u8 value, size_t size)
+{
+    if (size >= md_string::ERMS_THRESHOLD) {
+        md_string::RepStosb(dst, value, size);
+    } else {
+        VecFill(dst, value, size);
+    }
+}
+
+/** Compare memory blocks. SSE2 version.
+ *
+ * @param p1 First block.
+ * @param p2 Second block.
+ * @param size Number of bytes to compare.
+ * @return Difference of the first mismatching bytes, zero if the blocks are
+ *      equal.
+ */
+inline int
+MemcmpSse2(const u8 *p1, const u8 *p2, size_t size)
+{
+    using namespace md_string;
+    size_t offset = 0;
+    if (size >= 16) {
+        for (; offset + 32 <= size; offset += 32) {
+            v16qi eq = (Load16(p1 + offset) == Load16(p2 + offset)) &
+                       (Load16(p1 + offset + 16) == Load16(p2 + offset + 16));
+            if (Mask16(eq) != 0xffff) {
+                break;
+            }
+        }
+        for (; offset + 16 <= size; offset += 16) {
+            v16qi eq = Load16(p1 + offset) == Load16(p2 + offset);
+            unsigned mask = Mask16(eq) ^ 0xffff;
+            if (mask) {
+                offset += bsf(mask);
+                return p1[offset] - p2[offset];
+            }
+        }
+        /* Tail overlaps with already compared data. */
+        if (offset < size) {
+            offset = size - 16;
+            v16qi eq = Load16(p1 + offset) == Load16(p2 + offset);
+            unsigned mask = Mask16(eq) ^ 0xffff;
+            if (mask) {
+                offset += bsf(mask);
+                return p1[offset] - p2[offset];
+            }
+        }
+        return 0;
+    }
+    for (; offset < size; offset++) {
+        if (p1[offset] != p2[offset]) {
+            return p1[offset] - p2[offset];
+        }
+    }
+    return 0;
+}
+
+/** Find byte in memory block. SSE2 version. Aligned loads are used so the
+ * bytes preceding and following the block in the same 16 bytes chunk may be
+ * read (but never across a page boundary).
+ *
+ * @param ptr Block to search in.
+ * @param value Byte value to find.
+ * @param size Size of the block in bytes.
+ * @return Pointer to the first found byte, zero if not found.
+ */
+inline const u8 *
+MemchrSse2(const u8 *ptr, u8 value, size_t size)
+{
+    using namespace md_string;
+    if (!size) {
+        return 0;
+    }
+    const v16qi v = Broadcast16(value);
+    const u8 *end = ptr + size;
+    const v16qi *p = reinterpret_cast<const v16qi *>(
+        reinterpret_cast<uintptr_t>(ptr) & ~15ul);
+    unsigned mask = Mask16(*p == v) >> (ptr - reinterpret_cast<const u8 *>(p));
+    if (mask) {
+        const u8 *found = ptr + bsf(mask);
+        return found < end ? found : 0;
+    }
+    for (p++; reinterpret_cast<const u8 *>(p + 4) <= end; p += 4) {
+        v16qi eq = (p[0] == v) | (p[1] == v) | (p[2] == v) | (p[3] == v);
+        if (Mask16(eq)) {
+            break;
+        }
+    }
+    for (; reinterpret_cast<const u8 *>(p) < end; p++) {
+        mask = Mask16(*p == v);
+        if (mask) {
+            const u8 *found = reinterpret_cast<const u8 *>(p) + bsf(mask);
+            return found < end ? found : 0;
+        }
+    }
+    return 0;
+}
+
+/** Find byte in memory block. AVX2 version, can be used only if
+ * @ref CPU_CAP_AVX2 capability is present and AVX state is enabled. The same
+ * considerations about reading beyond the block as for @ref MemchrSse2 apply.
+ *
+ * @param ptr Block to search in.
+ * @param value Byte value to find.
+ * @param size Size of the block in bytes.
+ * @return Pointer to the first found byte, zero if not found.
+ */
+__attribute__((target("avx2"))) inline const u8 *
+MemchrAvx2(const u8 *ptr, u8 value, size_t size)
+{
+    using namespace md_string;
+    if (!size) {
+        return 0;
+    }
+    const char c = value;
+    const v32qi v = { c, c, c, c, c, c, c, c, c, c, c, c, c, c, c, c,
+                      c, c, c, c, c, c, c, c, c, c, c, c, c, c, c, c };
+    const u8 *end = ptr + size;
+    const v32qi *p = reinterpret_cast<const v32qi *>(
+        reinterpret_cast<uintptr_t>(ptr) & ~31ul);
+    v32qi eq = *p == v;
+    u32 mask = static_cast<u32>(__builtin_ia32_pmovmskb256(eq)) >>
+        (ptr - reinterpret_cast<const u8 *>(p));
+    if (mask) {
+        const u8 *found = ptr + bsf(mask);
+        return found < end ? found : 0;
+    }
+    for (p++; reinterpret_cast<const u8 *>(p + 2) <= end; p += 2) {
+        eq = (p[0] == v) | (p[1] == v);
+        if (__builtin_ia32_pmovmskb256(eq)) {
+            break;
+        }
+    }
+    for (; reinterpret_cast<const u8 *>(p) < end; p++) {
+        eq = *p == v;
+        mask = __builtin_ia32_pmovmskb256(eq);
+        if (mask) {
+            const u8 *found = reinterpret_cast<const u8 *>(p) + bsf(mask);
+            return found < end ? found : 0;
+        }
+    }
+    return 0;
+}
+
+/** Get string length. SSE2 version. The same considerations about reading
+ * beyond the string as for @ref MemchrSse2 apply.
+ *
+ * @param str Null-terminated string.
+ * @return Number of characters before the terminating null character.
+ */
+inline size_t
+StrlenSse2(const char *str)
+{
+    using namespace md_string;
+    const v16qi zero = { };
+    const v16qi *p = reinterpret_cast<const v16qi *>(
+        reinterpret_cast<uintptr_t>(str) & ~15ul);
+    unsigned mask = Mask16(*p == zero) >> (str - reinterpret_cast<const char *>(p));
+    if (mask) {
+        return bsf(mask);
+    }
+    while (true) {
+        p++;
+        mask = Mask16(*p == zero);
+        if (mask) {
+            return reinterpret_cast<const char *>(p) + bsf(mask) - str;
+        }
+    }
+}
+
+/** Get string length. AVX2 version, can be used only if @ref CPU_CAP_AVX2
+ * capability is present and AVX state is enabled. The same considerations
+ * about reading beyond the string as for @ref MemchrSse2 apply.
+ *
+ * @param str Null-terminated string.
+ * @return Number of characters before the terminating null character.
+ */
+__attribute__((target("avx2"))) inline size_t
+StrlenAvx2(const char *str)
+{
+    using namespace md_string;
+    const v32qi zero = { };
+    const v32qi *p = reinterpret_cast<const v32qi *>(
+        reinterpret_cast<uintptr_t>(str) & ~31ul);
+    v32qi eq = *p == zero;
+    u32 mask = static_cast<u32>(__builtin_ia32_pmovmskb256(eq)) >>
+        (str - reinterpret_cast<const char *>(p));
+    if (mask) {
+        return bsf(mask);
+    }
+    while (true) {
+        p++;
+        eq = *p == zero;
+        mask = __builtin_ia32_pmovmskb256(eq);
+        if (mask) {
+            return reinterpret_cast<const char *>(p) + bsf(mask) - str;
+        }
+    }
+}
+
+/** Zero memory block with non-temporal stores which bypass the cache. The
+ * stores are weakly ordered, @ref StoreFence should be called before the
+ * memory is accessed by other agents.
+ *
+ * @param dst Buffer to zero, should be 16 bytes aligned.
+ * @param size Size of the buffer in bytes, should be multiple of 64.
+ */
+inline void
+ZeroNonTemporal(u8 *dst, size_t size)
+{
+    typedef long long v2di __attribute__((vector_size(16)));
+    const v2di zero = { 0, 0 };
+    v2di *p = reinterpret_cast<v2di *>(dst);
+    ASSERT(!(reinterpret_cast<uintptr_t>(dst) & 15) && !(size % 64));
+    for (v2di *end = p + size / sizeof(v2di); p < end; p += 4) {
+        __builtin_ia32_movntdq(p, zero);
+        __builtin_ia32_movntdq(p + 1, zero);
+        __builtin_ia32_movntdq(p + 2, zero);
+        __builtin_ia32_movntdq(p + 3, zero);
+    }
+}
+
+/** Copy memory block with non-temporal stores which bypass the cache. The
+ * source is prefetched with non-temporal hint as well. The same ordering
+ * considerations as for @ref ZeroNonTemporal apply.
+ *
+ * @param dst Destination buffer, should be 16 bytes aligned.
+ * @param src Source buffer, should be 16 bytes aligned.
+ * @param size Size of the buffers in bytes, should be multiple of 64.
+ */
+inline void
+CopyNonTemporal(u8 *dst, const u8 *src, size_t size)
+{
+    typedef long long v2di __attribute__((vector_size(16)));
+    v2di *d = reinterpret_cast<v2di *>(dst);
+    const v2di *s = reinterpret_cast<const v2di *>(src);
+    ASSERT(!((reinterpret_cast<uintptr_t>(dst) | reinterpret_cast<uintptr_t>(src)) & 15) &&
+           !(size % 64));
+    for (v2di *end = d + size / sizeof(v2di); d < end; d += 4, s += 4) {
+        __builtin_prefetch(s + 16, 0, 0);
+        v2di x0 = s[0], x1 = s[1], x2 = s[2], x3 = s[3];
+        __builtin_ia32_movntdq(d, x0);
+        __builtin_ia32_movntdq(d + 1, x1);
+        __builtin_ia32_movntdq(d + 2, x2);
+        __builtin_ia32_movntdq(d + 3, x3);
+    }
+}
+
+/** Make all previous stores, including non-temporal ones, globally visible
+ * before any subsequent store.
+ */
+inline void
+StoreFence()
+{
+    __builtin_ia32_sfence();
+}
+
+/** Check whether AVX state is enabled by the OS so that AVX instructions can
+ * be used.
+ */
+inline bool
+IsAvxEnabled()
+{
+    CpuCaps caps;
+    if (!caps.GetCapability(CPU_CAP_OSXSAVE)) {
+        return false;
+    }
+    /* XMM and YMM state should be enabled in XCR0. */
+    return (xgetbv(0) & 0x6) == 0x6;
+}
+
+} /* namespace cpu */
+
+#endif /* MD_STRING_H_ */
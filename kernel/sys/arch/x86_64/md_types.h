@@ -48,4 +48,9 @@ typedef uintptr_t   vsize_t; /**< Virtual size */
 typedef u64         paddr_t; /**< Physical address */
 typedef u64         psize_t; /**< Physical size */
 
+/** CPU cache line size in bytes. Data which is frequently modified by
+ * different CPUs should be aligned on this boundary to avoid false sharing.
+ */
+#define CACHE_LINE_SIZE     64
+
 #endif /* MD_TYPES_H_ */
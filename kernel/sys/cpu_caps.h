@@ -37,6 +37,18 @@ enum CpuCapId {
     CPU_CAP_PG_WIDTH_PHYS, /**< Physical address width. */
     CPU_CAP_PG_WIDTH_LIN, /**< Linear address width. */
 
+    /* Instruction set extensions. */
+    CPU_CAP_SSE2,       /**< SSE2 instructions. */
+    CPU_CAP_SSE42,      /**< SSE4.2 instructions. */
+    CPU_CAP_PCLMUL,     /**< PCLMULQDQ instruction. */
+    CPU_CAP_POPCNT,     /**< POPCNT instruction. */
+    CPU_CAP_AVX2,       /**< AVX2 instructions. Only the CPU support is
+                             reported, the state must be enabled by the OS
+                             before use. */
+    CPU_CAP_OSXSAVE,    /**< XSAVE state management is enabled by the OS,
+                             XGETBV instruction is available. */
+    CPU_CAP_ERMS,       /**< Enhanced REP MOVSB/STOSB. */
+
     CPU_CAP_MAX,        /**< Number of capabilities available for inquiring. */
 };
 
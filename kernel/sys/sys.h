@@ -43,10 +43,17 @@
 #include <md_stack.h>
 #include <BitString.h>
 #include <lock.h>
+#include <common/BuddyMagazine.h>
+#include <common/ConcurrentBuddyAllocator.h>
+#include <common/ConcurrentRBTree.h>
+#include <common/SeqRing.h>
+#include <common/LogRing.h>
+#include <common/TraceBuffer.h>
 
 #include <triton.h>
 
 #include <log.h>
+#include <trace.h>
 
 /* Virtual memory */
 #include <vm.h>
@@ -0,0 +1,222 @@
+/*
+ * /phoenix/kernel/sys/trace.h
+ *
+ * This file is a part of Phoenix operating system.
+ * Copyright (c) 2011-2012, Artyom Lebedev <artyom.lebedev@gmail.com>
+ * All rights reserved.
+ * See COPYING file for copyright details.
+ */
+
+/** @file trace.h
+ * Binary tracepoints with deferred formatting.
+ *
+ * Tracepoints are intended for high-frequency events (page mappings,
+ * allocations) which cannot afford text formatting. A tracepoint is declared
+ * statically in the header of its subsystem and defined in one of the
+ * subsystem source files:
+ * @code
+ * TRACEPOINT_DECLARE(VM, QuickMap);
+ * TRACEPOINT_DEFINE(VM, QuickMap, "pa 0x%016x flags 0x%x -> va 0x%016x");
+ * @endcode
+ * Then it is hit by @ref TRACEPOINT macro:
+ * @code
+ * TRACEPOINT(VM, QuickMap, pa, flags, va);
+ * @endcode
+ * Each hit stores binary record with the tracepoint descriptor address, time
+ * stamp, CPU index and raw arguments into per-CPU @ref TraceBuffer. The
+ * records are formatted only when decoded: by @ref trace::Tracer::Dump or by
+ * @a phoenix-trace command of the GDB extension which reads the buffers from
+ * a halted system. @n
+ *
+ * The arguments are stored as 64 bits integers so the format string may
+ * contain only integer conversions (@a d, @a x, @a X, @a o, @a z). @n
+ *
+ * Tracepoints are compiled out when @a ENABLE_TRACING is not defined. When
+ * compiled in, the subsystems are enabled at run time by
+ * @ref trace::Tracer::Enable, a hit of disabled tracepoint costs one load and
+ * one predicted branch.
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+namespace trace {
+
+/** Subsystems which have tracepoints. Each subsystem is enabled separately. */
+enum Subsystem {
+    /** Virtual memory: page mappings and physical pages allocation. */
+    SUBSYS_VM,
+    /** Kernel dynamic memory allocations. */
+    SUBSYS_MEM,
+
+    SUBSYS_MAX
+};
+
+/** Static tracepoint descriptor. Its address identifies the tracepoint in the
+ * trace records.
+ */
+class Tracepoint {
+public:
+    /** Tracepoint name, "<subsystem>.<name>". */
+    const char *name;
+    /** Format string for the record arguments. */
+    const char *format;
+    /** Subsystem the tracepoint belongs to. */
+    Subsystem subsystem;
+};
+
+/** Bit mask of enabled subsystems, see @ref Subsystem. */
+extern u32 enabledSubsystems;
+
+/** Check if tracepoints of the subsystem are enabled. */
+inline bool
+IsEnabled(Subsystem subsystem)
+{
+    return __atomic_load_n(&enabledSubsystems, __ATOMIC_RELAXED) & (1 << subsystem);
+}
+
+/** Tracing facility state. */
+class Tracer {
+public:
+    enum {
+        /** Number of record slots in each per-CPU buffer. */
+        BUFFER_SIZE = 1024,
+    };
+
+    Tracer();
+
+    ~Tracer();
+
+    /** Allocate per-CPU buffers.
+     *
+     * @param numCpus Number of CPUs which can hit tracepoints.
+     * @return Status code.
+     */
+    RetCode Initialize(size_t numCpus);
+
+    /** Enable tracepoints of the specified subsystems.
+     *
+     * @param mask Bit mask of subsystems, bit number is a value of
+     *      @ref Subsystem.
+     */
+    void Enable(u32 mask = ~0u);
+
+    /** Disable tracepoints of the specified subsystems.
+     *
+     * @param mask Bit mask of subsystems, bit number is a value of
+     *      @ref Subsystem.
+     */
+    void Disable(u32 mask = ~0u);
+
+    /** Put a record for the tracepoint hit. Should not be called directly,
+     * use @ref TRACEPOINT macro.
+     */
+    template <typename... Args>
+    inline void Put(const Tracepoint *tp, Args... args) {
+        static_assert(sizeof...(Args) <= TraceBuffer::MAX_ARGS,
+                      "Too many tracepoint arguments");
+        /* Extra element to avoid zero-size array. */
+        u64 values[] = { _ArgValue(args)..., 0 };
+        size_t cpu = _GetCpu();
+        _buffers[cpu].Put(reinterpret_cast<uintptr_t>(tp), cpu::rdtsc(), cpu,
+                          values, sizeof...(Args));
+    }
+
+    /** Format all buffered records to the system log and remove them from the
+     * buffers. Records of all CPUs are merged in time stamp order.
+     */
+    void Dump();
+
+    /** Get total number of records put on all CPUs. */
+    u64 GetNumPut();
+
+    /** Get total number of records overwritten before they were dumped. */
+    u64 GetNumOverwritten();
+
+private:
+    /** Per-CPU buffers. */
+    TraceBuffer *_buffers = 0;
+    /** Merges the buffers content in time stamp order. */
+    SeqRingMerger<TraceBuffer> _merger;
+    size_t _numCpus = 0;
+    /** Serializes the records retrieval in @ref Dump. */
+    SpinLock _dumpLock;
+
+    /** Get index of the current CPU. */
+    inline size_t _GetCpu() {
+        /* XXX Only the bootstrap CPU is running on this phase. */
+        return 0;
+    }
+
+    template <typename T>
+    static inline u64 _ArgValue(T value) {
+        return static_cast<u64>(value);
+    }
+
+    template <typename T>
+    static inline u64 _ArgValue(T *value) {
+        return reinterpret_cast<uintptr_t>(value);
+    }
+};
+
+extern Tracer *tracer;
+
+/** Allocate tracing buffers and enable all subsystems. Does nothing if
+ * @a ENABLE_TRACING is not defined.
+ */
+void InitTrace();
+
+/** Used to reference the arguments of compiled out tracepoints. */
+template <typename... Args>
+inline void
+Ignore(Args...)
+{
+}
+
+} /* namespace trace */
+
+/** Declare a tracepoint. Should be placed in the global namespace.
+ *
+ * @param __subsys Subsystem name, see @ref trace::Subsystem.
+ * @param __name Tracepoint name.
+ */
+#define TRACEPOINT_DECLARE(__subsys, __name) \
+    extern const trace::Tracepoint __tp_ ## __subsys ## _ ## __name
+
+/** Define a tracepoint which is declared by @ref TRACEPOINT_DECLARE. Should be
+ * placed in the global namespace.
+ *
+ * @param __subsys Subsystem name, see @ref trace::Subsystem.
+ * @param __name Tracepoint name.
+ * @param __fmt Format string for the tracepoint arguments.
+ */
+#define TRACEPOINT_DEFINE(__subsys, __name, __fmt) \
+    const trace::Tracepoint __tp_ ## __subsys ## _ ## __name = \
+        { #__subsys "." #__name, __fmt, trace::SUBSYS_ ## __subsys }
+
+#ifdef ENABLE_TRACING
+
+/** Hit a tracepoint.
+ *
+ * @param __subsys Subsystem name, see @ref trace::Subsystem.
+ * @param __name Tracepoint name.
+ * @param ... Tracepoint arguments, integers or pointers, at most
+ *      @ref TraceBuffer::MAX_ARGS.
+ */
+#define TRACEPOINT(__subsys, __name, ...) do { \
+    if (UNLIKELY(trace::IsEnabled(trace::SUBSYS_ ## __subsys))) { \
+        trace::tracer->Put(&__tp_ ## __subsys ## _ ## __name, ## __VA_ARGS__); \
+    } \
+} while (false)
+
+#else /* ENABLE_TRACING */
+
+#define TRACEPOINT(__subsys, __name, ...) do { \
+    if (false) { \
+        trace::Ignore(__VA_ARGS__); \
+    } \
+} while (false)
+
+#endif /* ENABLE_TRACING */
+
+#endif /* TRACE_H_ */
@@ -15,6 +15,21 @@
 #define VM_MM_H_
 
 #include <vm_page.h>
+#include <vm_zone.h>
+#include <vm_slab.h>
+#include <vm_radix.h>
+
+TRACEPOINT_DECLARE(VM, MapPage);
+TRACEPOINT_DECLARE(VM, QuickMap);
+TRACEPOINT_DECLARE(VM, QuickUnmap);
+TRACEPOINT_DECLARE(VM, AllocPages);
+TRACEPOINT_DECLARE(VM, FreePages);
+TRACEPOINT_DECLARE(MEM, Alloc);
+TRACEPOINT_DECLARE(MEM, Free);
+
+namespace efi {
+class MemoryMap;
+}
 
 namespace vm {
 
@@ -59,6 +74,40 @@ private:
     void **_mapPte;
 };
 
+/** Zero pages bypassing the CPU cache, so that zeroing does not evict
+ * useful data. Intended for freshly allocated pages and LAT tables which are
+ * not accessed immediately in their entirety.
+ *
+ * @param va Virtual address of the first page, should be page aligned.
+ * @param numPages Number of consecutive pages to zero.
+ */
+void ZeroPages(Vaddr va, size_t numPages);
+
+/** Zero pages bypassing the CPU cache. Batch variant for pages which are not
+ * adjacent in the virtual address space, e.g. mapped by @ref QuickMap.
+ *
+ * @param pages Array of page aligned virtual addresses.
+ * @param numPages Number of pages in @a pages array.
+ */
+void ZeroPages(const Vaddr *pages, size_t numPages);
+
+/** Zero one page bypassing the CPU cache.
+ *
+ * @param va Virtual address of the page, should be page aligned.
+ */
+inline void
+ZeroPage(Vaddr va)
+{
+    ZeroPages(va, 1);
+}
+
+/** Copy page content bypassing the CPU cache for the destination.
+ *
+ * @param dst Virtual address of the destination page, should be page aligned.
+ * @param src Virtual address of the source page, should be page aligned.
+ */
+void CopyPage(Vaddr dst, Vaddr src);
+
 /** This class represents kernel virtual memory manager. */
 class MM {
 public:
@@ -131,18 +180,89 @@ public:
      * @return Reference to the physical page descriptor.
      */
     inline Page &GetPage(Paddr pa) {
-        ASSERT(pa >= _physFirst && pa < _physFirst + _physRange);
-        return _pageDesc[(pa - _physFirst) / PAGE_SIZE];
+        PhysZone *zone = GetZone(pa);
+        ASSERT(zone);
+        return zone->GetPage(pa);
     }
 
     inline bool IsPageManaged(Paddr pa) {
-        if (pa < _physFirst || pa >= _physFirst + _physRange) {
+        PhysZone *zone = GetZone(pa);
+        if (!zone) {
             return false;
         }
-        Page &page = GetPage(pa);
+        Page &page = zone->GetPage(pa);
         return page.GetFlags() & Page::F_MANAGED;
     }
 
+    /** Get physical memory zone which contains the specified address.
+     *
+     * @param pa Physical address.
+     * @return Zone which contains the address, zero if the address is not in
+     *      managed physical memory.
+     */
+    inline PhysZone *GetZone(Paddr pa) {
+        /* Zones are sorted by address. */
+        size_t low = 0, high = _numZones;
+        while (low < high) {
+            size_t mid = (low + high) / 2;
+            if (pa < _zones[mid].GetStart()) {
+                high = mid;
+            } else if (pa >= _zones[mid].GetEnd()) {
+                low = mid + 1;
+            } else {
+                return &_zones[mid];
+            }
+        }
+        return 0;
+    }
+
+    /** Get number of physical memory zones. */
+    inline size_t GetNumZones() { return _numZones; }
+
+    /** Get physical memory zone by its index. Zones are sorted by address. */
+    inline PhysZone &GetZone(size_t idx) {
+        ASSERT(idx < _numZones);
+        return _zones[idx];
+    }
+
+    /** Check if the virtual address belongs to the persistent physical memory
+     * mapping.
+     */
+    inline bool IsPhysMapped(Vaddr va) {
+        return va >= _physMemMap && va < _physMemMap + _physRange;
+    }
+
+    /** Convert virtual address in persistent physical memory mapping to
+     * corresponding physical address.
+     *
+     * @param va Virtual address in persistent physical memory mapping.
+     * @return Corresponding physical address.
+     */
+    inline Paddr VirtToPhys(Vaddr va) {
+        ASSERT(IsPhysMapped(va));
+        va -= _physMemMap;
+        return _physFirst + va.IdentityPaddr();
+    }
+
+    /** Allocate physically contiguous block of pages. The block is aligned
+     * to its size rounded up to power of two.
+     *
+     * @param numPages Number of pages to allocate.
+     * @param policy Zone preference policy.
+     * @return Descriptor of the first page in the block, zero if failed.
+     */
+    Page *AllocatePages(size_t numPages = 1,
+                        PhysZone::Policy policy = PhysZone::POLICY_NORMAL);
+
+    /** Free block of pages allocated by @ref AllocatePages.
+     *
+     * @param page Descriptor of the first page in the block.
+     */
+    void FreePages(Page *page);
+
+    /** Get kernel heap allocator. */
+    inline SlabAllocator &GetHeap() { return _heap; }
+
 private:
     friend class Page;
 
@@ -167,8 +287,10 @@ private:
     Paddr _physFirst;
     /** Range of managed physical memory addresses. */
     psize_t _physRange;
-    /** Array of managed physical pages descriptors. */
-    Page *_pageDesc;
+    /** Physical memory zones sorted by address. */
+    PhysZone *_zones;
+    /** Number of physical memory zones. */
+    size_t _numZones;
 
     /** Amount of physical memory available. */
     psize_t _physMemSize;
@@ -181,6 +303,9 @@ private:
     /** Default LAT root table. */
     Paddr _defLatRoot;
 
+    /** Kernel heap allocator. */
+    SlabAllocator _heap;
+
     /** Initialize physical memory. It will create persistent PM map and page
      * descriptors array.
      *
@@ -191,6 +316,14 @@ private:
      */
     void _InitializePhysMem(void *memMap, size_t memMapNumDesc,
                             size_t memMapDescSize, u32 memMapDescVersion);
+
+    /** Create physical memory zones from the managed regions of the memory
+     * map. Zones allocators internal data is allocated from the initial heap.
+     *
+     * @param map Memory map.
+     * @param numManaged Number of managed regions in the map.
+     */
+    void _CreateZones(efi::MemoryMap &map, size_t numManaged);
 };
 
 /** Global memory manager singleton. */
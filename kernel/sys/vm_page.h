@@ -17,7 +17,7 @@
 namespace vm {
 
 /** Physical page descriptor. The kernel memory manager maintains array of
- * these descriptors which covers whole the range of managed physical memory.
+ * these descriptors for each physical memory zone.
  */
 class Page {
 public:
@@ -37,10 +37,16 @@ public:
         F_ACPI_RECLAIM =    0x4,
         /** ACPI non-volatile storage area. */
         F_ACPI_NVS =        0x8,
+        /** The page is the first page of a block allocated from the physical
+         * memory allocator. Block order is available via @ref GetOrder.
+         */
+        F_ALLOCATED =       0x10,
     };
 
-    Page(long flags = 0) {
+    Page(long flags = 0, int zone = 0) {
         _flags = flags;
+        _order = 0;
+        _zone = zone;
     }
 
     /** Retrieve flags.
@@ -59,6 +65,22 @@ public:
         return ret;
     }
 
+    /** Get order of the allocated block which starts with this page. Valid
+     * only if @ref F_ALLOCATED flag is set.
+     *
+     * @return Block order, i.e. the block consists of (2 ^ order) pages.
+     */
+    inline int GetOrder() { return _order; }
+
+    /** Set order of the allocated block which starts with this page.
+     *
+     * @param order Block order.
+     */
+    inline void SetOrder(int order) { _order = order; }
+
+    /** Get index of the physical memory zone the page belongs to. */
+    inline int GetZone() { return _zone; }
+
     /** Get the physical address of the page which is described by this
      * descriptor.
      *
@@ -80,6 +102,10 @@ public:
 
 private:
     u32 _flags;
+    /** Order of the allocated block, see @ref GetOrder. */
+    u8 _order;
+    /** Index of the zone, see @ref GetZone. */
+    u8 _zone;
 };
 
 }
@@ -0,0 +1,342 @@
+/*
+ * /phoenix/kernel/sys/vm_radix.h
+ *
+ * This file is a part of Phoenix operating system.
+ * Copyright (c) 2011-2012, Artyom Lebedev <artyom.lebedev@gmail.com>
+ * All rights reserved.
+ * See COPYING file for copyright details.
+ */
+
+/** @file vm_radix.h
+ * Radix tree for sparse mappings indexed by page index.
+ */
+
+#ifndef VM_RADIX_H_
+#define VM_RADIX_H_
+
+namespace vm {
+
+/** Radix tree which maps page index (see @ref Addr::GetPageIdx) to a pointer.
+ * Intended for sparse per-page data - page caches, reverse mappings etc. @n
+ *
+ * Each node resolves @ref NODE_SHIFT bits of the index, so lookup costs one
+ * memory access per level without any comparisons. The tree height grows
+ * when an index which does not fit the current height is inserted and
+ * shrinks back on deletions, nodes are allocated only for populated index
+ * ranges. @n
+ *
+ * Each item can be marked with up to @ref MAX_TAGS tags (e.g. dirty,
+ * writeback). Each node keeps per-tag bitmaps of the slots which have tagged
+ * items in their subtrees, so tagged items are found without scanning
+ * untagged subtrees. @n
+ *
+ * Modifications are serialized by the tree lock. Lookups are lockless: a new
+ * node is fully initialized before it is linked, and a removed node is not
+ * released until all readers which could see it finish their read-side
+ * sections (see @ref ReadBegin). Removed items are not tracked by the tree,
+ * the caller should take care of items lifetime.
+ */
+class PageRadixTreeBase {
+public:
+    /** Various constants. */
+    enum {
+        /** Number of index bits resolved by one node. */
+        NODE_SHIFT = 6,
+        /** Number of slots in one node. */
+        NODE_SIZE = 1 << NODE_SHIFT,
+        /** Maximal number of tags. */
+        MAX_TAGS = 2,
+        /** Maximal tree height. */
+        MAX_HEIGHT = (sizeof(PageIdx) * NBBY + NODE_SHIFT - 1) / NODE_SHIFT,
+    };
+
+    PageRadixTreeBase();
+
+    ~PageRadixTreeBase();
+
+    /** Initialize the tree. Should be called before any readers appear.
+     *
+     * @param numCpus Number of CPUs which can read the tree.
+     * @return Status code.
+     */
+    RetCode Initialize(size_t numCpus);
+
+    /** Start read-side section. Sections cannot be nested. The caller should
+     * not be preempted or migrated to another CPU until the section end.
+     *
+     * @param cpu Index of the current CPU.
+     */
+    inline void ReadBegin(size_t cpu) { _readers.Enter(cpu); }
+
+    /** End read-side section.
+     *
+     * @param cpu Index of the current CPU.
+     */
+    inline void ReadEnd(size_t cpu) { _readers.Exit(cpu); }
+
+    /** Lockless lookup. Should be called inside a read-side section if the
+     * tree can be modified concurrently.
+     *
+     * @param idx Index to look for.
+     * @return Item stored at the index, zero if none.
+     */
+    inline void *Lookup(PageIdx idx) {
+        Node *node = __atomic_load_n(&_root, __ATOMIC_ACQUIRE);
+        if (!node || !_Fits(node->shift, idx)) {
+            return 0;
+        }
+        while (true) {
+            void *slot = __atomic_load_n(&node->slots[_GetOffset(node, idx)],
+                                         __ATOMIC_ACQUIRE);
+            if (!node->shift || !slot) {
+                return slot;
+            }
+            node = static_cast<Node *>(slot);
+        }
+    }
+
+    /** Insert item.
+     *
+     * @param idx Index to insert the item at.
+     * @param item Item to insert, should not be zero.
+     * @return RC(SUCCESS) if inserted, RC(INV_PARAM) if the index is already
+     *      occupied, RC(NO_MEMORY) if failed to allocate nodes.
+     */
+    RetCode Insert(PageIdx idx, void *item);
+
+    /** Delete item. The item tags are cleared.
+     *
+     * @param idx Index of the item to delete.
+     * @return Deleted item, zero if no item at the index.
+     */
+    void *Delete(PageIdx idx);
+
+    /** Set tag for an item.
+     *
+     * @param idx Index of the item.
+     * @param tag Tag to set.
+     * @return @a true if the tag is set, @a false if no item at the index.
+     */
+    bool SetTag(PageIdx idx, int tag);
+
+    /** Clear tag for an item.
+     *
+     * @param idx Index of the item.
+     * @param tag Tag to clear.
+     * @return @a true if the tag was set, @a false otherwise.
+     */
+    bool ClearTag(PageIdx idx, int tag);
+
+    /** Check if an item is tagged. Lockless.
+     *
+     * @param idx Index of the item.
+     * @param tag Tag to check.
+     * @return @a true if the item is tagged.
+     */
+    bool GetTag(PageIdx idx, int tag);
+
+    /** Check if any item in the tree is tagged. */
+    inline bool IsTagged(int tag) {
+        ASSERT(tag >= 0 && tag < MAX_TAGS);
+        Node *node = __atomic_load_n(&_root, __ATOMIC_ACQUIRE);
+        return node && __atomic_load_n(&node->tags[tag], __ATOMIC_RELAXED);
+    }
+
+    /** Find the first item at index not less than the provided one. Lockless.
+     *
+     * @param idx Index to start search from.
+     * @param found Index of the found item is stored there.
+     * @param tag Find only items with this tag, all items if -1.
+     * @return Found item, zero if none.
+     */
+    void *FindNext(PageIdx idx, PageIdx *found, int tag = -1);
+
+    /** Gang lookup - retrieve several items in ascending index order starting
+     * from the provided index. Lockless.
+     *
+     * @param first Index to start search from.
+     * @param items Found items are stored there.
+     * @param maxItems Maximal number of items to retrieve.
+     * @param indices Indices of found items are stored there if not null.
+     * @param tag Retrieve only items with this tag, all items if -1.
+     * @return Number of items retrieved.
+     */
+    size_t GangLookup(PageIdx first, void **items, size_t maxItems,
+                      PageIdx *indices = 0, int tag = -1);
+
+    /** Get number of items in the tree. */
+    inline size_t GetSize() { return _numItems; }
+
+    /** Get current tree height. */
+    inline int GetHeight() {
+        Node *node = __atomic_load_n(&_root, __ATOMIC_ACQUIRE);
+        return node ? node->shift / NODE_SHIFT + 1 : 0;
+    }
+
+    /** Validate the tree structure, intended for debugging and testing.
+     * Should not be called concurrently with modifications.
+     *
+     * @return @a true if the tree is valid, @a false otherwise.
+     */
+    bool Validate();
+
+private:
+    /** Tree node. */
+    class Node {
+    public:
+        /** Child nodes, or items in the last level nodes. */
+        void *slots[NODE_SIZE];
+        /** Bitmap of occupied slots. */
+        u64 present = 0;
+        /** Per-tag bitmaps of slots which have tagged items in their
+         * subtrees.
+         */
+        u64 tags[MAX_TAGS];
+        /** Index bits shift of the node level, zero for the last level. */
+        int shift;
+        /** Next node in the retired nodes list. */
+        Node *nextRetired;
+        /** Epoch in which the node was removed. */
+        u64 retireEpoch;
+
+        Node(int shift);
+    };
+
+    /** Path from the root to the last level node. */
+    class Path {
+    public:
+        Node *nodes[MAX_HEIGHT];
+        /** Offset of the slot taken in each node. */
+        size_t offsets[MAX_HEIGHT];
+        /** Number of nodes in the path. */
+        int depth = 0;
+    };
+
+    static_assert(NODE_SIZE == sizeof(u64) * NBBY,
+                  "Node slots bitmaps should fit 64 bits word");
+
+    /** Serializes writers. */
+    SpinLock _lock;
+    RBTreeReaders _readers;
+    Node *_root = 0;
+    size_t _numItems = 0;
+    /** List of removed nodes ordered by removal epoch. */
+    Node *_retiredHead = 0, *_retiredTail = 0;
+
+    /** Check if the index fits a subtree with the root at the provided
+     * level.
+     */
+    static inline bool _Fits(int shift, PageIdx idx) {
+        return shift + NODE_SHIFT >= static_cast<int>(sizeof(PageIdx) * NBBY) ||
+               !(idx >> (shift + NODE_SHIFT));
+    }
+
+    /** Get slot offset in the node for the index. */
+    static inline size_t _GetOffset(Node *node, PageIdx idx) {
+        return (idx >> node->shift) & (NODE_SIZE - 1);
+    }
+
+    /** Find the last level node for the index.
+     *
+     * @param idx Index to look for.
+     * @param path Path to the node is stored there.
+     * @return @a true if there is an item at the index.
+     */
+    bool _FindPath(PageIdx idx, Path &path);
+
+    /** Clear tag bits along the path bottom-up while nodes have no tagged
+     * slots.
+     */
+    void _PropagateTagClear(Path &path, int tag);
+
+    /** Remove empty nodes along the path bottom-up and shrink the tree
+     * height if possible.
+     */
+    void _Collapse(Path &path);
+
+    /** Put removed node to the retired list. */
+    void _Retire(Node *node);
+
+    /** Release retired nodes stamped with epochs less than the provided. */
+    void _Reclaim(u64 oldestEpoch);
+
+    /** Release all nodes in the subtree. */
+    void _FreeSubtree(Node *node);
+
+    /** Find the first item at index not less than the provided one in the
+     * subtree.
+     */
+    void *_FindNext(Node *node, PageIdx idx, PageIdx *found, int tag);
+
+    /** Validate the subtree.
+     *
+     * @param node Subtree root.
+     * @param tags Tags bits expected in the subtree are stored there.
+     * @param numItems Number of items in the subtree is added there.
+     */
+    bool _ValidateSubtree(Node *node, bool *tags, size_t *numItems);
+};
+
+/** Radix tree with typed items.
+ * @param T Type of items stored in the tree.
+ */
+template <class T>
+class PageRadixTree : public PageRadixTreeBase {
+public:
+    inline PageRadixTree() : PageRadixTreeBase() { }
+
+    /** @see PageRadixTreeBase::Lookup */
+    inline T *Lookup(PageIdx idx) {
+        return static_cast<T *>(PageRadixTreeBase::Lookup(idx));
+    }
+
+    /** Lookup the item by the page address.
+     *
+     * @param addr Virtual or physical address in the page.
+     * @return Item stored for the page, zero if none.
+     */
+    template <typename AddrType>
+    inline T *Lookup(Addr<AddrType> addr) {
+        return Lookup(addr.GetPageIdx());
+    }
+
+    /** @see PageRadixTreeBase::Insert */
+    inline RetCode Insert(PageIdx idx, T *item) {
+        return PageRadixTreeBase::Insert(idx, item);
+    }
+
+    /** @see PageRadixTreeBase::Delete */
+    inline T *Delete(PageIdx idx) {
+        return static_cast<T *>(PageRadixTreeBase::Delete(idx));
+    }
+
+    /** @see PageRadixTreeBase::FindNext */
+    inline T *FindNext(PageIdx idx, PageIdx *found, int tag = -1) {
+        return static_cast<T *>(PageRadixTreeBase::FindNext(idx, found, tag));
+    }
+
+    /** @see PageRadixTreeBase::GangLookup */
+    size_t GangLookup(PageIdx first, T **items, size_t maxItems,
+                      PageIdx *indices = 0, int tag = -1)
+    {
+        size_t numFound = 0;
+        PageIdx idx = first, found;
+        T *item;
+        while (numFound < maxItems && (item = FindNext(idx, &found, tag))) {
+            items[numFound] = item;
+            if (indices) {
+                indices[numFound] = found;
+            }
+            numFound++;
+            idx = found + 1;
+            if (!idx) {
+                break;
+            }
+        }
+        return numFound;
+    }
+};
+
+} /* namespace vm */
+
+#endif /* VM_RADIX_H_ */
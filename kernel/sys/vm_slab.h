@@ -0,0 +1,156 @@
+/*
+ * /phoenix/kernel/sys/vm_slab.h
+ *
+ * This file is a part of Phoenix operating system.
+ * Copyright (c) 2011-2012, Artyom Lebedev <artyom.lebedev@gmail.com>
+ * All rights reserved.
+ * See COPYING file for copyright details.
+ */
+
+/** @file vm_slab.h
+ * Kernel heap slab allocator.
+ */
+
+#ifndef VM_SLAB_H_
+#define VM_SLAB_H_
+
+namespace vm {
+
+/** Slab allocator which backs the kernel heap after the memory manager is
+ * initialized. @n
+ *
+ * Small objects are allocated from a set of size classes. Each size class
+ * carves one-page slabs into equal objects. The slab header is placed at the
+ * beginning of the page, so the slab of an object is found by rounding its
+ * address down to the page boundary. Each CPU has its own free list for each
+ * size class which serves allocations and freeings without any locking.
+ * Objects are moved between the per-CPU lists and the slabs in batches. @n
+ *
+ * Allocations which do not fit the largest size class are served by
+ * allocating physical pages directly. Such allocations are always page
+ * aligned while slab objects never are, and this is how they are
+ * distinguished on freeing.
+ */
+class SlabAllocator {
+public:
+    /** Various constants. */
+    enum {
+        /** Maximal number of CPUs supported. */
+        MAX_CPUS = 32,
+        /** Size reserved for the slab header in the slab page. */
+        SLAB_HDR_SIZE = 64,
+        /** Minimal allocation granularity and default alignment. */
+        MIN_ALIGN = 16,
+        /** Number of size classes. */
+        NUM_CLASSES = 15,
+        /** Object size of the largest size class. */
+        MAX_OBJ_SIZE = 2016,
+        /** Maximal number of objects in a per-CPU free list. */
+        CPU_LIST_SIZE = 64,
+        /** Number of objects moved between a per-CPU list and slabs at once. */
+        BATCH_SIZE = CPU_LIST_SIZE / 2,
+    };
+
+    SlabAllocator();
+
+    /** Allocate memory block.
+     *
+     * @param size Size of the block.
+     * @param align Required alignment, must be power of two. Zero for default
+     *      alignment which is @ref MIN_ALIGN.
+     * @return Pointer to the allocated block, zero if failed.
+     */
+    void *Allocate(size_t size, size_t align = 0);
+
+    /** Free memory block previously allocated by @ref Allocate.
+     *
+     * @param ptr Pointer to the block.
+     */
+    void Free(void *ptr);
+
+private:
+    class SizeClass;
+
+    /** Slab header located at the beginning of each slab page. */
+    class Slab {
+    public:
+        Slab *next, *prev; /**< Links in the size class partial slabs list. */
+        SizeClass *sizeClass; /**< Size class the slab belongs to. */
+        void *freeList; /**< List of free objects in the slab. */
+        size_t numFree; /**< Number of free objects in the slab. */
+        bool isListed; /**< The slab is in the partial slabs list. */
+
+        /** Get slab of the provided object. */
+        static inline Slab *FromObject(void *obj) {
+            return Vaddr(obj).RoundDown(PAGE_SIZE);
+        }
+    };
+
+    /** Objects size class. */
+    class SizeClass {
+    public:
+        size_t objSize; /**< Size of each object. */
+        size_t objsPerSlab; /**< Number of objects in one slab. */
+        Slab *partial = 0; /**< Slabs which have free objects. */
+        Slab *empty = 0; /**< One cached slab with all objects free. */
+        SpinLock lock; /**< Protects the slabs lists. */
+
+        /** Insert slab in partial slabs list. */
+        void Insert(Slab *slab);
+        /** Remove slab from partial slabs list. */
+        void Remove(Slab *slab);
+    };
+
+    /** Per-CPU free lists. Aligned to avoid false sharing between CPUs. */
+    class CpuCache {
+    public:
+        /** Free objects for each size class, linked through their first word. */
+        void *freeList[NUM_CLASSES];
+        /** Number of objects in each list. */
+        u32 numFree[NUM_CLASSES];
+    } __ALIGNED(CACHE_LINE_SIZE);
+
+    /** Objects sizes of the size classes. */
+    static const u16 _classSizes[NUM_CLASSES];
+    /** Size classes. */
+    SizeClass _classes[NUM_CLASSES];
+    /** Size class index for each size in @ref MIN_ALIGN units. */
+    u8 _classIdx[MAX_OBJ_SIZE / MIN_ALIGN + 1];
+    /** Per-CPU free lists. */
+    CpuCache _cpus[MAX_CPUS];
+
+    /** Get current CPU index. SMP is not supported yet so only the boot CPU
+     * executes the kernel code.
+     */
+    static inline size_t _GetCpu() { return 0; }
+
+    /** Get size class index for the provided size and alignment.
+     *
+     * @return Size class index, -1 if the allocation does not fit any class.
+     */
+    int _GetClass(size_t size, size_t align);
+
+    /** Move up to @ref BATCH_SIZE objects from slabs to per-CPU list.
+     *
+     * @param cache Per-CPU cache to fill.
+     * @param classIdx Size class index.
+     */
+    void _Refill(CpuCache &cache, int classIdx);
+
+    /** Move @ref BATCH_SIZE objects from per-CPU list back to their slabs.
+     *
+     * @param cache Per-CPU cache to drain.
+     * @param classIdx Size class index.
+     */
+    void _Drain(CpuCache &cache, int classIdx);
+
+    /** Allocate and initialize new slab for the size class. */
+    Slab *_CreateSlab(SizeClass &sc);
+
+    /** Allocate pages for a large allocation. */
+    void *_AllocateLarge(size_t size);
+};
+
+} /* namespace vm */
+
+#endif /* VM_SLAB_H_ */
@@ -0,0 +1,138 @@
+/*
+ * /phoenix/kernel/sys/vm_zone.h
+ *
+ * This file is a part of Phoenix operating system.
+ * Copyright (c) 2011-2012, Artyom Lebedev <artyom.lebedev@gmail.com>
+ * All rights reserved.
+ * See COPYING file for copyright details.
+ */
+
+/** @file vm_zone.h
+ * Physical memory zones.
+ */
+
+#ifndef VM_ZONE_H_
+#define VM_ZONE_H_
+
+namespace vm {
+
+/** Physical memory zone. Managed physical memory is split into zones, one
+ * zone per contiguous run of managed regions reported by the firmware. Each
+ * zone has its own page descriptors array and its own physical pages
+ * allocator with its own lock, so holes between the zones do not consume
+ * page descriptors and allocations in different zones do not contend. @n
+ *
+ * Zones never cross @ref DMA32_LIMIT, so each zone entirely belongs either to
+ * DMA32 memory or to high memory. Allocations choose zones according to
+ * @ref Policy.
+ */
+class PhysZone {
+public:
+    /** Various constants. */
+    enum {
+        /** Maximal order of physical pages blocks allocated, in pages. */
+        MAX_ORDER = 14,
+        /** Maximal number of zones. Limited by the zone index size in the
+         * page descriptor.
+         */
+        MAX_ZONES = 256,
+    };
+
+    /** Upper limit for memory accessible by devices with 32 bits DMA. */
+    static const paddr_t DMA32_LIMIT = static_cast<paddr_t>(1) << 32;
+
+    /** Zone preference policy for physical memory allocations. */
+    enum Policy {
+        /** Only memory below @ref DMA32_LIMIT. Zones are tried in ascending
+         * order.
+         */
+        POLICY_DMA32,
+        /** Any memory. High memory zones are tried first in order to
+         * preserve DMA32 memory for the devices which require it.
+         */
+        POLICY_NORMAL,
+        /** Only memory above @ref DMA32_LIMIT. Zones are tried in descending
+         * order.
+         */
+        POLICY_HIGH,
+    };
+
+    /** Initialize the zone allocator. Zone address range should be already
+     * set. The allocator is initially empty, it is populated when the page
+     * descriptors are initialized.
+     *
+     * @return Status code.
+     */
+    RetCode Initialize();
+
+    /** Get zone start address. */
+    inline Paddr GetStart() { return _start; }
+
+    /** Get zone end address. */
+    inline Paddr GetEnd() { return _end; }
+
+    /** Get number of pages in the zone. */
+    inline size_t GetNumPages() { return (_end - _start) / PAGE_SIZE; }
+
+    /** Check if the zone contains the specified physical address. */
+    inline bool Contains(Paddr pa) { return pa >= _start && pa < _end; }
+
+    /** Check if the zone can serve allocations with the specified policy. */
+    inline bool Matches(Policy policy) {
+        if (policy == POLICY_DMA32) {
+            return _end <= DMA32_LIMIT;
+        }
+        if (policy == POLICY_HIGH) {
+            return _start >= DMA32_LIMIT;
+        }
+        return true;
+    }
+
+    /** Get descriptor of the page which belongs to the zone. */
+    inline Page &GetPage(Paddr pa) {
+        ASSERT(Contains(pa));
+        return _pageDesc[(pa - _start) / PAGE_SIZE];
+    }
+
+    /** Get physical address of the page which belongs to the zone. */
+    inline Paddr GetPaddr(Page *page) {
+        ASSERT(page >= _pageDesc && page < _pageDesc + GetNumPages());
+        return _start + (page - _pageDesc) * PAGE_SIZE;
+    }
+
+    /** Allocate physically contiguous block of pages from the zone.
+     *
+     * @see MM::AllocatePages
+     */
+    Page *Allocate(size_t numPages);
+
+    /** Free block of pages previously allocated from the zone.
+     *
+     * @see MM::FreePages
+     */
+    void Free(Page *page);
+
+    /** Take snapshot of the zone allocator statistics. */
+    void GetStats(BuddyAllocatorBase::Stats *stats);
+
+private:
+    friend class MM;
+
+    /** Address range of the zone. */
+    Paddr _start, _end;
+    /** Descriptors of the zone pages. */
+    Page *_pageDesc = 0;
+    /** Physical memory allocator. */
+    BuddyAllocator<paddr_t> _alloc;
+    /** Lock for the physical memory allocator. */
+    SpinLock _lock;
+
+    /** Return all available pages of the zone to its allocator. Page
+     * descriptors should be initialized.
+     */
+    void _Populate();
+};
+
+} /* namespace vm */
+
+#endif /* VM_ZONE_H_ */
@@ -14,11 +14,20 @@
 #include <sys.h>
 #include <boot.h>
 #include <efi.h>
+#include <md_string.h>
 
 using namespace vm;
 
 MM *vm::mm;
 
+TRACEPOINT_DEFINE(VM, MapPage, "va 0x%016x -> pa 0x%016x");
+TRACEPOINT_DEFINE(VM, QuickMap, "pa 0x%016x flags 0x%x -> va 0x%016x");
+TRACEPOINT_DEFINE(VM, QuickUnmap, "va 0x%016x");
+TRACEPOINT_DEFINE(VM, AllocPages, "%d pages policy %d -> page 0x%016x");
+TRACEPOINT_DEFINE(VM, FreePages, "page 0x%016x");
+TRACEPOINT_DEFINE(MEM, Alloc, "size %d align %d -> 0x%016x");
+TRACEPOINT_DEFINE(MEM, Free, "0x%016x");
+
 VmCaps vm::vmCaps;
 
 MM::InitState MM::_initState = MM::IS_INITIAL;
@@ -58,17 +67,19 @@ MapHeap()
                 pa = boot::MappedToBoot(Vaddr(tmpHeap).RoundUp()).IdentityPaddr();
                 tmpHeap = Vaddr(tmpHeap).RoundUp() + PAGE_SIZE;
                 Vaddr tableVa = qm.Map(pa);
-                memset(tableVa, 0, PAGE_SIZE);
+                ZeroPage(tableVa);
                 e = pa;
                 e.SetFlags(LAT_EF_PRESENT | LAT_EF_WRITE | LAT_EF_EXECUTE);
                 qm.Unmap(table);
                 table = tableVa;
             } else {
                 /* Unmapped page, map it. */
-                e = boot::MappedToBoot(va).IdentityPaddr();
+                Paddr pagePa = boot::MappedToBoot(va).IdentityPaddr();
+                e = pagePa;
                 e.SetFlags(LAT_EF_PRESENT | LAT_EF_WRITE | LAT_EF_EXECUTE |
                            LAT_EF_GLOBAL);
                 InvalidateVaddr(va);
+                TRACEPOINT(VM, MapPage, va, pagePa);
             }
         }
         qm.Unmap(table);
@@ -94,11 +105,12 @@ KmemAllocate(size_t size, size_t align = 0)
         tmpHeap = va + size;
         MapHeap();
     } else if (LIKELY(MM::GetInitState() == MM::IS_INITIALIZED)) {
-
+        va = mm->GetHeap().Allocate(size, align);
     } else {
         FAULT("Memory allocation is not permitted in current state: %d",
               MM::GetInitState());
     }
+    TRACEPOINT(MEM, Alloc, size, align, va);
     return va;
 }
 
@@ -115,6 +127,13 @@ KmemFree(void *ptr)
     if (UNLIKELY(!ptr)) {
         return;
     }
+    TRACEPOINT(MEM, Free, ptr);
+    /* Memory allocated from the initial heap is never freed. */
+    if (UNLIKELY(MM::GetInitState() != MM::IS_INITIALIZED ||
+                 !mm->IsPhysMapped(ptr))) {
+        return;
+    }
+    mm->GetHeap().Free(ptr);
 }
 
 /** Overhead for dynamically allocated memory chunks for storing debug
@@ -164,7 +183,10 @@ KmemDebugOverhead::Allocate(size_t size, bool isArray, size_t align,
     if (align) {
         /* Client data must be properly aligned. */
         size_t numOhBlocks = sizeof(KmemDebugOverhead) / align + 1;
-        vm::Vaddr mem = KmemAllocate(size + align * numOhBlocks);
+        vm::Vaddr mem = KmemAllocate(size + align * numOhBlocks, align);
+        if (!mem) {
+            return 0;
+        }
         mem += align * numOhBlocks - sizeof(KmemDebugOverhead);
         oh = mem;
     } else {
@@ -278,6 +300,7 @@ QuickMap::Map(Paddr pa, long flags)
     e.SetFlags(flags);
     InvalidateVaddr(va);
     _mapped.Set(idx);
+    TRACEPOINT(VM, QuickMap, pa, flags, va);
     return va;
 }
 
@@ -292,13 +315,43 @@ QuickMap::Unmap(Vaddr va)
     e.Clear();
     _mapped.Clear(idx);
     InvalidateVaddr(va);
+    TRACEPOINT(VM, QuickUnmap, va);
+}
+
+void
+vm::ZeroPages(Vaddr va, size_t numPages)
+{
+    ASSERT(va.IsAligned());
+    cpu::ZeroNonTemporal(va, numPages * PAGE_SIZE);
+    cpu::StoreFence();
+}
+
+void
+vm::ZeroPages(const Vaddr *pages, size_t numPages)
+{
+    for (size_t i = 0; i < numPages; i++) {
+        Vaddr va = pages[i];
+        ASSERT(va.IsAligned());
+        cpu::ZeroNonTemporal(va, PAGE_SIZE);
+    }
+    /* One fence for the whole batch. */
+    cpu::StoreFence();
+}
+
+void
+vm::CopyPage(Vaddr dst, Vaddr src)
+{
+    ASSERT(dst.IsAligned() && src.IsAligned());
+    cpu::CopyNonTemporal(dst, src, PAGE_SIZE);
+    cpu::StoreFence();
 }
 
 MM::MM(void *memMap, size_t memMapNumDesc, size_t memMapDescSize,
        u32 memMapDescVersion) :
 
        _quickMap(tmpQuickMap, NUM_QUICK_MAP, tmpQuickMapPte),
-       _pageDesc(0),
+       _zones(0),
+       _numZones(0),
        _defLatRoot(::tmpDefaultLatRoot)
 {
     _InitializePhysMem(memMap, memMapNumDesc, memMapDescSize, memMapDescVersion);
@@ -322,20 +375,165 @@ MM::Initialize(void *memMap, size_t memMapNumDesc, size_t memMapDescSize,
                u32 memMapDescVersion)
 {
     ASSERT(!::mm);
-    ::mm = NEW MM(memMap, memMapNumDesc, memMapDescSize, memMapDescVersion);
+    /* The heap per-CPU caches are aligned on cache line size. */
+    ::mm = NEW_ALIGNED(CACHE_LINE_SIZE)
+        MM(memMap, memMapNumDesc, memMapDescSize, memMapDescVersion);
+    _initState = IS_INITIALIZED;
+}
+
+Page *
+MM::AllocatePages(size_t numPages, PhysZone::Policy policy)
+{
+    ASSERT(numPages);
+    /* Zones are sorted by address, DMA32 zones are the lowest ones. */
+    bool ascending = policy == PhysZone::POLICY_DMA32;
+    for (size_t i = 0; i < _numZones; i++) {
+        PhysZone &zone = _zones[ascending ? i : _numZones - 1 - i];
+        if (!zone.Matches(policy)) {
+            continue;
+        }
+        Page *page = zone.Allocate(numPages);
+        if (page) {
+            TRACEPOINT(VM, AllocPages, numPages, policy, page);
+            return page;
+        }
+    }
+    TRACEPOINT(VM, AllocPages, numPages, policy, 0);
+    return 0;
+}
+
+void
+MM::FreePages(Page *page)
+{
+    ASSERT(page->GetZone() < static_cast<int>(_numZones));
+    TRACEPOINT(VM, FreePages, page);
+    _zones[page->GetZone()].Free(page);
+}
+
+void
+MM::_CreateZones(efi::MemoryMap &map, size_t numManaged)
+{
+    /* One more zone for a run which crosses DMA32 limit. */
+    _zones = NEW PhysZone[numManaged + 1];
+    if (!_zones) {
+        FAULT("Failed to allocate physical memory zones");
+    }
+
+    /* Sort managed regions by address. The memory map is not guaranteed
+     * to be sorted.
+     */
+    _numZones = 0;
+    for (efi::MemoryMap::MemDesc &d: map) {
+        if (!d.NeedsManagement() || !d.numPages) {
+            continue;
+        }
+        Paddr start = d.paStart, end = d.paStart + d.numPages * PAGE_SIZE;
+        size_t idx = _numZones;
+        while (idx && _zones[idx - 1]._start > start) {
+            _zones[idx]._start = _zones[idx - 1]._start;
+            _zones[idx]._end = _zones[idx - 1]._end;
+            idx--;
+        }
+        _zones[idx]._start = start;
+        _zones[idx]._end = end;
+        _numZones++;
+    }
+
+    /* Merge adjacent regions into runs and split runs at DMA32 limit. */
+    size_t numRuns = 0;
+    for (size_t idx = 0; idx < _numZones; idx++) {
+        PhysZone &zone = _zones[idx];
+        if (numRuns && zone._start <= _zones[numRuns - 1]._end) {
+            PhysZone &run = _zones[numRuns - 1];
+            run._end = Max(run._end, zone._end);
+            continue;
+        }
+        _zones[numRuns]._start = zone._start;
+        _zones[numRuns]._end = zone._end;
+        numRuns++;
+    }
+    _numZones = numRuns;
+    for (size_t idx = 0; idx < _numZones; idx++) {
+        PhysZone &zone = _zones[idx];
+        if (zone._start < PhysZone::DMA32_LIMIT &&
+            zone._end > PhysZone::DMA32_LIMIT) {
+
+            /* Only one run can cross the limit. */
+            for (size_t i = _numZones; i > idx + 1; i--) {
+                _zones[i]._start = _zones[i - 1]._start;
+                _zones[i]._end = _zones[i - 1]._end;
+            }
+            _zones[idx + 1]._start = PhysZone::DMA32_LIMIT;
+            _zones[idx + 1]._end = zone._end;
+            zone._end = PhysZone::DMA32_LIMIT;
+            _numZones++;
+            break;
+        }
+    }
+    if (_numZones > PhysZone::MAX_ZONES) {
+        FAULT("Too many physical memory zones: %d",
+              static_cast<int>(_numZones));
+    }
+
+    for (size_t idx = 0; idx < _numZones; idx++) {
+        PhysZone &zone = _zones[idx];
+        LOG.Info("Physical memory zone %d: [%016x - %016x]", idx,
+                 zone._start, zone._end);
+        if (NOK(zone.Initialize())) {
+            FAULT("Failed to initialize physical memory zone");
+        }
+    }
 }
 
 void
 MM::_InitializePhysMem(void *memMap, size_t memMapNumDesc,
                        size_t memMapDescSize, u32 memMapDescVersion)
 {
-    _initState = IS_INITIALIZING;
-
     efi::MemoryMap map = efi::MemoryMap(memMap,
                                         memMapNumDesc,
                                         memMapDescSize,
                                         memMapDescVersion);
 
+    /* Firstly find the lowest and the highest available physical addresses. */
+    Paddr paMin, paMax;
+    size_t numManaged = 0;
+    _physMemSize = 0;
+    LOG.Info("System memory map:\n");
+    for (efi::MemoryMap::MemDesc &d: map) {
+        LOG.Format(OTS_FMT("[%016x - %016x] %s\n"),
+                   d.paStart, d.paStart + d.numPages * PAGE_SIZE,
+                   map.GetTypeName(static_cast<efi::MemoryMap::MemType>(d.type)));
+
+        if (!d.NeedsManagement()) {
+            continue;
+        }
+        numManaged++;
+
+        if (!paMax) {
+            paMin = d.paStart;
+            paMax = d.paStart + d.numPages * PAGE_SIZE;
+        } else if (d.paStart < paMin) {
+            paMin = d.paStart;
+        } else if (d.paStart + d.numPages * PAGE_SIZE > paMax) {
+            paMax = d.paStart + d.numPages * PAGE_SIZE;
+        }
+
+        if (d.IsAvailable()) {
+            _physMemSize += d.numPages * PAGE_SIZE;
+        }
+    }
+    _physFirst = paMin;
+    _physRange = paMax - paMin;
+    LOG.Info("Managed physical memory range: [%016x - %016x]", paMin, paMax);
+    LOG.Info("%dMB of physical memory available", _physMemSize / (1024 * 1024));
+
+    /* Create physical memory zones. Their internal data is allocated from
+     * the initial heap so it must be done before the initial area is fixed.
+     */
+    _CreateZones(map, numManaged);
+
+    _initState = IS_INITIALIZING;
+
     /* Memory occupied by the kernel image and its initial heap. */
     _initialStart = boot::MappedToBoot(VMA_KERNEL_TEXT).IdentityPaddr();
     _initialEnd = boot::MappedToBoot(::tmpHeap).IdentityPaddr();
@@ -492,37 +690,6 @@ MM::_InitializePhysMem(void *memMap, size_t memMapNumDesc,
         }
     } pageAlloc(map, _initialStart, _initialEnd);
 
-    /* Firstly find the lowest and the highest available physical addresses. */
-    Paddr paMin, paMax;
-    _physMemSize = 0;
-    LOG.Info("System memory map:\n");
-    for (efi::MemoryMap::MemDesc &d: map) {
-        LOG.Format("[%016x - %016x] %s\n",
-                   d.paStart, d.paStart + d.numPages * PAGE_SIZE,
-                   map.GetTypeName(static_cast<efi::MemoryMap::MemType>(d.type)));
-
-        if (!d.NeedsManagement()) {
-            continue;
-        }
-
-        if (!paMax) {
-            paMin = d.paStart;
-            paMax = d.paStart + d.numPages * PAGE_SIZE;
-        } else if (d.paStart < paMin) {
-            paMin = d.paStart;
-        } else if (d.paStart + d.numPages * PAGE_SIZE > paMax) {
-            paMax = d.paStart + d.numPages * PAGE_SIZE;
-        }
-
-        if (d.IsAvailable()) {
-            _physMemSize += d.numPages * PAGE_SIZE;
-        }
-    }
-    _physFirst = paMin;
-    _physRange = paMax - paMin;
-    LOG.Info("Managed physical memory range: [%016x - %016x]", paMin, paMax);
-    LOG.Info("%dMB of physical memory available", _physMemSize / (1024 * 1024));
-
     /* Calculate the PM mapping address. */
     cpu::CpuCaps caps;
     _physMemMap = static_cast<vaddr_t>(1) << (caps.GetCapability(cpu::CPU_CAP_PG_WIDTH_LIN) - 1);
@@ -549,7 +716,7 @@ MM::_InitializePhysMem(void *memMap, size_t memMapNumDesc,
                     /* Unmapped table, allocate and enter. */
                     pa = pageAlloc.AllocPage();
                     Vaddr tableVa = _quickMap.Map(pa);
-                    memset(tableVa, 0, PAGE_SIZE);
+                    ZeroPage(tableVa);
                     e = pa;
                     e.SetFlags(LAT_EF_PRESENT | LAT_EF_WRITE | LAT_EF_EXECUTE);
                     _quickMap.Unmap(table);
@@ -560,30 +727,45 @@ MM::_InitializePhysMem(void *memMap, size_t memMapNumDesc,
                     e.SetFlags(LAT_EF_PRESENT | LAT_EF_WRITE | LAT_EF_EXECUTE |
                                LAT_EF_GLOBAL);
                     InvalidateVaddr(va);
+                    TRACEPOINT(VM, MapPage, va, page);
                 }
             }
             _quickMap.Unmap(table);
         }
     }
 
-    /* Create page descriptors array. */
+    /* Create page descriptors arrays. They are placed in one space, holes
+     * between the zones are not covered.
+     */
     Paddr pagesHeap = pageAlloc.GetHeap();
-    size_t numPages = _physRange / PAGE_SIZE;
-    Paddr pageDescPa = pageAlloc.AllocSpace(numPages * sizeof(Page));
-    _pageDesc = PhysToVirt(pageDescPa);
-    for (size_t i = 0; i < numPages; i++) {
-        Paddr pa = _physFirst + i * PAGE_SIZE;
-        long flags = 0;
-        /* Exclude all occupied areas. */
-        if (pa >= pagesHeap && /* LAT tables. */
-            /* Page descriptors array. */
-            (pa < pageDescPa || pa >= pageDescPa + numPages * PAGE_SIZE) &&
-            /* Kernel initial heap. */
-            (pa < _initialStart || pa >= _initialEnd)) {
-
-            flags |= Page::F_MANAGED | Page::F_AVAILABLE;
+    size_t numPages = 0;
+    for (size_t idx = 0; idx < _numZones; idx++) {
+        numPages += _zones[idx].GetNumPages();
+    }
+    psize_t pageDescSize = RoundUp2(numPages * sizeof(Page), PAGE_SIZE);
+    Paddr pageDescPa = pageAlloc.AllocSpace(pageDescSize);
+    if (!pageDescPa) {
+        FAULT("No space for page descriptors");
+    }
+    Page *pageDesc = PhysToVirt(pageDescPa);
+    for (size_t idx = 0; idx < _numZones; idx++) {
+        PhysZone &zone = _zones[idx];
+        zone._pageDesc = pageDesc;
+        pageDesc += zone.GetNumPages();
+        for (size_t i = 0; i < zone.GetNumPages(); i++) {
+            Paddr pa = zone._start + i * PAGE_SIZE;
+            long flags = 0;
+            /* Exclude all occupied areas. */
+            if (pa >= pagesHeap && /* LAT tables. */
+                /* Page descriptors array. */
+                (pa < pageDescPa || pa >= pageDescPa + pageDescSize) &&
+                /* Kernel initial heap. */
+                (pa < _initialStart || pa >= _initialEnd)) {
+
+                flags |= Page::F_MANAGED | Page::F_AVAILABLE;
+            }
+            new(&zone._pageDesc[i]) Page(flags, idx);
         }
-        new(&_pageDesc[i]) Page(flags);
     }
 
     /* Exclude all pages in reserved areas reported by the firmware. */
@@ -593,7 +775,8 @@ MM::_InitializePhysMem(void *memMap, size_t memMapNumDesc,
             d.vaStart = PhysToVirt(d.paStart);
         }
 
-        if (d.IsAvailable()) {
+        /* Regions which are not managed are not covered by zones. */
+        if (d.IsAvailable() || !d.NeedsManagement()) {
             continue;
         }
         for (Paddr pa = d.paStart;
@@ -603,14 +786,10 @@ MM::_InitializePhysMem(void *memMap, size_t memMapNumDesc,
             Page &page = GetPage(pa);
             long flags = page.GetFlags();
             flags &= ~Page::F_AVAILABLE;
-            if (!d.NeedsManagement()) {
-                flags &= ~Page::F_MANAGED;
-            } else {
-                if (d.type == efi::MemoryMap::EfiACPIReclaimMemory) {
-                    flags |= Page::F_ACPI_RECLAIM;
-                } else if (d.type == efi::MemoryMap::EfiACPIMemoryNVS) {
-                    flags |= Page::F_ACPI_NVS;
-                }
+            if (d.type == efi::MemoryMap::EfiACPIReclaimMemory) {
+                flags |= Page::F_ACPI_RECLAIM;
+            } else if (d.type == efi::MemoryMap::EfiACPIMemoryNVS) {
+                flags |= Page::F_ACPI_NVS;
             }
             page.SetFlags(flags);
         }
@@ -621,6 +800,8 @@ MM::_InitializePhysMem(void *memMap, size_t memMapNumDesc,
         FAULT("Failed to update the firmware virtual address map");
     }
 
-    //XXX create allocator
-    _initState = IS_PREINITIALIZED;//XXX
+    /* Populate the zones allocators. */
+    for (size_t idx = 0; idx < _numZones; idx++) {
+        _zones[idx]._Populate();
+    }
 }
@@ -18,5 +18,5 @@ using namespace vm;
 Paddr
 Page::GetPaddr()
 {
-    return mm->_physFirst + (this - mm->_pageDesc) * PAGE_SIZE;
+    return mm->_zones[_zone].GetPaddr(this);
 }
@@ -0,0 +1,440 @@
+/*
+ * /phoenix/kernel/vm/vm_radix.cpp
+ *
+ * This file is a part of Phoenix operating system.
+ * Copyright (c) 2011-2012, Artyom Lebedev <artyom.lebedev@gmail.com>
+ * All rights reserved.
+ * See COPYING file for copyright details.
+ */
+
+/** @file vm_radix.cpp
+ * Page index radix tree implementation.
+ */
+
+#include <sys.h>
+
+using namespace vm;
+
+PageRadixTreeBase::Node::Node(int shift)
+{
+    memset(slots, 0, sizeof(slots));
+    memset(tags, 0, sizeof(tags));
+    this->shift = shift;
+}
+
+PageRadixTreeBase::PageRadixTreeBase()
+{
+
+}
+
+PageRadixTreeBase::~PageRadixTreeBase()
+{
+    if (_root) {
+        _FreeSubtree(_root);
+    }
+    _Reclaim(~static_cast<u64>(0));
+}
+
+RetCode
+PageRadixTreeBase::Initialize(size_t numCpus)
+{
+    return _readers.Initialize(numCpus);
+}
+
+void
+PageRadixTreeBase::_FreeSubtree(Node *node)
+{
+    if (node->shift) {
+        u64 present = node->present;
+        while (present) {
+            _FreeSubtree(static_cast<Node *>(node->slots[__builtin_ctzll(present)]));
+            present &= present - 1;
+        }
+    }
+    DELETE node;
+}
+
+void
+PageRadixTreeBase::_Retire(Node *node)
+{
+    node->nextRetired = 0;
+    node->retireEpoch = _readers.Retire();
+    if (_retiredTail) {
+        _retiredTail->nextRetired = node;
+    } else {
+        _retiredHead = node;
+    }
+    _retiredTail = node;
+}
+
+void
+PageRadixTreeBase::_Reclaim(u64 oldestEpoch)
+{
+    while (_retiredHead && _retiredHead->retireEpoch < oldestEpoch) {
+        Node *node = _retiredHead;
+        _retiredHead = node->nextRetired;
+        if (!_retiredHead) {
+            _retiredTail = 0;
+        }
+        DELETE node;
+    }
+}
+
+bool
+PageRadixTreeBase::_FindPath(PageIdx idx, Path &path)
+{
+    Node *node = _root;
+    if (!node || !_Fits(node->shift, idx)) {
+        return false;
+    }
+    while (true) {
+        size_t offset = _GetOffset(node, idx);
+        path.nodes[path.depth] = node;
+        path.offsets[path.depth] = offset;
+        path.depth++;
+        if (!(node->present & (static_cast<u64>(1) << offset))) {
+            return false;
+        }
+        if (!node->shift) {
+            return true;
+        }
+        node = static_cast<Node *>(node->slots[offset]);
+    }
+}
+
+RetCode
+PageRadixTreeBase::Insert(PageIdx idx, void *item)
+{
+    ASSERT(item);
+    _lock.Lock();
+
+    /* Grow the tree until the index fits. */
+    if (!_root) {
+        int shift = 0;
+        while (!_Fits(shift, idx)) {
+            shift += NODE_SHIFT;
+        }
+        Node *node = NEW Node(shift);
+        if (!node) {
+            _lock.Unlock();
+            return RC(NO_MEMORY);
+        }
+        __atomic_store_n(&_root, node, __ATOMIC_RELEASE);
+    }
+    while (!_Fits(_root->shift, idx)) {
+        Node *node = NEW Node(_root->shift + NODE_SHIFT);
+        if (!node) {
+            /* Shrink back the levels added. */
+            Path path;
+            _Collapse(path);
+            _Reclaim(_readers.GetOldestEpoch());
+            _lock.Unlock();
+            return RC(NO_MEMORY);
+        }
+        node->slots[0] = _root;
+        node->present = 1;
+        for (int tag = 0; tag < MAX_TAGS; tag++) {
+            node->tags[tag] = _root->tags[tag] ? 1 : 0;
+        }
+        __atomic_store_n(&_root, node, __ATOMIC_RELEASE);
+    }
+
+    Path path;
+    Node *node = _root;
+    while (true) {
+        size_t offset = _GetOffset(node, idx);
+        u64 bit = static_cast<u64>(1) << offset;
+        path.nodes[path.depth] = node;
+        path.offsets[path.depth] = offset;
+        path.depth++;
+        if (!node->shift) {
+            if (node->present & bit) {
+                _lock.Unlock();
+                return RC(INV_PARAM);
+            }
+            __atomic_store_n(&node->slots[offset], item, __ATOMIC_RELEASE);
+            __atomic_store_n(&node->present, node->present | bit,
+                             __ATOMIC_RELAXED);
+            break;
+        }
+        if (!(node->present & bit)) {
+            Node *child = NEW Node(node->shift - NODE_SHIFT);
+            if (!child) {
+                /* Remove the nodes created on the previous levels. */
+                _Collapse(path);
+                _Reclaim(_readers.GetOldestEpoch());
+                _lock.Unlock();
+                return RC(NO_MEMORY);
+            }
+            __atomic_store_n(&node->slots[offset], child, __ATOMIC_RELEASE);
+            __atomic_store_n(&node->present, node->present | bit,
+                             __ATOMIC_RELAXED);
+        }
+        node = static_cast<Node *>(node->slots[offset]);
+    }
+    _numItems++;
+    _lock.Unlock();
+    return RC(SUCCESS);
+}
+
+void *
+PageRadixTreeBase::Delete(PageIdx idx)
+{
+    _lock.Lock();
+    Path path;
+    if (!_FindPath(idx, path)) {
+        _lock.Unlock();
+        return 0;
+    }
+    Node *node = path.nodes[path.depth - 1];
+    size_t offset = path.offsets[path.depth - 1];
+    u64 bit = static_cast<u64>(1) << offset;
+    void *item = node->slots[offset];
+    __atomic_store_n(&node->present, node->present & ~bit, __ATOMIC_RELAXED);
+    __atomic_store_n(&node->slots[offset], static_cast<void *>(0),
+                     __ATOMIC_RELEASE);
+    for (int tag = 0; tag < MAX_TAGS; tag++) {
+        if (node->tags[tag] & bit) {
+            _PropagateTagClear(path, tag);
+        }
+    }
+    _numItems--;
+    _Collapse(path);
+    _Reclaim(_readers.GetOldestEpoch());
+    _lock.Unlock();
+    return item;
+}
+
+void
+PageRadixTreeBase::_PropagateTagClear(Path &path, int tag)
+{
+    for (int level = path.depth - 1; level >= 0; level--) {
+        Node *node = path.nodes[level];
+        u64 tags = node->tags[tag] & ~(static_cast<u64>(1) << path.offsets[level]);
+        __atomic_store_n(&node->tags[tag], tags, __ATOMIC_RELAXED);
+        if (tags) {
+            break;
+        }
+    }
+}
+
+void
+PageRadixTreeBase::_Collapse(Path &path)
+{
+    /* Remove empty nodes. */
+    for (int level = path.depth - 1; level >= 0; level--) {
+        Node *node = path.nodes[level];
+        if (node->present) {
+            break;
+        }
+        if (!level) {
+            __atomic_store_n(&_root, static_cast<Node *>(0), __ATOMIC_RELEASE);
+        } else {
+            Node *parent = path.nodes[level - 1];
+            u64 bit = static_cast<u64>(1) << path.offsets[level - 1];
+            __atomic_store_n(&parent->present, parent->present & ~bit,
+                             __ATOMIC_RELAXED);
+            __atomic_store_n(&parent->slots[path.offsets[level - 1]],
+                             static_cast<void *>(0), __ATOMIC_RELEASE);
+        }
+        _Retire(node);
+    }
+    /* Shrink the height while only the first slot of the root is used. */
+    while (_root && _root->shift && _root->present == 1) {
+        Node *node = _root;
+        __atomic_store_n(&_root, static_cast<Node *>(node->slots[0]),
+                         __ATOMIC_RELEASE);
+        _Retire(node);
+    }
+}
+
+bool
+PageRadixTreeBase::SetTag(PageIdx idx, int tag)
+{
+    ASSERT(tag >= 0 && tag < MAX_TAGS);
+    _lock.Lock();
+    Path path;
+    if (!_FindPath(idx, path)) {
+        _lock.Unlock();
+        return false;
+    }
+    for (int level = path.depth - 1; level >= 0; level--) {
+        Node *node = path.nodes[level];
+        u64 bit = static_cast<u64>(1) << path.offsets[level];
+        if (node->tags[tag] & bit) {
+            break;
+        }
+        __atomic_store_n(&node->tags[tag], node->tags[tag] | bit,
+                         __ATOMIC_RELAXED);
+    }
+    _lock.Unlock();
+    return true;
+}
+
+bool
+PageRadixTreeBase::ClearTag(PageIdx idx, int tag)
+{
+    ASSERT(tag >= 0 && tag < MAX_TAGS);
+    _lock.Lock();
+    Path path;
+    bool wasSet = false;
+    if (_FindPath(idx, path)) {
+        Node *node = path.nodes[path.depth - 1];
+        u64 bit = static_cast<u64>(1) << path.offsets[path.depth - 1];
+        if (node->tags[tag] & bit) {
+            _PropagateTagClear(path, tag);
+            wasSet = true;
+        }
+    }
+    _lock.Unlock();
+    return wasSet;
+}
+
+bool
+PageRadixTreeBase::GetTag(PageIdx idx, int tag)
+{
+    ASSERT(tag >= 0 && tag < MAX_TAGS);
+    Node *node = __atomic_load_n(&_root, __ATOMIC_ACQUIRE);
+    if (!node || !_Fits(node->shift, idx)) {
+        return false;
+    }
+    while (true) {
+        size_t offset = _GetOffset(node, idx);
+        u64 tags = __atomic_load_n(&node->tags[tag], __ATOMIC_RELAXED);
+        if (!(tags & (static_cast<u64>(1) << offset))) {
+            return false;
+        }
+        if (!node->shift) {
+            return true;
+        }
+        node = static_cast<Node *>(__atomic_load_n(&node->slots[offset],
+                                                   __ATOMIC_ACQUIRE));
+        if (!node) {
+            return false;
+        }
+    }
+}
+
+void *
+PageRadixTreeBase::_FindNext(Node *node, PageIdx idx, PageIdx *found, int tag)
+{
+    u64 mask = tag < 0 ? __atomic_load_n(&node->present, __ATOMIC_RELAXED) :
+                         __atomic_load_n(&node->tags[tag], __ATOMIC_RELAXED);
+    size_t offset = _GetOffset(node, idx);
+    mask &= ~static_cast<u64>(0) << offset;
+    /* Index of the first slot in the node. */
+    PageIdx base = _Fits(node->shift, ~static_cast<PageIdx>(0)) ? 0 :
+        idx & (~static_cast<PageIdx>(0) << (node->shift + NODE_SHIFT));
+    while (mask) {
+        size_t slot = __builtin_ctzll(mask);
+        mask &= mask - 1;
+        void *child = __atomic_load_n(&node->slots[slot], __ATOMIC_ACQUIRE);
+        if (!child) {
+            /* Removed concurrently. */
+            continue;
+        }
+        PageIdx slotIdx = base | (static_cast<PageIdx>(slot) << node->shift);
+        if (!node->shift) {
+            *found = slotIdx;
+            return child;
+        }
+        void *item = _FindNext(static_cast<Node *>(child),
+                               slot == offset ? idx : slotIdx, found, tag);
+        if (item) {
+            return item;
+        }
+    }
+    return 0;
+}
+
+void *
+PageRadixTreeBase::FindNext(PageIdx idx, PageIdx *found, int tag)
+{
+    ASSERT(tag >= -1 && tag < MAX_TAGS);
+    Node *node = __atomic_load_n(&_root, __ATOMIC_ACQUIRE);
+    if (!node || !_Fits(node->shift, idx)) {
+        return 0;
+    }
+    return _FindNext(node, idx, found, tag);
+}
+
+size_t
+PageRadixTreeBase::GangLookup(PageIdx first, void **items, size_t maxItems,
+                              PageIdx *indices, int tag)
+{
+    size_t numFound = 0;
+    PageIdx idx = first, found;
+    void *item;
+    while (numFound < maxItems && (item = FindNext(idx, &found, tag))) {
+        items[numFound] = item;
+        if (indices) {
+            indices[numFound] = found;
+        }
+        numFound++;
+        idx = found + 1;
+        if (!idx) {
+            break;
+        }
+    }
+    return numFound;
+}
+
+bool
+PageRadixTreeBase::_ValidateSubtree(Node *node, bool *tags, size_t *numItems)
+{
+    if (!node->present) {
+        return false;
+    }
+    for (int tag = 0; tag < MAX_TAGS; tag++) {
+        tags[tag] = node->tags[tag] != 0;
+        if (node->tags[tag] & ~node->present) {
+            return false;
+        }
+    }
+    for (size_t slot = 0; slot < NODE_SIZE; slot++) {
+        bool isPresent = node->present & (static_cast<u64>(1) << slot);
+        if (isPresent != (node->slots[slot] != 0)) {
+            return false;
+        }
+        if (!isPresent) {
+            continue;
+        }
+        if (!node->shift) {
+            (*numItems)++;
+            continue;
+        }
+        Node *child = static_cast<Node *>(node->slots[slot]);
+        if (child->shift != node->shift - NODE_SHIFT) {
+            return false;
+        }
+        bool childTags[MAX_TAGS];
+        if (!_ValidateSubtree(child, childTags, numItems)) {
+            return false;
+        }
+        for (int tag = 0; tag < MAX_TAGS; tag++) {
+            if (childTags[tag] !=
+                ((node->tags[tag] & (static_cast<u64>(1) << slot)) != 0)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool
+PageRadixTreeBase::Validate()
+{
+    if (!_root) {
+        return !_numItems;
+    }
+    /* The root should not be shrinkable. */
+    if (_root->shift && _root->present == 1) {
+        return false;
+    }
+    bool tags[MAX_TAGS];
+    size_t numItems = 0;
+    if (!_ValidateSubtree(_root, tags, &numItems)) {
+        return false;
+    }
+    return numItems == _numItems;
+}
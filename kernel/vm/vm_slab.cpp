@@ -0,0 +1,249 @@
+/*
+ * /phoenix/kernel/vm/vm_slab.cpp
+ *
+ * This file is a part of Phoenix operating system.
+ * Copyright (c) 2011-2012, Artyom Lebedev <artyom.lebedev@gmail.com>
+ * All rights reserved.
+ * See COPYING file for copyright details.
+ */
+
+/** @file vm_slab.cpp
+ * Kernel heap slab allocator implementation.
+ */
+
+#include <sys.h>
+
+using namespace vm;
+
+/* Size classes are chosen so that most of them fill the slab page without
+ * a tail (4032 = 4096 - 64 bytes are available for objects).
+ */
+const u16 SlabAllocator::_classSizes[NUM_CLASSES] = {
+    16, 32, 48, 64, 96, 128, 192, 256, 336, 448, 576, 672, 1008, 1344, 2016
+};
+
+SlabAllocator::SlabAllocator()
+{
+    static_assert(sizeof(Slab) <= SLAB_HDR_SIZE, "Slab header too big");
+    static_assert(SLAB_HDR_SIZE % MIN_ALIGN == 0, "Misaligned slab header");
+
+    size_t idx = 0;
+    for (size_t unit = 0; unit <= MAX_OBJ_SIZE / MIN_ALIGN; unit++) {
+        if (unit * MIN_ALIGN > _classSizes[idx]) {
+            idx++;
+        }
+        _classIdx[unit] = idx;
+    }
+    ASSERT(idx == NUM_CLASSES - 1);
+
+    for (idx = 0; idx < NUM_CLASSES; idx++) {
+        SizeClass &sc = _classes[idx];
+        sc.objSize = _classSizes[idx];
+        sc.objsPerSlab = (PAGE_SIZE - SLAB_HDR_SIZE) / sc.objSize;
+    }
+    memset(_cpus, 0, sizeof(_cpus));
+}
+
+void
+SlabAllocator::SizeClass::Insert(Slab *slab)
+{
+    ASSERT(!slab->isListed);
+    slab->prev = 0;
+    slab->next = partial;
+    if (partial) {
+        partial->prev = slab;
+    }
+    partial = slab;
+    slab->isListed = true;
+}
+
+void
+SlabAllocator::SizeClass::Remove(Slab *slab)
+{
+    ASSERT(slab->isListed);
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        partial = slab->next;
+    }
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+    slab->isListed = false;
+}
+
+int
+SlabAllocator::_GetClass(size_t size, size_t align)
+{
+    if (size > MAX_OBJ_SIZE) {
+        return -1;
+    }
+    int idx = _classIdx[(size + MIN_ALIGN - 1) / MIN_ALIGN];
+    if (align > MIN_ALIGN) {
+        /* Objects are located at SLAB_HDR_SIZE + n * objSize offsets in a
+         * page aligned slab.
+         */
+        if (SLAB_HDR_SIZE % align) {
+            return -1;
+        }
+        while (idx < NUM_CLASSES && _classes[idx].objSize % align) {
+            idx++;
+        }
+        if (idx == NUM_CLASSES) {
+            return -1;
+        }
+    }
+    return idx;
+}
+
+void *
+SlabAllocator::Allocate(size_t size, size_t align)
+{
+    ASSERT(!align || IsPowerOf2(align));
+    int classIdx = _GetClass(size, align);
+    if (UNLIKELY(classIdx == -1)) {
+        return _AllocateLarge(Max(size, align));
+    }
+
+    bool intr = cpu::DisableInterrupts();
+    CpuCache &cache = _cpus[_GetCpu()];
+    if (UNLIKELY(!cache.numFree[classIdx])) {
+        _Refill(cache, classIdx);
+        if (!cache.numFree[classIdx]) {
+            if (intr) {
+                cpu::EnableInterrupts();
+            }
+            return 0;
+        }
+    }
+    void *obj = cache.freeList[classIdx];
+    cache.freeList[classIdx] = *static_cast<void **>(obj);
+    cache.numFree[classIdx]--;
+    if (intr) {
+        cpu::EnableInterrupts();
+    }
+    return obj;
+}
+
+void
+SlabAllocator::Free(void *ptr)
+{
+    if (Vaddr(ptr).IsAligned()) {
+        /* Large allocation. */
+        mm->FreePages(&mm->GetPage(mm->VirtToPhys(ptr)));
+        return;
+    }
+
+    Slab *slab = Slab::FromObject(ptr);
+    int classIdx = slab->sizeClass - _classes;
+    ASSERT(classIdx >= 0 && classIdx < NUM_CLASSES);
+
+    bool intr = cpu::DisableInterrupts();
+    CpuCache &cache = _cpus[_GetCpu()];
+    if (UNLIKELY(cache.numFree[classIdx] == CPU_LIST_SIZE)) {
+        _Drain(cache, classIdx);
+    }
+    *static_cast<void **>(ptr) = cache.freeList[classIdx];
+    cache.freeList[classIdx] = ptr;
+    cache.numFree[classIdx]++;
+    if (intr) {
+        cpu::EnableInterrupts();
+    }
+}
+
+void
+SlabAllocator::_Refill(CpuCache &cache, int classIdx)
+{
+    SizeClass &sc = _classes[classIdx];
+    sc.lock.Lock();
+    while (cache.numFree[classIdx] < BATCH_SIZE) {
+        Slab *slab = sc.partial;
+        if (!slab) {
+            if (sc.empty) {
+                slab = sc.empty;
+                sc.empty = 0;
+            } else if (!(slab = _CreateSlab(sc))) {
+                break;
+            }
+            sc.Insert(slab);
+        }
+        while (slab->numFree && cache.numFree[classIdx] < BATCH_SIZE) {
+            void *obj = slab->freeList;
+            slab->freeList = *static_cast<void **>(obj);
+            slab->numFree--;
+            *static_cast<void **>(obj) = cache.freeList[classIdx];
+            cache.freeList[classIdx] = obj;
+            cache.numFree[classIdx]++;
+        }
+        if (!slab->numFree) {
+            sc.Remove(slab);
+        }
+    }
+    sc.lock.Unlock();
+}
+
+void
+SlabAllocator::_Drain(CpuCache &cache, int classIdx)
+{
+    SizeClass &sc = _classes[classIdx];
+    sc.lock.Lock();
+    for (size_t i = 0; i < BATCH_SIZE; i++) {
+        void *obj = cache.freeList[classIdx];
+        cache.freeList[classIdx] = *static_cast<void **>(obj);
+        cache.numFree[classIdx]--;
+
+        Slab *slab = Slab::FromObject(obj);
+        ASSERT(slab->sizeClass == &sc);
+        *static_cast<void **>(obj) = slab->freeList;
+        slab->freeList = obj;
+        slab->numFree++;
+        if (slab->numFree == sc.objsPerSlab) {
+            /* Keep one empty slab cached, release the rest. */
+            if (slab->isListed) {
+                sc.Remove(slab);
+            }
+            if (!sc.empty) {
+                sc.empty = slab;
+            } else {
+                mm->FreePages(&mm->GetPage(mm->VirtToPhys(slab)));
+            }
+        } else if (!slab->isListed) {
+            sc.Insert(slab);
+        }
+    }
+    sc.lock.Unlock();
+}
+
+SlabAllocator::Slab *
+SlabAllocator::_CreateSlab(SizeClass &sc)
+{
+    Page *page = mm->AllocatePages();
+    if (!page) {
+        return 0;
+    }
+    Vaddr va = mm->PhysToVirt(page->GetPaddr());
+    Slab *slab = va;
+    slab->next = 0;
+    slab->prev = 0;
+    slab->sizeClass = &sc;
+    slab->isListed = false;
+    slab->numFree = sc.objsPerSlab;
+    /* Link the objects so that they are allocated in ascending order. */
+    slab->freeList = 0;
+    for (size_t idx = sc.objsPerSlab; idx > 0; idx--) {
+        void **obj = va + SLAB_HDR_SIZE + (idx - 1) * sc.objSize;
+        *obj = slab->freeList;
+        slab->freeList = obj;
+    }
+    return slab;
+}
+
+void *
+SlabAllocator::_AllocateLarge(size_t size)
+{
+    Page *page = mm->AllocatePages(RoundUp2(size, PAGE_SIZE) / PAGE_SIZE);
+    if (!page) {
+        return 0;
+    }
+    return mm->PhysToVirt(page->GetPaddr());
+}
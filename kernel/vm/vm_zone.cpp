@@ -0,0 +1,115 @@
+/*
+ * /phoenix/kernel/vm/vm_zone.cpp
+ *
+ * This file is a part of Phoenix operating system.
+ * Copyright (c) 2011-2012, Artyom Lebedev <artyom.lebedev@gmail.com>
+ * All rights reserved.
+ * See COPYING file for copyright details.
+ */
+
+/** @file vm_zone.cpp
+ * Physical memory zones implementation.
+ */
+
+#include <sys.h>
+
+using namespace vm;
+
+const paddr_t PhysZone::DMA32_LIMIT;
+
+RetCode
+PhysZone::Initialize()
+{
+    ASSERT(_start.IsAligned() && _end.IsAligned() && _start < _end);
+    /* Small zones get smaller maximal order so that the allocator range
+     * does not exceed the zone much.
+     */
+    int order = MAX_ORDER;
+    while (order && (static_cast<psize_t>(PAGE_SIZE) << order) > _end - _start) {
+        order--;
+    }
+    psize_t maxBlockSize = static_cast<psize_t>(PAGE_SIZE) << order;
+    return _alloc.Initialize(RoundDown2(static_cast<paddr_t>(_start), maxBlockSize),
+                             RoundUp2(static_cast<paddr_t>(_end), maxBlockSize),
+                             PAGE_SHIFT, PAGE_SHIFT + order);
+}
+
+Page *
+PhysZone::Allocate(size_t numPages)
+{
+    ASSERT(numPages);
+    paddr_t pa;
+    bool intr = cpu::DisableInterrupts();
+    _lock.Lock();
+    /* Failure is not traced, the caller falls back to other zones. */
+    RetCode rc = _alloc.Allocate(numPages * PAGE_SIZE, &pa);
+    _lock.Unlock();
+    if (intr) {
+        cpu::EnableInterrupts();
+    }
+    if (!rc.IsOk()) {
+        return 0;
+    }
+    Page &page = GetPage(pa);
+    page.SetFlags(page.GetFlags() | Page::F_ALLOCATED);
+    page.SetOrder(_alloc.GetBlockOrder(numPages * PAGE_SIZE) - PAGE_SHIFT);
+    return &page;
+}
+
+void
+PhysZone::Free(Page *page)
+{
+    ENSURE(page->GetFlags() & Page::F_ALLOCATED);
+    page->SetFlags(page->GetFlags() & ~Page::F_ALLOCATED);
+    psize_t size = static_cast<psize_t>(PAGE_SIZE) << page->GetOrder();
+    bool intr = cpu::DisableInterrupts();
+    _lock.Lock();
+    RetCode rc = _alloc.Free(GetPaddr(page), size);
+    _lock.Unlock();
+    if (intr) {
+        cpu::EnableInterrupts();
+    }
+    ENSURE(OK(rc));
+}
+
+void
+PhysZone::GetStats(BuddyAllocatorBase::Stats *stats)
+{
+    bool intr = cpu::DisableInterrupts();
+    _lock.Lock();
+    _alloc.GetStats(stats);
+    _lock.Unlock();
+    if (intr) {
+        cpu::EnableInterrupts();
+    }
+}
+
+void
+PhysZone::_Populate()
+{
+    /* Take all blocks out of the allocator and return available pages
+     * back.
+     */
+    psize_t maxBlockSize = static_cast<psize_t>(1) << _alloc.GetMaxOrder();
+    paddr_t block;
+    while (_alloc.Allocate(maxBlockSize, &block).IsOk());
+
+    size_t numPages = GetNumPages();
+    Paddr runStart;
+    bool inRun = false;
+    for (size_t i = 0; i < numPages; i++) {
+        Paddr pa = _start + i * PAGE_SIZE;
+        if (_pageDesc[i].GetFlags() & Page::F_AVAILABLE) {
+            if (!inRun) {
+                runStart = pa;
+                inRun = true;
+            }
+        } else if (inRun) {
+            ENSURE(OK(_alloc.FreeRange(runStart, pa - runStart)));
+            inRun = false;
+        }
+    }
+    if (inRun) {
+        ENSURE(OK(_alloc.FreeRange(runStart, _end - runStart)));
+    }
+}
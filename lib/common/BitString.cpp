@@ -0,0 +1,212 @@
+/*
+ * /phoenix/lib/common/BitString.cpp
+ *
+ * This file is a part of Phoenix operating system.
+ * Copyright (c) 2011-2012, Artyom Lebedev <artyom.lebedev@gmail.com>
+ * All rights reserved.
+ * See COPYING file for copyright details.
+ */
+
+/** @file BitString.cpp
+ * Bulk bitmap operations implementation.
+ */
+
+#include <sys.h>
+#include <md_bitstring.h>
+
+BitStringOps::ScanFunc BitStringOps::_scan = BitStringOps::_ScanSelect;
+BitStringOps::CountFunc BitStringOps::_count = BitStringOps::_CountSelect;
+
+void
+BitStringOps::Select(bool allowSimd)
+{
+    ScanFunc scan = _ScanGeneric;
+    CountFunc count = _CountGeneric;
+    if (allowSimd) {
+        cpu::CpuCaps caps;
+        if (caps.GetCapability(cpu::CPU_CAP_SSE2)) {
+            scan = cpu::BitScanSse2;
+            count = cpu::BitCountSse2;
+        }
+        if (caps.GetCapability(cpu::CPU_CAP_POPCNT)) {
+            count = cpu::BitCountPopcnt;
+        }
+    }
+    _scan = scan;
+    _count = count;
+}
+
+size_t
+BitStringOps::_ScanSelect(const u8 *bytes, size_t size, u8 pattern)
+{
+    Select();
+    return _scan(bytes, size, pattern);
+}
+
+size_t
+BitStringOps::_CountSelect(const u8 *bytes, size_t size)
+{
+    Select();
+    return _count(bytes, size);
+}
+
+size_t
+BitStringOps::_ScanGeneric(const u8 *bytes, size_t size, u8 pattern)
+{
+    size_t offset = 0;
+    /* Bytes up to the word boundary. */
+    while (offset < size &&
+           reinterpret_cast<uintptr_t>(bytes + offset) % sizeof(uintptr_t)) {
+
+        if (bytes[offset] != pattern) {
+            return offset;
+        }
+        offset++;
+    }
+    const uintptr_t wordPattern =
+        static_cast<uintptr_t>(pattern) * (~static_cast<uintptr_t>(0) / 0xff);
+    for (; offset + sizeof(uintptr_t) <= size; offset += sizeof(uintptr_t)) {
+        if (*reinterpret_cast<const uintptr_t *>(bytes + offset) != wordPattern) {
+            break;
+        }
+    }
+    for (; offset < size; offset++) {
+        if (bytes[offset] != pattern) {
+            break;
+        }
+    }
+    return offset;
+}
+
+size_t
+BitStringOps::_CountGeneric(const u8 *bytes, size_t size)
+{
+    const uintptr_t m1 = ~static_cast<uintptr_t>(0) / 3;
+    const uintptr_t m2 = ~static_cast<uintptr_t>(0) / 5;
+    const uintptr_t m4 = ~static_cast<uintptr_t>(0) / 17;
+    const uintptr_t h01 = ~static_cast<uintptr_t>(0) / 255;
+    size_t count = 0, offset = 0;
+
+    while (offset < size &&
+           reinterpret_cast<uintptr_t>(bytes + offset) % sizeof(uintptr_t)) {
+
+        for (u8 x = bytes[offset]; x; x &= x - 1) {
+            count++;
+        }
+        offset++;
+    }
+    for (; offset + sizeof(uintptr_t) <= size; offset += sizeof(uintptr_t)) {
+        uintptr_t x = *reinterpret_cast<const uintptr_t *>(bytes + offset);
+        x -= (x >> 1) & m1;
+        x = (x & m2) + ((x >> 2) & m2);
+        x = (x + (x >> 4)) & m4;
+        count += (x * h01) >> ((sizeof(uintptr_t) - 1) * NBBY);
+    }
+    for (; offset < size; offset++) {
+        for (u8 x = bytes[offset]; x; x &= x - 1) {
+            count++;
+        }
+    }
+    return count;
+}
+
+size_t
+BitStringOps::FindSet(const u8 *bits, size_t numBits, size_t from)
+{
+    if (from >= numBits) {
+        return numBits;
+    }
+    size_t byte = from / NBBY;
+    u8 x = bits[byte] & _HeadMask(from);
+    if (!x) {
+        size_t numBytes = (numBits + NBBY - 1) / NBBY;
+        byte++;
+        byte += _scan(bits + byte, numBytes - byte, 0);
+        if (byte == numBytes) {
+            return numBits;
+        }
+        x = bits[byte];
+    }
+    return Min(byte * NBBY + cpu::bsf(x), numBits);
+}
+
+size_t
+BitStringOps::FindClear(const u8 *bits, size_t numBits, size_t from)
+{
+    if (from >= numBits) {
+        return numBits;
+    }
+    size_t byte = from / NBBY;
+    u8 x = ~bits[byte] & _HeadMask(from);
+    if (!x) {
+        size_t numBytes = (numBits + NBBY - 1) / NBBY;
+        byte++;
+        byte += _scan(bits + byte, numBytes - byte, 0xff);
+        if (byte == numBytes) {
+            return numBits;
+        }
+        x = ~bits[byte];
+    }
+    return Min(byte * NBBY + cpu::bsf(x), numBits);
+}
+
+size_t
+BitStringOps::Count(const u8 *bits, size_t numBits)
+{
+    size_t count = _count(bits, numBits / NBBY);
+    if (numBits % NBBY) {
+        for (u8 x = bits[numBits / NBBY] & _TailMask(numBits); x; x &= x - 1) {
+            count++;
+        }
+    }
+    return count;
+}
+
+size_t
+BitStringOps::FindClearRun(const u8 *bits, size_t numBits, size_t runLength)
+{
+    ASSERT(runLength);
+    size_t start = FindClear(bits, numBits);
+    while (runLength <= numBits - start) {
+        size_t end = FindSet(bits, numBits, start);
+        if (end - start >= runLength) {
+            return start;
+        }
+        start = FindClear(bits, numBits, end);
+    }
+    return numBits;
+}
+
+void
+BitStringOps::SetRange(u8 *bits, size_t start, size_t count)
+{
+    if (!count) {
+        return;
+    }
+    size_t end = start + count;
+    size_t firstByte = start / NBBY, lastByte = (end - 1) / NBBY;
+    if (firstByte == lastByte) {
+        bits[firstByte] |= _HeadMask(start) & _TailMask(end);
+        return;
+    }
+    bits[firstByte] |= _HeadMask(start);
+    memset(bits + firstByte + 1, 0xff, lastByte - firstByte - 1);
+    bits[lastByte] |= _TailMask(end);
+}
+
+void
+BitStringOps::ClearRange(u8 *bits, size_t start, size_t count)
+{
+    if (!count) {
+        return;
+    }
+    size_t end = start + count;
+    size_t firstByte = start / NBBY, lastByte = (end - 1) / NBBY;
+    if (firstByte == lastByte) {
+        bits[firstByte] &= ~(_HeadMask(start) & _TailMask(end));
+        return;
+    }
+    bits[firstByte] &= ~_HeadMask(start);
+    memset(bits + firstByte + 1, 0, lastByte - firstByte - 1);
+    bits[lastByte] &= ~_TailMask(end);
+}
@@ -26,17 +26,22 @@ BuddyAllocatorBase::~BuddyAllocatorBase()
 void
 BuddyAllocatorBase::_Free()
 {
-    DELETE [] _pool;
-    _pool = 0;
-    DELETE [] _cache;
-    _cache = 0;
+    if (_pool) {
+        DELETE [] _pool;
+        _pool = 0;
+    }
+    if (_cache) {
+        DELETE [] _cache;
+        _cache = 0;
+    }
+    _isInitialized = false;
 }
 
 RetCode
 BuddyAllocatorBase::Initialize(Addr startAddress, Addr endAddress, int minOrder,
                                int maxOrder, size_t cacheSize)
 {
-    if (startAddress >= endAddress) {
+    if (startAddress >= endAddress || minOrder < 0) {
         return RC(INV_PARAM);
     }
     _startAddress = startAddress;
@@ -72,13 +77,15 @@ BuddyAllocatorBase::Initialize(Addr startAddress, Addr endAddress, int minOrder,
         return RC(INV_PARAM);
     }
 
+    if (_minOrder > _maxOrder) {
+        return RC(INV_PARAM);
+    }
+
     if (cacheSize > MAX_CACHE_SIZE) {
         return RC(INV_PARAM);
     }
     _cacheSize = cacheSize;
 
-    //int numOrders = maxOrder - minOrder + 1;
-
     /* Allocate cache. */
     _cache = NEW CacheEntry[_cacheSize];
     if (!_cache) {
@@ -89,10 +96,468 @@ BuddyAllocatorBase::Initialize(Addr startAddress, Addr endAddress, int minOrder,
         _cache[idx].Insert(_cache, _freeCacheEntries);
     }
 
+    /* Allocate orders pool. */
+    int numOrders = _maxOrder - _minOrder + 1;
+    _pool = NEW OrderPool[numOrders];
+    if (!_pool) {
+        _Free();
+        return RC(NO_MEMORY);
+    }
+    for (int order = _minOrder; order <= _maxOrder; order++) {
+        RetCode rc = _GetPool(order).Initialize(
+            (_endAddress - _startAddress) >> order);
+        if (NOK(rc)) {
+            _Free();
+            return rc;
+        }
+    }
+
+    /* Initially the whole range consists of free blocks of maximal order. */
+    size_t numBlocks = (_endAddress - _startAddress) >> _maxOrder;
+    for (size_t idx = 0; idx < numBlocks; idx++) {
+        _PutFreeBlock(_GetBlockAddress(idx, _maxOrder), _maxOrder);
+    }
+
     _isInitialized = true;
     return RC(SUCCESS);
 }
 
+RetCode
+BuddyAllocatorBase::Allocate(Addr size, Addr *address)
+{
+    ASSERT(_isInitialized);
+    if (!size || size > _GetOrderSize(_maxOrder)) {
+        return RC(INV_PARAM);
+    }
+    int order = Max(_GetOrder(size), _minOrder);
+
+    /* Find the smallest order which has free blocks. */
+    int srcOrder = order;
+    Addr addr;
+    while (!_TakeFreeBlock(srcOrder, &addr)) {
+        srcOrder++;
+        if (srcOrder > _maxOrder) {
+            return RC(NO_RESOURCES);
+        }
+    }
+
+    /* Split the block, upper halves are returned to lower orders. */
+    while (srcOrder > order) {
+        _GetPool(srcOrder)._splits++;
+        srcOrder--;
+        _PutFreeBlock(addr + _GetOrderSize(srcOrder), srcOrder);
+    }
+
+    *address = addr;
+    return RC(SUCCESS);
+}
+
+RetCode
+BuddyAllocatorBase::Free(Addr address, Addr size)
+{
+    ASSERT(_isInitialized);
+    if (!size || size > _GetOrderSize(_maxOrder) ||
+        address < _startAddress || address >= _endAddress) {
+
+        return RC(INV_PARAM);
+    }
+    int order = Max(_GetOrder(size), _minOrder);
+    if (address & (_GetOrderSize(order) - 1)) {
+        return RC(INV_PARAM);
+    }
+    /* Double freeing. The block itself is not marked free if it has been
+     * coalesced with its buddy, so each containing block is checked as well.
+     */
+    for (int o = order; o <= _maxOrder; o++) {
+        if (_GetPool(o)._bitmap.IsSet(_GetBlockIdx(address, o))) {
+            return RC(INV_PARAM);
+        }
+    }
+
+    _ReleaseBlock(address, order);
+    return RC(SUCCESS);
+}
+
+RetCode
+BuddyAllocatorBase::AllocateRange(Addr size, Addr *address, Addr alignment,
+                                  Addr lowLimit, Addr highLimit)
+{
+    ASSERT(_isInitialized);
+    if (!size || size > _endAddress - _startAddress ||
+        (alignment && !IsPowerOf2(alignment))) {
+
+        return RC(INV_PARAM);
+    }
+    Addr minSize = _GetOrderSize(_minOrder);
+    size = RoundUp2(size, minSize);
+    alignment = Max(alignment, minSize);
+    lowLimit = Max(lowLimit, _startAddress);
+    highLimit = highLimit ? Min(highLimit, _endAddress) : _endAddress;
+    if (lowLimit >= highLimit || size > highLimit - lowLimit) {
+        return RC(NO_RESOURCES);
+    }
+
+    /* Ranges of power of two size are served by single block of the
+     * smallest fitting order. Blocks are aligned on their size so the
+     * alignment is satisfied by the order. Other sizes go to the first-fit
+     * search below so that the released tails are reused by the subsequent
+     * allocations.
+     */
+    for (int order = Max(_GetOrder(size), _GetOrder(alignment));
+         IsPowerOf2(size) && order <= _maxOrder;
+         order++) {
+
+        OrderPool &pool = _GetPool(order);
+        Addr blockSize = _GetOrderSize(order);
+        Addr first = RoundUp2(lowLimit, blockSize);
+        if (!pool._numFree || first >= highLimit) {
+            continue;
+        }
+        int bit = pool._bitmap.NextSet(_GetBlockIdx(first, order));
+        if (bit == -1) {
+            continue;
+        }
+        /* Blocks are found in ascending order so there is no point to look
+         * further in this order if the lowest one is out of the window.
+         * Greater orders may still have a fitting block.
+         */
+        Addr addr = _GetBlockAddress(bit, order);
+        if (addr >= highLimit || size > highLimit - addr) {
+            continue;
+        }
+        _TakeBlock(addr, order);
+        if (size < blockSize) {
+            pool._splits++;
+            _ReleaseRange(addr + size, addr + blockSize);
+        }
+        *address = addr;
+        return RC(SUCCESS);
+    }
+
+    /* Search for a run of adjacent free blocks. */
+    Addr pos = RoundUp2(lowLimit, alignment);
+    while (pos < highLimit && size <= highLimit - pos) {
+        Addr end = pos + size;
+        Addr cur = pos, block;
+        int order;
+        while (cur < end && _FindFreeBlock(cur, &block, &order)) {
+            cur = block + _GetOrderSize(order);
+        }
+        if (cur >= end) {
+            _TakeRange(pos, end);
+            *address = pos;
+            return RC(SUCCESS);
+        }
+        /* Skip allocated area. */
+        pos = RoundUp2(_FindNextFree(cur), alignment);
+    }
+    return RC(NO_RESOURCES);
+}
+
+RetCode
+BuddyAllocatorBase::FreeRange(Addr address, Addr size)
+{
+    ASSERT(_isInitialized);
+    Addr minSize = _GetOrderSize(_minOrder);
+    if (!size || address < _startAddress || address >= _endAddress ||
+        (address & (minSize - 1))) {
+
+        return RC(INV_PARAM);
+    }
+    size = RoundUp2(size, minSize);
+    if (size > _endAddress - address) {
+        return RC(INV_PARAM);
+    }
+    /* Detect double freeing. Checking each minimal block is too expensive,
+     * so only the first address of each block the range is released in is
+     * checked.
+     */
+    Addr end = address + size;
+    for (Addr cur = address; cur < end;) {
+        Addr block;
+        int order;
+        if (_FindFreeBlock(cur, &block, &order)) {
+            return RC(INV_PARAM);
+        }
+        cur += _GetOrderSize(_GetRangeOrder(cur, end));
+    }
+    _ReleaseRange(address, end);
+    return RC(SUCCESS);
+}
+
+void
+BuddyAllocatorBase::_ReleaseBlock(Addr address, int order)
+{
+    /* Coalesce with buddies while they are free. */
+    while (order < _maxOrder) {
+        Addr buddy = address ^ _GetOrderSize(order);
+        if (!_GetPool(order)._bitmap.IsSet(_GetBlockIdx(buddy, order))) {
+            break;
+        }
+        _TakeBlock(buddy, order);
+        _GetPool(order)._coalesces++;
+        if (buddy < address) {
+            address = buddy;
+        }
+        order++;
+    }
+
+    _PutFreeBlock(address, order);
+}
+
+void
+BuddyAllocatorBase::_ReleaseRange(Addr start, Addr end)
+{
+    while (start < end) {
+        int order = _GetRangeOrder(start, end);
+        _ReleaseBlock(start, order);
+        start += _GetOrderSize(order);
+    }
+}
+
+int
+BuddyAllocatorBase::_GetRangeOrder(Addr start, Addr end)
+{
+    int order = _minOrder;
+    while (order < _maxOrder &&
+           !(start & (_GetOrderSize(order + 1) - 1)) &&
+           end - start >= _GetOrderSize(order + 1)) {
+
+        order++;
+    }
+    return order;
+}
+
+bool
+BuddyAllocatorBase::_FindFreeBlock(Addr address, Addr *block, int *order)
+{
+    ASSERT(address >= _startAddress && address < _endAddress);
+    for (int o = _minOrder; o <= _maxOrder; o++) {
+        OrderPool &pool = _GetPool(o);
+        size_t idx = _GetBlockIdx(address, o);
+        if (pool._numFree && pool._bitmap.IsSet(idx)) {
+            *block = _GetBlockAddress(idx, o);
+            *order = o;
+            return true;
+        }
+    }
+    return false;
+}
+
+BuddyAllocatorBase::Addr
+BuddyAllocatorBase::_FindNextFree(Addr address)
+{
+    Addr next = _endAddress;
+    for (int order = _minOrder; order <= _maxOrder; order++) {
+        OrderPool &pool = _GetPool(order);
+        if (!pool._numFree) {
+            continue;
+        }
+        int bit = pool._bitmap.NextSet(_GetBlockIdx(address, order));
+        if (bit != -1) {
+            next = Min(next, _GetBlockAddress(bit, order));
+        }
+    }
+    return next;
+}
+
+void
+BuddyAllocatorBase::_TakeRange(Addr start, Addr end)
+{
+    Addr cur = start;
+    while (cur < end) {
+        Addr block;
+        int order;
+        ENSURE(_FindFreeBlock(cur, &block, &order));
+        Addr blockEnd = block + _GetOrderSize(order);
+        _TakeBlock(block, order);
+        if (block < start || blockEnd > end) {
+            _GetPool(order)._splits++;
+        }
+        if (block < start) {
+            _ReleaseRange(block, start);
+        }
+        if (blockEnd > end) {
+            _ReleaseRange(end, blockEnd);
+        }
+        cur = blockEnd;
+    }
+}
+
+void
+BuddyAllocatorBase::_PutFreeBlock(Addr address, int order)
+{
+    OrderPool &pool = _GetPool(order);
+    pool._bitmap.Set(_GetBlockIdx(address, order));
+    pool._numFree++;
+
+    if (_freeCacheEntries == CacheEntry::NONE) {
+        /* Cache exhausted, the block is tracked by the bitmap only. */
+        _cacheExhausted++;
+        return;
+    }
+    CacheEntry *entry = &_cache[_freeCacheEntries];
+    entry->Delete(_cache, _freeCacheEntries);
+    entry->address = address;
+    entry->Insert(_cache, pool._freeBlocks);
+    ENSURE(_cacheTree.Insert(entry, &entry->treeEntry));
+    _cacheUsed++;
+}
+
+bool
+BuddyAllocatorBase::_TakeFreeBlock(int order, Addr *address)
+{
+    OrderPool &pool = _GetPool(order);
+    if (!pool._numFree) {
+        return false;
+    }
+
+    size_t idx;
+    if (pool._freeBlocks != CacheEntry::NONE) {
+        /* Fast path - take cached block. */
+        CacheEntry *entry = &_cache[pool._freeBlocks];
+        *address = entry->address;
+        _ReleaseCacheEntry(entry, pool);
+        idx = _GetBlockIdx(*address, order);
+        pool._cacheHits++;
+    } else {
+        int bit = pool._bitmap.FirstSet();
+        ASSERT(bit != -1);
+        idx = bit;
+        *address = _GetBlockAddress(idx, order);
+        pool._cacheMisses++;
+    }
+    pool._bitmap.Clear(idx);
+    pool._numFree--;
+    return true;
+}
+
+void
+BuddyAllocatorBase::_TakeBlock(Addr address, int order)
+{
+    OrderPool &pool = _GetPool(order);
+    /* Cache tree lookup is not required if nothing is cached for this order. */
+    if (pool._freeBlocks != CacheEntry::NONE) {
+        CacheEntry *entry = _cacheTree.Lookup(address);
+        if (entry) {
+            ASSERT(entry->address == address);
+            _ReleaseCacheEntry(entry, pool);
+        }
+    }
+    pool._bitmap.Clear(_GetBlockIdx(address, order));
+    pool._numFree--;
+}
+
+void
+BuddyAllocatorBase::_ReleaseCacheEntry(CacheEntry *entry, OrderPool &pool)
+{
+    entry->Delete(_cache, pool._freeBlocks);
+    _cacheTree.Delete(&entry->treeEntry);
+    entry->Insert(_cache, _freeCacheEntries);
+    _cacheUsed--;
+}
+
+void
+BuddyAllocatorBase::GetStats(Stats *stats)
+{
+    ASSERT(_isInitialized);
+    stats->minOrder = _minOrder;
+    stats->maxOrder = _maxOrder;
+    stats->freeSize = 0;
+    stats->numFree = 0;
+    stats->largestFreeOrder = -1;
+    for (int order = _minOrder; order <= _maxOrder; order++) {
+        OrderPool &pool = _GetPool(order);
+        OrderStats &os = stats->orders[order];
+        os.numFree = pool._numFree;
+        os.cacheHits = pool._cacheHits;
+        os.cacheMisses = pool._cacheMisses;
+        os.splits = pool._splits;
+        os.coalesces = pool._coalesces;
+        stats->freeSize += static_cast<Addr>(pool._numFree) << order;
+        stats->numFree += pool._numFree;
+        if (pool._numFree) {
+            stats->largestFreeOrder = order;
+        }
+    }
+    stats->cacheSize = _cacheSize;
+    stats->cacheUsed = _cacheUsed;
+    stats->cacheExhausted = _cacheExhausted;
+}
+
+void
+BuddyAllocatorBase::ResetStats()
+{
+    ASSERT(_isInitialized);
+    for (int order = _minOrder; order <= _maxOrder; order++) {
+        OrderPool &pool = _GetPool(order);
+        pool._cacheHits = 0;
+        pool._cacheMisses = 0;
+        pool._splits = 0;
+        pool._coalesces = 0;
+    }
+    _cacheExhausted = 0;
+}
+
+int
+BuddyAllocatorBase::Stats::GetFragmentation(int order)
+{
+    ASSERT(order >= minOrder && order <= maxOrder);
+    if (largestFreeOrder >= order) {
+        return -1;
+    }
+    if (!numFree) {
+        /* Allocation fails due to lack of memory only. */
+        return 0;
+    }
+    /* All free blocks are smaller than the requested one here, so the number
+     * of requested blocks the free memory could hold is less than the number
+     * of free blocks. The more free blocks it takes to hold one requested
+     * block, the more fragmented the memory is.
+     */
+    return 1000 - (freeSize >> order) * 1000 / numFree;
+}
+
+bool
+BuddyAllocatorBase::Stats::ToString(text_stream::OTextStreamBase &stream,
+                                    text_stream::OTextStreamBase::Context &ctx,
+                                    char fmtChar UNUSED)
+{
+    text_stream::OTextStreamBase::Context _ctx;
+    bool ret = stream.Format(_ctx, "orders %d-%d, free 0x%x in %d blocks, "
+                             "cache %d/%d used, %d exhausted\n"
+                             "order      free      hits    misses    splits "
+                             " coalesces  frag\n",
+                             minOrder, maxOrder, freeSize, numFree,
+                             cacheUsed, cacheSize, cacheExhausted);
+    for (int order = minOrder; ret && order <= maxOrder; order++) {
+        OrderStats &os = orders[order];
+        ret = stream.Format(_ctx, "%5d %9d %9d %9d %9d %10d ", order,
+                            os.numFree, os.cacheHits, os.cacheMisses,
+                            os.splits, os.coalesces);
+        int frag = GetFragmentation(order);
+        if (ret) {
+            ret = frag == -1 ? stream.Format(_ctx, "%5s\n", "-") :
+                               stream.Format(_ctx, "%5d\n", frag);
+        }
+    }
+    ctx += _ctx;
+    return ret;
+}
+
+RetCode
+BuddyAllocatorBase::OrderPool::Initialize(size_t numBlocks)
+{
+    /* Summary levels make free block lookup logarithmic in the pool size. */
+    _bitmapData = NEW_ALIGNED(sizeof(uintptr_t))
+        u8[SummaryBitString::GetStorageSize(numBlocks)];
+    if (!_bitmapData) {
+        return RC(NO_MEMORY);
+    }
+    _bitmap = SummaryBitString(_bitmapData, numBlocks);
+    return RC(SUCCESS);
+}
+
 void
 BuddyAllocatorBase::CacheEntry::Insert(CacheEntry *cache, ListHead &head)
 {
@@ -112,8 +577,6 @@ BuddyAllocatorBase::CacheEntry::Delete(CacheEntry *cache, ListHead &head)
 {
     Index idx = GetIdx(cache);
     if (head != idx) {
-        head = next;
-
         ASSERT(prev != NONE);
         CacheEntry *prevEntry = GetPtr(cache, prev);
         ASSERT(prevEntry->next == idx);
@@ -0,0 +1,289 @@
+/*
+ * /phoenix/lib/common/BuddyMagazine.cpp
+ *
+ * This file is a part of Phoenix operating system.
+ * Copyright (c) 2011-2012, Artyom Lebedev <artyom.lebedev@gmail.com>
+ * All rights reserved.
+ * See COPYING file for copyright details.
+ */
+
+/** @file BuddyMagazine.cpp
+ * Per-CPU magazine cache for the buddy allocator implementation.
+ */
+
+#include <sys.h>
+
+BuddyMagazineBase::BuddyMagazineBase()
+{
+
+}
+
+BuddyMagazineBase::~BuddyMagazineBase()
+{
+    if (_alloc) {
+        for (size_t cpu = 0; cpu < _numCpus; cpu++) {
+            Flush(cpu);
+        }
+        Reclaim();
+    }
+    _Free();
+}
+
+void
+BuddyMagazineBase::_Free()
+{
+    if (_cpus) {
+        DELETE [] _cpus;
+        _cpus = 0;
+    }
+    if (_magazines) {
+        DELETE [] _magazines;
+        _magazines = 0;
+    }
+    _alloc = 0;
+}
+
+RetCode
+BuddyMagazineBase::Initialize(BuddyAllocatorBase *alloc, size_t numCpus,
+                              size_t depotSize)
+{
+    if (!alloc || !numCpus) {
+        return RC(INV_PARAM);
+    }
+
+    _cpus = NEW_ALIGNED(CACHE_LINE_SIZE) CpuCache[numCpus];
+    if (!_cpus) {
+        return RC(NO_MEMORY);
+    }
+    /* Two magazines per CPU for each order plus the depot reserve. */
+    size_t numMagazines = (numCpus * 2 + depotSize) * NUM_ORDERS;
+    _magazines = NEW Magazine[numMagazines];
+    if (!_magazines) {
+        _Free();
+        return RC(NO_MEMORY);
+    }
+
+    Magazine *m = _magazines;
+    for (size_t cpu = 0; cpu < numCpus; cpu++) {
+        for (size_t order = 0; order < NUM_ORDERS; order++) {
+            _cpus[cpu].orders[order].loaded = m++;
+            _cpus[cpu].orders[order].previous = m++;
+        }
+    }
+    for (size_t order = 0; order < NUM_ORDERS; order++) {
+        for (size_t i = 0; i < depotSize; i++) {
+            _depot[order].PushEmpty(m++);
+        }
+    }
+    ASSERT(m == _magazines + numMagazines);
+
+    _alloc = alloc;
+    _numCpus = numCpus;
+    return RC(SUCCESS);
+}
+
+RetCode
+BuddyMagazineBase::Allocate(size_t cpu, Addr size, Addr *address)
+{
+    ASSERT(_alloc);
+    ASSERT(cpu < _numCpus);
+    if (!size) {
+        return RC(INV_PARAM);
+    }
+    int order = _alloc->GetBlockOrder(size);
+    if (order > _alloc->GetMaxOrder()) {
+        return RC(INV_PARAM);
+    }
+    size_t idx = order - _alloc->GetMinOrder();
+    if (idx >= NUM_ORDERS) {
+        return _AllocateGlobal(size, address);
+    }
+
+    CpuOrderCache &cache = _cpus[cpu].orders[idx];
+    if (LIKELY(!cache.loaded->IsEmpty())) {
+        *address = cache.loaded->Pop();
+        return RC(SUCCESS);
+    }
+    if (!cache.previous->IsEmpty()) {
+        cache.Swap();
+        *address = cache.loaded->Pop();
+        return RC(SUCCESS);
+    }
+
+    /* Both magazines are empty, try to get full one from the depot. */
+    Depot &depot = _depot[idx];
+    _depotLock.Lock();
+    Magazine *m = depot.PopFull();
+    if (m) {
+        depot.PushEmpty(cache.previous);
+        cache.previous = cache.loaded;
+        cache.loaded = m;
+    }
+    _depotLock.Unlock();
+    if (m) {
+        *address = cache.loaded->Pop();
+        return RC(SUCCESS);
+    }
+
+    /* Refill the loaded magazine from the underlying allocator. */
+    _allocLock.Lock();
+    _FillMagazine(cache.loaded, order);
+    _allocLock.Unlock();
+    if (cache.loaded->IsEmpty()) {
+        /* Blocks held in the depot may be returned to the allocator. */
+        Reclaim();
+        _allocLock.Lock();
+        _FillMagazine(cache.loaded, order);
+        _allocLock.Unlock();
+        if (cache.loaded->IsEmpty()) {
+            return RC(NO_RESOURCES);
+        }
+    }
+    *address = cache.loaded->Pop();
+    return RC(SUCCESS);
+}
+
+RetCode
+BuddyMagazineBase::Free(size_t cpu, Addr address, Addr size)
+{
+    ASSERT(_alloc);
+    ASSERT(cpu < _numCpus);
+    if (!size) {
+        return RC(INV_PARAM);
+    }
+    int order = _alloc->GetBlockOrder(size);
+    if (order > _alloc->GetMaxOrder()) {
+        return RC(INV_PARAM);
+    }
+    size_t idx = order - _alloc->GetMinOrder();
+    if (idx >= NUM_ORDERS) {
+        return _FreeGlobal(address, size);
+    }
+
+    CpuOrderCache &cache = _cpus[cpu].orders[idx];
+    if (LIKELY(!cache.loaded->IsFull())) {
+        cache.loaded->Push(address);
+        return RC(SUCCESS);
+    }
+    if (!cache.previous->IsFull()) {
+        cache.Swap();
+        cache.loaded->Push(address);
+        return RC(SUCCESS);
+    }
+
+    /* Both magazines are full, try to get empty one from the depot. */
+    Depot &depot = _depot[idx];
+    _depotLock.Lock();
+    Magazine *m = depot.PopEmpty();
+    if (m) {
+        depot.PushFull(cache.previous);
+        cache.previous = cache.loaded;
+        cache.loaded = m;
+    }
+    _depotLock.Unlock();
+    if (!m) {
+        /* Depot exhausted, return the previous magazine content to the
+         * underlying allocator.
+         */
+        _allocLock.Lock();
+        _EmptyMagazine(cache.previous, order);
+        _allocLock.Unlock();
+        cache.Swap();
+    }
+    cache.loaded->Push(address);
+    return RC(SUCCESS);
+}
+
+void
+BuddyMagazineBase::Flush(size_t cpu)
+{
+    ASSERT(cpu < _numCpus);
+    int minOrder = _alloc->GetMinOrder();
+    _allocLock.Lock();
+    for (size_t idx = 0; idx < NUM_ORDERS; idx++) {
+        CpuOrderCache &cache = _cpus[cpu].orders[idx];
+        _EmptyMagazine(cache.loaded, minOrder + idx);
+        _EmptyMagazine(cache.previous, minOrder + idx);
+    }
+    _allocLock.Unlock();
+}
+
+void
+BuddyMagazineBase::Reclaim()
+{
+    int minOrder = _alloc->GetMinOrder();
+    for (size_t idx = 0; idx < NUM_ORDERS; idx++) {
+        Depot &depot = _depot[idx];
+        /* Detach full magazines so that the depot lock is not held while the
+         * blocks are returned.
+         */
+        _depotLock.Lock();
+        Magazine *full = depot.full;
+        depot.full = 0;
+        _depotLock.Unlock();
+        if (!full) {
+            continue;
+        }
+
+        _allocLock.Lock();
+        for (Magazine *m = full; m; m = m->next) {
+            _EmptyMagazine(m, minOrder + idx);
+        }
+        _allocLock.Unlock();
+
+        _depotLock.Lock();
+        while (full) {
+            Magazine *next = full->next;
+            depot.PushEmpty(full);
+            full = next;
+        }
+        _depotLock.Unlock();
+    }
+}
+
+RetCode
+BuddyMagazineBase::_AllocateGlobal(Addr size, Addr *address)
+{
+    _allocLock.Lock();
+    RetCode rc = _alloc->Allocate(size, address);
+    _allocLock.Unlock();
+    if (rc == RetCode::NO_RESOURCES) {
+        /* Blocks held in the depot may coalesce to the requested size. */
+        Reclaim();
+        _allocLock.Lock();
+        rc = _alloc->Allocate(size, address);
+        _allocLock.Unlock();
+    }
+    return rc;
+}
+
+RetCode
+BuddyMagazineBase::_FreeGlobal(Addr address, Addr size)
+{
+    _allocLock.Lock();
+    RetCode rc = _alloc->Free(address, size);
+    _allocLock.Unlock();
+    return rc;
+}
+
+void
+BuddyMagazineBase::_FillMagazine(Magazine *m, int order)
+{
+    Addr blockSize = static_cast<Addr>(1) << order;
+    while (m->numRounds < REFILL_SIZE) {
+        Addr addr;
+        if (!_alloc->Allocate(blockSize, &addr).IsOk()) {
+            break;
+        }
+        m->Push(addr);
+    }
+}
+
+void
+BuddyMagazineBase::_EmptyMagazine(Magazine *m, int order)
+{
+    Addr blockSize = static_cast<Addr>(1) << order;
+    while (!m->IsEmpty()) {
+        ENSURE(_alloc->Free(m->Pop(), blockSize).IsOk());
+    }
+}
@@ -14,6 +14,165 @@
  */
 
 #include <sys.h>
+#include <md_string.h>
+
+StringOps::CopyFunc StringOps::_copy = StringOps::_CopySelect;
+StringOps::CopyFunc StringOps::_move = StringOps::_MoveSelect;
+StringOps::FillFunc StringOps::_fill = StringOps::_FillSelect;
+StringOps::CompareFunc StringOps::_compare = StringOps::_CompareSelect;
+StringOps::FindFunc StringOps::_find = StringOps::_FindSelect;
+StringOps::LengthFunc StringOps::_length = StringOps::_LengthSelect;
+
+void
+StringOps::Select(bool allowSimd)
+{
+    /* Generic versions are installed first since the capabilities inquiring
+     * code may use the primitives itself.
+     */
+    _copy = _CopyGeneric;
+    _move = _MoveGeneric;
+    _fill = _FillGeneric;
+    _compare = _CompareGeneric;
+    _find = _FindGeneric;
+    _length = _LengthGeneric;
+    if (!allowSimd) {
+        return;
+    }
+
+    cpu::CpuCaps caps;
+    if (!caps.GetCapability(cpu::CPU_CAP_SSE2)) {
+        return;
+    }
+    CopyFunc copy = cpu::MemcpySse2;
+    FillFunc fill = cpu::MemsetSse2;
+    FindFunc find = cpu::MemchrSse2;
+    LengthFunc length = cpu::StrlenSse2;
+    bool erms = caps.GetCapability(cpu::CPU_CAP_ERMS);
+    if (caps.GetCapability(cpu::CPU_CAP_AVX2) && cpu::IsAvxEnabled()) {
+        copy = erms ? cpu::MemcpyErms<cpu::MemcpyAvx2> : cpu::MemcpyAvx2;
+        fill = erms ? cpu::MemsetErms<cpu::MemsetAvx2> : cpu::MemsetAvx2;
+        find = cpu::MemchrAvx2;
+        length = cpu::StrlenAvx2;
+    } else if (erms) {
+        copy = cpu::MemcpyErms<cpu::MemcpySse2>;
+        fill = cpu::MemsetErms<cpu::MemsetSse2>;
+    }
+    _move = cpu::MemmoveSse2;
+    _compare = cpu::MemcmpSse2;
+    _copy = copy;
+    _fill = fill;
+    _find = find;
+    _length = length;
+}
+
+void
+StringOps::_CopySelect(u8 *dst, const u8 *src, size_t size)
+{
+    Select();
+    _copy(dst, src, size);
+}
+
+void
+StringOps::_MoveSelect(u8 *dst, const u8 *src, size_t size)
+{
+    Select();
+    _move(dst, src, size);
+}
+
+void
+StringOps::_FillSelect(u8 *dst, u8 value, size_t size)
+{
+    Select();
+    _fill(dst, value, size);
+}
+
+int
+StringOps::_CompareSelect(const u8 *p1, const u8 *p2, size_t size)
+{
+    Select();
+    return _compare(p1, p2, size);
+}
+
+const u8 *
+StringOps::_FindSelect(const u8 *ptr, u8 value, size_t size)
+{
+    Select();
+    return _find(ptr, value, size);
+}
+
+size_t
+StringOps::_LengthSelect(const char *str)
+{
+    Select();
+    return _length(str);
+}
+
+void
+StringOps::_CopyGeneric(u8 *dst, const u8 *src, size_t size)
+{
+    while (size) {
+        *dst++ = *src++;
+        size--;
+    }
+}
+
+void
+StringOps::_MoveGeneric(u8 *dst, const u8 *src, size_t size)
+{
+    if (src > dst) {
+        while (size) {
+            *dst++ = *src++;
+            size--;
+        }
+    } else {
+        dst += size;
+        src += size;
+        while (size) {
+            *--dst = *--src;
+            size--;
+        }
+    }
+}
+
+void
+StringOps::_FillGeneric(u8 *dst, u8 value, size_t size)
+{
+    while (size) {
+        *dst++ = value;
+        size--;
+    }
+}
+
+int
+StringOps::_CompareGeneric(const u8 *p1, const u8 *p2, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        if (p1[i] != p2[i]) {
+            return p1[i] - p2[i];
+        }
+    }
+    return 0;
+}
+
+const u8 *
+StringOps::_FindGeneric(const u8 *ptr, u8 value, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        if (ptr[i] == value) {
+            return &ptr[i];
+        }
+    }
+    return 0;
+}
+
+size_t
+StringOps::_LengthGeneric(const char *str)
+{
+    const char *s;
+
+    for (s = str; *s; ++s);
+    return s - str;
+}
 
 /** Fill block of memory.
  *
@@ -31,13 +190,8 @@
 ASMCALL void *
 memset(void *dst, u8 value, size_t size)
 {
-    void *ret = dst;
-    while (size) {
-        *static_cast<u8 *>(dst) = value;
-        dst = static_cast<u8 *>(dst) + 1;
-        size--;
-    }
-    return ret;
+    StringOps::Fill(static_cast<u8 *>(dst), value, size);
+    return dst;
 }
 
 /** Copy block of memory.
@@ -71,14 +225,8 @@ memset(void *dst, u8 value, size_t size)
 ASMCALL void *
 memcpy(void *dst, const void *src, size_t size)
 {
-    void *ret = dst;
-    while (size) {
-        *static_cast<u8 *>(dst) = *(u8 *)src;
-        dst = static_cast<u8 *>(dst) + 1;
-        src = static_cast<const u8 *>(src) + 1;
-        size--;
-    }
-    return ret;
+    StringOps::Copy(static_cast<u8 *>(dst), static_cast<const u8 *>(src), size);
+    return dst;
 }
 
 /** Move block of memory
@@ -111,25 +259,8 @@ memcpy(void *dst, const void *src, size_t size)
 ASMCALL void *
 memmove(void *dst, const void *src, size_t size)
 {
-    void *ret = dst;
-    if (src > dst) {
-        while (size) {
-            *static_cast<u8 *>(dst) = *static_cast<const u8 *>(src);
-            dst = static_cast<u8 *>(dst) + 1;
-            src = static_cast<const u8 *>(src) + 1;
-            size--;
-        }
-    } else {
-        dst = static_cast<u8 *>(dst) + size - 1;
-        src = static_cast<const u8 *>(src) + size - 1;
-        while (size) {
-            *static_cast<u8 *>(dst) = *static_cast<const u8 *>(src);
-            dst = static_cast<u8 *>(dst) - 1;
-            src = static_cast<const u8 *>(src) - 1;
-            size--;
-        }
-    }
-    return ret;
+    StringOps::Move(static_cast<u8 *>(dst), static_cast<const u8 *>(src), size);
+    return dst;
 }
 
 /** Compare two blocks of memory.
@@ -156,13 +287,8 @@ memmove(void *dst, const void *src, size_t size)
 ASMCALL int
 memcmp(const void *ptr1, const void *ptr2, size_t size)
 {
-    while (size) {
-        if (*static_cast<const u8 *>(ptr1) != *static_cast<const u8 *>(ptr2)) {
-            return *static_cast<const u8 *>(ptr2) - *static_cast<const u8 *>(ptr1);
-        }
-        size--;
-    }
-    return 0;
+    return StringOps::Compare(static_cast<const u8 *>(ptr1),
+                              static_cast<const u8 *>(ptr2), size);
 }
 
 /** Locate character in block of memory.
@@ -187,14 +313,8 @@ memcmp(const void *ptr1, const void *ptr2, size_t size)
 ASMCALL void *
 memchr(void *ptr, int value, size_t size)
 {
-    u8 *p = static_cast<u8 *>(ptr);
-    while (size) {
-        if (static_cast<u8>(value) == *p++) {
-            return static_cast<void *>(p - 1);
-        }
-        size--;
-    }
-    return 0;
+    return const_cast<u8 *>(StringOps::Find(static_cast<const u8 *>(ptr),
+                                            static_cast<u8>(value), size));
 }
 
 /** Convert ASCII character to upper case. */
@@ -223,10 +343,7 @@ tolower(int c)
 ASMCALL size_t
 strlen(const char *str)
 {
-    register const char *s;
-
-    for (s = str; *s; ++s);
-    return s - str;
+    return StringOps::Length(str);
 }
 
 #ifdef strcpy
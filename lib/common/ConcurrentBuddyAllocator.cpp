@@ -0,0 +1,288 @@
+/*
+ * /phoenix/lib/common/ConcurrentBuddyAllocator.cpp
+ *
+ * This file is a part of Phoenix operating system.
+ * Copyright (c) 2011-2012, Artyom Lebedev <artyom.lebedev@gmail.com>
+ * All rights reserved.
+ * See COPYING file for copyright details.
+ */
+
+/** @file ConcurrentBuddyAllocator.cpp
+ * Buddy allocator with fine-grained locking implementation.
+ */
+
+#include <sys.h>
+
+ConcurrentBuddyAllocatorBase::ConcurrentBuddyAllocatorBase()
+{
+
+}
+
+ConcurrentBuddyAllocatorBase::~ConcurrentBuddyAllocatorBase()
+{
+    _Free();
+}
+
+void
+ConcurrentBuddyAllocatorBase::_Free()
+{
+    if (_pool) {
+        DELETE [] _pool;
+        _pool = 0;
+    }
+    _isInitialized = false;
+}
+
+RetCode
+ConcurrentBuddyAllocatorBase::Initialize(Addr startAddress, Addr endAddress,
+                                         int minOrder, int maxOrder)
+{
+    if (startAddress >= endAddress || minOrder < 0) {
+        return RC(INV_PARAM);
+    }
+    _startAddress = startAddress;
+    _endAddress = endAddress;
+    _minOrder = minOrder;
+
+    /* Find maximal possible order. */
+    int order = _GetOrder(endAddress - startAddress);
+    Addr alignedStart, alignedEnd;
+    Addr size;
+    do {
+        size = _GetOrderSize(order);
+        alignedStart = RoundUp2(startAddress, size);
+        alignedEnd = RoundDown2(endAddress, size);
+        order--;
+    } while ((alignedEnd <= alignedStart) ||
+             (alignedEnd - alignedStart) % size != 0);
+    order++;
+
+    if (maxOrder == -1 || order < maxOrder) {
+        _maxOrder = order;
+    } else {
+        if (maxOrder > static_cast<int>(MAX_ORDER)) {
+            return RC(INV_PARAM);
+        }
+        _maxOrder = maxOrder;
+    }
+
+    /* Range should be aligned on blocks of maximal order. */
+    if (startAddress != RoundUp2(startAddress, _GetOrderSize(_maxOrder)) ||
+        endAddress != RoundUp2(endAddress, _GetOrderSize(_maxOrder))) {
+
+        return RC(INV_PARAM);
+    }
+
+    if (_minOrder > _maxOrder) {
+        return RC(INV_PARAM);
+    }
+
+    /* Allocate orders pool. */
+    int numOrders = _maxOrder - _minOrder + 1;
+    _pool = NEW_ALIGNED(CACHE_LINE_SIZE) OrderPool[numOrders];
+    if (!_pool) {
+        return RC(NO_MEMORY);
+    }
+    for (int order = _minOrder; order <= _maxOrder; order++) {
+        RetCode rc = _GetPool(order).Initialize(
+            (_endAddress - _startAddress) >> order);
+        if (NOK(rc)) {
+            _Free();
+            return rc;
+        }
+    }
+
+    /* Initially the whole range consists of free blocks of maximal order. */
+    size_t numBlocks = (_endAddress - _startAddress) >> _maxOrder;
+    for (size_t idx = 0; idx < numBlocks; idx++) {
+        _PutFreeBlock(_GetBlockAddress(idx, _maxOrder), _maxOrder);
+    }
+
+    _isInitialized = true;
+    return RC(SUCCESS);
+}
+
+RetCode
+ConcurrentBuddyAllocatorBase::Allocate(Addr size, Addr *address)
+{
+    ASSERT(_isInitialized);
+    if (!size || size > _GetOrderSize(_maxOrder)) {
+        return RC(INV_PARAM);
+    }
+    int order = Max(_GetOrder(size), _minOrder);
+
+    /* Find the smallest order which has free blocks. Lower orders are kept
+     * locked, the halves of the split block are returned there.
+     */
+    int srcOrder = order;
+    Addr addr;
+    while (true) {
+        OrderPool &pool = _GetPool(srcOrder);
+        int hint = _Probe(pool);
+        pool._lock.Lock();
+        if (_TakeFreeBlock(srcOrder, hint, &addr)) {
+            break;
+        }
+        if (srcOrder == _maxOrder) {
+            for (int o = order; o <= srcOrder; o++) {
+                _GetPool(o)._lock.Unlock();
+            }
+            return RC(NO_RESOURCES);
+        }
+        srcOrder++;
+    }
+
+    /* Split the block, upper halves are returned to lower orders. */
+    while (srcOrder > order) {
+        OrderPool &pool = _GetPool(srcOrder);
+        pool._splits++;
+        pool._lock.Unlock();
+        srcOrder--;
+        _PutFreeBlock(addr + _GetOrderSize(srcOrder), srcOrder);
+    }
+    _GetPool(order)._lock.Unlock();
+
+    *address = addr;
+    return RC(SUCCESS);
+}
+
+RetCode
+ConcurrentBuddyAllocatorBase::Free(Addr address, Addr size)
+{
+    ASSERT(_isInitialized);
+    if (!size || size > _GetOrderSize(_maxOrder) ||
+        address < _startAddress || address >= _endAddress) {
+
+        return RC(INV_PARAM);
+    }
+    int order = Max(_GetOrder(size), _minOrder);
+    if (address & (_GetOrderSize(order) - 1)) {
+        return RC(INV_PARAM);
+    }
+
+    OrderPool *pool = &_GetPool(order);
+    pool->_lock.Lock();
+    /* Check for double freeing. The block may be already coalesced with its
+     * buddies so the containing blocks of greater orders are checked as well.
+     * Their locks are acquired in ascending order hand over hand, so a block
+     * which is being coalesced or split cannot pass by unnoticed.
+     */
+    bool isFree = pool->_bitmap.IsSet(_GetBlockIdx(address, order));
+    OrderPool *upper = pool;
+    for (int o = order + 1; o <= _maxOrder && !isFree; o++) {
+        OrderPool *next = &_GetPool(o);
+        next->_lock.Lock();
+        if (upper != pool) {
+            upper->_lock.Unlock();
+        }
+        upper = next;
+        isFree = upper->_bitmap.IsSet(_GetBlockIdx(address, o));
+    }
+    if (upper != pool) {
+        upper->_lock.Unlock();
+    }
+    if (isFree) {
+        pool->_lock.Unlock();
+        return RC(INV_PARAM);
+    }
+
+    /* Coalesce with buddies while they are free. The next order is locked
+     * before the current one is released so the block is always visible to
+     * the allocations climbing up through the orders.
+     */
+    while (order < _maxOrder) {
+        Addr buddy = address ^ _GetOrderSize(order);
+        size_t buddyIdx = _GetBlockIdx(buddy, order);
+        if (!pool->_bitmap.IsSet(buddyIdx)) {
+            break;
+        }
+        pool->_bitmap.Clear(buddyIdx);
+        pool->_numFree--;
+        pool->_coalesces++;
+        if (buddy < address) {
+            address = buddy;
+        }
+        order++;
+        OrderPool *next = &_GetPool(order);
+        next->_lock.Lock();
+        pool->_lock.Unlock();
+        pool = next;
+    }
+    _PutFreeBlock(address, order);
+    pool->_lock.Unlock();
+    return RC(SUCCESS);
+}
+
+void
+ConcurrentBuddyAllocatorBase::GetStats(BuddyAllocatorBase::Stats *stats)
+{
+    ASSERT(_isInitialized);
+    stats->minOrder = _minOrder;
+    stats->maxOrder = _maxOrder;
+    stats->freeSize = 0;
+    stats->numFree = 0;
+    stats->largestFreeOrder = -1;
+    for (int order = _minOrder; order <= _maxOrder; order++) {
+        OrderPool &pool = _GetPool(order);
+        BuddyAllocatorBase::OrderStats &os = stats->orders[order];
+        pool._lock.Lock();
+        os.numFree = pool._numFree;
+        os.cacheHits = pool._probeHits;
+        os.cacheMisses = pool._probeMisses;
+        os.splits = pool._splits;
+        os.coalesces = pool._coalesces;
+        pool._lock.Unlock();
+        stats->freeSize += static_cast<Addr>(os.numFree) << order;
+        stats->numFree += os.numFree;
+        if (os.numFree) {
+            stats->largestFreeOrder = order;
+        }
+    }
+    stats->cacheSize = 0;
+    stats->cacheUsed = 0;
+    stats->cacheExhausted = 0;
+}
+
+bool
+ConcurrentBuddyAllocatorBase::_TakeFreeBlock(int order, int hint, Addr *address)
+{
+    OrderPool &pool = _GetPool(order);
+    if (!pool._numFree) {
+        return false;
+    }
+    size_t idx;
+    if (hint != -1 && pool._bitmap.IsSet(hint)) {
+        /* Fast path - the probed block is still free. */
+        idx = hint;
+        pool._probeHits++;
+    } else {
+        int bit = pool._bitmap.FirstSet();
+        ASSERT(bit != -1);
+        idx = bit;
+        pool._probeMisses++;
+    }
+    pool._bitmap.Clear(idx);
+    pool._numFree--;
+    *address = _GetBlockAddress(idx, order);
+    return true;
+}
+
+void
+ConcurrentBuddyAllocatorBase::_PutFreeBlock(Addr address, int order)
+{
+    OrderPool &pool = _GetPool(order);
+    pool._bitmap.Set(_GetBlockIdx(address, order));
+    pool._numFree++;
+}
+
+RetCode
+ConcurrentBuddyAllocatorBase::OrderPool::Initialize(size_t numBlocks)
+{
+    _bitmapData = NEW_ALIGNED(sizeof(uintptr_t))
+        u8[SummaryBitString::GetStorageSize(numBlocks)];
+    if (!_bitmapData) {
+        return RC(NO_MEMORY);
+    }
+    _bitmap = SummaryBitString(_bitmapData, numBlocks);
+    return RC(SUCCESS);
+}
@@ -0,0 +1,59 @@
+/*
+ * /phoenix/lib/common/ConcurrentRBTree.cpp
+ *
+ * This file is a part of Phoenix operating system.
+ * Copyright (c) 2011-2012, Artyom Lebedev <artyom.lebedev@gmail.com>
+ * All rights reserved.
+ * See COPYING file for copyright details.
+ */
+
+/** @file ConcurrentRBTree.cpp
+ * Lockless readers registry for concurrent red-black trees.
+ */
+
+#include <sys.h>
+
+RBTreeReaders::RBTreeReaders()
+{
+
+}
+
+RBTreeReaders::~RBTreeReaders()
+{
+    if (_slots) {
+        DELETE [] _slots;
+    }
+}
+
+RetCode
+RBTreeReaders::Initialize(size_t numCpus)
+{
+    if (!numCpus) {
+        return RC(INV_PARAM);
+    }
+    ASSERT(!_slots);
+    _slots = NEW_ALIGNED(CACHE_LINE_SIZE) Slot[numCpus];
+    if (!_slots) {
+        return RC(NO_MEMORY);
+    }
+    _numCpus = numCpus;
+    return RC(SUCCESS);
+}
+
+u64
+RBTreeReaders::GetOldestEpoch()
+{
+    /* The node removal and the epoch advance should be visible before the
+     * slots are checked. A reader which is not seen active here will see the
+     * node removed.
+     */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    u64 oldest = _epoch;
+    for (size_t cpu = 0; cpu < _numCpus; cpu++) {
+        u64 epoch = __atomic_load_n(&_slots[cpu].epoch, __ATOMIC_ACQUIRE);
+        if (epoch != INACTIVE && epoch < oldest) {
+            oldest = epoch;
+        }
+    }
+    return oldest;
+}
@@ -0,0 +1,39 @@
+/*
+ * /phoenix/lib/common/LogRing.cpp
+ *
+ * This file is a part of Phoenix operating system.
+ * Copyright (c) 2011-2012, Artyom Lebedev <artyom.lebedev@gmail.com>
+ * All rights reserved.
+ * See COPYING file for copyright details.
+ */
+
+/** @file LogRing.cpp
+ * Lockless ring buffer for log records.
+ */
+
+#include <sys.h>
+
+size_t
+LogRing::Put(u64 timestamp, u16 cpu, u8 level, const char *text, size_t length)
+{
+    size_t offset = 0;
+    u8 flags = 0;
+    do {
+        u64 pos = 0;
+        Record *rec = static_cast<Record *>(_Reserve(&pos));
+        if (!rec) {
+            break;
+        }
+        size_t numChars = Min<size_t>(length - offset, TEXT_SIZE);
+        rec->timestamp = timestamp;
+        rec->cpu = cpu;
+        rec->level = level;
+        rec->flags = flags;
+        rec->length = numChars;
+        memcpy(rec->text, &text[offset], numChars);
+        _Commit(rec, pos);
+        offset += numChars;
+        flags = F_CONTINUATION;
+    } while (offset < length);
+    return offset;
+}
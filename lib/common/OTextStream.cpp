@@ -17,10 +17,11 @@ using namespace text_stream;
 
 /* Conversion context */
 
-OTextStreamBase::Context::Context()
+OTextStreamBase::Context::Context(OutputBuffer *buffer)
 {
     _size = 0;
     _endOfStream = false;
+    _buffer = buffer;
     memset(_optVal, 0, sizeof(_optVal));
 }
 
@@ -29,18 +30,96 @@ OTextStreamBase::OTextStreamBase()
 
 }
 
+size_t
+OTextStreamBase::_Write(const char *buf, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        if (!_Putc(buf[i])) {
+            return i;
+        }
+    }
+    return len;
+}
+
 bool
 OTextStreamBase::_Puts(Context &ctx, const char *str)
 {
-    while (*str) {
-        if (!_Putc(ctx, *str)) {
-            break;
+    return _Puts(ctx, str, strlen(str));
+}
+
+bool
+OTextStreamBase::_Puts(Context &ctx, const char *str, size_t len)
+{
+    OutputBuffer *buf = ctx.GetBuffer();
+    if (!buf) {
+        size_t numWritten = _Write(str, len);
+        ctx += numWritten;
+        if (numWritten < len) {
+            ctx.End();
+            return false;
         }
-        str++;
+        return ctx;
+    }
+    while (len) {
+        if (buf->_len == OutputBuffer::SIZE && !_FlushBuffer(ctx)) {
+            return false;
+        }
+        if (buf->_numDropped) {
+            ctx.End();
+            return false;
+        }
+        size_t numChars = MIN(len, OutputBuffer::SIZE - buf->_len);
+        memcpy(&buf->_data[buf->_len], str, numChars);
+        buf->_len += numChars;
+        ctx += numChars;
+        str += numChars;
+        len -= numChars;
     }
     return ctx;
 }
 
+bool
+OTextStreamBase::_PutPad(Context &ctx, char c, size_t count)
+{
+    char pad[16];
+    memset(pad, c, MIN(count, sizeof(pad)));
+    while (count) {
+        size_t numChars = MIN(count, sizeof(pad));
+        if (!_Puts(ctx, pad, numChars)) {
+            return false;
+        }
+        count -= numChars;
+    }
+    return ctx;
+}
+
+bool
+OTextStreamBase::_FlushBuffer(Context &ctx)
+{
+    OutputBuffer *buf = ctx.GetBuffer();
+    if (!buf) {
+        return ctx;
+    }
+    if (buf->_len) {
+        size_t numWritten = _Write(buf->_data, buf->_len);
+        buf->_numDropped += buf->_len - numWritten;
+        buf->_len = 0;
+    }
+    if (buf->_numDropped) {
+        ctx.End();
+        return false;
+    }
+    return ctx;
+}
+
+size_t
+OTextStreamBase::_Flush(Context &ctx)
+{
+    _FlushBuffer(ctx);
+    OutputBuffer *buf = ctx.GetBuffer();
+    return static_cast<size_t>(ctx) - (buf ? buf->_numDropped : 0);
+}
+
 OTextStreamBase &
 OTextStreamBase::operator << (const Opt &opt)
 {
@@ -115,7 +194,12 @@ OTextStreamBase::_ParseFormat(Context &ctx, const char **fmt, char *fmtChar)
     /* Skip all characters preceding format. */
     while (**fmt) {
         if (**fmt != '%') {
-            if (!_Putc(ctx, **fmt)) {
+            /* Output literal run at once. */
+            const char *start = *fmt;
+            while ((*fmt)[1] && (*fmt)[1] != '%') {
+                (*fmt)++;
+            }
+            if (!_Puts(ctx, start, *fmt - start + 1)) {
                 return false;
             }
         } else if ((*fmt)[1] == '%') {
@@ -238,7 +322,7 @@ OTextStreamBase::FormatV(Context &ctx, const char *fmt, va_list args)
 {
     while (true) {
         char fmtChar;
-        Context _ctx;
+        Context _ctx(ctx.GetBuffer());
 
         if (!_ParseFormat(_ctx, &fmt, &fmtChar) || !fmtChar) {
             ctx += _ctx;
@@ -367,41 +451,125 @@ OTextStreamBase::_FormatField(Context &ctx, const char *value, size_t numChars,
     }
 
     if (ctx.Opt(Opt::O_LEFT_ADJ)) {
-        for (size_t i = 0; i < numChars; i++) {
-            if (!_Putc(ctx, value[i])) {
-                return false;
-            }
-        }
-        for (size_t i = 0; i < width - numChars; i++) {
-            if (!_Putc(ctx, padChar)) {
-                return false;
-            }
-        }
+        return _Puts(ctx, value, numChars) &&
+               _PutPad(ctx, padChar, width - numChars);
+    }
+    return _PutPad(ctx, padChar, width - numChars) &&
+           _Puts(ctx, value, numChars);
+}
+
+/* Integer conversion engine. */
+
+namespace {
+
+/** Pairs of decimal digits for values 0..99. */
+const char decDigitPairs[] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+const char lowerDigits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+const char upperDigits[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+/** Powers of ten which fit into 64 bits. */
+const u64 powersOf10[] = {
+    1ull,
+    10ull,
+    100ull,
+    1000ull,
+    10000ull,
+    100000ull,
+    1000000ull,
+    10000000ull,
+    100000000ull,
+    1000000000ull,
+    10000000000ull,
+    100000000000ull,
+    1000000000000ull,
+    10000000000000ull,
+    100000000000000ull,
+    1000000000000000ull,
+    10000000000000000ull,
+    100000000000000000ull,
+    1000000000000000000ull,
+    10000000000000000000ull
+};
+
+/** Get number of significant bits in the value, at least one. */
+inline size_t
+NumBits(u64 value)
+{
+    return sizeof(u64) * NBBY - __builtin_clzl(value | 1);
+}
+
+/** Get number of decimal digits in the value. */
+inline size_t
+NumDecDigits(u64 value)
+{
+    /* 1233 / 4096 approximates log10(2). */
+    size_t n = (NumBits(value) * 1233) >> 12;
+    return n + (value >= powersOf10[n]) + (value == 0);
+}
+
+/** Write decimal digits of the value ending at @a end. */
+inline void
+WriteDec(u64 value, char *end)
+{
+    while (value >= 100) {
+        size_t idx = (value % 100) * 2;
+        value /= 100;
+        end -= 2;
+        end[0] = decDigitPairs[idx];
+        end[1] = decDigitPairs[idx + 1];
+    }
+    if (value >= 10) {
+        end[-2] = decDigitPairs[value * 2];
+        end[-1] = decDigitPairs[value * 2 + 1];
     } else {
-        for (size_t i = 0; i < width - numChars; i++) {
-            if (!_Putc(ctx, padChar)) {
-                return false;
-            }
-        }
-        for (size_t i = 0; i < numChars; i++) {
-            if (!_Putc(ctx, value[i])) {
-                return false;
-            }
-        }
+        end[-1] = '0' + value;
     }
+}
 
-    return ctx;
+/** Convert 32 bits value to eight hexadecimal digits in one 64 bits word.
+ * Each nibble is spread to its own byte, the bytes are converted to ASCII
+ * characters in parallel and reordered so that the word can be stored as
+ * text.
+ */
+inline u64
+HexWord(u32 value, bool upperCase)
+{
+    u64 x = value;
+    x = ((x & 0xffff0000ull) << 16) | (x & 0xffffull);
+    x = ((x & 0x0000ff000000ff00ull) << 8) | (x & 0x000000ff000000ffull);
+    x = ((x & 0x00f000f000f000f0ull) << 4) | (x & 0x000f000f000f000full);
+    /* One in each byte which nibble is greater than nine. */
+    u64 alpha = ((x + 0x0606060606060606ull) >> 4) & 0x0101010101010101ull;
+    x += 0x3030303030303030ull + alpha * (upperCase ? 'A' - '0' - 10 : 'a' - '0' - 10);
+    return __builtin_bswap64(x);
 }
 
+/** Write all 16 hexadecimal digits of the value ending at @a end. */
+inline void
+WriteHex16(u64 value, char *end, bool upperCase)
+{
+    PutUnaligned(HexWord(value >> 32, upperCase), end - 16);
+    PutUnaligned(HexWord(value, upperCase), end - 8);
+}
+
+} /* anonymous namespace */
+
 bool
 OTextStreamBase::_FormatInt(Context &ctx, unsigned long value, bool neg, char fmt)
 {
     /* Max number conversion buffer length: a 64-bits value with radix 2 plus
-     * sign or blank.
+     * sign or blank and radix prefix.
      */
-    char nbuf[sizeof(u64) * NBBY + 1];
+    char nbuf[sizeof(u64) * NBBY + 3];
+    char *nbufEnd = &nbuf[sizeof(nbuf)];
     long radix, width;
-    bool upperCase = false, changeWidth;
+    bool upperCase = false;
 
     switch (fmt) {
     case 0:
@@ -435,49 +603,61 @@ OTextStreamBase::_FormatInt(Context &ctx, unsigned long value, bool neg, char fm
         return false;
     }
 
-    size_t numChars = _IntToString(value, nbuf, radix, upperCase);
-    size_t totalChars = numChars;
-
-    if (ctx.Opt(Opt::O_WIDTH, &width) && !ctx.Opt(Opt::O_LEFT_ADJ) &&
-        ctx.Opt(Opt::O_ZERO)) {
+    if (neg && !ctx.Opt(Opt::O_SIGNED)) {
+        FAULT("Negative integer provided for unsigned conversion");
+    }
 
-        changeWidth = true;
-    } else {
-        changeWidth = false;
+    /* Fast path for zero-padded fixed-width hexadecimal numbers without
+     * prefix, e.g. "%016lx".
+     */
+    if (radix == 16 && !neg && ctx.Opt(Opt::O_ZERO) &&
+        ctx.Opt(Opt::O_WIDTH, &width) && width > 0 && width <= 16 &&
+        !ctx.Opt(Opt::O_LEFT_ADJ) && !ctx.Opt(Opt::O_SHARP) &&
+        !(ctx.Opt(Opt::O_SIGNED) &&
+          (ctx.Opt(Opt::O_SIGN) || ctx.Opt(Opt::O_SPACE)))) {
+
+        WriteHex16(value, nbufEnd, upperCase);
+        size_t numChars = Max<size_t>((NumBits(value) + 3) / 4, width);
+        return _Puts(ctx, nbufEnd - numChars, numChars);
     }
 
+    /* Digits are written at the end of the buffer, prefix is prepended in
+     * place.
+     */
+    size_t numChars = _IntToString(value, nbufEnd, radix, upperCase);
+    char *start = nbufEnd - numChars;
+
     if (ctx.Opt(Opt::O_SHARP)) {
         if (radix == 8) {
-            nbuf[totalChars++] = '0';
+            *--start = '0';
         } else if (radix == 16) {
-            nbuf[totalChars++] = upperCase ? 'X' : 'x';
-            nbuf[totalChars++] = '0';
+            *--start = upperCase ? 'X' : 'x';
+            *--start = '0';
         }
     }
 
     if (ctx.Opt(Opt::O_SIGNED)) {
         if (neg) {
-            nbuf[totalChars++] = '-';
+            *--start = '-';
         } else {
             if (ctx.Opt(Opt::O_SIGN)) {
-                nbuf[totalChars++] = '+';
+                *--start = '+';
             } else if (ctx.Opt(Opt::O_SPACE)) {
-                nbuf[totalChars++] = ' ';
+                *--start = ' ';
             }
         }
-    } else if (neg) {
-        FAULT("Negative integer provided for unsigned conversion");
     }
 
-    if (changeWidth && totalChars > numChars) {
-        ctx.SetOpt(Opt::O_WIDTH, width - (totalChars - numChars));
-        for (;totalChars > numChars; totalChars--) {
-            if (!_Putc(ctx, nbuf[totalChars - 1])) {
-                return false;
-            }
+    size_t prefixLen = nbufEnd - start - numChars;
+    if (prefixLen && ctx.Opt(Opt::O_WIDTH, &width) && !ctx.Opt(Opt::O_LEFT_ADJ) &&
+        ctx.Opt(Opt::O_ZERO)) {
+
+        /* Prefix goes before zero padding. */
+        ctx.SetOpt(Opt::O_WIDTH, width - prefixLen);
+        if (!_Puts(ctx, start, prefixLen)) {
+            return false;
         }
-    } else {
-        numChars = totalChars;
+        start += prefixLen;
     }
 
     char padChar;
@@ -487,27 +667,40 @@ OTextStreamBase::_FormatInt(Context &ctx, unsigned long value, bool neg, char fm
         padChar = ' ';
     }
 
-    /* Reverse characters in buffer. */
-    for (size_t idx = 0; idx < numChars / 2; idx++) {
-        char c = nbuf[idx];
-        nbuf[idx] = nbuf[numChars - 1 - idx];
-        nbuf[numChars - 1 - idx] = c;
-    }
-
-    return _FormatField(ctx, nbuf, numChars, padChar);
+    return _FormatField(ctx, start, nbufEnd - start, padChar);
 }
 
 size_t
-OTextStreamBase::_IntToString(unsigned long value, char *buf, unsigned long radix,
-                              bool upperCase)
+OTextStreamBase::_IntToString(unsigned long value, char *bufEnd,
+                              unsigned long radix, bool upperCase)
 {
-    size_t numChars = 0;
-    char const digits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+    size_t numChars;
 
     ASSERT(radix >= 2 && radix <= 36);
+    if (radix == 10) {
+        numChars = NumDecDigits(value);
+        WriteDec(value, bufEnd);
+        return numChars;
+    }
+    if (radix == 16) {
+        WriteHex16(value, bufEnd, upperCase);
+        return (NumBits(value) + 3) / 4;
+    }
+
+    const char *digits = upperCase ? upperDigits : lowerDigits;
+    if (IsPowerOf2(radix)) {
+        size_t shift = __builtin_ctzl(radix);
+        numChars = (NumBits(value) + shift - 1) / shift;
+        for (char *p = bufEnd - 1; p >= bufEnd - numChars; p--) {
+            *p = digits[value & (radix - 1)];
+            value >>= shift;
+        }
+        return numChars;
+    }
+
+    numChars = 0;
     do {
-        char c = digits[value % radix];
-        buf[numChars++] = upperCase ? toupper(c) : c;
+        bufEnd[-++numChars] = digits[value % radix];
     } while (value /= radix);
     return numChars;
 }
@@ -16,57 +16,50 @@
 RBTreeBase::RBTreeBase()
 {
     _root = 0;
+    _augment = 0;
     _nodesCount = 0;
     _generation = 0;
 }
 
-RBTreeBase::EntryBase *
-RBTreeBase::InsertNode(EntryBase *node)
+void
+RBTreeBase::LinkNode(EntryBase *node, EntryBase *parent, int dir)
 {
     ASSERT(!node->isWired);
 
     node->child[0] = 0;
     node->child[1] = 0;
+    node->parent = parent;
+    node->isWired = true;
+    _nodesCount++;
 
     /* Special case - empty tree, insert root. */
-    if (UNLIKELY(!_root)) {
-        _root = node;
-        node->parent = 0;
+    if (UNLIKELY(!parent)) {
+        ASSERT(!_root);
+        ASSERT(_nodesCount == 1);
         node->isRed = false;
-        node->isWired = true;
-        ASSERT(!_nodesCount);
-        _nodesCount++;
-        _generation++;
-        return node;
+        PropagateAggregates(node);
+        _BeginUpdate();
+        _root = node;
+        _EndUpdate();
+        return;
     }
 
-    /* Firstly search for insertion point and insert the node. */
-    EntryBase *parent = _root;
-    while (true) {
-        int cmp = Compare(node, parent);
-        if (!cmp) {
-            return parent;
-        }
-        if (parent->child[cmp > 0]) {
-            parent = parent->child[cmp > 0];
-        } else {
-            parent->child[cmp > 0] = node;
-            node->parent = parent;
-            node->isRed = true;
-            node->isWired = true;
-            _nodesCount++;
-            _generation++;
-            break;
-        }
-    }
+    /* The new node is fully initialized before it becomes reachable. */
+    _BeginUpdate();
+
+    ASSERT(!parent->child[dir]);
+    parent->child[dir] = node;
+    node->isRed = true;
+    /* Rotations keep aggregates valid so update them before re-balancing. */
+    PropagateAggregates(node);
 
     /* Re-balance the tree if necessary. */
-    if (node->parent->isRed) {
+    if (parent->isRed) {
         _RebalanceInsertion(node);
     }
     /* Set root black if it was re-colored during re-balancing. */
     _root->isRed = false;
-    return node;
+    _EndUpdate();
 }
 
 void
@@ -148,6 +141,7 @@ RBTreeBase::_RebalanceDeletion(EntryBase *node)
             tmpNode->parent = node->parent;
             node->parent->child[nodeDir] = tmpNode;
             tmpNode->isRed = false;
+            PropagateAggregates(tmpNode->parent);
             /* Node detached, all done. */
             return;
         }
@@ -217,6 +211,7 @@ RBTreeBase::_RebalanceDeletion(EntryBase *node)
         ASSERT(replNode->parent->child[1] == replNode);
         replNode->parent->child[1] = 0;
     }
+    PropagateAggregates(replNode->parent);
 }
 
 void
@@ -247,12 +242,13 @@ RBTreeBase::Delete(EntryBase *node)
         }
     }
 
+    _BeginUpdate();
+
     /* Re-balance the tree and detach replacement entry. */
     _RebalanceDeletion(replNode);
 
     ASSERT(_nodesCount);
     _nodesCount--;
-    _generation++;
 
     /* Replace target entry with detached replacement entry. */
     if (replNode == targetNode) {
@@ -260,6 +256,7 @@ RBTreeBase::Delete(EntryBase *node)
          * detached by the previous call, so we are done.
          */
         targetNode->isWired = false;
+        _EndUpdate();
         return;
     }
     /* Move all links and color from target entry to the replacement one. */
@@ -288,20 +285,8 @@ RBTreeBase::Delete(EntryBase *node)
         ASSERT(replNode->child[1]->parent == targetNode);
         replNode->child[1]->parent = replNode;
     }
-}
-
-RBTreeBase::EntryBase *
-RBTreeBase::Lookup(void *key)
-{
-    EntryBase *node = _root;
-    while (node) {
-        int cmp = Compare(node, key);
-        if (!cmp) {
-            return node;
-        }
-        node = node->child[cmp > 0];
-    }
-    return 0;
+    PropagateAggregates(replNode);
+    _EndUpdate();
 }
 
 RBTreeBase::EntryBase *
@@ -326,6 +311,64 @@ RBTreeBase::GetNextNode(EntryBase *node)
     return 0;
 }
 
+RBTreeBase::EntryBase *
+RBTreeBase::GetAdjacentNode(EntryBase *node, int dir)
+{
+    /* The extreme node of the subtree in the requested direction. */
+    if (node->child[dir]) {
+        node = node->child[dir];
+        while (node->child[!dir]) {
+            node = node->child[!dir];
+        }
+        return node;
+    }
+    /* Otherwise the first ancestor for which we are in the opposite subtree. */
+    while (node->parent && node->parent->child[dir] == node) {
+        node = node->parent;
+    }
+    return node->parent;
+}
+
+void
+RBTreeBase::AttachTree(EntryBase *root, size_t numNodes)
+{
+    ASSERT(!_root && !_nodesCount);
+    ASSERT(!root || (!root->parent && !root->isRed));
+    _BeginUpdate();
+    _root = root;
+    _nodesCount = numNodes;
+    _EndUpdate();
+}
+
+void
+RBTreeBase::Clear()
+{
+    /* Post-order traversal, each node is unlinked when its subtrees are
+     * already unlinked.
+     */
+    _BeginUpdate();
+    EntryBase *node = _root;
+    while (node) {
+        if (node->child[0]) {
+            node = node->child[0];
+            continue;
+        }
+        if (node->child[1]) {
+            node = node->child[1];
+            continue;
+        }
+        EntryBase *parent = node->parent;
+        if (parent) {
+            parent->child[parent->child[1] == node] = 0;
+        }
+        node->isWired = false;
+        node = parent;
+    }
+    _root = 0;
+    _nodesCount = 0;
+    _EndUpdate();
+}
+
 RBTreeBase::EntryBase *
 RBTreeBase::Lowest()
 {
@@ -368,11 +411,9 @@ RBTreeBase::Validate()
                 return false;
             }
         }
-        /* Validate children. */
-        if (node->child[0] && Compare(node->child[0], node) >= 0) {
-            return false;
-        }
-        if (node->child[1] && Compare(node->child[1], node) <= 0) {
+        /* Validate links with children. */
+        if ((node->child[0] && node->child[0]->parent != node) ||
+            (node->child[1] && node->child[1]->parent != node)) {
             return false;
         }
         /* Red node never can have red children. */
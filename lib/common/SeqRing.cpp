@@ -0,0 +1,86 @@
+/*
+ * /phoenix/lib/common/SeqRing.cpp
+ *
+ * This file is a part of Phoenix operating system.
+ * Copyright (c) 2011-2012, Artyom Lebedev <artyom.lebedev@gmail.com>
+ * All rights reserved.
+ * See COPYING file for copyright details.
+ */
+
+/** @file SeqRing.cpp
+ * Lockless ring buffer of fixed size records with sequence numbered slots.
+ */
+
+#include <sys.h>
+
+SeqRing::SeqRing()
+{
+
+}
+
+SeqRing::~SeqRing()
+{
+    if (_slots) {
+        DELETE [] _slots;
+    }
+}
+
+RetCode
+SeqRing::Initialize(size_t numSlots, size_t slotSize, OverflowPolicy policy)
+{
+    if (!numSlots || !IsPowerOf2(numSlots) || slotSize < sizeof(u64)) {
+        return RC(INV_PARAM);
+    }
+    ASSERT(!_slots);
+    _slots = NEW_ALIGNED(CACHE_LINE_SIZE) u8[numSlots * slotSize];
+    if (!_slots) {
+        return RC(NO_MEMORY);
+    }
+    _numSlots = numSlots;
+    _slotSize = slotSize;
+    _policy = policy;
+    for (size_t i = 0; i < numSlots; i++) {
+        *_GetSlot(i) = 0;
+    }
+    return RC(SUCCESS);
+}
+
+bool
+SeqRing::_Get(void *rec)
+{
+    u64 tail = _tail.value;
+    while (true) {
+        if (_policy == OVERWRITE_OLD) {
+            /* Skip the records which were overwritten by producers. */
+            u64 head = __atomic_load_n(&_head.value, __ATOMIC_ACQUIRE);
+            if (head - tail > _numSlots) {
+                __atomic_fetch_add(&_numOverwritten, head - _numSlots - tail,
+                                   __ATOMIC_RELAXED);
+                tail = head - _numSlots;
+            }
+        }
+        u64 *slot = _GetSlot(tail);
+        u64 seq = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+        if (seq != tail + 1) {
+            if (_policy == OVERWRITE_OLD && seq > tail + 1) {
+                /* Already overwritten by a record of later lap. */
+                __atomic_fetch_add(&_numOverwritten, 1, __ATOMIC_RELAXED);
+                tail++;
+                continue;
+            }
+            /* Empty or not yet committed. */
+            __atomic_store_n(&_tail.value, tail, __ATOMIC_RELEASE);
+            return false;
+        }
+        memcpy(rec, slot, _slotSize);
+        /* Check that the record was not overwritten while being copied. */
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(slot, __ATOMIC_RELAXED) != tail + 1) {
+            __atomic_fetch_add(&_numOverwritten, 1, __ATOMIC_RELAXED);
+            tail++;
+            continue;
+        }
+        __atomic_store_n(&_tail.value, tail + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+}
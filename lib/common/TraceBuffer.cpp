@@ -0,0 +1,37 @@
+/*
+ * /phoenix/lib/common/TraceBuffer.cpp
+ *
+ * This file is a part of Phoenix operating system.
+ * Copyright (c) 2011-2012, Artyom Lebedev <artyom.lebedev@gmail.com>
+ * All rights reserved.
+ * See COPYING file for copyright details.
+ */
+
+/** @file TraceBuffer.cpp
+ * Lockless ring buffer for binary trace records.
+ */
+
+#include <sys.h>
+
+size_t
+TraceBuffer::Record::FormatArgs(text_stream::OTextStreamBase &stream,
+                                const char *fmt)
+{
+    static_assert(MAX_ARGS == 4, "Arguments number is not handled");
+    switch (numArgs) {
+    case 0:
+        return stream.Format(fmt);
+    case 1:
+        return stream.Format(fmt, args[0]);
+    case 2:
+        return stream.Format(fmt, args[0], args[1]);
+    case 3:
+        return stream.Format(fmt, args[0], args[1], args[2]);
+    case 4:
+        return stream.Format(fmt, args[0], args[1], args[2], args[3]);
+    default:
+        FAULT("Invalid number of trace record arguments: %d",
+              static_cast<int>(numArgs));
+    }
+    return 0;
+}
@@ -12,8 +12,9 @@
  */
 
 #include <sys.h>
+#include <md_crc.h>
 
-Crc32::Crc32(u32 polynomial)
+Crc32::Crc32(u32 polynomial, bool allowHw)
 {
     _polynomial = polynomial;
     /* Build the CRC lookup table */
@@ -26,18 +27,123 @@ Crc32::Crc32(u32 polynomial)
                 crc >>= 1;
             }
         }
-        _crcTable[i] = crc;
+        _crcTable[0][i] = crc;
+    }
+    for (int t = 1; t < 16; t++) {
+        for (int i = 0; i < 256; i++) {
+            u32 crc = _crcTable[t - 1][i];
+            _crcTable[t][i] = (crc >> 8) ^ _crcTable[0][crc & 0xff];
+        }
+    }
+
+    /* x^1 in reflected representation, each next is square of previous. */
+    _x2n[0] = 1u << 30;
+    for (size_t n = 1; n < SIZEOF_ARRAY(_x2n); n++) {
+        _x2n[n] = _MultModP(_x2n[n - 1], _x2n[n - 1]);
+    }
+
+    _method = METHOD_TABLES;
+    if (allowHw) {
+        cpu::CpuCaps caps;
+        if (_polynomial == POLY_IEEE && caps.GetCapability(cpu::CPU_CAP_PCLMUL)) {
+            _method = METHOD_PCLMUL;
+        } else if (_polynomial == POLY_CASTAGNOLI &&
+                   caps.GetCapability(cpu::CPU_CAP_SSE42)) {
+            _method = METHOD_SSE42;
+        }
     }
 }
 
 u32
-Crc32::Calculate(void *buf, size_t size, u32 crc)
+Crc32::Calculate(const void *buf, size_t size, u32 crc) const
 {
-    u8 *ptr = static_cast<u8 *>(buf);
+    const u8 *ptr = static_cast<const u8 *>(buf);
+    switch (_method) {
+    case METHOD_SSE42:
+        return cpu::Crc32cSse42(crc, ptr, size);
+    case METHOD_PCLMUL:
+        if (size >= 64) {
+            size_t bulkSize = size & ~static_cast<size_t>(15);
+            crc = cpu::Crc32Pclmul(crc, ptr, bulkSize);
+            ptr += bulkSize;
+            size -= bulkSize;
+        }
+        break;
+    case METHOD_TABLES:
+        break;
+    }
+    return _CalculateTables(ptr, size, crc);
+}
+
+u32
+Crc32::_CalculateTables(const u8 *ptr, size_t size, u32 crc) const
+{
+    /* Slicing-by-16, the CRC is applied to the first word of each slice. */
+    while (size >= 16) {
+        u32 w0 = GetUnaligned<u32>(&ptr[0]) ^ crc;
+        u32 w1 = GetUnaligned<u32>(&ptr[4]);
+        u32 w2 = GetUnaligned<u32>(&ptr[8]);
+        u32 w3 = GetUnaligned<u32>(&ptr[12]);
+        crc = _crcTable[15][w0 & 0xff] ^ _crcTable[14][(w0 >> 8) & 0xff] ^
+              _crcTable[13][(w0 >> 16) & 0xff] ^ _crcTable[12][w0 >> 24] ^
+              _crcTable[11][w1 & 0xff] ^ _crcTable[10][(w1 >> 8) & 0xff] ^
+              _crcTable[9][(w1 >> 16) & 0xff] ^ _crcTable[8][w1 >> 24] ^
+              _crcTable[7][w2 & 0xff] ^ _crcTable[6][(w2 >> 8) & 0xff] ^
+              _crcTable[5][(w2 >> 16) & 0xff] ^ _crcTable[4][w2 >> 24] ^
+              _crcTable[3][w3 & 0xff] ^ _crcTable[2][(w3 >> 8) & 0xff] ^
+              _crcTable[1][(w3 >> 16) & 0xff] ^ _crcTable[0][w3 >> 24];
+        ptr += 16;
+        size -= 16;
+    }
+    /* Slicing-by-8 for the rest. */
+    if (size >= 8) {
+        u32 w0 = GetUnaligned<u32>(&ptr[0]) ^ crc;
+        u32 w1 = GetUnaligned<u32>(&ptr[4]);
+        crc = _crcTable[7][w0 & 0xff] ^ _crcTable[6][(w0 >> 8) & 0xff] ^
+              _crcTable[5][(w0 >> 16) & 0xff] ^ _crcTable[4][w0 >> 24] ^
+              _crcTable[3][w1 & 0xff] ^ _crcTable[2][(w1 >> 8) & 0xff] ^
+              _crcTable[1][(w1 >> 16) & 0xff] ^ _crcTable[0][w1 >> 24];
+        ptr += 8;
+        size -= 8;
+    }
     while (size) {
-        crc = (crc >> 8) ^ _crcTable[(crc ^ *ptr) & 0xff];
+        crc = (crc >> 8) ^ _crcTable[0][(crc ^ *ptr) & 0xff];
         ptr++;
         size--;
     }
     return crc;
 }
+
+u32
+Crc32::_MultModP(u32 a, u32 b) const
+{
+    /* Bit 31 corresponds to x^0 in reflected representation. */
+    u32 m = 1u << 31, p = 0;
+    while (true) {
+        if (a & m) {
+            p ^= b;
+            if (!(a & (m - 1))) {
+                break;
+            }
+        }
+        m >>= 1;
+        b = b & 1 ? (b >> 1) ^ _polynomial : b >> 1;
+    }
+    return p;
+}
+
+u32
+Crc32::Combine(u32 crcA, u32 crcB, size_t lenB) const
+{
+    /* CRC of the concatenation is crcB xor (crcA xor INITIAL) shifted by
+     * lenB zero bytes, i.e. multiplied by x^(8 * lenB) mod P.
+     */
+    u32 shift = 1u << 31;
+    u64 numBits = static_cast<u64>(lenB) * NBBY;
+    for (int n = 0; numBits; numBits >>= 1, n++) {
+        if (numBits & 1) {
+            shift = _MultModP(_x2n[n], shift);
+        }
+    }
+    return _MultModP(shift, crcA ^ INITIAL) ^ crcB;
+}
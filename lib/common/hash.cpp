@@ -8,7 +8,7 @@
  */
 
 /** @file hash.cpp
- * This file contains implementation of Phoenix primary hash algorithm.
+ * This file contains implementation of Phoenix hash algorithms.
  */
 
 #include <sys.h>
@@ -139,3 +139,167 @@ Hash::Feed(const void *data, size_t size)
     _resid = size;
     _length += size;
 }
+
+/* FastHash class. */
+
+namespace {
+
+const u64 PRIME1 = 0x9e3779b185ebca87ull;
+const u64 PRIME2 = 0xc2b2ae3d27d4eb4full;
+const u64 PRIME3 = 0x165667b19e3779f9ull;
+const u64 PRIME4 = 0x85ebca77c2b2ae63ull;
+const u64 PRIME5 = 0x27d4eb2f165667c5ull;
+
+/** Mix one input word into a lane accumulator. */
+inline u64
+FastHashRound(u64 acc, u64 input)
+{
+    acc += input * PRIME2;
+    acc = RotL(acc, 31);
+    return acc * PRIME1;
+}
+
+/** Merge lane accumulator into the final hash. */
+inline u64
+FastHashMerge(u64 h, u64 acc)
+{
+    h ^= FastHashRound(0, acc);
+    return h * PRIME1 + PRIME4;
+}
+
+/** Process all full stripes of the input.
+ *
+ * @param v Lanes accumulators.
+ * @param p Input data.
+ * @param size Size of the input in bytes.
+ * @return Number of bytes processed.
+ */
+inline size_t
+FastHashStripes(u64 *v, const u8 *p, size_t size)
+{
+    u64 v1 = v[0], v2 = v[1], v3 = v[2], v4 = v[3];
+    size_t offset = 0;
+    for (; offset + 32 <= size; offset += 32) {
+        v1 = FastHashRound(v1, GetUnaligned<u64>(&p[offset]));
+        v2 = FastHashRound(v2, GetUnaligned<u64>(&p[offset + 8]));
+        v3 = FastHashRound(v3, GetUnaligned<u64>(&p[offset + 16]));
+        v4 = FastHashRound(v4, GetUnaligned<u64>(&p[offset + 24]));
+    }
+    v[0] = v1;
+    v[1] = v2;
+    v[2] = v3;
+    v[3] = v4;
+    return offset;
+}
+
+/** Initialize lanes accumulators. */
+inline void
+FastHashInit(u64 *v, u64 seed)
+{
+    v[0] = seed + PRIME1 + PRIME2;
+    v[1] = seed + PRIME2;
+    v[2] = seed;
+    v[3] = seed - PRIME1;
+}
+
+/** Calculate final hash value.
+ *
+ * @param v Lanes accumulators.
+ * @param seed Hash seed.
+ * @param length Total length of the input.
+ * @param tail Input tail which does not make full stripe.
+ * @param tailSize Size of the tail in bytes.
+ * @return Hash value.
+ */
+u64
+FastHashFinal(const u64 *v, u64 seed, size_t length, const u8 *tail,
+              size_t tailSize)
+{
+    u64 h;
+    if (length >= 32) {
+        h = RotL(v[0], 1) + RotL(v[1], 7) + RotL(v[2], 12) + RotL(v[3], 18);
+        for (int i = 0; i < 4; i++) {
+            h = FastHashMerge(h, v[i]);
+        }
+    } else {
+        h = seed + PRIME5;
+    }
+    h += length;
+
+    const u8 *p = tail;
+    for (; tailSize >= 8; tailSize -= 8, p += 8) {
+        h ^= FastHashRound(0, GetUnaligned<u64>(p));
+        h = RotL(h, 27) * PRIME1 + PRIME4;
+    }
+    if (tailSize >= 4) {
+        h ^= static_cast<u64>(GetUnaligned<u32>(p)) * PRIME1;
+        h = RotL(h, 23) * PRIME2 + PRIME3;
+        p += 4;
+        tailSize -= 4;
+    }
+    for (; tailSize; tailSize--, p++) {
+        h ^= *p * PRIME5;
+        h = RotL(h, 11) * PRIME1;
+    }
+
+    /* Avalanche. */
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+} /* anonymous namespace */
+
+void
+FastHash::Reset(u64 seed)
+{
+    FastHashInit(_v, seed);
+    _seed = seed;
+    _bufSize = 0;
+    _length = 0;
+}
+
+void
+FastHash::Feed(const void *data, size_t size)
+{
+    const u8 *p = static_cast<const u8 *>(data);
+    _length += size;
+
+    /* Complete the buffered stripe. */
+    if (_bufSize) {
+        size_t fill = STRIPE_SIZE - _bufSize;
+        if (size < fill) {
+            memcpy(&_buf[_bufSize], p, size);
+            _bufSize += size;
+            return;
+        }
+        memcpy(&_buf[_bufSize], p, fill);
+        FastHashStripes(_v, _buf, STRIPE_SIZE);
+        p += fill;
+        size -= fill;
+        _bufSize = 0;
+    }
+
+    size_t processed = FastHashStripes(_v, p, size);
+    _bufSize = size - processed;
+    memcpy(_buf, p + processed, _bufSize);
+}
+
+u64
+FastHash::Get64()
+{
+    return FastHashFinal(_v, _seed, _length, _buf, _bufSize);
+}
+
+u64
+FastHash::Calculate(const void *data, size_t size, u64 seed)
+{
+    const u8 *p = static_cast<const u8 *>(data);
+    u64 v[4];
+    FastHashInit(v, seed);
+    size_t processed = FastHashStripes(v, p, size);
+    return FastHashFinal(v, seed, size, p + processed, size - processed);
+}
@@ -85,7 +85,7 @@ $(OBJ_DIR): $(COMPILE_DIR)
 	[ -d $@ ] || mkdir $@
 
 $(BINARY_NAME): $(OBJ_DIR) $(OBJS) $(AUTO_OBJ)
-	$(NAT_LD) -lstdc++ $(OBJS) $(AUTO_OBJ) -o $@
+	$(NAT_LD) -lstdc++ -lpthread $(OBJS) $(AUTO_OBJ) -o $@
 
 $(OBJ_DIR)/%.o: %.cpp
 	$(NAT_CC) -c $(INCLUDE_FLAGS) $(NAT_INCLUDE_FLAGS) $(COMMON_FLAGS) \
@@ -8,6 +8,7 @@
 
 import gdb
 import gdb.printing
+import re
 
 '''
 This module is used as GDB extension to provide more convenient and effective
@@ -187,6 +188,61 @@ def parse_va(va):
     pml4e = (va >> (12 + 9 + 9 + 9)) & 0x1ff
     print("PML4E=%d PDPTE=%d PDE=%d PTE=%d" % (pml4e, pdpte, pde, pte))
             
+# Conversion in tracepoint format string: flags, width, precision, letter.
+trace_fmt_re = re.compile(r'%([-#0 +]*\d*(?:\.\d+)?)([a-zA-Z%])')
+
+def format_trace_args(fmt, args):
+    '''
+    Format raw tracepoint arguments according to the tracepoint format string
+    (see kernel/sys/trace.h). Only integer conversions are supported.
+    '''
+
+    values = list(args)
+    def conv(m):
+        if m.group(2) == '%':
+            return '%'
+        if not values:
+            return '<missing>'
+        letter = m.group(2)
+        if letter == 'z':
+            letter = 'd'
+        if letter not in 'dxXo':
+            return '<bad format %s>' % m.group(0)
+        return ('%' + m.group(1) + letter) % values.pop(0)
+    return trace_fmt_re.sub(conv, fmt)
+
+def get_trace_records():
+    '''
+    Get committed records from all per-CPU trace buffers, sorted by time
+    stamp. Each record is a tuple (timestamp, cpu, name, text). Records are
+    not removed from the buffers.
+    '''
+
+    tracer = gdb_eval('trace::tracer')
+    if int(tracer) == 0:
+        raise gdb.error('Tracing is not initialized')
+    tp_ptr_t = gdb.lookup_type('trace::Tracepoint').const().pointer()
+    rec_ptr_t = gdb.lookup_type('TraceBuffer::Record').pointer()
+    records = []
+    for cpu in range(0, int(tracer['_numCpus'])):
+        buf = tracer['_buffers'][cpu]
+        num_slots = int(buf['_numSlots'])
+        head = int(buf['_head']['value'])
+        # Slots are untyped in the base ring class.
+        slots = buf['_slots'].cast(rec_ptr_t)
+        for pos in range(max(0, head - num_slots), head):
+            rec = slots[pos & (num_slots - 1)]
+            # Skip records which are being written or overwritten.
+            if int(rec['seq']) != pos + 1:
+                continue
+            tp = rec['id'].cast(tp_ptr_t)
+            args = [int(rec['args'][i]) for i in range(0, int(rec['numArgs']))]
+            records.append((int(rec['timestamp']), int(rec['cpu']),
+                            get_string(tp['name']),
+                            format_trace_args(get_string(tp['format']), args)))
+    records.sort(key = lambda r: r[0])
+    return records
+
 ###############################################################################
 # Module startup code which outputs some useful information
 
@@ -208,6 +264,32 @@ class PhoenixtestCommand(gdb.Command):
 
 PhoenixtestCommand()
 
+class PhoenixTraceCommand(gdb.Command):
+    '''
+    Decode binary trace records from the per-CPU trace buffers.
+    Usage: phoenix-trace [NUM_RECORDS]
+    Only the last NUM_RECORDS records are output if specified. Time stamp delta
+    from the previous record is shown in TSC cycles.
+    '''
+
+    def __init__(self):
+        super(PhoenixTraceCommand, self).__init__('phoenix-trace',
+                                                  gdb.COMMAND_DATA)
+
+    def invoke(self, arg, from_tty):
+        records = get_trace_records()
+        if arg.strip():
+            num_records = int(gdb_eval(arg))
+            records = records[max(0, len(records) - num_records):]
+        prev_ts = None
+        for (ts, cpu, name, text) in records:
+            delta = 0 if prev_ts is None else ts - prev_ts
+            gdb.write('[trace %016x +%8d cpu %d] %s: %s\n' %
+                      (ts, delta, cpu, name, text))
+            prev_ts = ts
+
+PhoenixTraceCommand()
+
 ###############################################################################
 # Pretty printers for Phoenix data structures
 
@@ -26,3 +26,187 @@ UT_TEST("Finding first set/clear bit")
     UT(bs.FirstClear()) == UT(1020);
 }
 UT_TEST_END
+
+UT_TEST("Summary bit string")
+{
+    /* Sizes around word and summary level boundaries. */
+    const size_t sizes[] = { 1, 63, 64, 65, 4095, 4096, 4097, 300000 };
+
+    for (size_t numBits: sizes) {
+        u8 *storage = NEW_ALIGNED(sizeof(uintptr_t))
+            u8[SummaryBitString::GetStorageSize(numBits)];
+        SummaryBitString bs(storage, numBits);
+        u8 *refStorage = NEW u8[(numBits + NBBY - 1) / NBBY];
+        BitString<> ref(refStorage, numBits);
+
+        UT(bs.FirstSet()) == UT(-1);
+        UT(bs.FirstClear()) == UT(0);
+
+        bs.SetAll();
+        UT(bs.FirstSet()) == UT(0);
+        UT(bs.FirstClear()) == UT(-1);
+        bs.Clear(numBits - 1);
+        UT(bs.FirstClear()) == UT(static_cast<int>(numBits - 1));
+        bs.Set(numBits - 1);
+        UT(bs.FirstClear()) == UT(-1);
+        bs.Invert();
+        UT(bs.FirstSet()) == UT(-1);
+        UT(bs.FirstClear()) == UT(0);
+
+        /* Random operations verified against plain bit string. */
+        u32 seed = 42;
+        for (size_t i = 0; i < 20000; i++) {
+            seed = seed * 1103515245 + 12345;
+            size_t idx = (seed >> 8) % numBits;
+            if (seed & 0x80000000) {
+                bs.Set(idx);
+                ref.Set(idx);
+            } else {
+                bs.Clear(idx);
+                ref.Clear(idx);
+            }
+            if (i % 64 == 0) {
+                UT(bs.FirstSet()) == UT(ref.FirstSet());
+                UT(bs.FirstClear()) == UT(ref.FirstClear());
+                size_t next = BitStringOps::FindSet(refStorage, numBits, idx);
+                UT(bs.NextSet(idx)) ==
+                    UT(next < numBits ? static_cast<int>(next) : -1);
+            }
+        }
+        for (size_t idx = 0; idx < numBits; idx++) {
+            UT(bs.IsSet(idx)) == UT(ref.IsSet(idx));
+        }
+        /* Drain the set bits through FirstSet. */
+        int bit;
+        while ((bit = bs.FirstSet()) != -1) {
+            UT(ref.FirstSet()) == UT(bit);
+            bs.Clear(bit);
+            ref.Clear(bit);
+        }
+        UT(ref.FirstSet()) == UT(-1);
+
+        DELETE [] storage;
+        DELETE [] refStorage;
+    }
+}
+UT_TEST_END
+
+/* Reference implementations for bulk operations verification. */
+static size_t
+RefFind(BitString<> &bs, size_t numBits, size_t from, bool set)
+{
+    for (size_t idx = from; idx < numBits; idx++) {
+        if (bs.IsSet(idx) == set) {
+            return idx;
+        }
+    }
+    return numBits;
+}
+
+static int
+RefClearRun(BitString<> &bs, size_t numBits, size_t runLength)
+{
+    size_t run = 0;
+    for (size_t idx = 0; idx < numBits; idx++) {
+        run = bs.IsSet(idx) ? 0 : run + 1;
+        if (run == runLength) {
+            return idx + 1 - runLength;
+        }
+    }
+    return -1;
+}
+
+UT_TEST("Bulk operations")
+{
+    const size_t sizes[] = { 1, 7, 8, 9, 64, 127, 1000, 4099 };
+
+    for (int simd = 0; simd < 2; simd++) {
+        BitStringOps::Select(simd);
+        for (size_t numBits: sizes) {
+            /* Unaligned bitmap start to check the scan heads. */
+            u8 *storage = NEW u8[(numBits + NBBY - 1) / NBBY + 1];
+            BitString<> bs(storage + 1, numBits);
+
+            UT(bs.Count()) == UT(0ul);
+            UT(bs.FindClearRun(numBits)) == UT(0);
+            bs.SetRange(0, numBits);
+            UT(bs.Count()) == UT(numBits);
+            UT(bs.FirstClear()) == UT(-1);
+            UT(bs.FindClearRun(1)) == UT(-1);
+            bs.ClearRange(0, numBits);
+            UT(bs.FirstSet()) == UT(-1);
+
+            u32 seed = 7;
+            for (size_t i = 0; i < 200; i++) {
+                seed = seed * 1103515245 + 12345;
+                size_t start = (seed >> 8) % numBits;
+                seed = seed * 1103515245 + 12345;
+                size_t count = (seed >> 8) % (numBits - start + 1);
+                if (i & 1) {
+                    bs.SetRange(start, count);
+                } else {
+                    bs.ClearRange(start, count);
+                }
+                size_t refCount = 0;
+                for (size_t idx = 0; idx < numBits; idx++) {
+                    if (idx >= start && idx < start + count) {
+                        UT(bs.IsSet(idx)) == UT(!!(i & 1));
+                    }
+                    refCount += bs.IsSet(idx);
+                }
+                UT(bs.Count()) == UT(refCount);
+                UT(BitStringOps::FindSet(storage + 1, numBits, start)) ==
+                    UT(RefFind(bs, numBits, start, true));
+                UT(BitStringOps::FindClear(storage + 1, numBits, start)) ==
+                    UT(RefFind(bs, numBits, start, false));
+                size_t runLength = 1 + (seed >> 4) % 40;
+                UT(bs.FindClearRun(runLength)) ==
+                    UT(RefClearRun(bs, numBits, runLength));
+            }
+            DELETE [] storage;
+        }
+    }
+    BitStringOps::Select();
+}
+UT_TEST_END
+
+UT_TEST("Bulk operations benchmark")
+{
+    const size_t numBits = 64 * 1024 * 1024;
+    u8 *storage = NEW u8[numBits / NBBY];
+    BitString<> bs(storage, numBits);
+
+    for (int simd = 0; simd < 2; simd++) {
+        BitStringOps::Select(simd);
+        const char *name = simd ? "SIMD" : "generic";
+
+        bs.ClearAll();
+        bs.Set(numBits - 1);
+        u64 start = cpu::rdtsc();
+        UT(bs.FirstSet()) == UT(static_cast<int>(numBits - 1));
+        u64 cycles = cpu::rdtsc() - start;
+        UT_TRACE("%s FirstSet: %lu bytes per kcycle", name,
+                 numBits / NBBY * 1000 / cycles);
+
+        bs.SetRange(0, numBits);
+        start = cpu::rdtsc();
+        UT(bs.Count()) == UT(numBits);
+        cycles = cpu::rdtsc() - start;
+        UT_TRACE("%s Count: %lu bytes per kcycle", name,
+                 numBits / NBBY * 1000 / cycles);
+
+        /* Short clear runs everywhere, the long one at the end. */
+        for (size_t idx = 0; idx < numBits - 4096; idx += 512) {
+            bs.ClearRange(idx, 100);
+        }
+        bs.ClearRange(numBits - 1024, 1024);
+        start = cpu::rdtsc();
+        UT(bs.FindClearRun(1000)) == UT(static_cast<int>(numBits - 1024));
+        cycles = cpu::rdtsc() - start;
+        UT_TRACE("%s FindClearRun: %lu bytes per kcycle", name,
+                 numBits / NBBY * 1000 / cycles);
+    }
+    BitStringOps::Select();
+    DELETE [] storage;
+}
+UT_TEST_END
@@ -11,6 +11,20 @@
 
 #include <sys.h>
 
+/** Simple pseudo-random numbers generator for reproducible test sequences. */
+class TestRandom {
+public:
+    TestRandom(u64 seed = 1) : _state(seed) { }
+
+    u32 Next() {
+        _state = _state * 6364136223846793005ull + 1442695040888963407ull;
+        return _state >> 33;
+    }
+
+private:
+    u64 _state;
+};
+
 UT_TEST("Universal buddy allocator")
 {
     BuddyAllocator<vm::Vaddr> alloc;
@@ -24,3 +38,835 @@ UT_TEST("Universal buddy allocator")
     UT(rc) == UT(true);
 }
 UT_TEST_END
+
+UT_TEST("Buddy allocator - exhaust and coalesce")
+{
+    typedef BuddyAllocatorBase::Addr Addr;
+    const int minOrder = 12, maxOrder = 16;
+    const Addr start = 1ul << 32;
+    const size_t numMaxBlocks = 4;
+    const size_t numBlocks = numMaxBlocks << (maxOrder - minOrder);
+    BuddyAllocator<Addr> alloc;
+
+    UT(alloc.Initialize(start, start + (numMaxBlocks << maxOrder), minOrder,
+                        maxOrder, 16).IsOk()) == UT_TRUE;
+
+    /* Allocate everything in minimal blocks, the cache is small so the bitmap
+     * scanning path is exercised as well.
+     */
+    u8 *map = new u8[numBlocks];
+    memset(map, 0, numBlocks);
+    Addr *blocks = new Addr[numBlocks];
+    for (size_t i = 0; i < numBlocks; i++) {
+        UT(alloc.Allocate(1, &blocks[i]).IsOk()) == UT_TRUE;
+        UT(blocks[i] >= start) == UT_TRUE;
+        UT(blocks[i] & ((1 << minOrder) - 1)) == UT(0ul);
+        size_t idx = (blocks[i] - start) >> minOrder;
+        UT(idx < numBlocks) == UT_TRUE;
+        UT(map[idx]) == UT(0);
+        map[idx] = 1;
+    }
+    Addr addr;
+    UT(alloc.Allocate(1, &addr).IsOk()) == UT_FALSE;
+
+    /* Double freeing is detected. */
+    UT(alloc.Free(blocks[0], 1).IsOk()) == UT_TRUE;
+    UT(alloc.Free(blocks[0], 1).IsOk()) == UT_FALSE;
+    UT(alloc.Allocate(1, &blocks[0]).IsOk()) == UT_TRUE;
+
+    /* Double freeing is detected after the block is coalesced with its buddy
+     * into a block of greater order.
+     */
+    UT(alloc.Free(blocks[0], 1).IsOk()) == UT_TRUE;
+    UT(alloc.Free(blocks[1], 1).IsOk()) == UT_TRUE;
+    UT(alloc.Free(blocks[0], 1).IsOk()) == UT_FALSE;
+    UT(alloc.Free(blocks[1], 1).IsOk()) == UT_FALSE;
+    UT(alloc.Allocate(1 << (minOrder + 1), &addr).IsOk()) == UT_TRUE;
+    UT(alloc.Allocate(1, &addr).IsOk()) == UT_FALSE;
+    UT(alloc.Free(blocks[0], 1 << (minOrder + 1)).IsOk()) == UT_TRUE;
+    UT(alloc.Allocate(1, &blocks[0]).IsOk()) == UT_TRUE;
+    UT(alloc.Allocate(1, &blocks[1]).IsOk()) == UT_TRUE;
+
+    /* Invalid parameters. */
+    UT(alloc.Free(start - (1 << minOrder), 1).IsOk()) == UT_FALSE;
+    UT(alloc.Free(start + 1, 1).IsOk()) == UT_FALSE;
+    UT(alloc.Allocate(0, &addr).IsOk()) == UT_FALSE;
+    UT(alloc.Allocate((1 << maxOrder) + 1, &addr).IsOk()) == UT_FALSE;
+
+    /* Free in scattered order, everything should coalesce back. */
+    for (size_t i = 0; i < numBlocks; i += 2) {
+        UT(alloc.Free(blocks[i], 1 << minOrder).IsOk()) == UT_TRUE;
+    }
+    UT(alloc.Allocate(1 << (minOrder + 1), &addr).IsOk()) == UT_FALSE;
+    for (size_t i = 1; i < numBlocks; i += 2) {
+        UT(alloc.Free(blocks[i], 1 << minOrder).IsOk()) == UT_TRUE;
+    }
+
+    for (size_t i = 0; i < numMaxBlocks; i++) {
+        UT(alloc.Allocate(1 << maxOrder, &blocks[i]).IsOk()) == UT_TRUE;
+        UT(blocks[i] & ((1 << maxOrder) - 1)) == UT(0ul);
+    }
+    UT(alloc.Allocate(1, &addr).IsOk()) == UT_FALSE;
+    for (size_t i = 0; i < numMaxBlocks; i++) {
+        UT(alloc.Free(blocks[i], 1 << maxOrder).IsOk()) == UT_TRUE;
+    }
+
+    delete[] blocks;
+    delete[] map;
+}
+UT_TEST_END
+
+UT_TEST("Buddy allocator - random sizes")
+{
+    typedef BuddyAllocatorBase::Addr Addr;
+    const int minOrder = 4, maxOrder = 12;
+    const size_t numMaxBlocks = 8;
+    const size_t numUnits = numMaxBlocks << (maxOrder - minOrder);
+    const size_t numSlots = 512;
+    const size_t numIterations = 100000;
+    BuddyAllocator<Addr> alloc;
+
+    UT(alloc.Initialize(0, numMaxBlocks << maxOrder, minOrder, maxOrder,
+                        64).IsOk()) == UT_TRUE;
+
+    /* Shadow map of allocated units for overlapping detection. */
+    u8 *map = new u8[numUnits];
+    memset(map, 0, numUnits);
+    Addr addrs[numSlots];
+    Addr sizes[numSlots];
+    memset(sizes, 0, sizeof(sizes));
+    TestRandom rnd;
+
+    for (size_t iter = 0; iter < numIterations; iter++) {
+        size_t slot = rnd.Next() % numSlots;
+        if (sizes[slot]) {
+            size_t first = addrs[slot] >> minOrder;
+            size_t num = RoundUp(sizes[slot], 1 << minOrder) >> minOrder;
+            UT(alloc.Free(addrs[slot], sizes[slot]).IsOk()) == UT_TRUE;
+            for (size_t i = 0; i < num; i++) {
+                map[first + i] = 0;
+            }
+            sizes[slot] = 0;
+            continue;
+        }
+        Addr size = rnd.Next() % (1 << (maxOrder - 2)) + 1;
+        Addr addr;
+        if (!alloc.Allocate(size, &addr).IsOk()) {
+            continue;
+        }
+        size_t blockSize = Max(static_cast<Addr>(1) << minOrder, size);
+        while (!IsPowerOf2(blockSize)) {
+            blockSize++;
+        }
+        UT(addr & (blockSize - 1)) == UT(0ul);
+        size_t first = addr >> minOrder;
+        size_t num = RoundUp(size, 1 << minOrder) >> minOrder;
+        for (size_t i = 0; i < num; i++) {
+            UT(map[first + i]) == UT(0);
+            map[first + i] = 1;
+        }
+        addrs[slot] = addr;
+        sizes[slot] = size;
+    }
+
+    for (size_t slot = 0; slot < numSlots; slot++) {
+        if (sizes[slot]) {
+            UT(alloc.Free(addrs[slot], sizes[slot]).IsOk()) == UT_TRUE;
+        }
+    }
+    /* Everything should be coalesced back to maximal blocks. */
+    for (size_t i = 0; i < numMaxBlocks; i++) {
+        UT(alloc.Allocate(1 << maxOrder, &addrs[i]).IsOk()) == UT_TRUE;
+    }
+
+    delete[] map;
+}
+UT_TEST_END
+
+UT_TEST("Buddy allocator - contiguous ranges")
+{
+    typedef BuddyAllocatorBase::Addr Addr;
+    const int minOrder = 12, maxOrder = 16;
+    const Addr unit = 1 << minOrder;
+    const Addr start = 1ul << 32;
+    const size_t numMaxBlocks = 8;
+    const size_t numUnits = numMaxBlocks << (maxOrder - minOrder);
+    const Addr end = start + numUnits * unit;
+    BuddyAllocator<Addr> alloc;
+
+    UT(alloc.Initialize(start, end, minOrder, maxOrder, 64).IsOk()) == UT_TRUE;
+
+    /* No rounding waste - all but the remainder is allocated in 3 units
+     * ranges.
+     */
+    Addr addrs[numUnits];
+    size_t num = 0;
+    while (alloc.AllocateRange(3 * unit, &addrs[num]).IsOk()) {
+        num++;
+    }
+    UT(num) == UT(numUnits / 3);
+    UT(alloc.AllocateRange(numUnits % 3 * unit, &addrs[num]).IsOk()) == UT_TRUE;
+    UT(alloc.Allocate(1, &addrs[num + 1]).IsOk()) == UT_FALSE;
+    UT(alloc.FreeRange(addrs[num], numUnits % 3 * unit).IsOk()) == UT_TRUE;
+    for (size_t i = 0; i < num; i++) {
+        UT(alloc.FreeRange(addrs[i], 3 * unit).IsOk()) == UT_TRUE;
+    }
+    UT(alloc.FreeRange(addrs[0], unit).IsOk()) == UT_FALSE;
+
+    /* Range spanning several maximal blocks within an address window. */
+    Addr addr;
+    Addr window = start + 2 * (1 << maxOrder) + unit;
+    UT(alloc.AllocateRange((3 << maxOrder) / 2, &addr, 0, window,
+                           window + 2 * (1 << maxOrder)).IsOk()) == UT_TRUE;
+    UT(addr) == UT(window);
+    UT(alloc.AllocateRange(2 << maxOrder, &addr, 0, window,
+                           window + 2 * (1 << maxOrder)).IsOk()) == UT_FALSE;
+    UT(alloc.FreeRange(window, (3 << maxOrder) / 2).IsOk()) == UT_TRUE;
+
+    /* Random sizes, alignments and windows. */
+    const size_t numSlots = 64;
+    Addr sizes[numSlots];
+    memset(sizes, 0, sizeof(sizes));
+    u8 *map = new u8[numUnits];
+    memset(map, 0, numUnits);
+    TestRandom rnd;
+    for (size_t iter = 0; iter < 20000; iter++) {
+        size_t slot = rnd.Next() % numSlots;
+        if (sizes[slot]) {
+            /* Free in two parts to check partial freeing. */
+            size_t units = sizes[slot] / unit;
+            size_t split = rnd.Next() % units;
+            if (split) {
+                UT(alloc.FreeRange(addrs[slot], split * unit).IsOk()) == UT_TRUE;
+            }
+            UT(alloc.FreeRange(addrs[slot] + split * unit,
+                               (units - split) * unit).IsOk()) == UT_TRUE;
+            memset(map + (addrs[slot] - start) / unit, 0, units);
+            sizes[slot] = 0;
+            continue;
+        }
+        Addr size = (rnd.Next() % (3 << (maxOrder - minOrder)) + 1) * unit;
+        Addr alignment = rnd.Next() % 2 ? 0 :
+            static_cast<Addr>(1) << (minOrder + rnd.Next() % 4);
+        Addr low = 0, high = 0;
+        if (rnd.Next() % 2) {
+            low = start + rnd.Next() % numUnits * unit;
+            high = low + size + rnd.Next() % numUnits * unit;
+        }
+        if (!alloc.AllocateRange(size, &addrs[slot], alignment, low,
+                                 high).IsOk()) {
+            continue;
+        }
+        Addr a = addrs[slot];
+        UT(a >= Max(low, start)) == UT_TRUE;
+        UT(a + size <= (high ? Min(high, end) : end)) == UT_TRUE;
+        UT(a & (Max(alignment, unit) - 1)) == UT(0ul);
+        for (size_t i = 0; i < size / unit; i++) {
+            UT(map[(a - start) / unit + i]) == UT(0);
+            map[(a - start) / unit + i] = 1;
+        }
+        sizes[slot] = size;
+    }
+    for (size_t slot = 0; slot < numSlots; slot++) {
+        if (sizes[slot]) {
+            UT(alloc.FreeRange(addrs[slot], sizes[slot]).IsOk()) == UT_TRUE;
+        }
+    }
+    /* Everything should be coalesced back to maximal blocks. */
+    for (size_t i = 0; i < numMaxBlocks; i++) {
+        UT(alloc.Allocate(1 << maxOrder, &addrs[i]).IsOk()) == UT_TRUE;
+    }
+
+    delete[] map;
+}
+UT_TEST_END
+
+namespace {
+
+/** Text stream which prints to a fixed buffer. */
+class StatsStream : public text_stream::OTextStream<StatsStream> {
+public:
+    StatsStream(char *buf, size_t bufSize) :
+        text_stream::OTextStream<StatsStream>(this), _buf(buf), _bufSize(bufSize)
+    {
+        _buf[0] = 0;
+    }
+
+    bool Putc(char c, void *arg UNUSED) {
+        if (_curPos >= _bufSize - 1) {
+            return false;
+        }
+        _buf[_curPos++] = c;
+        _buf[_curPos] = 0;
+        return true;
+    }
+
+private:
+    char *_buf;
+    size_t _bufSize, _curPos = 0;
+};
+
+} /* anonymous namespace */
+
+UT_TEST("Buddy allocator - statistics")
+{
+    typedef BuddyAllocatorBase::Addr Addr;
+    const int maxOrder = 4;
+    const size_t numUnits = 4 << maxOrder;
+    BuddyAllocator<Addr> alloc;
+    BuddyAllocatorBase::Stats *stats = new BuddyAllocatorBase::Stats;
+
+    /* Small cache to make it exhausted. */
+    UT(alloc.Initialize(0, numUnits, 0, maxOrder, 2).IsOk()) == UT_TRUE;
+    alloc.GetStats(stats);
+    UT(stats->numFree) == UT(4ul);
+    UT(stats->freeSize) == UT(numUnits);
+    UT(stats->largestFreeOrder) == UT(maxOrder);
+    UT(stats->cacheUsed) == UT(2ul);
+    UT(stats->cacheExhausted) == UT(2ul);
+    UT(stats->GetFragmentation(maxOrder)) == UT(-1);
+
+    /* Single unit allocation splits one block of each order above zero. */
+    Addr addr;
+    UT(alloc.Allocate(1, &addr).IsOk()) == UT_TRUE;
+    alloc.GetStats(stats);
+    UT(stats->orders[maxOrder].cacheHits) == UT(1ul);
+    for (int order = 0; order <= maxOrder; order++) {
+        UT(stats->orders[order].splits) == UT(order ? 1ul : 0ul);
+        UT(stats->orders[order].numFree) == UT(order == maxOrder ? 3ul : 1ul);
+    }
+    /* Freeing coalesces it back. */
+    UT(alloc.Free(addr, 1).IsOk()) == UT_TRUE;
+    alloc.GetStats(stats);
+    for (int order = 0; order <= maxOrder; order++) {
+        UT(stats->orders[order].coalesces) == UT(order < maxOrder ? 1ul : 0ul);
+    }
+    UT(stats->orders[maxOrder].numFree) == UT(4ul);
+
+    /* Free every other unit to get maximal fragmentation. */
+    Addr addrs[numUnits];
+    for (size_t i = 0; i < numUnits; i++) {
+        UT(alloc.Allocate(1, &addrs[i]).IsOk()) == UT_TRUE;
+    }
+    alloc.GetStats(stats);
+    size_t numMisses = 0;
+    for (int order = 0; order <= maxOrder; order++) {
+        numMisses += stats->orders[order].cacheMisses;
+    }
+    UT(numMisses) != UT(0ul);
+    UT(stats->largestFreeOrder) == UT(-1);
+    UT(stats->GetFragmentation(0)) == UT(0);
+    for (size_t i = 0; i < numUnits; i += 2) {
+        UT(alloc.Free(addrs[i], 1).IsOk()) == UT_TRUE;
+    }
+    alloc.GetStats(stats);
+    UT(stats->numFree) == UT(numUnits / 2);
+    UT(stats->GetFragmentation(0)) == UT(-1);
+    UT(stats->GetFragmentation(1)) == UT(500);
+    UT(stats->GetFragmentation(maxOrder)) == UT(938);
+
+    char buf[1024];
+    StatsStream stream(buf, sizeof(buf));
+    stream.Format("%s", *stats);
+    UT_TRACE("%s", buf);
+    UT(strncmp(buf, "orders 0-4, free 0x20 in 32 blocks,", 35)) == UT(0);
+
+    alloc.ResetStats();
+    alloc.GetStats(stats);
+    for (int order = 0; order <= maxOrder; order++) {
+        UT(stats->orders[order].cacheHits) == UT(0ul);
+        UT(stats->orders[order].splits) == UT(0ul);
+    }
+    UT(stats->cacheExhausted) == UT(0ul);
+    UT(stats->numFree) == UT(numUnits / 2);
+
+    delete stats;
+}
+UT_TEST_END
+
+UT_TEST("Buddy allocator - allocation rate benchmark")
+{
+    typedef BuddyAllocatorBase::Addr Addr;
+    const int minOrder = 12, maxOrder = 22;
+    const size_t numMaxBlocks = 64;
+    const size_t numBlocks = numMaxBlocks << (maxOrder - minOrder);
+    const size_t numRounds = 4;
+    BuddyAllocator<Addr> alloc;
+
+    UT(alloc.Initialize(0, numMaxBlocks << maxOrder, minOrder,
+                        maxOrder).IsOk()) == UT_TRUE;
+    Addr *blocks = new Addr[numBlocks];
+
+    /* Allocate/free pairs - should be served by the free blocks cache. One
+     * block is kept allocated so that its buddy stays free in the minimal
+     * order and is not coalesced on each freeing.
+     */
+    Addr pinned;
+    UT(alloc.Allocate(1 << minOrder, &pinned).IsOk()) == UT_TRUE;
+    u64 start = cpu::rdtsc();
+    u64 startNs = ut::__ut_time_ns();
+    for (size_t i = 0; i < numBlocks * numRounds; i++) {
+        Addr addr;
+        alloc.Allocate(1 << minOrder, &addr);
+        alloc.Free(addr, 1 << minOrder);
+    }
+    u64 cycles = cpu::rdtsc() - start;
+    u64 ns = ut::__ut_time_ns() - startNs;
+    UT(alloc.Free(pinned, 1 << minOrder).IsOk()) == UT_TRUE;
+    UT_TRACE("Allocate/free pairs: %lu allocations/sec, %lu cycles per pair",
+             numBlocks * numRounds * 1000000000ul / Max<u64>(ns, 1),
+             cycles / (numBlocks * numRounds));
+
+    /* Fill and drain the whole range - exercises splitting, bitmap scanning
+     * when the cache is exhausted, and coalescing.
+     */
+    u64 allocCycles = 0, freeCycles = 0, allocNs = 0, freeNs = 0;
+    for (size_t round = 0; round < numRounds; round++) {
+        start = cpu::rdtsc();
+        startNs = ut::__ut_time_ns();
+        for (size_t i = 0; i < numBlocks; i++) {
+            alloc.Allocate(1 << minOrder, &blocks[i]);
+        }
+        allocCycles += cpu::rdtsc() - start;
+        allocNs += ut::__ut_time_ns() - startNs;
+        start = cpu::rdtsc();
+        startNs = ut::__ut_time_ns();
+        for (size_t i = 0; i < numBlocks; i++) {
+            alloc.Free(blocks[i], 1 << minOrder);
+        }
+        freeCycles += cpu::rdtsc() - start;
+        freeNs += ut::__ut_time_ns() - startNs;
+    }
+    UT_TRACE("Fill: %lu allocations/sec, %lu cycles per allocation",
+             numBlocks * numRounds * 1000000000ul / Max<u64>(allocNs, 1),
+             allocCycles / (numBlocks * numRounds));
+    UT_TRACE("Drain: %lu frees/sec, %lu cycles per free",
+             numBlocks * numRounds * 1000000000ul / Max<u64>(freeNs, 1),
+             freeCycles / (numBlocks * numRounds));
+
+    delete[] blocks;
+}
+UT_TEST_END
+
+UT_TEST("Buddy allocator - per-CPU magazines")
+{
+    typedef BuddyAllocatorBase::Addr Addr;
+    const int minOrder = 12, maxOrder = 18;
+    const size_t numMaxBlocks = 8;
+    const size_t numUnits = numMaxBlocks << (maxOrder - minOrder);
+    const size_t numCpus = 3;
+    BuddyAllocator<Addr> alloc;
+    UT(alloc.Initialize(0, numMaxBlocks << maxOrder, minOrder,
+                        maxOrder).IsOk()) == UT_TRUE;
+    BuddyMagazine<Addr> mag;
+    UT(mag.Initialize(&alloc, numCpus, 2).IsOk()) == UT_TRUE;
+
+    /* Allocate everything in blocks of different orders including ones not
+     * served by magazines.
+     */
+    u8 *map = new u8[numUnits];
+    memset(map, 0, numUnits);
+    Addr *addrs = new Addr[numUnits];
+    Addr *sizes = new Addr[numUnits];
+    size_t numBlocks = 0;
+    for (int order = minOrder + BuddyMagazineBase::NUM_ORDERS;
+         order >= minOrder; order--) {
+
+        Addr size = static_cast<Addr>(1) << order;
+        Addr addr;
+        while (mag.Allocate(numBlocks % numCpus, size, &addr).IsOk()) {
+            UT(addr & (size - 1)) == UT(0ul);
+            size_t first = addr >> minOrder;
+            for (size_t i = 0; i < size >> minOrder; i++) {
+                UT(map[first + i]) == UT(0);
+                map[first + i] = 1;
+            }
+            addrs[numBlocks] = addr;
+            sizes[numBlocks] = size;
+            numBlocks++;
+        }
+    }
+    for (size_t i = 0; i < numUnits; i++) {
+        UT(map[i]) == UT(1);
+    }
+
+    /* Free from CPUs other than allocating ones. */
+    for (size_t i = 0; i < numBlocks; i++) {
+        UT(mag.Free((i + 1) % numCpus, addrs[i], sizes[i]).IsOk()) == UT_TRUE;
+    }
+
+    /* Reuse cached blocks. */
+    Addr addr;
+    UT(mag.Allocate(0, 1, &addr).IsOk()) == UT_TRUE;
+    UT(mag.Free(0, addr, 1).IsOk()) == UT_TRUE;
+
+    /* After returning everything the range should be fully coalesced. */
+    for (size_t cpu = 0; cpu < numCpus; cpu++) {
+        mag.Flush(cpu);
+    }
+    mag.Reclaim();
+    for (size_t i = 0; i < numMaxBlocks; i++) {
+        UT(alloc.Allocate(1 << maxOrder, &addrs[i]).IsOk()) == UT_TRUE;
+    }
+    for (size_t i = 0; i < numMaxBlocks; i++) {
+        UT(alloc.Free(addrs[i], 1 << maxOrder).IsOk()) == UT_TRUE;
+    }
+
+    delete[] sizes;
+    delete[] addrs;
+    delete[] map;
+}
+UT_TEST_END
+
+UT_TEST("Buddy allocator - magazines reclaim")
+{
+    typedef BuddyAllocatorBase::Addr Addr;
+    const int minOrder = 12, maxOrder = 13;
+    const size_t numBlocks = 256;
+    BuddyAllocator<Addr> alloc;
+    UT(alloc.Initialize(0, numBlocks << minOrder, minOrder,
+                        maxOrder).IsOk()) == UT_TRUE;
+    BuddyMagazine<Addr> mag;
+    UT(mag.Initialize(&alloc, 2, 8).IsOk()) == UT_TRUE;
+
+    /* Cached order above the allocator maximal order. */
+    Addr addr;
+    UT(mag.Allocate(0, 1 << (maxOrder + 1), &addr) == RetCode::INV_PARAM) ==
+        UT_TRUE;
+    UT(mag.Free(0, 0, 1 << (maxOrder + 1)) == RetCode::INV_PARAM) == UT_TRUE;
+
+    /* Park all the memory in the magazines of one CPU and the depot. */
+    Addr *blocks = new Addr[numBlocks];
+    for (size_t i = 0; i < numBlocks; i++) {
+        UT(mag.Allocate(0, 1 << minOrder, &blocks[i]).IsOk()) == UT_TRUE;
+    }
+    UT(mag.Allocate(0, 1 << minOrder, &addr).IsOk()) == UT_FALSE;
+    for (size_t i = 0; i < numBlocks; i++) {
+        UT(mag.Free(0, blocks[i], 1 << minOrder).IsOk()) == UT_TRUE;
+    }
+    UT(alloc.Allocate(1 << minOrder, &addr).IsOk()) == UT_FALSE;
+
+    /* The other CPU gets blocks of cached order after the depot is
+     * reclaimed.
+     */
+    UT(mag.Allocate(1, 1 << maxOrder, &addr).IsOk()) == UT_TRUE;
+    UT(mag.Free(1, addr, 1 << maxOrder).IsOk()) == UT_TRUE;
+
+    delete[] blocks;
+}
+UT_TEST_END
+
+namespace {
+
+/** Parameters for multi-threaded benchmark worker. */
+struct BenchmarkWorker {
+    typedef BuddyAllocatorBase::Addr Addr;
+    enum {
+        NUM_ITERATIONS = 100000,
+        BATCH_SIZE = 16,
+        BLOCK_SIZE = 1 << 12,
+    };
+
+    size_t cpu;
+    BuddyAllocator<Addr> *alloc;
+    SpinLock *allocLock;
+    BuddyMagazine<Addr> *mag;
+    size_t numFailures;
+};
+
+/** Allocate and free page-sized blocks in batches via the shared allocator. */
+void
+LockedWorker(void *arg)
+{
+    BenchmarkWorker *w = static_cast<BenchmarkWorker *>(arg);
+    BenchmarkWorker::Addr blocks[BenchmarkWorker::BATCH_SIZE];
+    for (size_t iter = 0; iter < BenchmarkWorker::NUM_ITERATIONS; iter++) {
+        for (size_t i = 0; i < BenchmarkWorker::BATCH_SIZE; i++) {
+            w->allocLock->Lock();
+            if (!w->alloc->Allocate(BenchmarkWorker::BLOCK_SIZE, &blocks[i]).IsOk()) {
+                w->numFailures++;
+            }
+            w->allocLock->Unlock();
+        }
+        for (size_t i = 0; i < BenchmarkWorker::BATCH_SIZE; i++) {
+            w->allocLock->Lock();
+            w->alloc->Free(blocks[i], BenchmarkWorker::BLOCK_SIZE);
+            w->allocLock->Unlock();
+        }
+    }
+}
+
+/** Allocate and free page-sized blocks in batches via the magazine layer. */
+void
+MagazineWorker(void *arg)
+{
+    BenchmarkWorker *w = static_cast<BenchmarkWorker *>(arg);
+    BenchmarkWorker::Addr blocks[BenchmarkWorker::BATCH_SIZE];
+    for (size_t iter = 0; iter < BenchmarkWorker::NUM_ITERATIONS; iter++) {
+        for (size_t i = 0; i < BenchmarkWorker::BATCH_SIZE; i++) {
+            if (!w->mag->Allocate(w->cpu, BenchmarkWorker::BLOCK_SIZE, &blocks[i]).IsOk()) {
+                w->numFailures++;
+            }
+        }
+        for (size_t i = 0; i < BenchmarkWorker::BATCH_SIZE; i++) {
+            w->mag->Free(w->cpu, blocks[i], BenchmarkWorker::BLOCK_SIZE);
+        }
+    }
+}
+
+/** Run the workers in parallel and return elapsed cycles. */
+u64
+RunWorkers(void (*func)(void *), BenchmarkWorker *workers, size_t numThreads)
+{
+    void *threads[numThreads];
+    u64 start = cpu::rdtsc();
+    for (size_t i = 0; i < numThreads; i++) {
+        threads[i] = ut::__ut_thread_create(func, &workers[i]);
+    }
+    for (size_t i = 0; i < numThreads; i++) {
+        ut::__ut_thread_join(threads[i]);
+    }
+    return cpu::rdtsc() - start;
+}
+
+} /* anonymous namespace */
+
+UT_TEST("Buddy allocator - multi-threaded magazines benchmark")
+{
+    typedef BuddyAllocatorBase::Addr Addr;
+    const size_t maxThreads = 8;
+    const int minOrder = 12, maxOrder = 22;
+
+    for (size_t numThreads = 1; numThreads <= maxThreads; numThreads *= 2) {
+        BuddyAllocator<Addr> alloc;
+        UT(alloc.Initialize(0, 16ul << maxOrder, minOrder,
+                            maxOrder).IsOk()) == UT_TRUE;
+        SpinLock allocLock;
+        BenchmarkWorker workers[numThreads];
+        for (size_t i = 0; i < numThreads; i++) {
+            workers[i].cpu = i;
+            workers[i].alloc = &alloc;
+            workers[i].allocLock = &allocLock;
+            workers[i].mag = nullptr;
+            workers[i].numFailures = 0;
+        }
+        u64 lockedCycles = RunWorkers(LockedWorker, workers, numThreads);
+
+        {
+            BuddyMagazine<Addr> mag;
+            UT(mag.Initialize(&alloc, numThreads).IsOk()) == UT_TRUE;
+            for (size_t i = 0; i < numThreads; i++) {
+                workers[i].mag = &mag;
+            }
+            u64 magCycles = RunWorkers(MagazineWorker, workers, numThreads);
+
+            u64 numOps = numThreads * BenchmarkWorker::NUM_ITERATIONS *
+                BenchmarkWorker::BATCH_SIZE * 2;
+            UT_TRACE("%lu threads: locked allocator %lu ops/Mcycle, "
+                     "magazines %lu ops/Mcycle",
+                     numThreads, numOps * 1000000 / lockedCycles,
+                     numOps * 1000000 / magCycles);
+        }
+
+        for (size_t i = 0; i < numThreads; i++) {
+            UT(workers[i].numFailures) == UT(0ul);
+        }
+    }
+}
+UT_TEST_END
+
+UT_TEST("Concurrent buddy allocator - double free after coalescing")
+{
+    typedef BuddyAllocatorBase::Addr Addr;
+    const int minOrder = 12, maxOrder = 16;
+    const Addr start = 1ul << 20;
+    const size_t numMaxBlocks = 4;
+    ConcurrentBuddyAllocator<Addr> alloc;
+    UT(alloc.Initialize(start, start + (numMaxBlocks << maxOrder), minOrder,
+                        maxOrder).IsOk()) == UT_TRUE;
+
+    Addr a, b, addr;
+    UT(alloc.Allocate(1, &a).IsOk()) == UT_TRUE;
+    UT(alloc.Allocate(1, &b).IsOk()) == UT_TRUE;
+    UT(a ^ b) == UT(1ul << minOrder);
+
+    /* Not coalesced yet. */
+    UT(alloc.Free(a, 1).IsOk()) == UT_TRUE;
+    UT(alloc.Free(a, 1).IsOk()) == UT_FALSE;
+    UT(alloc.Allocate(1, &a).IsOk()) == UT_TRUE;
+
+    /* Coalesced with the buddy up to the maximal order. */
+    UT(alloc.Free(a, 1).IsOk()) == UT_TRUE;
+    UT(alloc.Free(b, 1).IsOk()) == UT_TRUE;
+    UT(alloc.Free(a, 1).IsOk()) == UT_FALSE;
+    UT(alloc.Free(b, 1).IsOk()) == UT_FALSE;
+    UT(alloc.Free(Min(a, b), 1 << (minOrder + 1)).IsOk()) == UT_FALSE;
+
+    /* Everything is still allocated exactly once. */
+    Addr blocks[numMaxBlocks];
+    for (size_t i = 0; i < numMaxBlocks; i++) {
+        UT(alloc.Allocate(1 << maxOrder, &blocks[i]).IsOk()) == UT_TRUE;
+    }
+    UT(alloc.Allocate(1, &addr).IsOk()) == UT_FALSE;
+    for (size_t i = 0; i < numMaxBlocks; i++) {
+        UT(alloc.Free(blocks[i], 1 << maxOrder).IsOk()) == UT_TRUE;
+    }
+}
+UT_TEST_END
+
+namespace {
+
+/** Worker of the concurrent allocator stress test. */
+class StressWorker {
+public:
+    typedef BuddyAllocatorBase::Addr Addr;
+
+    enum {
+        NUM_ITERATIONS = 20000,
+        MAX_BLOCKS = 64,
+        /** Maximal block size is (2 ^ MAX_SIZE_ORDER) minimal blocks. */
+        MAX_SIZE_ORDER = 6,
+    };
+
+    ConcurrentBuddyAllocator<Addr> *alloc;
+    /** Owner ID of each minimal block, zero if free. */
+    u32 *owners;
+    int minOrder;
+    u32 id;
+    /** Minimal blocks which were found owned by another worker. */
+    size_t numDoubleAllocs;
+    /** Failed freeings. */
+    size_t numFreeFailures;
+    /** Allocations failed due to lack of memory. */
+    size_t numNoResources;
+};
+
+/** Claim or release ownership of all minimal blocks of the block.
+ *
+ * @return Number of minimal blocks with unexpected owner.
+ */
+size_t
+SetOwner(StressWorker *w, StressWorker::Addr addr, StressWorker::Addr size,
+         u32 from, u32 to)
+{
+    size_t numBad = 0;
+    size_t first = addr >> w->minOrder;
+    for (size_t i = 0; i < size >> w->minOrder; i++) {
+        u32 expected = from;
+        if (!__atomic_compare_exchange_n(&w->owners[first + i], &expected, to,
+                                         false, __ATOMIC_SEQ_CST,
+                                         __ATOMIC_SEQ_CST)) {
+            numBad++;
+        }
+    }
+    return numBad;
+}
+
+/** Randomly allocate and free blocks of different sizes tracking ownership
+ * of each minimal block.
+ */
+void
+StressWorkerFunc(void *arg)
+{
+    typedef StressWorker::Addr Addr;
+    StressWorker *w = static_cast<StressWorker *>(arg);
+    TestRandom rnd(w->id);
+    Addr addrs[StressWorker::MAX_BLOCKS], sizes[StressWorker::MAX_BLOCKS];
+    size_t numBlocks = 0;
+
+    for (size_t iter = 0; iter < StressWorker::NUM_ITERATIONS; iter++) {
+        if (numBlocks == StressWorker::MAX_BLOCKS ||
+            (numBlocks && rnd.Next() % 2)) {
+
+            size_t idx = rnd.Next() % numBlocks;
+            w->numDoubleAllocs += SetOwner(w, addrs[idx], sizes[idx], w->id, 0);
+            if (!w->alloc->Free(addrs[idx], sizes[idx]).IsOk()) {
+                w->numFreeFailures++;
+            }
+            numBlocks--;
+            addrs[idx] = addrs[numBlocks];
+            sizes[idx] = sizes[numBlocks];
+            continue;
+        }
+        Addr size = static_cast<Addr>(1) <<
+            (w->minOrder + rnd.Next() % (StressWorker::MAX_SIZE_ORDER + 1));
+        Addr addr;
+        if (!w->alloc->Allocate(size, &addr).IsOk()) {
+            w->numNoResources++;
+            continue;
+        }
+        w->numDoubleAllocs += SetOwner(w, addr, size, 0, w->id);
+        addrs[numBlocks] = addr;
+        sizes[numBlocks] = size;
+        numBlocks++;
+    }
+    while (numBlocks) {
+        numBlocks--;
+        w->numDoubleAllocs += SetOwner(w, addrs[numBlocks], sizes[numBlocks],
+                                       w->id, 0);
+        if (!w->alloc->Free(addrs[numBlocks], sizes[numBlocks]).IsOk()) {
+            w->numFreeFailures++;
+        }
+    }
+}
+
+} /* anonymous namespace */
+
+UT_TEST("Concurrent buddy allocator - multi-threaded stress")
+{
+    typedef BuddyAllocatorBase::Addr Addr;
+    const size_t numThreads = 8;
+    const int minOrder = 12, maxOrder = 18;
+    /* Small enough to run out of memory sometimes. */
+    const size_t numMaxBlocks = 32;
+    const size_t numUnits = numMaxBlocks << (maxOrder - minOrder);
+
+    ConcurrentBuddyAllocator<Addr> alloc;
+    UT(alloc.Initialize(0, numMaxBlocks << maxOrder, minOrder,
+                        maxOrder).IsOk()) == UT_TRUE;
+    u32 *owners = new u32[numUnits];
+    memset(owners, 0, numUnits * sizeof(u32));
+
+    StressWorker workers[numThreads];
+    void *threads[numThreads];
+    u64 start = cpu::rdtsc();
+    for (size_t i = 0; i < numThreads; i++) {
+        StressWorker &w = workers[i];
+        w.alloc = &alloc;
+        w.owners = owners;
+        w.minOrder = minOrder;
+        w.id = i + 1;
+        w.numDoubleAllocs = 0;
+        w.numFreeFailures = 0;
+        w.numNoResources = 0;
+        threads[i] = ut::__ut_thread_create(StressWorkerFunc, &w);
+    }
+    for (size_t i = 0; i < numThreads; i++) {
+        ut::__ut_thread_join(threads[i]);
+    }
+    u64 cycles = cpu::rdtsc() - start;
+
+    size_t numNoResources = 0;
+    for (size_t i = 0; i < numThreads; i++) {
+        UT(workers[i].numDoubleAllocs) == UT(0ul);
+        UT(workers[i].numFreeFailures) == UT(0ul);
+        numNoResources += workers[i].numNoResources;
+    }
+    for (size_t i = 0; i < numUnits; i++) {
+        UT(owners[i]) == UT(0u);
+    }
+    UT_TRACE("%lu threads: %lu cycles per operation, %lu allocations failed",
+             numThreads,
+             cycles / (numThreads * StressWorker::NUM_ITERATIONS),
+             numNoResources);
+
+    /* Everything should be coalesced back to maximal blocks. */
+    BuddyAllocatorBase::Stats *stats = new BuddyAllocatorBase::Stats;
+    alloc.GetStats(stats);
+    UT(stats->orders[maxOrder].numFree) == UT(numMaxBlocks);
+    UT(stats->numFree) == UT(numMaxBlocks);
+    delete stats;
+
+    delete[] owners;
+}
+UT_TEST_END
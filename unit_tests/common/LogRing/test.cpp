@@ -0,0 +1,243 @@
+/*
+ * /phoenix/unit_tests/common/LogRing/test.cpp
+ *
+ * This file is a part of Phoenix operating system.
+ * Copyright (c) 2011-2012, Artyom Lebedev <artyom.lebedev@gmail.com>
+ * All rights reserved.
+ * See COPYING file for copyright details.
+ */
+
+/** @file test.cpp
+ * Lockless log ring buffer tests.
+ */
+
+#include <phoenix_ut.h>
+
+#include <sys.h>
+
+namespace {
+
+/** Producer thread of the concurrent test. Each record text contains the
+ * producer index and the record number.
+ */
+class Producer {
+public:
+    LogRing *ring;
+    size_t idx, numRecords;
+    size_t numPut = 0;
+    bool done = false;
+
+    static void
+    Run(void *arg)
+    {
+        Producer *p = static_cast<Producer *>(arg);
+        for (size_t i = 0; i < p->numRecords; i++) {
+            u64 data[2] = { p->idx, i };
+            if (p->ring->Put(i, p->idx, 0, reinterpret_cast<char *>(data),
+                             sizeof(data)) == sizeof(data)) {
+                p->numPut++;
+            }
+            /* Let the consumer keep up with the producers most of time. */
+            for (int j = 0; j < 64; j++) {
+                cpu::Pause();
+            }
+        }
+        __atomic_store_n(&p->done, true, __ATOMIC_RELEASE);
+    }
+};
+
+} /* anonymous namespace */
+
+UT_TEST("Put and get")
+{
+    LogRing ring;
+    LogRing::Record rec;
+
+    UT(ring.Initialize(0).IsOk()) == UT_FALSE;
+    UT(ring.Initialize(12).IsOk()) == UT_FALSE;
+    UT(ring.Initialize(16).IsOk()) == UT_TRUE;
+    UT(ring.Get(&rec)) == UT_FALSE;
+
+    UT(ring.Put(100, 3, 5, "Test message", 12)) == UT(12ul);
+    UT(ring.GetNumPending()) == UT(1ul);
+    UT(ring.Get(&rec)) == UT_TRUE;
+    UT(rec.timestamp) == UT(100ul);
+    UT(rec.cpu) == UT(3);
+    UT(rec.level) == UT(5);
+    UT(rec.flags) == UT(0);
+    UT(rec.length) == UT(12);
+    UT(memcmp(rec.text, "Test message", 12)) == UT(0);
+    UT(ring.Get(&rec)) == UT_FALSE;
+    UT(ring.GetNumPending()) == UT(0ul);
+
+    /* Long text is split into continuation records. */
+    char text[LogRing::TEXT_SIZE * 2 + 10];
+    for (size_t i = 0; i < sizeof(text); i++) {
+        text[i] = 'a' + i % 26;
+    }
+    UT(ring.Put(200, 0, 0, text, sizeof(text))) == UT(sizeof(text));
+    UT(ring.GetNumPending()) == UT(3ul);
+    size_t offset = 0;
+    for (int i = 0; i < 3; i++) {
+        UT(ring.Get(&rec)) == UT_TRUE;
+        UT(rec.flags) == UT(i ? LogRing::F_CONTINUATION : 0);
+        UT(memcmp(rec.text, &text[offset], rec.length)) == UT(0);
+        offset += rec.length;
+    }
+    UT(offset) == UT(sizeof(text));
+    UT(ring.Get(&rec)) == UT_FALSE;
+}
+UT_TEST_END
+
+UT_TEST("Overflow policies")
+{
+    const size_t numSlots = 16;
+    LogRing::Record rec;
+
+    /* New records are dropped. */
+    LogRing dropRing;
+    UT(dropRing.Initialize(numSlots, LogRing::DROP_NEW).IsOk()) == UT_TRUE;
+    for (size_t i = 0; i < numSlots + 5; i++) {
+        size_t n = dropRing.Put(i, 0, 0, "x", 1);
+        UT(n) == UT(i < numSlots ? 1ul : 0ul);
+    }
+    UT(dropRing.GetNumDropped()) == UT(5ul);
+    UT(dropRing.GetNumOverwritten()) == UT(0ul);
+    for (size_t i = 0; i < numSlots; i++) {
+        UT(dropRing.Get(&rec)) == UT_TRUE;
+        UT(rec.timestamp) == UT(i);
+    }
+    UT(dropRing.Get(&rec)) == UT_FALSE;
+    /* Space is available again after consuming. */
+    UT(dropRing.Put(100, 0, 0, "x", 1)) == UT(1ul);
+    UT(dropRing.Get(&rec)) == UT_TRUE;
+    UT(rec.timestamp) == UT(100ul);
+
+    /* Oldest records are overwritten. */
+    LogRing owRing;
+    UT(owRing.Initialize(numSlots, LogRing::OVERWRITE_OLD).IsOk()) == UT_TRUE;
+    for (size_t i = 0; i < numSlots + 5; i++) {
+        UT(owRing.Put(i, 0, 0, "x", 1)) == UT(1ul);
+    }
+    UT(owRing.GetNumDropped()) == UT(0ul);
+    for (size_t i = 5; i < numSlots + 5; i++) {
+        UT(owRing.Get(&rec)) == UT_TRUE;
+        UT(rec.timestamp) == UT(i);
+    }
+    UT(owRing.Get(&rec)) == UT_FALSE;
+    UT(owRing.GetNumOverwritten()) == UT(5ul);
+}
+UT_TEST_END
+
+UT_TEST("Merging rings")
+{
+    const size_t numRings = 3, numRecords = 10;
+    LogRing rings[numRings];
+    SeqRingMerger<LogRing> merger;
+    for (size_t i = 0; i < numRings; i++) {
+        UT(rings[i].Initialize(16).IsOk()) == UT_TRUE;
+    }
+    UT(merger.Initialize(rings, numRings)) == UT_TRUE;
+    UT(merger.GetNext() == 0) == UT_TRUE;
+
+    /* Time stamps are interleaved between the rings. */
+    for (size_t i = 0; i < numRecords; i++) {
+        rings[i % numRings].Put(i, i % numRings, 0, "x", 1);
+    }
+    for (size_t i = 0; i < numRecords; i++) {
+        LogRing::Record *rec = merger.GetNext();
+        UT(rec != 0) == UT_TRUE;
+        UT(rec->timestamp) == UT(i);
+        UT(rec->cpu) == UT(i % numRings);
+    }
+    UT(merger.GetNext() == 0) == UT_TRUE;
+
+    /* Records put after the rings were drained are merged as well. */
+    rings[2].Put(100, 2, 0, "x", 1);
+    rings[0].Put(200, 0, 0, "x", 1);
+    UT(merger.GetNext()->timestamp) == UT(100ul);
+    UT(merger.GetNext()->timestamp) == UT(200ul);
+    UT(merger.GetNext() == 0) == UT_TRUE;
+}
+UT_TEST_END
+
+UT_TEST("Concurrent producers")
+{
+    const size_t numProducers = 4, numRecords = 200000;
+
+    for (LogRing::OverflowPolicy policy: { LogRing::DROP_NEW, LogRing::OVERWRITE_OLD }) {
+        LogRing ring;
+        UT(ring.Initialize(256, policy).IsOk()) == UT_TRUE;
+        Producer producers[numProducers];
+        void *threads[numProducers];
+        for (size_t i = 0; i < numProducers; i++) {
+            producers[i].ring = &ring;
+            producers[i].idx = i;
+            producers[i].numRecords = numRecords;
+            threads[i] = ut::__ut_thread_create(Producer::Run, &producers[i]);
+        }
+
+        /* Consume concurrently. Records of each producer should come in order
+         * and not corrupted.
+         */
+        u64 nextRecord[numProducers];
+        size_t numReceived = 0, numErrors = 0;
+        memset(nextRecord, 0, sizeof(nextRecord));
+        LogRing::Record rec;
+        while (true) {
+            if (!ring.Get(&rec)) {
+                size_t numDone = 0;
+                for (size_t i = 0; i < numProducers; i++) {
+                    numDone += __atomic_load_n(&producers[i].done, __ATOMIC_ACQUIRE);
+                }
+                if (numDone < numProducers) {
+                    continue;
+                }
+                /* Records committed before the producers finished. */
+                if (!ring.Get(&rec)) {
+                    break;
+                }
+            }
+            u64 data[2];
+            memcpy(data, rec.text, sizeof(data));
+            if (rec.length != sizeof(data) || data[0] >= numProducers ||
+                rec.cpu != data[0] || rec.timestamp != data[1] ||
+                data[1] < nextRecord[data[0]]) {
+                numErrors++;
+                continue;
+            }
+            nextRecord[data[0]] = data[1] + 1;
+            numReceived++;
+        }
+
+        size_t numPut = 0;
+        for (size_t i = 0; i < numProducers; i++) {
+            ut::__ut_thread_join(threads[i]);
+            numPut += producers[i].numPut;
+        }
+        UT(numErrors) == UT(0ul);
+        /* Each record is either received or accounted as lost. */
+        UT(numPut + ring.GetNumDropped()) == UT(numProducers * numRecords);
+        UT(numReceived + ring.GetNumOverwritten()) == UT(numPut);
+        UT_TRACE("%s: %lu received, %lu dropped, %lu overwritten",
+                 policy == LogRing::DROP_NEW ? "Drop new" : "Overwrite old",
+                 numReceived, ring.GetNumDropped(), ring.GetNumOverwritten());
+    }
+}
+UT_TEST_END
+
+UT_TEST("Producer cost benchmark")
+{
+    const size_t numRecords = 1000000;
+    LogRing ring;
+    UT(ring.Initialize(1024, LogRing::OVERWRITE_OLD).IsOk()) == UT_TRUE;
+    const char msg[] = "[0000000000001000 - 0000000000002000] Conventional\n";
+
+    u64 start = cpu::rdtsc();
+    for (size_t i = 0; i < numRecords; i++) {
+        ring.Put(i, 0, 0, msg, sizeof(msg) - 1);
+    }
+    u64 cycles = cpu::rdtsc() - start;
+    UT_TRACE("%lu cycles per record", cycles / numRecords);
+}
+UT_TEST_END
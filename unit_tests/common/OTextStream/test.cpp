@@ -64,6 +64,16 @@ CheckFormatV(const char *result, utStringStream &stream, const char *fmt, ...)
         stream.Erase(); \
     } while (false)
 
+/* Verify string and size for compile-time parsed format string. */
+#define CHECK_FMT_STATIC(result, fmt, ...) \
+do {\
+    size_t size = stream.Format(OTS_FMT(fmt), ## __VA_ARGS__); \
+    UT(size) == UT(sizeof(result) - 1); \
+    UT(stream.Get()) == UT_CSTR(result); \
+    stream.Erase(); \
+    stream.ClearOptions(); \
+} while (false)
+
 /* Verify string and size. */
 #define CHECK_FMT_NOV(result, fmt, ...) \
 do {\
@@ -72,6 +82,7 @@ do {\
     UT(stream.Get()) == UT_CSTR(result); \
     stream.Erase(); \
     stream.ClearOptions(); \
+    CHECK_FMT_STATIC(result, fmt, ## __VA_ARGS__); \
 } while (false)
 
 /* Verify string and size. */
@@ -208,3 +219,272 @@ UT_TEST("Stringifying user defined classes")
     CHECK_FMT_NOV("Object: fmt 'a': 12345678 tail", "Object: %a tail", p);
 }
 UT_TEST_END
+
+UT_TEST("Compile-time parsed format strings")
+{
+    char buf[1024];
+    utStringStream stream(buf, sizeof(buf));
+
+    CHECK_FMT_STATIC("No arguments", "No arguments");
+    CHECK_FMT_STATIC("", "");
+    CHECK_FMT_STATIC("100% done", "%d%% done", 100);
+    CHECK_FMT_STATIC("%12345678%", "%%%d%%", 12345678);
+    CHECK_FMT_STATIC("12345678", "%d", 12345678);
+    CHECK_FMT_STATIC("[0000000000001000 - 0000000000002000] Name\n",
+                     "[%016lx - %016lx] %s\n", 0x1000ul, 0x2000ul, "Name");
+    CHECK_FMT_STATIC("a1b   2c", "a%db%*dc", 1, 4, 2);
+
+    /* Truncated output. */
+    char smallBuf[8];
+    utStringStream smallStream(smallBuf, sizeof(smallBuf));
+    smallStream.Format(OTS_FMT("Value %d tail"), 12345678);
+    UT(smallStream.Get()) == UT_CSTR("Value 1");
+}
+UT_TEST_END
+
+/* Stream with span output support. */
+class utSpanStream : public OTextStream<utSpanStream> {
+public:
+    utSpanStream(size_t limit) : OTextStream<utSpanStream>(this)
+    {
+        _limit = limit;
+        Erase();
+    }
+
+    bool Putc(char c, void *arg UNUSED) {
+        numPutc++;
+        return Write(&c, 1, 0) == 1;
+    }
+
+    size_t Write(const char *buf, size_t len, void *arg UNUSED) {
+        numWrites++;
+        size_t i;
+        for (i = 0; i < len && _curPos < _limit; i++) {
+            _buf[_curPos++] = buf[i];
+        }
+        _buf[_curPos] = 0;
+        return i;
+    }
+
+    char *Get() { return _buf; }
+
+    void Erase() {
+        _curPos = 0;
+        _buf[0] = 0;
+        numPutc = 0;
+        numWrites = 0;
+    }
+
+    size_t numPutc, numWrites;
+private:
+    size_t _limit, _curPos;
+    char _buf[1024];
+};
+
+UT_TEST("Span output")
+{
+    utSpanStream stream(1000);
+    utPrintable p(12345678);
+
+    /* Formatted string is passed to the back-end at once. */
+    size_t size = stream.Format("Value %d in the middle %-12s tail", 12345678, "str");
+    UT(size) == UT(sizeof("Value 12345678 in the middle str          tail") - 1);
+    UT(stream.Get()) == UT_CSTR("Value 12345678 in the middle str          tail");
+    UT(stream.numWrites) == UT(1ul);
+    UT(stream.numPutc) == UT(0ul);
+    stream.Erase();
+
+    stream.Format(OTS_FMT("Value %08x tail"), 0x1234abcd);
+    UT(stream.Get()) == UT_CSTR("Value 1234abcd tail");
+    UT(stream.numWrites) == UT(1ul);
+    stream.Erase();
+
+    /* Output longer than the buffer. */
+    char longStr[300];
+    memset(longStr, 'a', sizeof(longStr) - 1);
+    longStr[sizeof(longStr) - 1] = 0;
+    size = stream.Format("%s%d", longStr, 1);
+    UT(size) == UT(sizeof(longStr));
+    UT(stream.numWrites) == UT(3ul);
+    UT(ut::__ut_strlen(stream.Get())) == UT(sizeof(longStr));
+    UT(stream.Get()[sizeof(longStr) - 1]) == UT('1');
+    stream.Erase();
+
+    /* Raw span is passed as is regardless of its length. */
+    size = stream.WriteSpan(longStr, sizeof(longStr) - 1);
+    UT(size) == UT(sizeof(longStr) - 1);
+    UT(stream.numWrites) == UT(1ul);
+    UT(stream.Get()) == UT_CSTR(longStr);
+    stream.Erase();
+
+    /* Insertion operators output values by spans as well. */
+    stream << OtsOpt(OtsOpt::O_WIDTH, 12L) << 12345678;
+    UT(stream.Get()) == UT_CSTR("    12345678");
+    UT(stream.numPutc) == UT(0ul);
+    stream.Erase();
+    stream.ClearOptions();
+
+    /* User defined classes output is ordered with buffered characters. */
+    stream.Format("Object: %a tail", p);
+    UT(stream.Get()) == UT_CSTR("Object: fmt 'a': 12345678 tail");
+    stream.Erase();
+
+    /* End of stream in the back-end. */
+    utSpanStream smallStream(7);
+    size = smallStream.Format("Value %d tail", 12345678);
+    UT(size) == UT(7ul);
+    UT(smallStream.Get()) == UT_CSTR("Value 1");
+}
+UT_TEST_END
+
+/* Stream which discards all output. */
+class utNullStream : public OTextStream<utNullStream> {
+public:
+    utNullStream() : OTextStream<utNullStream>(this) {}
+
+    bool Putc(char c UNUSED, void *arg UNUSED) { return true; }
+
+    size_t Write(const char *buf UNUSED, size_t len, void *arg UNUSED) {
+        return len;
+    }
+
+    /* Expose conversion engine for testing. */
+    static size_t IntToString(unsigned long value, char *bufEnd,
+                              unsigned long radix, bool upperCase)
+    {
+        return _IntToString(value, bufEnd, radix, upperCase);
+    }
+};
+
+namespace {
+
+/* Previous conversion implementation for reference and benchmarking. */
+size_t
+RefIntToString(unsigned long value, char *buf, unsigned long radix,
+               bool upperCase)
+{
+    size_t numChars = 0;
+    char const digits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+
+    do {
+        char c = digits[value % radix];
+        buf[numChars++] = upperCase ? toupper(c) : c;
+    } while (value /= radix);
+    for (size_t idx = 0; idx < numChars / 2; idx++) {
+        char c = buf[idx];
+        buf[idx] = buf[numChars - 1 - idx];
+        buf[numChars - 1 - idx] = c;
+    }
+    return numChars;
+}
+
+/* Test values: boundaries for each number of digits and pseudo-random ones. */
+unsigned long
+TestValue(size_t idx)
+{
+    if (idx < 64) {
+        return 1ul << idx;
+    }
+    if (idx < 128) {
+        return (1ul << (idx - 64)) - 1;
+    }
+    if (idx < 148) {
+        unsigned long p = 1;
+        for (size_t i = 0; i < idx - 128; i++) {
+            p *= 10;
+        }
+        return p - 1;
+    }
+    unsigned long x = idx * 0x9e3779b97f4a7c15ul;
+    return x >> (idx % 64);
+}
+
+} /* anonymous namespace */
+
+UT_TEST("Integer conversion")
+{
+    static const unsigned long radixes[] = { 2, 3, 8, 10, 16, 32, 36 };
+    char buf[80], refBuf[80];
+
+    for (unsigned long radix: radixes) {
+        for (size_t idx = 0; idx < 2048; idx++) {
+            unsigned long value = TestValue(idx);
+            for (int upperCase = 0; upperCase < 2; upperCase++) {
+                size_t refLen = RefIntToString(value, refBuf, radix, upperCase);
+                size_t len = utNullStream::IntToString(value, &buf[sizeof(buf)],
+                                                       radix, upperCase);
+                UT(len) == UT(refLen);
+                UT(memcmp(&buf[sizeof(buf) - len], refBuf, len)) == UT(0);
+            }
+        }
+    }
+
+    char sbuf[1024];
+    utStringStream stream(sbuf, sizeof(sbuf));
+
+    /* Zero-padded fixed-width hexadecimal numbers. */
+    CHECK_FMT("[0000000000000000]", "[%016lx]", 0ul);
+    CHECK_FMT("[ffffffffffffffff]", "[%016lx]", ~0ul);
+    CHECK_FMT("[00000000DEADBEEF]", "[%016lX]", 0xdeadbeeful);
+    CHECK_FMT("[deadbeef12345678]", "[%08lx]", 0xdeadbeef12345678ul);
+    CHECK_FMT("[0001]", "[%04x]", 1);
+    CHECK_FMT("[0x0001]", "[%#06x]", 1);
+    CHECK_FMT_NOV("[-0001]", "[%05x]", -1);
+    CHECK_FMT("[00000000000000000001]", "[%020lx]", 1ul);
+    CHECK_FMT("[18446744073709551615]", "[%z]", ~0ul);
+    CHECK_FMT("[-9223372036854775807]", "[%ld]", -0x7fffffffffffffffl);
+    CHECK_FMT("[1777777777777777777777]", "[%lo]", ~0ul);
+}
+UT_TEST_END
+
+UT_TEST("Integer conversion benchmark")
+{
+    const size_t numValues = 1024, numRounds = 64;
+    char buf[80];
+    unsigned long values[numValues];
+    size_t result = 0;
+
+    for (size_t i = 0; i < numValues; i++) {
+        values[i] = TestValue(i + 148);
+    }
+
+    static const unsigned long radixes[] = { 10, 16 };
+    for (unsigned long radix: radixes) {
+        u64 start = cpu::rdtsc();
+        for (size_t round = 0; round < numRounds; round++) {
+            for (size_t i = 0; i < numValues; i++) {
+                result += RefIntToString(values[i], buf, radix, false);
+                ASM ("" : : : "memory");
+            }
+        }
+        u64 refCycles = cpu::rdtsc() - start;
+
+        start = cpu::rdtsc();
+        for (size_t round = 0; round < numRounds; round++) {
+            for (size_t i = 0; i < numValues; i++) {
+                result += utNullStream::IntToString(values[i], &buf[sizeof(buf)],
+                                                    radix, false);
+                ASM ("" : : : "memory");
+            }
+        }
+        u64 newCycles = cpu::rdtsc() - start;
+
+        UT_TRACE("Radix %lu: previous %lu, current %lu cycles per value",
+                 radix, refCycles / (numValues * numRounds),
+                 newCycles / (numValues * numRounds));
+    }
+
+    /* Complete formatting path for memory map dump lines. */
+    utNullStream stream;
+    u64 start = cpu::rdtsc();
+    for (size_t round = 0; round < numRounds; round++) {
+        for (size_t i = 0; i < numValues; i++) {
+            result += stream.Format(OTS_FMT("[%016x - %016x] %s\n"),
+                                    values[i], values[i] + 0x1000, "Conventional");
+        }
+    }
+    u64 fmtCycles = cpu::rdtsc() - start;
+    UT_TRACE("Memory map line format: %lu cycles per line (%lu)",
+             fmtCycles / (numValues * numRounds), result);
+}
+UT_TEST_END
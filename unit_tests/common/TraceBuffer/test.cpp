@@ -0,0 +1,260 @@
+/*
+ * /phoenix/unit_tests/common/TraceBuffer/test.cpp
+ *
+ * This file is a part of Phoenix operating system.
+ * Copyright (c) 2011-2012, Artyom Lebedev <artyom.lebedev@gmail.com>
+ * All rights reserved.
+ * See COPYING file for copyright details.
+ */
+
+/** @file test.cpp
+ * Lockless trace records buffer tests.
+ */
+
+#include <phoenix_ut.h>
+
+#include <sys.h>
+
+namespace {
+
+/** Producer thread of the concurrent test. Record identifier is the producer
+ * index, the arguments contain the record number.
+ */
+class Producer {
+public:
+    TraceBuffer *buffer;
+    size_t idx, numRecords;
+    bool done = false;
+
+    static void
+    Run(void *arg)
+    {
+        Producer *p = static_cast<Producer *>(arg);
+        for (size_t i = 0; i < p->numRecords; i++) {
+            u64 args[TraceBuffer::MAX_ARGS] = { i, ~i, i * 3, i * 5 };
+            p->buffer->Put(p->idx, i, p->idx, args, TraceBuffer::MAX_ARGS);
+            /* Let the consumer keep up with the producers most of time. */
+            for (int j = 0; j < 64; j++) {
+                cpu::Pause();
+            }
+        }
+        __atomic_store_n(&p->done, true, __ATOMIC_RELEASE);
+    }
+};
+
+/** Stream which outputs to a fixed size string. */
+class StringStream : public text_stream::OTextStream<StringStream> {
+public:
+    StringStream() : text_stream::OTextStream<StringStream>(this) {
+        Erase();
+    }
+
+    bool Putc(char c, void *arg UNUSED) {
+        if (_curPos >= sizeof(_buf) - 1) {
+            return false;
+        }
+        _buf[_curPos++] = c;
+        _buf[_curPos] = 0;
+        return true;
+    }
+
+    const char *Get() { return _buf; }
+
+    void Erase() {
+        _curPos = 0;
+        _buf[0] = 0;
+    }
+private:
+    size_t _curPos;
+    char _buf[256];
+};
+
+} /* anonymous namespace */
+
+UT_TEST("Put and get")
+{
+    TraceBuffer buffer;
+    TraceBuffer::Record rec;
+
+    UT(buffer.Initialize(0).IsOk()) == UT_FALSE;
+    UT(buffer.Initialize(12).IsOk()) == UT_FALSE;
+    UT(buffer.Initialize(16).IsOk()) == UT_TRUE;
+    UT(buffer.Get(&rec)) == UT_FALSE;
+
+    u64 args[] = { 0x1000, 0x42, 0xffff800000001000ul };
+    buffer.Put(0xdeadbeef, 100, 3, args, 3);
+    buffer.Put(0xcafe, 200, 1, args, 0);
+    UT(buffer.GetNumPut()) == UT(2ul);
+
+    UT(buffer.Get(&rec)) == UT_TRUE;
+    UT(rec.id) == UT(0xdeadbeeful);
+    UT(rec.timestamp) == UT(100ul);
+    UT(rec.cpu) == UT(3);
+    UT(rec.numArgs) == UT(3);
+    for (size_t i = 0; i < 3; i++) {
+        UT(rec.args[i]) == UT(args[i]);
+    }
+
+    UT(buffer.Get(&rec)) == UT_TRUE;
+    UT(rec.id) == UT(0xcafeul);
+    UT(rec.timestamp) == UT(200ul);
+    UT(rec.numArgs) == UT(0);
+    UT(buffer.Get(&rec)) == UT_FALSE;
+    UT(buffer.GetNumOverwritten()) == UT(0ul);
+}
+UT_TEST_END
+
+UT_TEST("Arguments decoding")
+{
+    TraceBuffer buffer;
+    TraceBuffer::Record rec;
+    StringStream stream;
+    UT(buffer.Initialize(16).IsOk()) == UT_TRUE;
+
+    /* Only the stored arguments are passed to the format. */
+    u64 args[] = { 0x1000, 0x3, 0xffff800000001000ul, 42 };
+    buffer.Put(1, 100, 0, args, 0);
+    buffer.Put(1, 101, 0, args, 1);
+    buffer.Put(1, 102, 0, args, 2);
+    buffer.Put(1, 103, 0, args, 3);
+    buffer.Put(1, 104, 0, args, 4);
+
+    UT(buffer.Get(&rec)) == UT_TRUE;
+    rec.FormatArgs(stream, "no arguments");
+    UT(stream.Get()) == UT_CSTR("no arguments");
+    stream.Erase();
+
+    UT(buffer.Get(&rec)) == UT_TRUE;
+    rec.FormatArgs(stream, "pa 0x%016x");
+    UT(stream.Get()) == UT_CSTR("pa 0x0000000000001000");
+    stream.Erase();
+
+    UT(buffer.Get(&rec)) == UT_TRUE;
+    rec.FormatArgs(stream, "pa 0x%016x flags 0x%x");
+    UT(stream.Get()) == UT_CSTR("pa 0x0000000000001000 flags 0x3");
+    stream.Erase();
+
+    UT(buffer.Get(&rec)) == UT_TRUE;
+    size_t size = rec.FormatArgs(stream, "pa 0x%016x flags 0x%x -> va 0x%016x");
+    UT(stream.Get()) ==
+        UT_CSTR("pa 0x0000000000001000 flags 0x3 -> va 0xffff800000001000");
+    UT(size) == UT(ut::__ut_strlen(stream.Get()));
+    stream.Erase();
+
+    UT(buffer.Get(&rec)) == UT_TRUE;
+    rec.FormatArgs(stream, "%x %d %x %d");
+    UT(stream.Get()) == UT_CSTR("1000 3 ffff800000001000 42");
+    stream.Erase();
+}
+UT_TEST_END
+
+UT_TEST("Overwriting")
+{
+    const size_t numSlots = 16;
+    TraceBuffer buffer;
+    TraceBuffer::Record rec;
+    UT(buffer.Initialize(numSlots).IsOk()) == UT_TRUE;
+
+    /* The latest records are kept. */
+    for (size_t i = 0; i < numSlots + 5; i++) {
+        buffer.Put(1, i, 0, &i, 1);
+    }
+    for (size_t i = 5; i < numSlots + 5; i++) {
+        UT(buffer.Get(&rec)) == UT_TRUE;
+        UT(rec.timestamp) == UT(i);
+        UT(rec.args[0]) == UT(i);
+    }
+    UT(buffer.Get(&rec)) == UT_FALSE;
+    UT(buffer.GetNumOverwritten()) == UT(5ul);
+
+    /* Consumed slots are reused without loss. */
+    for (size_t i = 0; i < numSlots; i++) {
+        buffer.Put(2, i, 0, &i, 1);
+    }
+    for (size_t i = 0; i < numSlots; i++) {
+        UT(buffer.Get(&rec)) == UT_TRUE;
+        UT(rec.id) == UT(2ul);
+        UT(rec.timestamp) == UT(i);
+    }
+    UT(buffer.Get(&rec)) == UT_FALSE;
+    UT(buffer.GetNumOverwritten()) == UT(5ul);
+    UT(buffer.GetNumPut()) == UT(2 * numSlots + 5);
+}
+UT_TEST_END
+
+UT_TEST("Concurrent producers")
+{
+    const size_t numProducers = 4, numRecords = 200000;
+
+    TraceBuffer buffer;
+    UT(buffer.Initialize(256).IsOk()) == UT_TRUE;
+    Producer producers[numProducers];
+    void *threads[numProducers];
+    for (size_t i = 0; i < numProducers; i++) {
+        producers[i].buffer = &buffer;
+        producers[i].idx = i;
+        producers[i].numRecords = numRecords;
+        threads[i] = ut::__ut_thread_create(Producer::Run, &producers[i]);
+    }
+
+    /* Consume concurrently. Records of each producer should come in order and
+     * not corrupted.
+     */
+    u64 nextRecord[numProducers];
+    size_t numReceived = 0, numErrors = 0;
+    memset(nextRecord, 0, sizeof(nextRecord));
+    TraceBuffer::Record rec;
+    while (true) {
+        if (!buffer.Get(&rec)) {
+            size_t numDone = 0;
+            for (size_t i = 0; i < numProducers; i++) {
+                numDone += __atomic_load_n(&producers[i].done, __ATOMIC_ACQUIRE);
+            }
+            if (numDone < numProducers) {
+                continue;
+            }
+            /* Records committed before the producers finished. */
+            if (!buffer.Get(&rec)) {
+                break;
+            }
+        }
+        u64 i = rec.timestamp;
+        if (rec.id >= numProducers || rec.cpu != rec.id ||
+            rec.numArgs != TraceBuffer::MAX_ARGS || rec.args[0] != i ||
+            rec.args[1] != ~i || rec.args[2] != i * 3 || rec.args[3] != i * 5 ||
+            i < nextRecord[rec.id]) {
+            numErrors++;
+            continue;
+        }
+        nextRecord[rec.id] = i + 1;
+        numReceived++;
+    }
+
+    for (size_t i = 0; i < numProducers; i++) {
+        ut::__ut_thread_join(threads[i]);
+    }
+    UT(numErrors) == UT(0ul);
+    /* Each record is either received or accounted as overwritten. */
+    UT(buffer.GetNumPut()) == UT(numProducers * numRecords);
+    UT(numReceived + buffer.GetNumOverwritten()) == UT(numProducers * numRecords);
+    UT_TRACE("%lu received, %lu overwritten", numReceived,
+             buffer.GetNumOverwritten());
+}
+UT_TEST_END
+
+UT_TEST("Producer cost benchmark")
+{
+    const size_t numRecords = 1000000;
+    TraceBuffer buffer;
+    UT(buffer.Initialize(1024).IsOk()) == UT_TRUE;
+
+    u64 start = cpu::rdtsc();
+    for (size_t i = 0; i < numRecords; i++) {
+        u64 pa = i * vm::PAGE_SIZE;
+        u64 args[] = { pa, 0x3, 0xffff800000000000ul + pa };
+        buffer.Put(1, cpu::rdtsc(), 0, args, 3);
+    }
+    u64 cycles = cpu::rdtsc() - start;
+    UT_TRACE("%lu cycles per record", cycles / numRecords);
+}
+UT_TEST_END
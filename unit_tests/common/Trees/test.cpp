@@ -116,3 +116,548 @@ UT_TEST("RB tree")
     }
 }
 UT_TEST_END
+
+/** Address space region for augmented tree test. Aggregates are maximal end
+ * address and maximal free gap before a region in the subtree.
+ */
+class TestRegion {
+public:
+    size_t start, end;
+    /** Free space between the previous region and this one. */
+    size_t gap;
+    size_t maxEnd, maxGap;
+    bool inserted = false;
+
+    int Compare(TestRegion &region)
+    {
+        return start < region.start ? -1 : (start > region.start ? 1 : 0);
+    }
+
+    int Compare(size_t &key)
+    {
+        return key < start ? -1 : (key > start ? 1 : 0);
+    }
+
+    void Augment(TestRegion *left, TestRegion *right)
+    {
+        maxEnd = end;
+        maxGap = gap;
+        if (left) {
+            maxEnd = Max(maxEnd, left->maxEnd);
+            maxGap = Max(maxGap, left->maxGap);
+        }
+        if (right) {
+            maxEnd = Max(maxEnd, right->maxEnd);
+            maxGap = Max(maxGap, right->maxGap);
+        }
+    }
+
+    typedef class AugmentedRBTree<TestRegion, &TestRegion::Compare, size_t,
+                                  &TestRegion::Compare, &TestRegion::Augment> Tree;
+
+    Tree::Entry _rbEntry;
+};
+
+namespace {
+
+/** Find the lowest region preceded by a free gap of at least the specified
+ * size.
+ */
+class GapFilter {
+public:
+    size_t size;
+
+    bool MatchSubtree(TestRegion &r) { return r.maxGap >= size; }
+    bool Match(TestRegion &r) { return r.gap >= size; }
+};
+
+/** Find the lowest region overlapping [start, end). */
+class OverlapFilter {
+public:
+    size_t start, end;
+
+    bool MatchSubtree(TestRegion &r) { return r.maxEnd > start; }
+    bool Match(TestRegion &r) { return r.start < end && r.end > start; }
+};
+
+/** Recompute gap of the region at the specified position. */
+void
+UpdateGap(TestRegion::Tree &tree, size_t pos)
+{
+    TestRegion *r = tree.Select(pos);
+    if (!r) {
+        return;
+    }
+    TestRegion *prev = pos ? tree.Select(pos - 1) : 0;
+    r->gap = r->start - (prev ? prev->end : 0);
+    tree.Update(&r->_rbEntry);
+}
+
+} /* anonymous namespace */
+
+UT_TEST("RB tree - augmented tree")
+{
+    const size_t numRegions = 512;
+    const size_t slotSize = 64;
+    TestRegion::Tree tree;
+    TestRegion *regions = new TestRegion[numRegions];
+
+    /* Each region occupies part of its own slot. */
+    for (size_t i = 0; i < numRegions; i++) {
+        TestRegion &r = regions[i];
+        r.start = i * slotSize + (i * 7) % 16;
+        r.end = r.start + 1 + (i * 13) % 40;
+    }
+
+    auto verify = [&]() {
+        UT(tree.Validate()) == UT(true);
+        /* Collect inserted regions in ascending order. */
+        size_t numInserted = 0;
+        for (size_t i = 0; i < numRegions; i++) {
+            TestRegion &r = regions[i];
+            if (r.inserted) {
+                UT(tree.Select(numInserted)) == UT(&r);
+                UT(tree.Rank(&r._rbEntry)) == UT(numInserted);
+                numInserted++;
+            }
+        }
+        UT(tree.GetSize()) == UT(numInserted);
+        UT(tree.Select(numInserted)) == UT_NULL;
+
+        for (size_t size = 1; size < slotSize * 4; size += 7) {
+            GapFilter gf;
+            gf.size = size;
+            TestRegion *expected = 0;
+            size_t prevEnd = 0;
+            for (size_t i = 0; i < numRegions; i++) {
+                TestRegion &r = regions[i];
+                if (!r.inserted) {
+                    continue;
+                }
+                if (r.start - prevEnd >= size) {
+                    expected = &r;
+                    break;
+                }
+                prevEnd = r.end;
+            }
+            UT(tree.FindFirst(gf)) == UT(expected);
+        }
+
+        for (size_t start = 0; start < numRegions * slotSize; start += 29) {
+            OverlapFilter of;
+            of.start = start;
+            of.end = start + 1 + start % 100;
+            TestRegion *expected = 0;
+            for (size_t i = 0; i < numRegions; i++) {
+                TestRegion &r = regions[i];
+                if (r.inserted && of.Match(r)) {
+                    expected = &r;
+                    break;
+                }
+            }
+            UT(tree.FindFirst(of)) == UT(expected);
+        }
+    };
+
+    UT_TRACE("Verifying insertions...");
+    for (size_t i = 0; i < numRegions; i++) {
+        size_t idx = (i * 211) % numRegions;
+        TestRegion &r = regions[idx];
+        r.gap = 0;
+        UT(tree.Insert(&r, &r._rbEntry)) == UT(&r);
+        r.inserted = true;
+        size_t pos = tree.Rank(&r._rbEntry);
+        UpdateGap(tree, pos);
+        UpdateGap(tree, pos + 1);
+        if (i % 64 == 0) {
+            verify();
+        }
+    }
+    verify();
+
+    UT_TRACE("Verifying deletions...");
+    for (size_t i = 0; i < numRegions; i++) {
+        size_t idx = (i * 97) % numRegions;
+        TestRegion &r = regions[idx];
+        size_t pos = tree.Rank(&r._rbEntry);
+        UT(tree.Delete(r.start)) == UT(&r);
+        r.inserted = false;
+        UpdateGap(tree, pos);
+        if (i % 64 == 0) {
+            verify();
+        }
+    }
+    verify();
+    UT(tree.GetSize()) == UT(0ul);
+
+    delete[] regions;
+}
+UT_TEST_END
+
+UT_TEST("RB tree - bulk construction and ordered iteration")
+{
+    const size_t maxItems = 300;
+    TestItem *items = new TestItem[maxItems];
+    TestItem **sorted = new TestItem *[maxItems];
+
+    /* Only even keys are present so that bounds lookups of odd keys are
+     * tested as well.
+     */
+    for (size_t i = 0; i < maxItems; i++) {
+        items[i].idx = i * 2;
+        sorted[i] = &items[i];
+    }
+
+    for (size_t numItems = 0; numItems <= maxItems; numItems++) {
+        TestItem::TestTree tree;
+        tree.BuildFromSorted(sorted, numItems, &TestItem::_rbEntry);
+        UT(tree.Validate()) == UT(true);
+        UT(tree.GetSize()) == UT(numItems);
+
+        /* Ordered iteration in both directions. */
+        size_t n = 0, from = 0, to = numItems * 2;
+        for (TestItem &item: tree.GetRange(from, to)) {
+            UT(&item) == UT(&items[n]);
+            n++;
+        }
+        UT(n) == UT(numItems);
+        if (numItems) {
+            n = numItems;
+            for (auto it = tree.Last(); it != TestItem::TestTree::OrderedIterator(); --it) {
+                n--;
+                UT(&*it) == UT(&items[n]);
+            }
+            UT(n) == UT(0ul);
+        }
+
+        for (size_t key = 0; key <= numItems * 2 + 1; key++) {
+            size_t lower = (key + 1) / 2, upper = key / 2 + 1;
+            UT(tree.LowerBound(key).Get()) ==
+                UT(lower < numItems ? &items[lower] : 0);
+            UT(tree.UpperBound(key).Get()) ==
+                UT(upper < numItems ? &items[upper] : 0);
+        }
+
+        /* The built tree should be fully functional. */
+        if (numItems) {
+            size_t key = (numItems - 1) * 2;
+            UT(tree.Delete(key)) != UT_NULL;
+            TestItem extra(numItems * 2 + 1);
+            UT(tree.Insert(&extra, &extra._rbEntry)) == UT(&extra);
+            UT(tree.Validate()) == UT(true);
+            tree.Delete(&extra._rbEntry);
+        }
+
+        tree.Clear();
+        UT(tree.GetSize()) == UT(0ul);
+        UT(tree.Lowest()) == UT_NULL;
+        /* Entries can be reused after clearing. */
+        for (size_t i = 0; i < numItems; i++) {
+            UT(tree.Insert(&items[i], &items[i]._rbEntry)) == UT(&items[i]);
+        }
+        UT(tree.Validate()) == UT(true);
+        tree.Clear();
+    }
+
+    /* Augmented tree aggregates are computed during the construction. */
+    TestRegion *regions = new TestRegion[maxItems];
+    TestRegion **sortedRegions = new TestRegion *[maxItems];
+    for (size_t i = 0; i < maxItems; i++) {
+        regions[i].start = i * 16;
+        regions[i].end = regions[i].start + 8;
+        regions[i].gap = i ? 8 : 0;
+        sortedRegions[i] = &regions[i];
+    }
+    regions[maxItems / 3].gap = 100;
+    TestRegion::Tree regionTree;
+    regionTree.BuildFromSorted(sortedRegions, maxItems, &TestRegion::_rbEntry);
+    UT(regionTree.Validate()) == UT(true);
+    UT(regionTree.Select(maxItems / 2)) == UT(&regions[maxItems / 2]);
+    GapFilter gf;
+    gf.size = 50;
+    UT(regionTree.FindFirst(gf)) == UT(&regions[maxItems / 3]);
+    regionTree.Clear();
+
+    delete[] sortedRegions;
+    delete[] regions;
+    delete[] sorted;
+    delete[] items;
+}
+UT_TEST_END
+
+UT_TEST("RB tree - lookup benchmark")
+{
+    const size_t numItems = 1 << 16;
+    const size_t numLookups = 1 << 22;
+    TestItem::TestTree tree;
+    TestItem *items = new TestItem[numItems];
+
+    /* Insert in pseudo-random order so that the tree shape is not
+     * degenerated by sequential insertions.
+     */
+    u64 start = cpu::rdtsc();
+    for (size_t i = 0; i < numItems; i++) {
+        size_t idx = (i * 40503) % numItems;
+        items[idx].idx = idx;
+        UT(tree.Insert(&items[idx], &items[idx]._rbEntry)) == UT(&items[idx]);
+    }
+    u64 cycles = cpu::rdtsc() - start;
+    UT(tree.Validate()) == UT(true);
+    UT_TRACE("Insertion: %lu cycles per node", cycles / numItems);
+
+    TestItem::TestTree builtTree;
+    TestItem *builtItems = new TestItem[numItems];
+    TestItem **sorted = new TestItem *[numItems];
+    for (size_t i = 0; i < numItems; i++) {
+        builtItems[i].idx = i;
+        sorted[i] = &builtItems[i];
+    }
+    start = cpu::rdtsc();
+    builtTree.BuildFromSorted(sorted, numItems, &TestItem::_rbEntry);
+    cycles = cpu::rdtsc() - start;
+    UT(builtTree.Validate()) == UT(true);
+    UT_TRACE("Bulk construction: %lu cycles per node", cycles / numItems);
+
+    size_t numFound = 0;
+    u32 seed = 1;
+    start = cpu::rdtsc();
+    for (size_t i = 0; i < numLookups; i++) {
+        seed = seed * 1103515245 + 12345;
+        size_t key = (seed >> 8) % (numItems * 2);
+        if (tree.Lookup(key)) {
+            numFound++;
+        }
+    }
+    cycles = cpu::rdtsc() - start;
+    UT(numFound) != UT(0ul);
+    UT_TRACE("Lookup: %lu cycles per lookup (%lu nodes)",
+             cycles / numLookups, numItems);
+
+    size_t numVisited = 0, from = 0, to = numItems;
+    start = cpu::rdtsc();
+    for (TestItem &item: tree.GetRange(from, to)) {
+        (void)item;
+        numVisited++;
+    }
+    cycles = cpu::rdtsc() - start;
+    UT(numVisited) == UT(numItems);
+    UT_TRACE("Ordered iteration: %lu cycles per step", cycles / numItems);
+
+    delete[] sorted;
+    delete[] builtItems;
+    delete[] items;
+}
+UT_TEST_END
+
+namespace {
+
+/** Item of the concurrent tree test. */
+class SharedItem {
+public:
+    size_t key;
+    /** Set when the item is reclaimed, cleared before it is inserted. */
+    volatile bool reclaimed = true;
+    /** The item is in the tree, used by the writer only. */
+    bool inTree = false;
+
+    int Compare(SharedItem &item)
+    {
+        return key < item.key ? -1 : (key > item.key ? 1 : 0);
+    }
+
+    int Compare(size_t &key)
+    {
+        return key < this->key ? -1 : (key > this->key ? 1 : 0);
+    }
+
+    typedef class ConcurrentRBTree<SharedItem, &SharedItem::Compare, size_t,
+                                   &SharedItem::Compare> Tree;
+    typedef class RBTree<SharedItem, &SharedItem::Compare, size_t,
+                         &SharedItem::Compare> PlainTree;
+
+    Tree::Entry _rbEntry;
+
+    static void
+    Reclaim(SharedItem *item, void *)
+    {
+        item->reclaimed = true;
+    }
+};
+
+/** Reader thread of the concurrent tree test. */
+class TreeReader {
+public:
+    SharedItem::Tree *tree;
+    /** Use plain lookups under this lock if not NULL. */
+    RWSpinLock *lock = nullptr;
+    size_t cpu, numItems, numLookups;
+    volatile bool *stop;
+    size_t numFound = 0, numErrors = 0;
+    u64 cycles = 0;
+
+    static void
+    Run(void *arg)
+    {
+        TreeReader *r = static_cast<TreeReader *>(arg);
+        u32 seed = r->cpu + 1;
+        u64 start = cpu::rdtsc();
+        for (size_t i = 0; i < r->numLookups || (r->stop && !*r->stop); i++) {
+            seed = seed * 1103515245 + 12345;
+            size_t key = (seed >> 8) % r->numItems;
+            SharedItem *item;
+            if (r->lock) {
+                r->lock->ReadLock();
+                item = static_cast<SharedItem::PlainTree *>(r->tree)->Lookup(key);
+            } else {
+                r->tree->ReadBegin(r->cpu);
+                item = r->tree->Lookup(key);
+            }
+            if (item) {
+                if (item->key != key || item->reclaimed) {
+                    r->numErrors++;
+                }
+                r->numFound++;
+            } else if (key % 2 == 0) {
+                /* Even keys are never deleted. */
+                r->numErrors++;
+            }
+            if (r->lock) {
+                r->lock->ReadUnlock();
+            } else {
+                r->tree->ReadEnd(r->cpu);
+            }
+        }
+        r->cycles = cpu::rdtsc() - start;
+    }
+};
+
+} /* anonymous namespace */
+
+UT_TEST("RB tree - concurrent lookups")
+{
+    const size_t numItems = 4096;
+    const size_t numReaders = 4;
+    const size_t numUpdates = 20000;
+    SharedItem *items = new SharedItem[numItems];
+    SharedItem::Tree tree(SharedItem::Reclaim);
+    UT(tree.Initialize(numReaders).IsOk()) == UT_TRUE;
+
+    for (size_t i = 0; i < numItems; i++) {
+        items[i].key = i;
+        items[i].reclaimed = false;
+        items[i].inTree = true;
+        UT(tree.Insert(&items[i], &items[i]._rbEntry)) == UT(&items[i]);
+    }
+
+    volatile bool stop = false;
+    TreeReader readers[numReaders];
+    void *threads[numReaders];
+    for (size_t i = 0; i < numReaders; i++) {
+        readers[i].tree = &tree;
+        readers[i].cpu = i;
+        readers[i].numItems = numItems;
+        readers[i].numLookups = 0;
+        readers[i].stop = &stop;
+        threads[i] = ut::__ut_thread_create(TreeReader::Run, &readers[i]);
+    }
+
+    /* Odd keys are deleted and inserted back while readers are running. An
+     * item is reinserted only after it was reclaimed. Reclamation is delayed
+     * while readers are preempted inside read-side sections, so run until
+     * enough items have passed the whole cycle.
+     */
+    u32 seed = 1;
+    size_t numReinserted = 0;
+    for (size_t i = 0; numReinserted < numUpdates / 8 && i < numUpdates * 10000; i++) {
+        seed = seed * 1103515245 + 12345;
+        size_t key = ((seed >> 8) % (numItems / 2)) * 2 + 1;
+        SharedItem &item = items[key];
+        if (item.inTree) {
+            UT(tree.Delete(key)) == UT(&item);
+            item.inTree = false;
+        } else if (item.reclaimed) {
+            item.reclaimed = false;
+            UT(tree.Insert(&item, &item._rbEntry)) == UT(&item);
+            item.inTree = true;
+            numReinserted++;
+        }
+        if (i % 1024 == 0) {
+            tree.Reclaim();
+        }
+    }
+    stop = true;
+    size_t numFound = 0;
+    for (size_t i = 0; i < numReaders; i++) {
+        ut::__ut_thread_join(threads[i]);
+        UT(readers[i].numErrors) == UT(0ul);
+        numFound += readers[i].numFound;
+    }
+    UT(numFound) != UT(0ul);
+    UT(numReinserted) != UT(0ul);
+    UT(tree.Validate()) == UT(true);
+
+    /* All deleted items are reclaimed when there are no readers. */
+    tree.Reclaim();
+    for (size_t i = 0; i < numItems; i++) {
+        UT(items[i].reclaimed) == UT(!items[i].inTree);
+    }
+
+    tree.Clear();
+    for (size_t i = 0; i < numItems; i++) {
+        UT(items[i].reclaimed) == UT_TRUE;
+    }
+    delete[] items;
+}
+UT_TEST_END
+
+UT_TEST("RB tree - concurrent lookups scaling")
+{
+    const size_t numItems = 1 << 16;
+    const size_t numLookups = 1 << 20;
+    const size_t maxReaders = 8;
+    SharedItem *items = new SharedItem[numItems];
+    SharedItem::Tree tree;
+    UT(tree.Initialize(maxReaders).IsOk()) == UT_TRUE;
+    for (size_t i = 0; i < numItems; i++) {
+        items[i].key = i * 2;
+        items[i].reclaimed = false;
+    }
+    SharedItem **sorted = new SharedItem *[numItems];
+    for (size_t i = 0; i < numItems; i++) {
+        sorted[i] = &items[i];
+    }
+    tree.BuildFromSorted(sorted, numItems, &SharedItem::_rbEntry);
+
+    RWSpinLock lock;
+    for (size_t numReaders = 1; numReaders <= maxReaders; numReaders *= 2) {
+        u64 cycles[2];
+        for (int locked = 0; locked < 2; locked++) {
+            TreeReader readers[numReaders];
+            void *threads[numReaders];
+            u64 start = cpu::rdtsc();
+            for (size_t i = 0; i < numReaders; i++) {
+                readers[i].tree = &tree;
+                readers[i].lock = locked ? &lock : nullptr;
+                readers[i].cpu = i;
+                readers[i].numItems = numItems * 2;
+                readers[i].numLookups = numLookups;
+                readers[i].stop = nullptr;
+                threads[i] = ut::__ut_thread_create(TreeReader::Run, &readers[i]);
+            }
+            for (size_t i = 0; i < numReaders; i++) {
+                ut::__ut_thread_join(threads[i]);
+                UT(readers[i].numErrors) == UT(0ul);
+            }
+            cycles[locked] = cpu::rdtsc() - start;
+        }
+        UT_TRACE("%lu readers: lockless %lu lookups/Mcycle, "
+                 "read-locked %lu lookups/Mcycle", numReaders,
+                 numReaders * numLookups * 1000000 / cycles[0],
+                 numReaders * numLookups * 1000000 / cycles[1]);
+    }
+
+    tree.Clear();
+    delete[] sorted;
+    delete[] items;
+}
+UT_TEST_END
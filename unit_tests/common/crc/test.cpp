@@ -0,0 +1,190 @@
+/*
+ * /phoenix/unit_tests/common/crc/test.cpp
+ *
+ * This file is a part of Phoenix operating system.
+ * Copyright (c) 2011-2012, Artyom Lebedev <artyom.lebedev@gmail.com>
+ * All rights reserved.
+ * See COPYING file for copyright details.
+ */
+
+/** @file test.cpp
+ * Unit tests for CRC algorithms.
+ */
+
+#include <phoenix_ut.h>
+
+#include <sys.h>
+
+namespace {
+
+/** Reference bit-wise implementation. */
+u32
+CrcBitwise(u32 polynomial, const u8 *data, size_t size, u32 crc = Crc32::INITIAL)
+{
+    for (size_t i = 0; i < size; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < NBBY; bit++) {
+            crc = crc & 1 ? (crc >> 1) ^ polynomial : crc >> 1;
+        }
+    }
+    return crc;
+}
+
+u8 testData[4096 + 64];
+
+void
+FillData()
+{
+    u32 x = 0x12345678;
+    for (size_t i = 0; i < sizeof(testData); i++) {
+        x = x * 1103515245 + 12345;
+        testData[i] = x >> 16;
+    }
+}
+
+} /* anonymous namespace */
+
+UT_TEST("Reference values")
+{
+    static const char check[] = "123456789";
+    Crc32 *ieee = NEW Crc32(), *ieeeTables = NEW Crc32(Crc32::POLY_IEEE, false),
+          *c = NEW Crc32(Crc32::POLY_CASTAGNOLI),
+          *cTables = NEW Crc32(Crc32::POLY_CASTAGNOLI, false);
+
+    UT(ieee->Calculate(check, 9) ^ 0xffffffff) == UT(0xcbf43926u);
+    UT(ieeeTables->Calculate(check, 9) ^ 0xffffffff) == UT(0xcbf43926u);
+    UT(c->Calculate(check, 9) ^ 0xffffffff) == UT(0xe3069283u);
+    UT(cTables->Calculate(check, 9) ^ 0xffffffff) == UT(0xe3069283u);
+    UT(ieee->Calculate(check, 0)) == UT(static_cast<u32>(Crc32::INITIAL));
+
+    DELETE ieee;
+    DELETE ieeeTables;
+    DELETE c;
+    DELETE cTables;
+}
+UT_TEST_END
+
+UT_TEST("Implementations consistency")
+{
+    FillData();
+    static const u32 polys[] = { Crc32::POLY_IEEE, Crc32::POLY_CASTAGNOLI,
+                                 0xeb31d82e };
+    for (u32 poly: polys) {
+        Crc32 *hw = NEW Crc32(poly), *tables = NEW Crc32(poly, false);
+        for (size_t offset = 0; offset < 16; offset += 3) {
+            for (size_t size = 0; size <= 600; size++) {
+                u32 expected = CrcBitwise(poly, &testData[offset], size);
+                UT(tables->Calculate(&testData[offset], size)) == UT(expected);
+                UT(hw->Calculate(&testData[offset], size)) == UT(expected);
+            }
+            u32 expected = CrcBitwise(poly, &testData[offset], 4096);
+            UT(tables->Calculate(&testData[offset], 4096)) == UT(expected);
+            UT(hw->Calculate(&testData[offset], 4096)) == UT(expected);
+        }
+        /* Incremental calculation. */
+        u32 expected = hw->Calculate(testData, 1000);
+        for (size_t split = 0; split <= 1000; split += 37) {
+            u32 crc = hw->Calculate(testData, split);
+            UT(hw->Calculate(&testData[split], 1000 - split, crc)) == UT(expected);
+        }
+        DELETE hw;
+        DELETE tables;
+    }
+}
+UT_TEST_END
+
+UT_TEST("Combine")
+{
+    FillData();
+    static const u32 polys[] = { Crc32::POLY_IEEE, Crc32::POLY_CASTAGNOLI };
+    for (u32 poly: polys) {
+        Crc32 *crc = NEW Crc32(poly);
+        for (size_t size = 0; size <= 4096; size += size < 100 ? 1 : 333) {
+            u32 expected = crc->Calculate(testData, size);
+            for (size_t split = 0; split <= size; split += split < 20 ? 1 : 97) {
+                u32 crcA = crc->Calculate(testData, split);
+                u32 crcB = crc->Calculate(&testData[split], size - split);
+                UT(crc->Combine(crcA, crcB, size - split)) == UT(expected);
+            }
+        }
+        DELETE crc;
+    }
+}
+UT_TEST_END
+
+UT_TEST("Combine long buffers")
+{
+    FillData();
+    static const u32 polys[] = { Crc32::POLY_IEEE, Crc32::POLY_CASTAGNOLI };
+    const int chunkOrder = 28;
+    const size_t chunkSize = static_cast<size_t>(1) << chunkOrder;
+    for (u32 poly: polys) {
+        Crc32 *crc = NEW Crc32(poly);
+        /* CRC of the chunk of zero bytes, built by doubling. */
+        const u8 zero = 0;
+        u32 crcChunk = crc->Calculate(&zero, 1);
+        for (int order = 0; order < chunkOrder; order++) {
+            crcChunk = crc->Combine(crcChunk, crcChunk,
+                                    static_cast<size_t>(1) << order);
+        }
+
+        u32 crcA = crc->Calculate(testData, 100);
+        /* Longer zero buffers should give the same result as the chained
+         * combining of the chunks.
+         */
+        u32 crcB = crcChunk, expected = crc->Combine(crcA, crcChunk, chunkSize);
+        for (size_t numChunks = 2; numChunks <= 40; numChunks++) {
+            crcB = crc->Combine(crcB, crcChunk, chunkSize);
+            expected = crc->Combine(expected, crcChunk, chunkSize);
+            UT(crc->Combine(crcA, crcB, numChunks * chunkSize)) == UT(expected);
+        }
+        DELETE crc;
+    }
+}
+UT_TEST_END
+
+UT_TEST("Benchmark")
+{
+    FillData();
+    Crc32 *tables = NEW Crc32(Crc32::POLY_IEEE, false),
+          *ieee = NEW Crc32(Crc32::POLY_IEEE),
+          *c = NEW Crc32(Crc32::POLY_CASTAGNOLI);
+    const size_t size = 4096, numRounds = 256;
+    u32 result = 0;
+
+    u64 start = cpu::rdtsc();
+    for (size_t i = 0; i < numRounds / 16; i++) {
+        result ^= CrcBitwise(Crc32::POLY_IEEE, testData, size);
+    }
+    u64 bitwiseCycles = (cpu::rdtsc() - start) * 16;
+
+    start = cpu::rdtsc();
+    for (size_t i = 0; i < numRounds; i++) {
+        result ^= tables->Calculate(testData, size);
+    }
+    u64 tablesCycles = cpu::rdtsc() - start;
+
+    start = cpu::rdtsc();
+    for (size_t i = 0; i < numRounds; i++) {
+        result ^= ieee->Calculate(testData, size);
+    }
+    u64 ieeeCycles = cpu::rdtsc() - start;
+
+    start = cpu::rdtsc();
+    for (size_t i = 0; i < numRounds; i++) {
+        result ^= c->Calculate(testData, size);
+    }
+    u64 cCycles = cpu::rdtsc() - start;
+
+    UT_TRACE("%lu bytes input: bit-wise %lu, slicing-by-16 %lu, CRC32 %lu, "
+             "CRC32C %lu bytes per kcycle (%08x)", size,
+             size * numRounds * 1000 / Max<u64>(bitwiseCycles, 1),
+             size * numRounds * 1000 / Max<u64>(tablesCycles, 1),
+             size * numRounds * 1000 / Max<u64>(ieeeCycles, 1),
+             size * numRounds * 1000 / Max<u64>(cCycles, 1), result);
+
+    DELETE tables;
+    DELETE ieee;
+    DELETE c;
+}
+UT_TEST_END
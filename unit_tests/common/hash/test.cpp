@@ -8,7 +8,7 @@
  */
 
 /** @file test.cpp
- * Unit tests for Phoenix lookup hash algorithm.
+ * Unit tests for Phoenix lookup hash algorithms.
  */
 
 #include <phoenix_ut.h>
@@ -53,3 +53,162 @@ UT_TEST("Hash class")
     UT(h2.Get64()) == UT(h1.Get64());
 }
 UT_TEST_END
+
+UT_TEST("FastHash class")
+{
+    /* Reference xxHash64 values. */
+    UT(FastHash::Calculate("", 0)) == UT(0xef46db3751d8e999ul);
+    UT(FastHash::Calculate("a", 1)) == UT(0xd24ec4f1a98c6e5bul);
+    UT(FastHash::Calculate("abc", 3)) == UT(0x44bc2cf5ad770999ul);
+    static const char ref[] = "Nobody inspects the spammish repetition";
+    UT(FastHash::Calculate(ref, sizeof(ref) - 1)) == UT(0xfbcea83c8a378bf1ul);
+
+    u8 data[300];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = i * 7 + 3;
+    }
+    UT(FastHash::Calculate(data, 64)) != UT(FastHash::Calculate(data, 65));
+    UT(FastHash::Calculate(data, 64, 1)) != UT(FastHash::Calculate(data, 64));
+
+    /* Incremental calculation gives the same result for any split. */
+    for (size_t size = 0; size <= 130; size++) {
+        u64 expected = FastHash::Calculate(data, size, 5);
+        for (size_t split = 0; split <= size; split++) {
+            FastHash h(5);
+            h.Feed(data, split);
+            h.Feed(&data[split], size - split);
+            UT(h.GetLength()) == UT(size);
+            UT(h.Get64()) == UT(expected);
+        }
+    }
+    FastHash h;
+    for (size_t i = 0; i < sizeof(data); i++) {
+        h.Feed(&data[i], 1);
+        UT(h.Get64()) == UT(FastHash::Calculate(data, i + 1));
+    }
+    UT(static_cast<u32>(h)) == UT(static_cast<u32>(h.Get64()));
+    h.Reset();
+    UT(h.Get64()) == UT(FastHash::Calculate(data, 0));
+}
+UT_TEST_END
+
+namespace {
+
+u64
+RandomWord(u64 &state)
+{
+    state = state * 6364136223846793005ul + 1442695040888963407ul;
+    return state ^ (state >> 29);
+}
+
+/** Check avalanche - each input bit flip should change each output bit with
+ * probability close to 0.5.
+ */
+void
+CheckAvalanche(size_t size, size_t numSamples)
+{
+    u8 data[64];
+    size_t flips[64][64];
+    memset(flips, 0, sizeof(flips));
+    u64 state = size;
+    for (size_t sample = 0; sample < numSamples; sample++) {
+        for (size_t i = 0; i < size; i += sizeof(u64)) {
+            u64 word = RandomWord(state);
+            memcpy(&data[i], &word, sizeof(word));
+        }
+        u64 h = FastHash::Calculate(data, size);
+        for (size_t bit = 0; bit < size * NBBY && bit < 64; bit++) {
+            data[bit / NBBY] ^= 1 << (bit % NBBY);
+            u64 diff = h ^ FastHash::Calculate(data, size);
+            data[bit / NBBY] ^= 1 << (bit % NBBY);
+            for (size_t outBit = 0; outBit < 64; outBit++) {
+                flips[bit][outBit] += (diff >> outBit) & 1;
+            }
+        }
+    }
+    size_t minFlips = numSamples, maxFlips = 0;
+    for (size_t bit = 0; bit < size * NBBY && bit < 64; bit++) {
+        for (size_t outBit = 0; outBit < 64; outBit++) {
+            minFlips = Min(minFlips, flips[bit][outBit]);
+            maxFlips = Max(maxFlips, flips[bit][outBit]);
+        }
+    }
+    UT_TRACE("Avalanche for %lu bytes input: flip probability %lu..%lu%%", size,
+             minFlips * 100 / numSamples, maxFlips * 100 / numSamples);
+    UT(minFlips * 100 / numSamples) >= UT(45ul);
+    UT(maxFlips * 100 / numSamples) <= UT(55ul);
+}
+
+} /* anonymous namespace */
+
+UT_TEST("FastHash quality")
+{
+    CheckAvalanche(8, 4000);
+    CheckAvalanche(16, 4000);
+    CheckAvalanche(64, 4000);
+
+    /* Sequential keys should be distributed evenly over buckets selected by
+     * either low or high bits of the hash.
+     */
+    const size_t numBuckets = 1 << 12, numKeys = numBuckets * 64;
+    u32 *lowBuckets = new u32[numBuckets];
+    u32 *highBuckets = new u32[numBuckets];
+    memset(lowBuckets, 0, numBuckets * sizeof(u32));
+    memset(highBuckets, 0, numBuckets * sizeof(u32));
+    for (u64 key = 0; key < numKeys; key++) {
+        u64 h = FastHash::Calculate(&key, sizeof(key));
+        lowBuckets[h % numBuckets]++;
+        highBuckets[h >> 52]++;
+    }
+    u32 minLow = numKeys, maxLow = 0, minHigh = numKeys, maxHigh = 0;
+    for (size_t i = 0; i < numBuckets; i++) {
+        minLow = Min(minLow, lowBuckets[i]);
+        maxLow = Max(maxLow, lowBuckets[i]);
+        minHigh = Min(minHigh, highBuckets[i]);
+        maxHigh = Max(maxHigh, highBuckets[i]);
+    }
+    UT_TRACE("Buckets load for sequential keys (64 expected): low bits %u..%u, "
+             "high bits %u..%u", minLow, maxLow, minHigh, maxHigh);
+    /* About six standard deviations. */
+    UT(minLow) >= UT(16u);
+    UT(maxLow) <= UT(112u);
+    UT(minHigh) >= UT(16u);
+    UT(maxHigh) <= UT(112u);
+    delete[] lowBuckets;
+    delete[] highBuckets;
+}
+UT_TEST_END
+
+UT_TEST("Hash throughput")
+{
+    const size_t bufSize = 1 << 16;
+    u8 *buf = new u8[bufSize];
+    for (size_t i = 0; i < bufSize; i++) {
+        buf[i] = i * 13;
+    }
+    static const size_t sizes[] = { 8, 16, 32, 64, 256, 1024, 4096, bufSize };
+    for (size_t size: sizes) {
+        /* About 16MB of input for each size. */
+        size_t numIterations = (1 << 24) / size;
+        u64 sum = 0;
+        u64 start = cpu::rdtsc();
+        for (size_t i = 0; i < numIterations; i++) {
+            Hash h;
+            h.Feed(&buf[(i * 8) % (bufSize - size + 1)], size);
+            sum += h.Get64();
+        }
+        u64 lookup3Cycles = cpu::rdtsc() - start;
+        start = cpu::rdtsc();
+        for (size_t i = 0; i < numIterations; i++) {
+            sum += FastHash::Calculate(&buf[(i * 8) % (bufSize - size + 1)],
+                                       size);
+        }
+        u64 fastCycles = cpu::rdtsc() - start;
+        UT(sum) != UT(0ul);
+        UT_TRACE("%lu bytes input: Hash %lu, FastHash %lu bytes per kcycle",
+                 size, numIterations * size * 1000 / lookup3Cycles,
+                 numIterations * size * 1000 / fastCycles);
+    }
+    delete[] buf;
+}
+UT_TEST_END
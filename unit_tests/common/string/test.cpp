@@ -0,0 +1,216 @@
+/*
+ * /phoenix/unit_tests/common/string/test.cpp
+ *
+ * This file is a part of Phoenix operating system.
+ * Copyright (c) 2011-2012, Artyom Lebedev <artyom.lebedev@gmail.com>
+ * All rights reserved.
+ * See COPYING file for copyright details.
+ */
+
+/** @file test.cpp
+ * Unit tests for memory and string primitives.
+ */
+
+#include <phoenix_ut.h>
+
+#include <sys.h>
+#include <md_string.h>
+
+namespace {
+
+const size_t BUF_SIZE = 16384;
+
+u8 srcBuf[BUF_SIZE + 128], dstBuf[BUF_SIZE + 128], refBuf[BUF_SIZE + 128];
+
+void
+FillPattern(u8 *buf, size_t size, u32 seed)
+{
+    for (size_t i = 0; i < size; i++) {
+        seed = seed * 1103515245 + 12345;
+        /* Avoid zero bytes for strlen tests. */
+        buf[i] = (seed >> 16) | 1;
+    }
+}
+
+/* Sizes to check, all the small ones and around the thresholds. */
+const size_t testSizes[] = {
+    0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 47, 48, 63, 64, 65,
+    95, 96, 127, 128, 129, 255, 256, 257, 1000, 2047, 2048, 2049, 4095, 4096,
+    4097, 10000
+};
+
+void
+CheckPrimitives()
+{
+    for (size_t size: testSizes) {
+        for (size_t dstOff = 0; dstOff < 40; dstOff += 13) {
+            for (size_t srcOff = 0; srcOff < 40; srcOff += 7) {
+                FillPattern(srcBuf, sizeof(srcBuf), size + srcOff);
+                FillPattern(dstBuf, sizeof(dstBuf), dstOff);
+                memcpy(refBuf, dstBuf, sizeof(dstBuf));
+                for (size_t i = 0; i < size; i++) {
+                    refBuf[dstOff + i] = srcBuf[srcOff + i];
+                }
+                UT(memcpy(&dstBuf[dstOff], &srcBuf[srcOff], size)) ==
+                    UT(static_cast<void *>(&dstBuf[dstOff]));
+                /* Check memcmp by byte-wise comparison to detect errors in
+                 * both.
+                 */
+                bool equal = true;
+                for (size_t i = 0; i < sizeof(dstBuf); i++) {
+                    if (dstBuf[i] != refBuf[i]) {
+                        equal = false;
+                        break;
+                    }
+                }
+                UT(equal) == UT_TRUE;
+                UT(memcmp(dstBuf, refBuf, sizeof(dstBuf))) == UT(0);
+            }
+
+            /* memset */
+            FillPattern(dstBuf, sizeof(dstBuf), size);
+            memcpy(refBuf, dstBuf, sizeof(dstBuf));
+            for (size_t i = 0; i < size; i++) {
+                refBuf[dstOff + i] = 0x5a;
+            }
+            UT(memset(&dstBuf[dstOff], 0x5a, size)) ==
+                UT(static_cast<void *>(&dstBuf[dstOff]));
+            UT(memcmp(dstBuf, refBuf, sizeof(dstBuf))) == UT(0);
+
+            /* memmove in both directions with various distances. */
+            for (size_t dist = 1; dist < 80; dist += dist < 20 ? 1 : 17) {
+                FillPattern(dstBuf, sizeof(dstBuf), size + dist);
+                memcpy(refBuf, dstBuf, sizeof(dstBuf));
+                for (size_t i = 0; i < size; i++) {
+                    refBuf[dstOff + i] = dstBuf[dstOff + dist + i];
+                }
+                memmove(&dstBuf[dstOff], &dstBuf[dstOff + dist], size);
+                UT(memcmp(dstBuf, refBuf, sizeof(dstBuf))) == UT(0);
+
+                FillPattern(dstBuf, sizeof(dstBuf), size + dist);
+                memcpy(refBuf, dstBuf, sizeof(dstBuf));
+                for (size_t i = size; i > 0; i--) {
+                    refBuf[dstOff + dist + i - 1] = dstBuf[dstOff + i - 1];
+                }
+                memmove(&dstBuf[dstOff + dist], &dstBuf[dstOff], size);
+                UT(memcmp(dstBuf, refBuf, sizeof(dstBuf))) == UT(0);
+            }
+
+            /* memcmp sign and position of the first difference. */
+            FillPattern(srcBuf, sizeof(srcBuf), size);
+            memcpy(&dstBuf[dstOff], srcBuf, size);
+            UT(memcmp(&dstBuf[dstOff], srcBuf, size)) == UT(0);
+            if (size) {
+                size_t pos = size * 5 / 7;
+                dstBuf[dstOff + pos] = srcBuf[pos] - 1;
+                UT(memcmp(&dstBuf[dstOff], srcBuf, size)) < UT(0);
+                UT(memcmp(srcBuf, &dstBuf[dstOff], size)) > UT(0);
+                if (pos + 1 < size) {
+                    dstBuf[dstOff + size - 1] = srcBuf[size - 1] + 1;
+                    UT(memcmp(&dstBuf[dstOff], srcBuf, size)) < UT(0);
+                }
+            }
+
+            /* memchr and strlen */
+            FillPattern(dstBuf, sizeof(dstBuf), size);
+            dstBuf[dstOff + size] = 0;
+            UT(strlen(reinterpret_cast<char *>(&dstBuf[dstOff]))) == UT(size);
+            UT(memchr(&dstBuf[dstOff], 0, size)) == UT_NULL;
+            UT(memchr(&dstBuf[dstOff], 0, size + 1)) ==
+                UT(static_cast<void *>(&dstBuf[dstOff + size]));
+            if (size) {
+                size_t pos = size / 3;
+                u8 value = dstBuf[dstOff + pos];
+                void *found = memchr(&dstBuf[dstOff], value, size);
+                UT(found) != UT_NULL;
+                UT(static_cast<u8 *>(found) <= &dstBuf[dstOff + pos]) == UT(true);
+                UT(*static_cast<u8 *>(found)) == UT(value);
+                for (u8 *p = &dstBuf[dstOff]; p < found; p++) {
+                    UT(*p) != UT(value);
+                }
+            }
+        }
+    }
+}
+
+} /* anonymous namespace */
+
+UT_TEST("Generic implementation")
+{
+    StringOps::Select(false);
+    CheckPrimitives();
+    StringOps::Select();
+}
+UT_TEST_END
+
+UT_TEST("Accelerated implementation")
+{
+    StringOps::Select();
+    CheckPrimitives();
+}
+UT_TEST_END
+
+UT_TEST("Non-temporal primitives")
+{
+    static u8 buf[3 * 4096] __attribute__((aligned(64)));
+    FillPattern(buf, sizeof(buf), 3);
+    cpu::ZeroNonTemporal(&buf[4096], 4096);
+    cpu::StoreFence();
+    for (size_t i = 4096; i < 2 * 4096; i++) {
+        UT(buf[i]) == UT(static_cast<u8>(0));
+    }
+    UT(buf[4095]) != UT(static_cast<u8>(0));
+    UT(buf[2 * 4096]) != UT(static_cast<u8>(0));
+
+    cpu::CopyNonTemporal(&buf[4096], &buf[2 * 4096], 4096);
+    cpu::StoreFence();
+    UT(memcmp(&buf[4096], &buf[2 * 4096], 4096)) == UT(0);
+}
+UT_TEST_END
+
+UT_TEST("Benchmark")
+{
+    static const size_t sizes[] = { 8, 32, 128, 512, 4096, BUF_SIZE };
+    FillPattern(srcBuf, sizeof(srcBuf), 1);
+    srcBuf[BUF_SIZE - 1] = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        StringOps::Select(pass != 0);
+        for (size_t size: sizes) {
+            size_t numRounds = 4 * 1024 * 1024 / size;
+            u64 start = cpu::rdtsc();
+            for (size_t i = 0; i < numRounds; i++) {
+                memcpy(dstBuf, srcBuf, size);
+            }
+            u64 copyCycles = cpu::rdtsc() - start;
+            start = cpu::rdtsc();
+            for (size_t i = 0; i < numRounds; i++) {
+                memset(dstBuf, i, size);
+            }
+            u64 fillCycles = cpu::rdtsc() - start;
+            memcpy(dstBuf, srcBuf, size);
+            size_t result = 0;
+            start = cpu::rdtsc();
+            for (size_t i = 0; i < numRounds; i++) {
+                result += memcmp(dstBuf, srcBuf, size);
+                /* Prevent hoisting the call out of the loop. */
+                ASM ("" : : : "memory");
+            }
+            u64 compareCycles = cpu::rdtsc() - start;
+            start = cpu::rdtsc();
+            for (size_t i = 0; i < numRounds; i++) {
+                result += memchr(srcBuf, 0, size) != 0;
+                ASM ("" : : : "memory");
+            }
+            u64 findCycles = cpu::rdtsc() - start;
+            UT_TRACE("%s %lu bytes: memcpy %lu, memset %lu, memcmp %lu, "
+                     "memchr %lu bytes per kcycle (%lu)",
+                     pass ? "accelerated" : "generic", size,
+                     size * numRounds * 1000 / Max<u64>(copyCycles, 1),
+                     size * numRounds * 1000 / Max<u64>(fillCycles, 1),
+                     size * numRounds * 1000 / Max<u64>(compareCycles, 1),
+                     size * numRounds * 1000 / Max<u64>(findCycles, 1),
+                     result);
+        }
+    }
+}
+UT_TEST_END
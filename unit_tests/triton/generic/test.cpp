@@ -174,6 +174,10 @@ UT_TEST("Tuples")
     UT(hash(t2)) != UT(hash(t));
     t2.get<2>() = v2;
     UT(hash(t2)) == UT(hash(t));
+
+    /* Hash depends on the components order. */
+    UT(hash(Tuple<int, int>(1, 2))) != UT(hash(Tuple<int, int>(2, 1)));
+    UT(hash(Tuple<int, int>(1, 2))) == UT(hash(Tuple<long, int>(1, 2)));
 }
 UT_TEST_END
 
@@ -194,14 +198,22 @@ UT_TEST("Numeric values")
     UT(i1 > 0.5) == UT_TRUE;
     UT(i1 < i2) == UT_TRUE;
 
-    Object::hash_t h1 = 1, h2 = 2;
+    Object::hash_t h1 = hash(1), h2 = hash(2);
+    UT(h1) != UT(h2);
     UT(hash(i1)) == UT(h1);
     UT(hash(i2)) == UT(h2);
-    UT(hash(1)) == UT(h1);
-    UT(hash(2)) == UT(h2);
 
     int int_i1 = i1;
     UT(hash(int_i1)) == UT(h1);
+    /* Equal values have equal hashes regardless of their types. */
+    UT(hash(1ul)) == UT(h1);
+    UT(hash(static_cast<char>(1))) == UT(h1);
+    UT(hash(-1)) == UT(hash(-1l));
+    UT(hash(1.0)) == UT(h1);
+    UT(hash(2.0f)) == UT(h2);
+    UT(hash(0.0)) == UT(hash(-0.0));
+    UT(hash(0.5)) != UT(hash(0.25));
+    UT(hash(0.5)) == UT(hash(0.5f));
 
     i1 = 7;
     UT(i1 == 7) == UT_TRUE;
@@ -0,0 +1,651 @@
+/*
+ * /phoenix/unit_tests/triton/maps/test.cpp
+ *
+ * This file is a part of Phoenix operating system.
+ * Copyright (c) 2011-2012, Artyom Lebedev <artyom.lebedev@gmail.com>
+ * All rights reserved.
+ * See COPYING file for copyright details.
+ */
+
+/** @file test.cpp
+ * Unit tests for Triton maps.
+ */
+
+#include <phoenix_ut.h>
+
+#include <sys.h>
+
+using namespace triton;
+
+UT_TEST("B-tree map - basic operations")
+{
+    BTreeMap<int, long> map;
+    UT(len(map)) == UT(0ul);
+    UT(map.Validate()) == UT_TRUE;
+
+    for (int i = 0; i < 1000; i++) {
+        map.__setitem__(i * 2, i * 10);
+    }
+    UT(len(map)) == UT(1000ul);
+    UT(map.Validate()) == UT_TRUE;
+    UT(map[10]) == UT(50);
+    UT(map.__contains__(10)) == UT_TRUE;
+    UT(map.__contains__(11)) == UT_FALSE;
+    UT(map.get(11, -1)) == UT(-1);
+    UT(map.get(12, -1)) == UT(60);
+
+    bool catched = false;
+    try {
+        map[11];
+    } catch (KeyError &) {
+        catched = true;
+    }
+    UT(catched) == UT_TRUE;
+
+    /* Replace existing value. */
+    map.__setitem__(10, 7);
+    UT(map[10]) == UT(7);
+    UT(len(map)) == UT(1000ul);
+    UT(map.setdefault(10, 8)) == UT(7);
+    UT(map.setdefault(11, 8)) == UT(8);
+    UT(len(map)) == UT(1001ul);
+
+    UT(map.pop(11)) == UT(8);
+    UT(map.pop(11, -1)) == UT(-1);
+    catched = false;
+    try {
+        map.pop(11);
+    } catch (KeyError &) {
+        catched = true;
+    }
+    UT(catched) == UT_TRUE;
+    map.__delitem__(10);
+    UT(map.__contains__(10)) == UT_FALSE;
+    UT(len(map)) == UT(999ul);
+    map.__setitem__(10, 50);
+
+    /* Keys are iterated in ascending order. */
+    int expected = 0;
+    for (int &key: map) {
+        UT(key) == UT(expected);
+        expected += 2;
+    }
+    UT(expected) == UT(2000);
+    auto it = iter(map);
+    UT(next(it)) == UT(0);
+    UT(next(it)) == UT(2);
+
+    /* Range bounds do not need to be present in the map. */
+    expected = 101;
+    for (int &key: map.range(101, 201)) {
+        expected += expected & 1;
+        UT(key) == UT(expected);
+        expected++;
+    }
+    UT(expected) == UT(201);
+    size_t num = 0;
+    for (int &key: map.range(200, 100)) {
+        (void)key;
+        num++;
+    }
+    UT(num) == UT(0ul);
+    for (int &key: map.range(5000, 6000)) {
+        (void)key;
+        num++;
+    }
+    UT(num) == UT(0ul);
+
+    long sum = 0;
+    for (long &value: map.values(0, 20)) {
+        sum += value;
+    }
+    UT(sum) == UT(450l);
+    sum = 0;
+    for (long &value: map.values()) {
+        sum += value;
+    }
+    UT(sum) == UT(4995000l);
+
+    /* Copy and move. */
+    BTreeMap<int, long> copy(map);
+    UT(copy.Validate()) == UT_TRUE;
+    UT(len(copy)) == UT(1000ul);
+    copy.__delitem__(0);
+    UT(map.__contains__(0)) == UT_TRUE;
+    BTreeMap<int, long> moved(move(copy));
+    UT(len(copy)) == UT(0ul);
+    UT(len(moved)) == UT(999ul);
+    UT(moved.Validate()) == UT_TRUE;
+
+    map.clear();
+    UT(len(map)) == UT(0ul);
+    UT(map.Validate()) == UT_TRUE;
+    UT(map.__contains__(0)) == UT_FALSE;
+}
+UT_TEST_END
+
+namespace {
+
+/** Key which is compared by its operator only, so the generic search is used. */
+class StructKey {
+public:
+    u64 value;
+
+    StructKey(u64 value = 0) : value(value) {}
+
+    bool
+    operator <(const StructKey &key) const
+    {
+        return value < key.value;
+    }
+};
+
+u64
+GetKeyValue(u64 key)
+{
+    return key;
+}
+
+u64
+GetKeyValue(u32 key)
+{
+    return key;
+}
+
+u64
+GetKeyValue(const StructKey &key)
+{
+    return key.value;
+}
+
+/** Do random insertions and deletions and compare the map with reference
+ * presence bitmap.
+ */
+template <class MapT, typename K>
+void
+RandomTest(size_t numKeys, size_t numOps)
+{
+    MapT map;
+    bool *present = new bool[numKeys];
+    memset(present, 0, numKeys);
+    size_t numPresent = 0;
+    u32 seed = 1;
+    for (size_t op = 0; op < numOps; op++) {
+        seed = seed * 1103515245 + 12345;
+        size_t idx = (seed >> 8) % numKeys;
+        K key(idx);
+        /* Insertions prevail in the first half, deletions in the second. */
+        bool insert = ((seed >> 4) & 0xf) < (op < numOps / 2 ? 11u : 5u);
+        if (insert) {
+            map.__setitem__(key, idx + 1);
+            if (!present[idx]) {
+                present[idx] = true;
+                numPresent++;
+            }
+        } else {
+            UT(map.pop(key, 0)) == UT(present[idx] ? idx + 1 : 0ul);
+            if (present[idx]) {
+                present[idx] = false;
+                numPresent--;
+            }
+        }
+        if (op % 1024 == 0) {
+            UT(map.Validate()) == UT_TRUE;
+        }
+    }
+    UT(map.Validate()) == UT_TRUE;
+    UT(len(map)) == UT(numPresent);
+
+    size_t numIterated = 0, prevIdx = 0;
+    for (K &key: map) {
+        size_t idx = GetKeyValue(key);
+        UT(present[idx]) == UT_TRUE;
+        if (numIterated) {
+            UT(idx) > UT(prevIdx);
+        }
+        prevIdx = idx;
+        numIterated++;
+    }
+    UT(numIterated) == UT(numPresent);
+    for (size_t idx = 0; idx < numKeys; idx++) {
+        UT(map.get(K(idx), 0)) == UT(present[idx] ? idx + 1 : 0ul);
+    }
+
+    /* Delete everything. */
+    for (size_t idx = 0; idx < numKeys; idx++) {
+        if (present[idx]) {
+            map.__delitem__(K(idx));
+        }
+    }
+    UT(len(map)) == UT(0ul);
+    UT(map.Validate()) == UT_TRUE;
+    delete[] present;
+}
+
+} /* anonymous namespace */
+
+UT_TEST("B-tree map - random operations")
+{
+    /* Minimal nodes to get high trees with many splits and merges. */
+    RandomTest<BTreeMap<u64, size_t, Allocator<u64>, 32>, u64>(5000, 100000);
+    RandomTest<BTreeMap<u32, size_t, Allocator<u32>, 128>, u32>(5000, 100000);
+    RandomTest<BTreeMap<StructKey, size_t, Allocator<StructKey>, 64>,
+               StructKey>(5000, 100000);
+    RandomTest<BTreeMap<u64, size_t>, u64>(50000, 200000);
+    RandomTest<BTreeMap<u64, size_t, Allocator<u64>, vm::PAGE_SIZE>, u64>(50000,
+                                                                      200000);
+}
+UT_TEST_END
+
+namespace {
+
+class TreeItem {
+public:
+    u64 key;
+
+    int Compare(TreeItem &item)
+    {
+        return key < item.key ? -1 : (key > item.key ? 1 : 0);
+    }
+
+    int Compare(u64 &key)
+    {
+        return key < this->key ? -1 : (key > this->key ? 1 : 0);
+    }
+
+    typedef class RBTree<TreeItem, &TreeItem::Compare, u64, &TreeItem::Compare> Tree;
+
+    Tree::Entry rbEntry;
+};
+
+/** Allocator which carves objects from big chunks so that millions of nodes
+ * do not stress the test framework allocations tracking. Memory is released
+ * when the allocator is destroyed.
+ */
+template <typename T>
+class ChunkAllocator: public Allocator<T> {
+public:
+    template <typename Tother>
+    using Rebind = ChunkAllocator<Tother>;
+
+    ~ChunkAllocator()
+    {
+        while (_chunk) {
+            Chunk *next = _chunk->next;
+            delete _chunk;
+            _chunk = next;
+        }
+    }
+
+    template<typename... Args>
+    T *
+    Allocate(Args&&... args)
+    {
+        if (!_chunk || _numUsed == NUM_OBJS) {
+            Chunk *chunk = new Chunk;
+            chunk->next = _chunk;
+            _chunk = chunk;
+            _numUsed = 0;
+        }
+        void *location = &_chunk->data[_numUsed * sizeof(T)];
+        _numUsed++;
+        return new(location) T(forward<Args>(args)...);
+    }
+
+    void
+    Free(T *ptr)
+    {
+        ptr->~T();
+    }
+
+private:
+    enum: size_t {
+        NUM_OBJS = 4096,
+    };
+
+    class Chunk {
+    public:
+        Chunk *next;
+        u8 data[NUM_OBJS * sizeof(T)] __ALIGNED(sizeof(void *));
+    };
+
+    Chunk *_chunk = nullptr;
+    size_t _numUsed = 0;
+};
+
+/** Benchmark B-tree map with the specified node size. */
+template <size_t NodeSize>
+void
+BTreeBenchmark(size_t numItems, size_t numLookups)
+{
+    BTreeMap<u64, u64, ChunkAllocator<u64>, NodeSize> map;
+    u64 start = cpu::rdtsc();
+    for (size_t i = 0; i < numItems; i++) {
+        /* Pseudo-random permutation of keys. */
+        u64 key = ((i * 2654435761ul) & (numItems - 1)) * 2;
+        map.__setitem__(key, i);
+    }
+    u64 cycles = cpu::rdtsc() - start;
+    UT(len(map)) == UT(numItems);
+    UT_TRACE("B-tree map (%lu bytes nodes) insertion: %lu cycles per item",
+             NodeSize, cycles / numItems);
+
+    size_t numFound = 0;
+    u32 seed = 1;
+    start = cpu::rdtsc();
+    for (size_t i = 0; i < numLookups; i++) {
+        seed = seed * 1103515245 + 12345;
+        u64 key = (seed >> 4) % (numItems * 2);
+        if (map.__contains__(key)) {
+            numFound++;
+        }
+    }
+    cycles = cpu::rdtsc() - start;
+    UT(numFound) != UT(0ul);
+    UT_TRACE("B-tree map (%lu bytes nodes) lookup: %lu cycles per lookup",
+             NodeSize, cycles / numLookups);
+
+    size_t numVisited = 0;
+    start = cpu::rdtsc();
+    for (u64 &key: map) {
+        (void)key;
+        numVisited++;
+    }
+    cycles = cpu::rdtsc() - start;
+    UT(numVisited) == UT(numItems);
+    UT_TRACE("B-tree map (%lu bytes nodes) ordered iteration: %lu cycles per step",
+             NodeSize, cycles / numItems);
+}
+
+} /* anonymous namespace */
+
+UT_TEST("B-tree map - benchmark against RB tree")
+{
+    const size_t numItems = 1 << 21;
+    const size_t numLookups = 1 << 22;
+
+    TreeItem::Tree tree;
+    TreeItem *items = new TreeItem[numItems];
+    u64 start = cpu::rdtsc();
+    for (size_t i = 0; i < numItems; i++) {
+        items[i].key = ((i * 2654435761ul) & (numItems - 1)) * 2;
+        tree.Insert(&items[i], &items[i].rbEntry);
+    }
+    u64 cycles = cpu::rdtsc() - start;
+    UT_TRACE("RB tree insertion: %lu cycles per item (%lu items)",
+             cycles / numItems, numItems);
+
+    size_t numFound = 0;
+    u32 seed = 1;
+    start = cpu::rdtsc();
+    for (size_t i = 0; i < numLookups; i++) {
+        seed = seed * 1103515245 + 12345;
+        u64 key = (seed >> 4) % (numItems * 2);
+        if (tree.Lookup(key)) {
+            numFound++;
+        }
+    }
+    cycles = cpu::rdtsc() - start;
+    UT(numFound) != UT(0ul);
+    UT_TRACE("RB tree lookup: %lu cycles per lookup", cycles / numLookups);
+
+    size_t numVisited = 0;
+    u64 from = 0, to = numItems * 2;
+    start = cpu::rdtsc();
+    for (TreeItem &item: tree.GetRange(from, to)) {
+        (void)item;
+        numVisited++;
+    }
+    cycles = cpu::rdtsc() - start;
+    UT(numVisited) == UT(numItems);
+    UT_TRACE("RB tree ordered iteration: %lu cycles per step",
+             cycles / numItems);
+    tree.Clear();
+    delete[] items;
+
+    BTreeBenchmark<4 * CACHE_LINE_SIZE>(numItems, numLookups);
+    BTreeBenchmark<vm::PAGE_SIZE>(numItems, numLookups);
+}
+UT_TEST_END
+
+UT_TEST("Dictionary - basic operations")
+{
+    Dict<int, long> dict;
+    UT(len(dict)) == UT(0ul);
+    UT(dict.__contains__(0)) == UT_FALSE;
+    UT(dict.Validate()) == UT_TRUE;
+
+    for (int i = 0; i < 1000; i++) {
+        dict.__setitem__(i * 2, i * 10);
+    }
+    UT(len(dict)) == UT(1000ul);
+    UT(dict.Validate()) == UT_TRUE;
+    UT(dict[10]) == UT(50);
+    UT(dict.__contains__(10)) == UT_TRUE;
+    UT(dict.__contains__(11)) == UT_FALSE;
+    UT(dict.get(11, -1)) == UT(-1);
+    UT(dict.get(12, -1)) == UT(60);
+
+    bool catched = false;
+    try {
+        dict[11];
+    } catch (KeyError &) {
+        catched = true;
+    }
+    UT(catched) == UT_TRUE;
+
+    dict.__setitem__(10, 7);
+    UT(dict[10]) == UT(7);
+    UT(len(dict)) == UT(1000ul);
+    UT(dict.setdefault(10, 8)) == UT(7);
+    UT(dict.setdefault(11, 8)) == UT(8);
+    UT(len(dict)) == UT(1001ul);
+
+    UT(dict.pop(11)) == UT(8);
+    UT(dict.pop(11, -1)) == UT(-1);
+    catched = false;
+    try {
+        dict.pop(11);
+    } catch (KeyError &) {
+        catched = true;
+    }
+    UT(catched) == UT_TRUE;
+    dict.__delitem__(10);
+    UT(dict.__contains__(10)) == UT_FALSE;
+    UT(len(dict)) == UT(999ul);
+    UT(dict.Validate()) == UT_TRUE;
+    dict.__setitem__(10, 50);
+
+    /* Each key is iterated once, values in the same order. */
+    long keySum = 0, valueSum = 0;
+    size_t num = 0;
+    for (int &key: dict) {
+        keySum += key;
+        num++;
+    }
+    UT(num) == UT(1000ul);
+    UT(keySum) == UT(999000l);
+    auto keysIt = iter(dict);
+    for (long &value: dict.values()) {
+        UT(value) == UT(next(keysIt) * 5l);
+        valueSum += value;
+    }
+    UT(valueSum) == UT(4995000l);
+
+    /* Copy and move. */
+    Dict<int, long> copy(dict);
+    UT(copy.Validate()) == UT_TRUE;
+    UT(len(copy)) == UT(1000ul);
+    copy.__delitem__(0);
+    UT(dict.__contains__(0)) == UT_TRUE;
+    Dict<int, long> moved(move(copy));
+    UT(len(copy)) == UT(0ul);
+    UT(len(moved)) == UT(999ul);
+    UT(moved.Validate()) == UT_TRUE;
+    UT(moved[2]) == UT(10);
+
+    dict.clear();
+    UT(len(dict)) == UT(0ul);
+    UT(dict.Validate()) == UT_TRUE;
+    UT(dict.__contains__(0)) == UT_FALSE;
+    for (int &key: dict) {
+        (void)key;
+        num++;
+    }
+    UT(num) == UT(1000ul);
+
+    /* Tuples as keys. */
+    Dict<Tuple<int, int>, int> tupleDict;
+    for (int i = 0; i < 100; i++) {
+        tupleDict.__setitem__(Tuple<int, int>(i, -i), i);
+    }
+    UT(len(tupleDict)) == UT(100ul);
+    UT(tupleDict.Validate()) == UT_TRUE;
+    UT((tupleDict[Tuple<int, int>(50, -50)])) == UT(50);
+    UT((tupleDict.__contains__(Tuple<int, int>(50, 50)))) == UT_FALSE;
+}
+UT_TEST_END
+
+UT_TEST("Set - basic operations")
+{
+    Set<u64> set;
+    UT(len(set)) == UT(0ul);
+    for (u64 i = 0; i < 1000; i++) {
+        set.add(i * 3);
+        set.add(i * 3);
+    }
+    UT(len(set)) == UT(1000ul);
+    UT(set.Validate()) == UT_TRUE;
+    UT(set.__contains__(3)) == UT_TRUE;
+    UT(set.__contains__(4)) == UT_FALSE;
+    UT(set.discard(3)) == UT_TRUE;
+    UT(set.discard(3)) == UT_FALSE;
+    set.remove(6);
+    bool catched = false;
+    try {
+        set.remove(6);
+    } catch (KeyError &) {
+        catched = true;
+    }
+    UT(catched) == UT_TRUE;
+    UT(len(set)) == UT(998ul);
+
+    u64 sum = 0;
+    for (u64 &value: set) {
+        UT(value % 3) == UT(0ul);
+        sum += value;
+    }
+    UT(sum) == UT(1498500ul - 9);
+
+    Set<u64> copy(set);
+    copy.clear();
+    UT(len(copy)) == UT(0ul);
+    UT(len(set)) == UT(998ul);
+    UT(set.Validate()) == UT_TRUE;
+}
+UT_TEST_END
+
+namespace {
+
+/** Do random insertions and deletions in a dictionary and compare it with
+ * reference presence bitmap.
+ */
+template <typename K>
+void
+DictRandomTest(size_t numKeys, size_t numOps)
+{
+    Dict<K, size_t> dict;
+    bool *present = new bool[numKeys];
+    memset(present, 0, numKeys);
+    size_t numPresent = 0;
+    u32 seed = 1;
+    for (size_t op = 0; op < numOps; op++) {
+        seed = seed * 1103515245 + 12345;
+        size_t idx = (seed >> 8) % numKeys;
+        K key(idx);
+        /* Insertions prevail in the first half, deletions in the second. */
+        bool insert = ((seed >> 4) & 0xf) < (op < numOps / 2 ? 11u : 5u);
+        if (insert) {
+            dict.__setitem__(key, idx + 1);
+            if (!present[idx]) {
+                present[idx] = true;
+                numPresent++;
+            }
+        } else {
+            UT(dict.pop(key, 0)) == UT(present[idx] ? idx + 1 : 0ul);
+            if (present[idx]) {
+                present[idx] = false;
+                numPresent--;
+            }
+        }
+        if (op % 4096 == 0) {
+            UT(dict.Validate()) == UT_TRUE;
+        }
+    }
+    UT(dict.Validate()) == UT_TRUE;
+    UT(len(dict)) == UT(numPresent);
+
+    size_t numIterated = 0;
+    for (K &key: dict) {
+        UT(present[static_cast<size_t>(key)]) == UT_TRUE;
+        numIterated++;
+    }
+    UT(numIterated) == UT(numPresent);
+    for (size_t idx = 0; idx < numKeys; idx++) {
+        UT(dict.get(K(idx), 0)) == UT(present[idx] ? idx + 1 : 0ul);
+    }
+
+    for (size_t idx = 0; idx < numKeys; idx++) {
+        if (present[idx]) {
+            dict.__delitem__(K(idx));
+        }
+    }
+    UT(len(dict)) == UT(0ul);
+    UT(dict.Validate()) == UT_TRUE;
+    delete[] present;
+}
+
+} /* anonymous namespace */
+
+UT_TEST("Dictionary - random operations")
+{
+    DictRandomTest<u64>(5000, 100000);
+    DictRandomTest<u32>(50000, 200000);
+    DictRandomTest<i8>(100, 10000);
+}
+UT_TEST_END
+
+UT_TEST("Dictionary - benchmark against B-tree map")
+{
+    const size_t numItems = 1 << 21;
+    const size_t numLookups = 1 << 22;
+
+    Dict<u64, u64> dict;
+    u64 start = cpu::rdtsc();
+    for (size_t i = 0; i < numItems; i++) {
+        u64 key = ((i * 2654435761ul) & (numItems - 1)) * 2;
+        dict.__setitem__(key, i);
+    }
+    u64 cycles = cpu::rdtsc() - start;
+    UT(len(dict)) == UT(numItems);
+    UT_TRACE("Dictionary insertion: %lu cycles per item (%lu items)",
+             cycles / numItems, numItems);
+
+    size_t numFound = 0;
+    u32 seed = 1;
+    start = cpu::rdtsc();
+    for (size_t i = 0; i < numLookups; i++) {
+        seed = seed * 1103515245 + 12345;
+        u64 key = (seed >> 4) % (numItems * 2);
+        if (dict.__contains__(key)) {
+            numFound++;
+        }
+    }
+    cycles = cpu::rdtsc() - start;
+    UT(numFound) != UT(0ul);
+    UT_TRACE("Dictionary lookup: %lu cycles per lookup", cycles / numLookups);
+    dict.clear();
+
+    BTreeBenchmark<4 * CACHE_LINE_SIZE>(numItems, numLookups);
+}
+UT_TEST_END
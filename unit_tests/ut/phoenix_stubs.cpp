@@ -125,6 +125,15 @@ log::KSysLog::Putc(char c, void *)
     return true;
 }
 
+size_t
+log::KSysLog::Write(const char *buf, size_t len, void *)
+{
+    for (size_t i = 0; i < len; i++) {
+        Putc(buf[i]);
+    }
+    return len;
+}
+
 #endif /* KERNEL */
 
 /* Initialize stubs module. */
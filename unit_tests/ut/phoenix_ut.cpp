@@ -16,6 +16,8 @@
 #include <stdarg.h>
 #include <string.h>
 #include <stdio.h>
+#include <pthread.h>
+#include <time.h>
 #include <string>
 #include <sstream>
 #include <list>
@@ -329,6 +331,61 @@ ut::__ut_vtrace(const char *file, int line, const char *msg, __ut_va_list args)
     printf("\n");
 }
 
+namespace {
+
+/** Parameters for a test thread entry point. */
+struct UtThreadParams {
+    void (*func)(void *);
+    void *arg;
+};
+
+void *
+UtThreadEntry(void *arg)
+{
+    UtThreadParams params = *static_cast<UtThreadParams *>(arg);
+    free(arg);
+    params.func(params.arg);
+    return nullptr;
+}
+
+} /* anonymous namespace */
+
+void *
+ut::__ut_thread_create(void (*func)(void *), void *arg)
+{
+    UtThreadParams *params =
+        static_cast<UtThreadParams *>(malloc(sizeof(UtThreadParams)));
+    if (!params) {
+        UT_FAIL("Memory allocation failed for thread parameters");
+    }
+    params->func = func;
+    params->arg = arg;
+    pthread_t *thread = static_cast<pthread_t *>(malloc(sizeof(pthread_t)));
+    if (!thread) {
+        UT_FAIL("Memory allocation failed for thread handle");
+    }
+    if (pthread_create(thread, nullptr, UtThreadEntry, params)) {
+        UT_FAIL("Failed to create thread");
+    }
+    return thread;
+}
+
+void
+ut::__ut_thread_join(void *thread)
+{
+    pthread_join(*static_cast<pthread_t *>(thread), nullptr);
+    free(thread);
+}
+
+unsigned long long
+ut::__ut_time_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<unsigned long long>(ts.tv_sec) * 1000000000ull +
+        ts.tv_nsec;
+}
+
 int
 ut::__ut_snprintf(char *str, unsigned long size, const char *format, ...)
 {
@@ -370,6 +427,8 @@ struct ut_mblock_hdr {
 };
 
 static std::list<ut_mblock_hdr *, UtAllocator<ut_mblock_hdr *>> allocatedBlocks;
+/* Tests may allocate memory from several threads. */
+static pthread_mutex_t allocatedBlocksLock = PTHREAD_MUTEX_INITIALIZER;
 
 void *
 ut::__ut_malloc(const char *file, int line, unsigned long size, unsigned long align)
@@ -379,7 +438,7 @@ ut::__ut_malloc(const char *file, int line, unsigned long size, unsigned long al
         if (!IS_POWER_OF_2(align)) {
             UT_FAIL("Invalid alignment: %lu bytes at %s:%d", align, file, line);
         }
-        mem = malloc(sizeof(ut_mblock_hdr) + size * 2);
+        mem = malloc(sizeof(ut_mblock_hdr) + size + align);
     } else {
         mem = malloc(sizeof(ut_mblock_hdr) + size);
     }
@@ -387,7 +446,7 @@ ut::__ut_malloc(const char *file, int line, unsigned long size, unsigned long al
         UT_FAIL("Memory allocation failed: %lu bytes at %s:%d", size, file, line);
     }
     if (align) {
-        block = reinterpret_cast<void *>(ROUND_UP2(reinterpret_cast<uintptr_t>(mem) + sizeof(ut_mblock_hdr), size));
+        block = reinterpret_cast<void *>(ROUND_UP2(reinterpret_cast<uintptr_t>(mem) + sizeof(ut_mblock_hdr), align));
     } else {
         block = static_cast<char *>(mem) + sizeof(ut_mblock_hdr);
     }
@@ -401,7 +460,9 @@ ut::__ut_malloc(const char *file, int line, unsigned long size, unsigned long al
     hdr->memStart = mem;
 
     if (::__ut_mtrack_enabled) {
+        pthread_mutex_lock(&::allocatedBlocksLock);
         ::allocatedBlocks.push_front(hdr);
+        pthread_mutex_unlock(&::allocatedBlocksLock);
     }
 
     memset(block, 0xcc, size);
@@ -422,7 +483,9 @@ ut::__ut_mfree(void *ptr)
     free(hdr->memStart);
 
     if (::__ut_mtrack_enabled) {
+        pthread_mutex_lock(&::allocatedBlocksLock);
         ::allocatedBlocks.remove(hdr);
+        pthread_mutex_unlock(&::allocatedBlocksLock);
     }
 }
 
@@ -158,6 +158,22 @@ int __ut_strcmp(const char *s1, const char *s2);
 int __ut_snprintf(char *str, unsigned long size, const char *format, ...);
 int __ut_vsnprintf(char *str, unsigned long size, const char *format, __ut_va_list ap);
 
+/** Create host thread. Test assertions should not be used in the thread
+ * function, only the main thread can report test failures.
+ *
+ * @param func Thread entry point.
+ * @param arg Argument for the entry point.
+ * @return Thread handle which should be passed to @ref __ut_thread_join.
+ */
+void *__ut_thread_create(void (*func)(void *), void *arg);
+/** Wait for host thread termination and release its handle. */
+void __ut_thread_join(void *thread);
+
+/** Get host monotonic time in nanoseconds. Intended for benchmarks which
+ * report rates in wall-clock units.
+ */
+unsigned long long __ut_time_ns();
+
 class UtString {
 public:
     UtString();